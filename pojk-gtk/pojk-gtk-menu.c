@@ -67,6 +67,15 @@ static void                 pojk_gtk_menu_set_property                (GObject
                                                                          GParamSpec              *pspec);
 static void                 pojk_gtk_menu_show                        (GtkWidget               *widget);
 static void                 pojk_gtk_menu_load                        (PojkGtkMenu           *menu);
+static void                 pojk_gtk_menu_load_ready                  (GObject                 *source_object,
+                                                                         GAsyncResult            *result,
+                                                                         gpointer                 user_data);
+static gboolean             pojk_gtk_menu_add                         (PojkGtkMenu           *menu,
+                                                                         GtkMenu                 *gtk_menu,
+                                                                         PojkMenu              *pojk_menu);
+static void                 pojk_gtk_menu_disconnect                  (PojkGtkMenu           *menu,
+                                                                         PojkMenu              *pojk_menu,
+                                                                         gboolean                 recursive);
 
 
 
@@ -76,8 +85,12 @@ struct _PojkGtkMenuPrivate
 
   guint is_loaded : 1;
 
+  /* running asynchronous load */
+  GCancellable *load_cancellable;
+
   /* reload idle */
   guint reload_id;
+  guint rebuild_only : 1;
 
   /* settings */
   guint show_generic_names : 1;
@@ -87,6 +100,13 @@ struct _PojkGtkMenuPrivate
   guint right_click_edits : 1;
 };
 
+/* data of a running asynchronous load */
+typedef struct
+{
+  PojkGtkMenu  *menu;
+  GCancellable *cancellable;
+} PojkGtkMenuLoad;
+
 
 
 static const GtkTargetEntry dnd_target_list[] = {
@@ -226,6 +246,10 @@ pojk_gtk_menu_finalize (GObject *object)
   if (menu->priv->reload_id != 0)
     g_source_remove (menu->priv->reload_id);
 
+  /* Release the cancellable of an aborted load */
+  if (menu->priv->load_cancellable != NULL)
+    g_object_unref (menu->priv->load_cancellable);
+
   /* Release menu */
   if (menu->priv->menu != NULL)
     g_object_unref (menu->priv->menu);
@@ -612,11 +636,16 @@ pojk_gtk_menu_reload_idle (gpointer data)
   children = gtk_container_get_children (GTK_CONTAINER (menu));
   g_list_free_full (children, (GDestroyNotify) gtk_widget_destroy);
 
-  /* reload the menu */
-  pojk_gtk_menu_load (menu);
+  /* reload the menu or only recreate the items if the menu tree was
+   * updated in place, a running load fills the menu when done */
+  if (!menu->priv->rebuild_only)
+    pojk_gtk_menu_load (menu);
+  else if (menu->priv->menu != NULL && menu->priv->load_cancellable == NULL)
+    pojk_gtk_menu_add (menu, GTK_MENU (menu), menu->priv->menu);
 
   /* reset */
   menu->priv->reload_id = 0;
+  menu->priv->rebuild_only = FALSE;
 
   return FALSE;
 }
@@ -626,6 +655,9 @@ pojk_gtk_menu_reload_idle (gpointer data)
 static void
 pojk_gtk_menu_reload (PojkGtkMenu *menu)
 {
+  /* a reload also recreates the items */
+  menu->priv->rebuild_only = FALSE;
+
   /* schedule a menu reload */
   if (menu->priv->reload_id == 0
       && menu->priv->is_loaded)
@@ -636,6 +668,20 @@ pojk_gtk_menu_reload (PojkGtkMenu *menu)
 
 
 
+static void
+pojk_gtk_menu_rebuild (PojkGtkMenu *menu)
+{
+  /* schedule recreating the items, unless a reload is pending anyway */
+  if (menu->priv->reload_id == 0
+      && menu->priv->is_loaded)
+    {
+      menu->priv->rebuild_only = TRUE;
+      menu->priv->reload_id = g_timeout_add (100, pojk_gtk_menu_reload_idle, menu);
+    }
+}
+
+
+
 static GtkWidget*
 pojk_gtk_menu_load_icon (const gchar *icon_name)
 {
@@ -829,6 +875,13 @@ pojk_gtk_menu_add (PojkGtkMenu *menu,
   g_return_val_if_fail (GTK_IS_MENU (gtk_menu), FALSE);
   g_return_val_if_fail (POJK_IS_MENU (pojk_menu), FALSE);
 
+  /* watch for items moving in and out of the menu */
+  g_signal_handlers_disconnect_by_func (G_OBJECT (pojk_menu), pojk_gtk_menu_rebuild, menu);
+  g_signal_connect_object (G_OBJECT (pojk_menu), "item-added",
+      G_CALLBACK (pojk_gtk_menu_rebuild), menu, G_CONNECT_SWAPPED);
+  g_signal_connect_object (G_OBJECT (pojk_menu), "item-removed",
+      G_CALLBACK (pojk_gtk_menu_rebuild), menu, G_CONNECT_SWAPPED);
+
   elements = pojk_menu_get_elements (pojk_menu);
   for (li = elements; li != NULL; li = li->next)
     {
@@ -971,7 +1024,7 @@ pojk_gtk_menu_add (PojkGtkMenu *menu,
 static void
 pojk_gtk_menu_load (PojkGtkMenu *menu)
 {
-  GError    *error = NULL;
+  PojkGtkMenuLoad *load;
 
   g_return_if_fail (POJK_GTK_IS_MENU (menu));
   g_return_if_fail (menu->priv->menu == NULL || POJK_IS_MENU (menu->priv->menu));
@@ -979,19 +1032,19 @@ pojk_gtk_menu_load (PojkGtkMenu *menu)
   if (menu->priv->menu == NULL)
     return;
 
-  if (pojk_menu_load (menu->priv->menu, NULL, &error))
-    {
-      pojk_gtk_menu_add (menu, GTK_MENU (menu), menu->priv->menu);
+  /* the running load will pick up the current state */
+  if (menu->priv->load_cancellable != NULL)
+    return;
 
-      /* watch for changes */
-      g_signal_connect_swapped (G_OBJECT (menu->priv->menu), "reload-required",
-        G_CALLBACK (pojk_gtk_menu_reload), menu);
-    }
-  else
-    {
-       xfce_dialog_show_error (NULL, error, _("Failed to load the applications menu"));
-       g_error_free (error);
-    }
+  /* load the menu in a thread to not block the main loop, the menu is
+   * filled once loading is done; keep the widget alive until then */
+  load = g_slice_new (PojkGtkMenuLoad);
+  load->menu = g_object_ref (menu);
+  load->cancellable = g_cancellable_new ();
+
+  menu->priv->load_cancellable = g_object_ref (load->cancellable);
+  pojk_menu_load_async (menu->priv->menu, load->cancellable,
+                        pojk_gtk_menu_load_ready, load);
 
   menu->priv->reload_id = 0;
   menu->priv->is_loaded = TRUE;
@@ -999,6 +1052,51 @@ pojk_gtk_menu_load (PojkGtkMenu *menu)
 
 
 
+static void
+pojk_gtk_menu_load_ready (GObject      *source_object,
+                          GAsyncResult *result,
+                          gpointer      user_data)
+{
+  PojkGtkMenuLoad *load = user_data;
+  PojkGtkMenu     *menu = load->menu;
+  PojkMenu        *pojk_menu = POJK_MENU (source_object);
+  GError          *error = NULL;
+  gboolean         succeed;
+
+  succeed = pojk_menu_load_finish (pojk_menu, result, &error);
+
+  /* ignore the result if this load was aborted or replaced by another
+   * one in the meantime, even if it was for the same menu */
+  if (load->cancellable == menu->priv->load_cancellable
+      && pojk_menu == menu->priv->menu)
+    {
+      g_object_unref (menu->priv->load_cancellable);
+      menu->priv->load_cancellable = NULL;
+
+      if (succeed)
+        {
+          pojk_gtk_menu_add (menu, GTK_MENU (menu), pojk_menu);
+
+          /* watch for changes */
+          g_signal_connect_swapped (G_OBJECT (pojk_menu), "reload-required",
+            G_CALLBACK (pojk_gtk_menu_reload), menu);
+        }
+      else if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+          xfce_dialog_show_error (NULL, error, _("Failed to load the applications menu"));
+        }
+    }
+
+  if (error != NULL)
+    g_error_free (error);
+
+  g_object_unref (load->cancellable);
+  g_object_unref (load->menu);
+  g_slice_free (PojkGtkMenuLoad, load);
+}
+
+
+
 /**
  * pojk_gtk_menu_new:
  * @pojk_menu  :
@@ -1042,10 +1140,21 @@ pojk_gtk_menu_set_menu (PojkGtkMenu *menu,
 
   if (menu->priv->menu != NULL)
     {
-      g_signal_handlers_disconnect_by_func (G_OBJECT (menu->priv->menu), pojk_gtk_menu_reload, menu);
+      /* the submenus of a menu that is still loading are replaced by
+       * the loader thread and have no handlers of ours yet */
+      pojk_gtk_menu_disconnect (menu, menu->priv->menu,
+                                menu->priv->load_cancellable == NULL);
       g_object_unref (G_OBJECT (menu->priv->menu));
     }
 
+  /* abort loading the old menu */
+  if (menu->priv->load_cancellable != NULL)
+    {
+      g_cancellable_cancel (menu->priv->load_cancellable);
+      g_object_unref (menu->priv->load_cancellable);
+      menu->priv->load_cancellable = NULL;
+    }
+
   if (pojk_menu != NULL)
     menu->priv->menu = POJK_MENU (g_object_ref (G_OBJECT (pojk_menu)));
   else
@@ -1058,6 +1167,27 @@ pojk_gtk_menu_set_menu (PojkGtkMenu *menu,
 
 
 
+static void
+pojk_gtk_menu_disconnect (PojkGtkMenu *menu,
+                          PojkMenu    *pojk_menu,
+                          gboolean     recursive)
+{
+  GList *submenus, *li;
+
+  g_signal_handlers_disconnect_by_func (G_OBJECT (pojk_menu), pojk_gtk_menu_reload, menu);
+  g_signal_handlers_disconnect_by_func (G_OBJECT (pojk_menu), pojk_gtk_menu_rebuild, menu);
+
+  if (!recursive)
+    return;
+
+  submenus = pojk_menu_get_menus (pojk_menu);
+  for (li = submenus; li != NULL; li = li->next)
+    pojk_gtk_menu_disconnect (menu, li->data, TRUE);
+  g_list_free (submenus);
+}
+
+
+
 /**
  * pojk_gtk_menu_get_menu:
  * @menu  : A #PojkGtkMenu
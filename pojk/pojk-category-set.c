@@ -0,0 +1,248 @@
+/* vi:set et ai sw=2 sts=2 ts=2: */
+/*-
+ * Copyright (c) 2026 The pojk developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <glib.h>
+
+#include <pojk/pojk-category-set.h>
+
+
+
+/* Every category gets a small integer id, so that the categories of an
+ * item fit in a bitset and Category rules test a single bit. The ids of
+ * the registered categories of the menu specification are fixed, the
+ * main categories first. Other categories are numbered in the order they
+ * are seen. Ids are never released, just like interned strings */
+
+
+
+static const gchar *registered_categories[] =
+{
+  /* Main categories */
+  "AudioVideo", "Audio", "Video", "Development", "Education", "Game",
+  "Graphics", "Network", "Office", "Science", "Settings", "System",
+  "Utility",
+
+  /* Additional categories */
+  "Building", "Debugger", "IDE", "GUIDesigner", "Profiling",
+  "RevisionControl", "Translation", "Calendar", "ContactManagement",
+  "Database", "Dictionary", "Chart", "Email", "Finance", "FlowChart",
+  "PDA", "ProjectManagement", "Presentation", "Spreadsheet",
+  "WordProcessor", "2DGraphics", "VectorGraphics", "RasterGraphics",
+  "3DGraphics", "Scanning", "OCR", "Photography", "Publishing", "Viewer",
+  "TextTools", "DesktopSettings", "HardwareSettings", "Printing",
+  "PackageManager", "Dialup", "InstantMessaging", "Chat", "IRCClient",
+  "Feed", "FileTransfer", "HamRadio", "News", "P2P", "RemoteAccess",
+  "Telephony", "TelephonyTools", "VideoConference", "WebBrowser",
+  "WebDevelopment", "Midi", "Mixer", "Sequencer", "Tuner", "TV",
+  "AudioVideoEditing", "Player", "Recorder", "DiscBurning", "ActionGame",
+  "AdventureGame", "ArcadeGame", "BoardGame", "BlocksGame", "CardGame",
+  "KidsGame", "LogicGame", "RolePlaying", "Shooter", "Simulation",
+  "SportsGame", "StrategyGame", "Art", "Construction", "Music",
+  "Languages", "ArtificialIntelligence", "Astronomy", "Biology",
+  "Chemistry", "ComputerScience", "DataVisualization", "Economy",
+  "Electricity", "Geography", "Geology", "Geoscience", "History",
+  "Humanities", "ImageProcessing", "Literature", "Maps", "Math",
+  "NumericalAnalysis", "MedicalSoftware", "Physics", "Robotics",
+  "Spirituality", "Sports", "ParallelComputing", "Amusement",
+  "Archiving", "Compression", "Electronics", "Emulator", "Engineering",
+  "FileTools", "FileManager", "TerminalEmulator", "Filesystem",
+  "Monitor", "Security", "Accessibility", "Calculator", "Clock",
+  "TextEditor", "Documentation", "Adult", "Core", "KDE", "GNOME", "XFCE",
+  "DDE", "GTK", "Qt", "Motif", "Java", "ConsoleOnly",
+
+  /* Reserved categories */
+  "Screensaver", "TrayIcon", "Applet", "Shell",
+};
+
+
+
+/* Interned category name => id + 1 */
+static GHashTable *category_ids = NULL;
+G_LOCK_DEFINE_STATIC (category_ids);
+
+
+
+static void
+pojk_category_ensure_table (void)
+{
+  guint n;
+
+  if (G_LIKELY (category_ids != NULL))
+    return;
+
+  category_ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  for (n = 0; n < G_N_ELEMENTS (registered_categories); n++)
+    g_hash_table_insert (category_ids,
+                         (gpointer) g_intern_static_string (registered_categories[n]),
+                         GUINT_TO_POINTER (n + 1));
+}
+
+
+
+/* Returns the id of the interned string @category, assigning a new one
+ * if the category was not seen before */
+guint
+_pojk_category_get_id (const gchar *category)
+{
+  guint id;
+
+  g_return_val_if_fail (category != NULL, POJK_CATEGORY_ID_NONE);
+
+  G_LOCK (category_ids);
+
+  pojk_category_ensure_table ();
+
+  id = GPOINTER_TO_UINT (g_hash_table_lookup (category_ids, category));
+  if (id == 0)
+    {
+      id = g_hash_table_size (category_ids) + 1;
+      g_hash_table_insert (category_ids, (gpointer) category, GUINT_TO_POINTER (id));
+    }
+
+  G_UNLOCK (category_ids);
+
+  return id - 1;
+}
+
+
+
+/* Same as _pojk_category_get_id(), but returns POJK_CATEGORY_ID_NONE
+ * for categories without an id */
+guint
+_pojk_category_lookup_id (const gchar *category)
+{
+  guint id;
+
+  g_return_val_if_fail (category != NULL, POJK_CATEGORY_ID_NONE);
+
+  G_LOCK (category_ids);
+
+  pojk_category_ensure_table ();
+  id = GPOINTER_TO_UINT (g_hash_table_lookup (category_ids, category));
+
+  G_UNLOCK (category_ids);
+
+  return id == 0 ? POJK_CATEGORY_ID_NONE : id - 1;
+}
+
+
+
+/* Returns the set of the interned strings in @categories, or %NULL if
+ * the list is empty */
+PojkCategorySet *
+_pojk_category_set_new (GList *categories)
+{
+  PojkCategorySet *set = NULL;
+  GList           *lp;
+
+  for (lp = categories; lp != NULL; lp = lp->next)
+    _pojk_category_set_add (&set, _pojk_category_get_id (lp->data));
+
+  return set;
+}
+
+
+
+void
+_pojk_category_set_add (PojkCategorySet **set,
+                        guint             id)
+{
+  guint word = id / POJK_CATEGORY_SET_WORD_BITS;
+  guint n_words;
+
+  g_return_if_fail (set != NULL);
+  g_return_if_fail (id != POJK_CATEGORY_ID_NONE);
+
+  if (*set == NULL || word >= (*set)->n_words)
+    {
+      n_words = *set != NULL ? (*set)->n_words : 0;
+
+      *set = g_realloc (*set, G_STRUCT_OFFSET (PojkCategorySet, words)
+                              + (word + 1) * sizeof (gulong));
+      memset ((*set)->words + n_words, 0, (word + 1 - n_words) * sizeof (gulong));
+      (*set)->n_words = word + 1;
+    }
+
+  (*set)->words[word] |= 1UL << (id % POJK_CATEGORY_SET_WORD_BITS);
+}
+
+
+
+void
+_pojk_category_set_free (PojkCategorySet *set)
+{
+  g_free (set);
+}
+
+
+
+/* Whether @set has all categories of @mask */
+gboolean
+_pojk_category_set_contains_all (const PojkCategorySet *set,
+                                 const PojkCategorySet *mask)
+{
+  guint n;
+
+  if (mask == NULL)
+    return TRUE;
+
+  for (n = 0; n < mask->n_words; n++)
+    {
+      if (set == NULL || n >= set->n_words)
+        {
+          if (mask->words[n] != 0)
+            return FALSE;
+        }
+      else if ((mask->words[n] & ~set->words[n]) != 0)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+
+
+/* Whether @set has any of the categories of @mask */
+gboolean
+_pojk_category_set_intersects (const PojkCategorySet *set,
+                               const PojkCategorySet *mask)
+{
+  guint n_words;
+  guint n;
+
+  if (set == NULL || mask == NULL)
+    return FALSE;
+
+  n_words = MIN (set->n_words, mask->n_words);
+  for (n = 0; n < n_words; n++)
+    if ((set->words[n] & mask->words[n]) != 0)
+      return TRUE;
+
+  return FALSE;
+}
@@ -0,0 +1,73 @@
+/* vi:set et ai sw=2 sts=2 ts=2: */
+/*-
+ * Copyright (c) 2026 The pojk developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#if !defined(POJK_INSIDE_POJK_H) && !defined(POJK_COMPILATION)
+#error "Only <pojk/pojk.h> can be included directly. This file may disappear or change contents."
+#endif
+
+#ifndef __POJK_CATEGORY_SET_H__
+#define __POJK_CATEGORY_SET_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Returned by _pojk_category_lookup_id() for unknown categories */
+#define POJK_CATEGORY_ID_NONE G_MAXUINT
+
+#define POJK_CATEGORY_SET_WORD_BITS (sizeof (gulong) * 8)
+
+/* Bitset of category ids. Words past n_words are all zero */
+typedef struct _PojkCategorySet PojkCategorySet;
+struct _PojkCategorySet
+{
+  guint  n_words;
+  gulong words[1];
+};
+
+guint             _pojk_category_get_id       (const gchar           *category);
+guint             _pojk_category_lookup_id    (const gchar           *category);
+
+PojkCategorySet  *_pojk_category_set_new      (GList                 *categories) G_GNUC_MALLOC;
+void              _pojk_category_set_add      (PojkCategorySet      **set,
+                                               guint                  id);
+void              _pojk_category_set_free     (PojkCategorySet       *set);
+
+gboolean          _pojk_category_set_contains_all (const PojkCategorySet *set,
+                                                   const PojkCategorySet *mask);
+gboolean          _pojk_category_set_intersects   (const PojkCategorySet *set,
+                                                   const PojkCategorySet *mask);
+
+
+
+static inline gboolean
+_pojk_category_set_contains (const PojkCategorySet *set,
+                             guint                  id)
+{
+  guint word = id / POJK_CATEGORY_SET_WORD_BITS;
+
+  return set != NULL
+         && word < set->n_words
+         && (set->words[word] & (1UL << (id % POJK_CATEGORY_SET_WORD_BITS))) != 0;
+}
+
+G_END_DECLS
+
+#endif /* !__POJK_CATEGORY_SET_H__ */
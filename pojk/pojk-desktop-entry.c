@@ -0,0 +1,506 @@
+/* vi:set et ai sw=2 sts=2 ts=2: */
+/*-
+ * Copyright (c) 2026 The pojk developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <glib.h>
+
+#include <pojk/pojk-desktop-entry.h>
+
+
+
+/* A minimal reader for desktop entry files. The file is mapped and only
+ * the lines of the current group are indexed; keys and values point into
+ * the mapped data. Of the localized variants of a key, only the one that
+ * fits the current locale best is remembered. Values are unescaped and
+ * copied when they are read, so keys nobody asks for cost nothing. */
+
+
+
+typedef struct
+{
+  /* Name of the key, without locale */
+  const gchar *key;
+  gsize        key_len;
+
+  /* Untranslated value, %NULL if the file only has localized ones */
+  const gchar *value;
+  gsize        value_len;
+
+  /* Best localized value and its index in g_get_language_names() */
+  const gchar *translated;
+  gsize        translated_len;
+  guint        rank;
+} PojkDesktopEntryKey;
+
+struct _PojkDesktopEntry
+{
+  GMappedFile *file;
+  const gchar *data;
+  gsize        length;
+
+  /* Keys of the current group */
+  GArray      *keys;
+};
+
+
+
+static inline gboolean
+pojk_desktop_entry_is_space (gchar c)
+{
+  return c == ' ' || c == '\t';
+}
+
+
+
+/* Returns the index of @locale in the language names of the current
+ * locale, or G_MAXUINT if values in @locale are never used */
+static guint
+pojk_desktop_entry_get_rank (const gchar *locale,
+                             gsize        locale_len)
+{
+  const gchar * const *names;
+  guint                n;
+
+  names = g_get_language_names ();
+
+  for (n = 0; names[n] != NULL; n++)
+    if (strncmp (names[n], locale, locale_len) == 0 && names[n][locale_len] == '\0')
+      return n;
+
+  return G_MAXUINT;
+}
+
+
+
+static PojkDesktopEntryKey *
+pojk_desktop_entry_find_key (PojkDesktopEntry *entry,
+                             const gchar      *key,
+                             gsize             key_len)
+{
+  PojkDesktopEntryKey *entry_key;
+  guint                n;
+
+  for (n = 0; n < entry->keys->len; n++)
+    {
+      entry_key = &g_array_index (entry->keys, PojkDesktopEntryKey, n);
+      if (entry_key->key_len == key_len && memcmp (entry_key->key, key, key_len) == 0)
+        return entry_key;
+    }
+
+  return NULL;
+}
+
+
+
+static void
+pojk_desktop_entry_add_line (PojkDesktopEntry *entry,
+                             const gchar      *line,
+                             const gchar      *end)
+{
+  PojkDesktopEntryKey  new_key;
+  PojkDesktopEntryKey *entry_key;
+  const gchar         *equals;
+  const gchar         *key_end;
+  const gchar         *locale = NULL;
+  const gchar         *value;
+  gsize                locale_len = 0;
+  guint                rank;
+
+  equals = memchr (line, '=', end - line);
+  if (G_UNLIKELY (equals == NULL || equals == line))
+    return;
+
+  /* Split "Key[locale] = value" */
+  for (key_end = equals; key_end > line && pojk_desktop_entry_is_space (key_end[-1]); key_end--);
+  for (value = equals + 1; value < end && pojk_desktop_entry_is_space (*value); value++);
+  for (; end > value && pojk_desktop_entry_is_space (end[-1]); end--);
+
+  if (key_end > line && key_end[-1] == ']')
+    {
+      locale = memchr (line, '[', key_end - line);
+      if (G_UNLIKELY (locale == NULL))
+        return;
+
+      locale_len = key_end - locale - 2;
+      key_end = locale++;
+    }
+
+  if (G_UNLIKELY (key_end == line))
+    return;
+
+  /* Skip translations that don't fit the current locale */
+  rank = G_MAXUINT;
+  if (locale != NULL)
+    {
+      rank = pojk_desktop_entry_get_rank (locale, locale_len);
+      if (rank == G_MAXUINT)
+        return;
+    }
+
+  entry_key = pojk_desktop_entry_find_key (entry, line, key_end - line);
+  if (entry_key == NULL)
+    {
+      memset (&new_key, 0, sizeof (new_key));
+      new_key.key = line;
+      new_key.key_len = key_end - line;
+      new_key.rank = G_MAXUINT;
+      g_array_append_val (entry->keys, new_key);
+
+      entry_key = &g_array_index (entry->keys, PojkDesktopEntryKey, entry->keys->len - 1);
+    }
+
+  /* The first occurrence of a key wins */
+  if (locale == NULL)
+    {
+      if (entry_key->value == NULL)
+        {
+          entry_key->value = value;
+          entry_key->value_len = end - value;
+        }
+    }
+  else if (rank < entry_key->rank)
+    {
+      entry_key->translated = value;
+      entry_key->translated_len = end - value;
+      entry_key->rank = rank;
+    }
+}
+
+
+
+PojkDesktopEntry *
+_pojk_desktop_entry_new (const gchar *filename)
+{
+  PojkDesktopEntry *entry;
+  GMappedFile      *file;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  file = g_mapped_file_new (filename, FALSE, NULL);
+  if (G_UNLIKELY (file == NULL))
+    return NULL;
+
+  entry = g_slice_new (PojkDesktopEntry);
+  entry->file = file;
+  entry->data = g_mapped_file_get_contents (file);
+  entry->length = g_mapped_file_get_length (file);
+  entry->keys = g_array_sized_new (FALSE, FALSE, sizeof (PojkDesktopEntryKey), 32);
+
+  _pojk_desktop_entry_set_group (entry, G_KEY_FILE_DESKTOP_GROUP);
+
+  return entry;
+}
+
+
+
+void
+_pojk_desktop_entry_free (PojkDesktopEntry *entry)
+{
+  g_return_if_fail (entry != NULL);
+
+  g_array_free (entry->keys, TRUE);
+  g_mapped_file_unref (entry->file);
+  g_slice_free (PojkDesktopEntry, entry);
+}
+
+
+
+/* Indexes the keys of @group, which afterwards are the ones all other
+ * functions look at. Returns %FALSE if the file has no such group */
+gboolean
+_pojk_desktop_entry_set_group (PojkDesktopEntry *entry,
+                               const gchar      *group)
+{
+  const gchar *line;
+  const gchar *end;
+  const gchar *data_end;
+  gboolean     in_group = FALSE;
+  gboolean     found = FALSE;
+  gsize        group_len;
+
+  g_return_val_if_fail (entry != NULL, FALSE);
+  g_return_val_if_fail (group != NULL, FALSE);
+
+  g_array_set_size (entry->keys, 0);
+
+  if (G_UNLIKELY (entry->data == NULL))
+    return FALSE;
+
+  group_len = strlen (group);
+  data_end = entry->data + entry->length;
+
+  for (line = entry->data; line < data_end; line = end + 1)
+    {
+      end = memchr (line, '\n', data_end - line);
+      if (end == NULL)
+        end = data_end;
+
+      /* Only look at the lines of the group */
+      if (*line == '[')
+        {
+          /* Groups are not merged, the first one with the name wins */
+          if (in_group)
+            break;
+
+          in_group = (end - line >= (gssize) group_len + 2
+                      && memcmp (line + 1, group, group_len) == 0
+                      && line[group_len + 1] == ']');
+          found = found || in_group;
+        }
+      else if (in_group && *line != '#')
+        {
+          pojk_desktop_entry_add_line (entry, line,
+                                       end > line && end[-1] == '\r' ? end - 1 : end);
+        }
+    }
+
+  return found;
+}
+
+
+
+gboolean
+_pojk_desktop_entry_has_key (PojkDesktopEntry *entry,
+                             const gchar      *key)
+{
+  PojkDesktopEntryKey *entry_key;
+
+  g_return_val_if_fail (entry != NULL, FALSE);
+  g_return_val_if_fail (key != NULL, FALSE);
+
+  entry_key = pojk_desktop_entry_find_key (entry, key, strlen (key));
+
+  return entry_key != NULL && entry_key->value != NULL;
+}
+
+
+
+static gboolean
+pojk_desktop_entry_lookup (PojkDesktopEntry  *entry,
+                           const gchar       *key,
+                           gboolean           translated,
+                           const gchar      **value,
+                           gsize             *value_len)
+{
+  PojkDesktopEntryKey *entry_key;
+
+  entry_key = pojk_desktop_entry_find_key (entry, key, strlen (key));
+  if (entry_key == NULL)
+    return FALSE;
+
+  if (translated && entry_key->translated != NULL)
+    {
+      *value = entry_key->translated;
+      *value_len = entry_key->translated_len;
+    }
+  else
+    {
+      *value = entry_key->value;
+      *value_len = entry_key->value_len;
+    }
+
+  return *value != NULL;
+}
+
+
+
+/* Copies @len bytes of @value and resolves the escape sequences of the
+ * desktop entry specification. With @separator, an escaped separator
+ * stays in the string, unescaped ones end it. Returns the end of the
+ * copied part of @value */
+static const gchar *
+pojk_desktop_entry_unescape (const gchar *value,
+                             gsize        len,
+                             gchar        separator,
+                             GString     *result)
+{
+  const gchar *end = value + len;
+  const gchar *p;
+
+  for (p = value; p < end; p++)
+    {
+      if (*p == separator)
+        break;
+
+      if (*p == '\\' && p + 1 < end)
+        {
+          switch (*++p)
+            {
+            case 's':
+              g_string_append_c (result, ' ');
+              break;
+
+            case 'n':
+              g_string_append_c (result, '\n');
+              break;
+
+            case 't':
+              g_string_append_c (result, '\t');
+              break;
+
+            case 'r':
+              g_string_append_c (result, '\r');
+              break;
+
+            case '\\':
+              g_string_append_c (result, '\\');
+              break;
+
+            default:
+              if (*p != separator)
+                g_string_append_c (result, '\\');
+              g_string_append_c (result, *p);
+              break;
+            }
+        }
+      else
+        {
+          g_string_append_c (result, *p);
+        }
+    }
+
+  return p;
+}
+
+
+
+gchar *
+_pojk_desktop_entry_get_string (PojkDesktopEntry *entry,
+                                const gchar      *key,
+                                gboolean          translated)
+{
+  const gchar *value;
+  GString     *result;
+  gsize        value_len;
+
+  g_return_val_if_fail (entry != NULL, NULL);
+  g_return_val_if_fail (key != NULL, NULL);
+
+  if (!pojk_desktop_entry_lookup (entry, key, translated, &value, &value_len))
+    return NULL;
+
+  /* Most values have nothing to unescape */
+  if (memchr (value, '\\', value_len) == NULL)
+    return g_strndup (value, value_len);
+
+  result = g_string_sized_new (value_len);
+  pojk_desktop_entry_unescape (value, value_len, '\0', result);
+
+  return g_string_free (result, FALSE);
+}
+
+
+
+/* Appends the unescaped value of @key to @string, without a terminating
+ * nul byte. Returns %FALSE and leaves @string alone if there is no such
+ * key */
+gboolean
+_pojk_desktop_entry_append_string (PojkDesktopEntry *entry,
+                                   const gchar      *key,
+                                   gboolean          translated,
+                                   GString          *string)
+{
+  const gchar *value;
+  gsize        value_len;
+
+  g_return_val_if_fail (entry != NULL, FALSE);
+  g_return_val_if_fail (key != NULL, FALSE);
+  g_return_val_if_fail (string != NULL, FALSE);
+
+  if (!pojk_desktop_entry_lookup (entry, key, translated, &value, &value_len))
+    return FALSE;
+
+  if (memchr (value, '\\', value_len) == NULL)
+    g_string_append_len (string, value, value_len);
+  else
+    pojk_desktop_entry_unescape (value, value_len, '\0', string);
+
+  return TRUE;
+}
+
+
+
+gboolean
+_pojk_desktop_entry_get_boolean (PojkDesktopEntry *entry,
+                                 const gchar      *key,
+                                 gboolean          fallback)
+{
+  const gchar *value;
+  gsize        value_len;
+
+  g_return_val_if_fail (entry != NULL, fallback);
+  g_return_val_if_fail (key != NULL, fallback);
+
+  if (!pojk_desktop_entry_lookup (entry, key, FALSE, &value, &value_len))
+    return fallback;
+
+  return (value_len == 4 && g_ascii_strncasecmp (value, "true", 4) == 0)
+         || (value_len == 3 && g_ascii_strncasecmp (value, "yes", 3) == 0)
+         || (value_len == 2 && g_ascii_strncasecmp (value, "on", 2) == 0);
+}
+
+
+
+/* Returns the non-empty elements of a ';' separated list, or %NULL if
+ * @key does not exist. Lists are translated, like keywords */
+gchar **
+_pojk_desktop_entry_get_list (PojkDesktopEntry *entry,
+                              const gchar      *key)
+{
+  const gchar *value;
+  const gchar *end;
+  const gchar *p;
+  GPtrArray   *list;
+  GString     *element;
+  gsize        value_len;
+
+  g_return_val_if_fail (entry != NULL, NULL);
+  g_return_val_if_fail (key != NULL, NULL);
+
+  if (!pojk_desktop_entry_lookup (entry, key, TRUE, &value, &value_len))
+    return NULL;
+
+  list = g_ptr_array_new ();
+  element = g_string_sized_new (32);
+  end = value + value_len;
+
+  for (p = value; p < end; p++)
+    {
+      p = pojk_desktop_entry_unescape (p, end - p, ';', element);
+
+      if (element->len > 0)
+        {
+          g_ptr_array_add (list, g_strndup (element->str, element->len));
+          g_string_truncate (element, 0);
+        }
+    }
+
+  g_string_free (element, TRUE);
+  g_ptr_array_add (list, NULL);
+
+  return (gchar **) g_ptr_array_free (list, FALSE);
+}
@@ -0,0 +1,55 @@
+/* vi:set et ai sw=2 sts=2 ts=2: */
+/*-
+ * Copyright (c) 2026 The pojk developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#if !defined(POJK_INSIDE_POJK_H) && !defined(POJK_COMPILATION)
+#error "Only <pojk/pojk.h> can be included directly. This file may disappear or change contents."
+#endif
+
+#ifndef __POJK_DESKTOP_ENTRY_H__
+#define __POJK_DESKTOP_ENTRY_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PojkDesktopEntry PojkDesktopEntry;
+
+PojkDesktopEntry  *_pojk_desktop_entry_new         (const gchar      *filename);
+void               _pojk_desktop_entry_free        (PojkDesktopEntry *entry);
+gboolean           _pojk_desktop_entry_set_group   (PojkDesktopEntry *entry,
+                                                    const gchar      *group);
+gboolean           _pojk_desktop_entry_has_key     (PojkDesktopEntry *entry,
+                                                    const gchar      *key);
+gchar             *_pojk_desktop_entry_get_string  (PojkDesktopEntry *entry,
+                                                    const gchar      *key,
+                                                    gboolean          translated) G_GNUC_MALLOC;
+gboolean           _pojk_desktop_entry_append_string (PojkDesktopEntry *entry,
+                                                      const gchar      *key,
+                                                      gboolean          translated,
+                                                      GString          *string);
+gboolean           _pojk_desktop_entry_get_boolean (PojkDesktopEntry *entry,
+                                                    const gchar      *key,
+                                                    gboolean          fallback);
+gchar            **_pojk_desktop_entry_get_list    (PojkDesktopEntry *entry,
+                                                    const gchar      *key) G_GNUC_MALLOC;
+
+G_END_DECLS
+
+#endif /* !__POJK_DESKTOP_ENTRY_H__ */
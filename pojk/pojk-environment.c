@@ -24,6 +24,7 @@
 #endif
 
 #include <pojk/pojk-environment.h>
+#include <pojk/pojk-private.h>
 
 
 /**
@@ -38,7 +39,8 @@
 
 
 
-static gchar *environment = NULL;
+static gchar        *environment = NULL;
+static const gchar **environment_names = NULL;
 
 
 
@@ -58,6 +60,12 @@ pojk_set_environment (const gchar *env)
     g_free (environment);
 
   environment = g_strdup (env);
+
+  /* The environment can be multiple desktop names separated by colons */
+  g_free (environment_names);
+  environment_names = NULL;
+  if (env != NULL)
+    environment_names = _pojk_intern_strv (g_strsplit (env, ":", 0));
 }
 
 
@@ -78,6 +86,16 @@ pojk_get_environment (void)
 
 
 
+/* Returns the interned desktop names of the environment, or %NULL if
+ * no environment is set */
+const gchar * const *
+_pojk_get_environment_names (void)
+{
+  return environment_names;
+}
+
+
+
 /**
  * pojk_set_environment_xdg:
  * @fallback_env: fallback value
@@ -0,0 +1,498 @@
+/* vi:set et ai sw=2 sts=2 ts=2: */
+/*-
+ * Copyright (c) 2026 The pojk developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include <pojk/pojk-menu-app-dir-scan.h>
+#include <pojk/pojk-private.h>
+
+
+
+/* Scanning an application directory collects the desktop-file ids and
+ * URIs of all desktop files below it. The result only depends on the
+ * directory, so it is shared by all menus that list the directory and,
+ * if the cache is used, by later loads for as long as none of the
+ * scanned directories changed its modification time. Only scans of
+ * local directories read with directory file descriptors record these
+ * times and can be cached. */
+
+
+
+/* Scan local application directories using directory file descriptors */
+#if defined(HAVE_OPENAT) && defined(HAVE_FDOPENDIR) && defined(HAVE_FSTATAT) && defined(DT_UNKNOWN)
+#define POJK_MENU_APP_DIR_SCAN_NATIVE 1
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0
+#endif
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+#endif
+
+
+
+struct _PojkMenuAppDirScan
+{
+  gint       ref_count;
+
+  /* Desktop-file ids and URIs in the order they were found */
+  GPtrArray *desktop_ids;
+  GPtrArray *uris;
+
+  /* Paths and modification times of all scanned directories, %NULL
+   * if the scan cannot be validated */
+  GPtrArray *dirs;
+  GArray    *stamps;
+};
+
+
+
+/* Scans of earlier loads, keyed by directory URI */
+G_LOCK_DEFINE_STATIC (scan_cache);
+static GHashTable *scan_cache = NULL;
+
+
+
+static PojkMenuAppDirScan *
+pojk_menu_app_dir_scan_new (gboolean validatable)
+{
+  PojkMenuAppDirScan *scan;
+
+  scan = g_slice_new0 (PojkMenuAppDirScan);
+  scan->ref_count = 1;
+  scan->desktop_ids = g_ptr_array_new_with_free_func (g_free);
+  scan->uris = g_ptr_array_new_with_free_func (g_free);
+
+  if (validatable)
+    {
+      scan->dirs = g_ptr_array_new_with_free_func (g_free);
+      scan->stamps = g_array_new (FALSE, FALSE, sizeof (gint64));
+    }
+
+  return scan;
+}
+
+
+
+void
+_pojk_menu_app_dir_scan_unref (PojkMenuAppDirScan *scan)
+{
+  g_return_if_fail (scan != NULL);
+
+  if (!g_atomic_int_dec_and_test (&scan->ref_count))
+    return;
+
+  g_ptr_array_free (scan->desktop_ids, TRUE);
+  g_ptr_array_free (scan->uris, TRUE);
+
+  if (scan->dirs != NULL)
+    {
+      g_ptr_array_free (scan->dirs, TRUE);
+      g_array_free (scan->stamps, TRUE);
+    }
+
+  g_slice_free (PojkMenuAppDirScan, scan);
+}
+
+
+
+static void
+pojk_menu_app_dir_scan_add_dir (PojkMenuAppDirScan *scan,
+                                const gchar        *path,
+                                gint64              stamp)
+{
+  g_ptr_array_add (scan->dirs, g_strdup (path));
+  g_array_append_val (scan->stamps, stamp);
+}
+
+
+
+static gint64
+pojk_menu_app_dir_scan_get_stamp (const gchar *path)
+{
+  GStatBuf statb;
+
+  /* Missing directories are recorded too, so that their creation is noticed */
+  if (g_stat (path, &statb) != 0)
+    return -1;
+
+  return _pojk_stat_get_mtime (&statb);
+}
+
+
+
+static gboolean
+pojk_menu_app_dir_scan_is_valid (PojkMenuAppDirScan *scan)
+{
+  guint n;
+
+  if (scan->dirs == NULL)
+    return FALSE;
+
+  /* Adding, removing or renaming a file changes the time of its directory */
+  for (n = 0; n < scan->dirs->len; n++)
+    if (pojk_menu_app_dir_scan_get_stamp (g_ptr_array_index (scan->dirs, n))
+        != g_array_index (scan->stamps, gint64, n))
+      {
+        return FALSE;
+      }
+
+  return TRUE;
+}
+
+
+
+static void
+pojk_menu_app_dir_scan_from_path (PojkMenuAppDirScan *scan,
+                                  GFile              *dir,
+                                  const gchar        *id_prefix)
+{
+  GFileEnumerator *enumerator;
+  GFileInfo       *file_info;
+  GFile           *file;
+  gchar           *base_name;
+  gchar           *new_id_prefix;
+  gchar           *desktop_id;
+
+  /* Skip directory if it doesn't exist */
+  if (G_UNLIKELY (!g_file_query_exists (dir, NULL)))
+    return;
+
+  /* Skip directory if it's not a directory */
+  if (G_UNLIKELY (g_file_query_file_type (dir, G_FILE_QUERY_INFO_NONE,
+                                          NULL) != G_FILE_TYPE_DIRECTORY))
+    {
+      return;
+    }
+
+  /* Open directory for reading */
+  enumerator = g_file_enumerate_children (dir, "standard::name,standard::type",
+                                          G_FILE_QUERY_INFO_NONE, NULL, NULL);
+
+  /* Abort if directory cannot be opened */
+  if (G_UNLIKELY (enumerator == NULL))
+    return;
+
+  /* Read file by file */
+  while (TRUE)
+    {
+      file_info = g_file_enumerator_next_file (enumerator, NULL, NULL);
+
+      if (G_UNLIKELY (file_info == NULL))
+        break;
+
+      file = g_file_resolve_relative_path (dir, g_file_info_get_name (file_info));
+      base_name = g_file_get_basename (file);
+
+      /* Treat files and directories differently */
+      if (g_file_info_get_file_type (file_info) == G_FILE_TYPE_DIRECTORY)
+        {
+          /* Create new desktop-file id prefix */
+          if (G_LIKELY (id_prefix == NULL))
+            new_id_prefix = g_strdup (base_name);
+          else
+            new_id_prefix = g_strjoin ("-", id_prefix, base_name, NULL);
+
+          /* Collect files in the directory */
+          pojk_menu_app_dir_scan_from_path (scan, file, new_id_prefix);
+
+          /* Free id prefix */
+          g_free (new_id_prefix);
+        }
+      else if (G_LIKELY (g_str_has_suffix (base_name, ".desktop")))
+        {
+          /* Create desktop-file id */
+          if (G_LIKELY (id_prefix == NULL))
+            desktop_id = g_strdup (base_name);
+          else
+            desktop_id = g_strjoin ("-", id_prefix, base_name, NULL);
+
+          g_ptr_array_add (scan->desktop_ids, desktop_id);
+          g_ptr_array_add (scan->uris, g_file_get_uri (file));
+        }
+
+      /* Free absolute path */
+      g_free (base_name);
+
+      /* Destroy file */
+      g_object_unref (file);
+
+      /* Destroy info */
+      g_object_unref (file_info);
+    }
+
+  g_object_unref (enumerator);
+}
+
+
+
+#ifdef POJK_MENU_APP_DIR_SCAN_NATIVE
+/* Same as pojk_menu_app_dir_scan_from_path() for local directories, but
+ * without creating GFile and GFileInfo objects for every entry. @path and
+ * @desktop_id hold the directory path and desktop-file id prefix and are
+ * restored before returning. Takes ownership of @dir_fd */
+static void
+pojk_menu_app_dir_scan_from_fd (PojkMenuAppDirScan *scan,
+                                gint                dir_fd,
+                                GString            *path,
+                                GString            *desktop_id)
+{
+  struct dirent *entry;
+  GStatBuf       statb;
+  DIR           *dir;
+  gboolean       is_dir;
+  gsize          path_len = path->len;
+  gsize          id_len = desktop_id->len;
+  gchar         *uri;
+  gint           fd;
+
+  /* Take the time before reading, so that changes made while
+   * reading invalidate the scan */
+  if (fstat (dir_fd, &statb) == 0)
+    pojk_menu_app_dir_scan_add_dir (scan, path->str, _pojk_stat_get_mtime (&statb));
+  else
+    pojk_menu_app_dir_scan_add_dir (scan, path->str, -1);
+
+  dir = fdopendir (dir_fd);
+  if (G_UNLIKELY (dir == NULL))
+    {
+      close (dir_fd);
+      return;
+    }
+
+  while ((entry = readdir (dir)) != NULL)
+    {
+      /* Skip the . and .. entries */
+      if (entry->d_name[0] == '.'
+          && (entry->d_name[1] == '\0'
+              || (entry->d_name[1] == '.' && entry->d_name[2] == '\0')))
+        continue;
+
+      /* Only stat entries if the file system did not tell us their type
+       * or they are symlinks, which GIO follows as well */
+      if (entry->d_type == DT_DIR)
+        is_dir = TRUE;
+      else if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK)
+        is_dir = (fstatat (dirfd (dir), entry->d_name, &statb, 0) == 0
+                  && S_ISDIR (statb.st_mode));
+      else
+        is_dir = FALSE;
+
+      if (is_dir)
+        {
+          fd = openat (dirfd (dir), entry->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+          if (G_UNLIKELY (fd < 0))
+            continue;
+
+          /* Extend path and desktop-file id prefix */
+          g_string_append_c (path, G_DIR_SEPARATOR);
+          g_string_append (path, entry->d_name);
+          if (id_len > 0)
+            g_string_append_c (desktop_id, '-');
+          g_string_append (desktop_id, entry->d_name);
+
+          /* Collect files in the directory */
+          pojk_menu_app_dir_scan_from_fd (scan, fd, path, desktop_id);
+
+          g_string_truncate (path, path_len);
+          g_string_truncate (desktop_id, id_len);
+        }
+      else if (G_LIKELY (g_str_has_suffix (entry->d_name, ".desktop")))
+        {
+          g_string_append_c (path, G_DIR_SEPARATOR);
+          g_string_append (path, entry->d_name);
+
+          uri = g_filename_to_uri (path->str, NULL, NULL);
+          if (G_LIKELY (uri != NULL))
+            {
+              /* Create desktop-file id */
+              if (id_len > 0)
+                g_string_append_c (desktop_id, '-');
+              g_string_append (desktop_id, entry->d_name);
+
+              g_ptr_array_add (scan->desktop_ids, g_strdup (desktop_id->str));
+              g_ptr_array_add (scan->uris, uri);
+
+              g_string_truncate (desktop_id, id_len);
+            }
+
+          g_string_truncate (path, path_len);
+        }
+    }
+
+  /* Also closes dir_fd */
+  closedir (dir);
+}
+#endif
+
+
+
+static PojkMenuAppDirScan *
+pojk_menu_app_dir_scan_run (GFile *dir)
+{
+  PojkMenuAppDirScan *scan;
+#ifdef POJK_MENU_APP_DIR_SCAN_NATIVE
+  GString            *path;
+  GString            *desktop_id;
+  gchar              *filename;
+  gint                fd;
+
+  filename = g_file_get_path (dir);
+  if (G_LIKELY (filename != NULL))
+    {
+      scan = pojk_menu_app_dir_scan_new (TRUE);
+
+      /* Skip directory if it doesn't exist or isn't a directory */
+      fd = open (filename, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (G_LIKELY (fd >= 0))
+        {
+          path = g_string_new (filename);
+          desktop_id = g_string_sized_new (64);
+          pojk_menu_app_dir_scan_from_fd (scan, fd, path, desktop_id);
+          g_string_free (desktop_id, TRUE);
+          g_string_free (path, TRUE);
+        }
+      else
+        {
+          pojk_menu_app_dir_scan_add_dir (scan, filename,
+                                          pojk_menu_app_dir_scan_get_stamp (filename));
+        }
+
+      g_free (filename);
+
+      return scan;
+    }
+#endif
+
+  scan = pojk_menu_app_dir_scan_new (FALSE);
+  pojk_menu_app_dir_scan_from_path (scan, dir, NULL);
+
+  return scan;
+}
+
+
+
+/* Returns the desktop files below @dir. With @use_cache, the scan of an
+ * earlier load is reused if @dir did not change since then, which is
+ * reported in @cache_hit */
+PojkMenuAppDirScan *
+_pojk_menu_app_dir_scan_lookup (GFile    *dir,
+                                gboolean  use_cache,
+                                gboolean *cache_hit)
+{
+  PojkMenuAppDirScan *scan = NULL;
+  gchar              *uri;
+
+  g_return_val_if_fail (G_IS_FILE (dir), NULL);
+
+  if (cache_hit != NULL)
+    *cache_hit = FALSE;
+
+  if (!use_cache)
+    return pojk_menu_app_dir_scan_run (dir);
+
+  uri = g_file_get_uri (dir);
+
+  G_LOCK (scan_cache);
+  if (scan_cache != NULL)
+    scan = g_hash_table_lookup (scan_cache, uri);
+  if (scan != NULL)
+    g_atomic_int_inc (&scan->ref_count);
+  G_UNLOCK (scan_cache);
+
+  /* Validate outside the lock, loads in other threads may be waiting */
+  if (scan != NULL && pojk_menu_app_dir_scan_is_valid (scan))
+    {
+      if (cache_hit != NULL)
+        *cache_hit = TRUE;
+      g_free (uri);
+      return scan;
+    }
+
+  if (scan != NULL)
+    _pojk_menu_app_dir_scan_unref (scan);
+
+  scan = pojk_menu_app_dir_scan_run (dir);
+
+  if (scan->dirs != NULL)
+    {
+      G_LOCK (scan_cache);
+      if (scan_cache == NULL)
+        {
+          scan_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                              (GDestroyNotify) _pojk_menu_app_dir_scan_unref);
+        }
+      g_atomic_int_inc (&scan->ref_count);
+      g_hash_table_replace (scan_cache, uri, scan);
+      G_UNLOCK (scan_cache);
+    }
+  else
+    {
+      g_free (uri);
+    }
+
+  return scan;
+}
+
+
+
+/* Adds the desktop files of @scan to @desktop_id_table, unless their
+ * desktop-file ids are already taken by a directory merged before */
+void
+_pojk_menu_app_dir_scan_merge (PojkMenuAppDirScan *scan,
+                               GHashTable         *desktop_id_table)
+{
+  const gchar *desktop_id;
+  guint        n;
+
+  g_return_if_fail (scan != NULL);
+  g_return_if_fail (desktop_id_table != NULL);
+
+  for (n = 0; n < scan->desktop_ids->len; n++)
+    {
+      desktop_id = g_ptr_array_index (scan->desktop_ids, n);
+      if (G_LIKELY (g_hash_table_lookup (desktop_id_table, desktop_id) == NULL))
+        {
+          g_hash_table_insert (desktop_id_table, g_strdup (desktop_id),
+                               g_strdup (g_ptr_array_index (scan->uris, n)));
+        }
+    }
+}
@@ -0,0 +1,43 @@
+/* vi:set et ai sw=2 sts=2 ts=2: */
+/*-
+ * Copyright (c) 2026 The pojk developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#if !defined(POJK_INSIDE_POJK_H) && !defined(POJK_COMPILATION)
+#error "Only <pojk/pojk.h> can be included directly. This file may disappear or change contents."
+#endif
+
+#ifndef __POJK_MENU_APP_DIR_SCAN_H__
+#define __POJK_MENU_APP_DIR_SCAN_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PojkMenuAppDirScan PojkMenuAppDirScan;
+
+PojkMenuAppDirScan *_pojk_menu_app_dir_scan_lookup (GFile              *dir,
+                                                    gboolean            use_cache,
+                                                    gboolean           *cache_hit);
+void                _pojk_menu_app_dir_scan_merge  (PojkMenuAppDirScan *scan,
+                                                    GHashTable         *desktop_id_table);
+void                _pojk_menu_app_dir_scan_unref  (PojkMenuAppDirScan *scan);
+
+G_END_DECLS
+
+#endif /* !__POJK_MENU_APP_DIR_SCAN_H__ */
@@ -24,8 +24,8 @@
 
 #include <locale.h>
 #include <glib.h>
-#include <libbladeutil/libbladeutil.h>
 
+#include <pojk/pojk-desktop-entry.h>
 #include <pojk/pojk-environment.h>
 #include <pojk/pojk-menu-directory.h>
 #include <pojk/pojk-private.h>
@@ -338,35 +338,36 @@ PojkMenuDirectory *
 pojk_menu_directory_new (GFile *file)
 {
   PojkMenuDirectory *directory = NULL;
-  XfceRc              *rc;
-  const gchar         *name;
-  const gchar         *comment;
-  const gchar         *icon_name;
+  PojkDesktopEntry    *entry;
+  gchar               *name;
+  gchar               *comment;
+  gchar               *icon_name;
   gboolean             no_display;
   gchar               *filename;
 
   g_return_val_if_fail (G_IS_FILE (file), NULL);
   g_return_val_if_fail (g_file_is_native (file), NULL);
 
- /* Open the rc file */
+ /* Open the desktop file */
   filename = g_file_get_path (file);
-  rc = xfce_rc_simple_open (filename, TRUE);
+  entry = _pojk_desktop_entry_new (filename);
   g_free (filename);
-  if (G_UNLIKELY (rc == NULL))
+  if (G_UNLIKELY (entry == NULL))
     return NULL;
 
-  xfce_rc_set_group (rc, G_KEY_FILE_DESKTOP_GROUP);
-
   /* Parse name, exec command and icon name */
-  name = xfce_rc_read_entry (rc, G_KEY_FILE_DESKTOP_KEY_NAME, NULL);
+  name = _pojk_desktop_entry_get_string (entry, G_KEY_FILE_DESKTOP_KEY_NAME, TRUE);
 
   /* If there is no name we must bail out now or segfault later */
   if (G_UNLIKELY (name == NULL))
-    return NULL;
+    {
+      _pojk_desktop_entry_free (entry);
+      return NULL;
+    }
 
-  comment = xfce_rc_read_entry (rc, G_KEY_FILE_DESKTOP_KEY_COMMENT, NULL);
-  icon_name = xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_ICON, NULL);
-  no_display = xfce_rc_read_bool_entry (rc, G_KEY_FILE_DESKTOP_KEY_NO_DISPLAY, FALSE);
+  comment = _pojk_desktop_entry_get_string (entry, G_KEY_FILE_DESKTOP_KEY_COMMENT, TRUE);
+  icon_name = _pojk_desktop_entry_get_string (entry, G_KEY_FILE_DESKTOP_KEY_ICON, FALSE);
+  no_display = _pojk_desktop_entry_get_boolean (entry, G_KEY_FILE_DESKTOP_KEY_NO_DISPLAY, FALSE);
 
   /* Allocate a new directory instance */
   directory = g_object_new (POJK_TYPE_MENU_DIRECTORY,
@@ -378,12 +379,15 @@ pojk_menu_directory_new (GFile *file)
                             NULL);
 
   /* Set rest of the private data directly */
-  directory->priv->only_show_in = xfce_rc_read_list_entry (rc, G_KEY_FILE_DESKTOP_KEY_ONLY_SHOW_IN, ";");
-  directory->priv->not_show_in = xfce_rc_read_list_entry (rc, G_KEY_FILE_DESKTOP_KEY_NOT_SHOW_IN, ";");
-  directory->priv->hidden = xfce_rc_read_bool_entry (rc, G_KEY_FILE_DESKTOP_KEY_HIDDEN, FALSE);
+  directory->priv->only_show_in = _pojk_desktop_entry_get_list (entry, G_KEY_FILE_DESKTOP_KEY_ONLY_SHOW_IN);
+  directory->priv->not_show_in = _pojk_desktop_entry_get_list (entry, G_KEY_FILE_DESKTOP_KEY_NOT_SHOW_IN);
+  directory->priv->hidden = _pojk_desktop_entry_get_boolean (entry, G_KEY_FILE_DESKTOP_KEY_HIDDEN, FALSE);
 
   /* Cleanup */
-  xfce_rc_close (rc);
+  _pojk_desktop_entry_free (entry);
+  g_free (name);
+  g_free (comment);
+  g_free (icon_name);
 
   return directory;
 }
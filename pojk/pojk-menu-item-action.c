@@ -309,3 +309,22 @@ pojk_menu_item_action_unref (PojkMenuItemAction *action)
   /* Decrement the reference counter */
   g_object_unref (G_OBJECT (action));
 }
+
+
+
+/* Creates an action that takes over @name, @command and @icon_name,
+ * without going through the property setters */
+PojkMenuItemAction *
+_pojk_menu_item_action_new_take (gchar *name,
+                                 gchar *command,
+                                 gchar *icon_name)
+{
+  PojkMenuItemAction *action;
+
+  action = g_object_new (POJK_TYPE_MENU_ITEM_ACTION, NULL);
+  action->priv->name = name;
+  action->priv->command = command;
+  action->priv->icon_name = icon_name;
+
+  return action;
+}
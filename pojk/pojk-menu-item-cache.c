@@ -40,35 +40,111 @@
 
 #include <pojk/pojk-menu-item.h>
 #include <pojk/pojk-menu-item-cache.h>
+#include <pojk/pojk-menu-item-database.h>
+#include <pojk/pojk-private.h>
 
 
 
-static void pojk_menu_item_cache_finalize   (GObject                  *object);
+static void     pojk_menu_item_cache_finalize       (GObject                  *object);
+static void     pojk_menu_item_cache_entry_free     (gpointer                  data);
+static gpointer pojk_menu_item_cache_write_database (gpointer                  data);
 
 
 
-#if GLIB_CHECK_VERSION (2, 32, 0)
 /* Object Mutex Lock */
 #define _item_cache_lock(cache)    g_mutex_lock (&((cache)->priv->lock))
 #define _item_cache_unlock(cache)  g_mutex_unlock (&((cache)->priv->lock))
-#else
-/* Mutex lock */
-static GStaticMutex lock = G_STATIC_MUTEX_INIT;
 
-#define _item_cache_lock(cache)    g_static_mutex_lock (&lock))
-#define _item_cache_unlock(cache)  g_static_mutex_unlock (&lock))
-#endif
+/* Delay before writing the item database is tried again after it failed,
+ * doubled after every further failure, in microseconds */
+#define ITEM_DATABASE_RETRY_DELAY     (60 * G_TIME_SPAN_SECOND)
+#define ITEM_DATABASE_MAX_RETRY_DELAY (60 * G_TIME_SPAN_MINUTE)
+
+
+
+/* How an item was found by pojk_menu_item_cache_get() */
+typedef enum
+{
+  ITEM_CACHE_HIT,
+  ITEM_CACHE_HIT_UNCHANGED,
+  ITEM_CACHE_LOADED,
+} PojkMenuItemCacheResult;
+
+/* Cached item, linked into the LRU list of the cache. Owns the URI used
+ * as the key of the hash table */
+typedef struct _PojkMenuItemCacheEntry
+{
+  PojkMenuItemCache *cache;
+  PojkMenuItem      *item;
+  gchar             *uri;
+  gsize              size;
+  gint               size_serial;
+  GList              link;
+
+  /* Load epoch in which the item was last returned, 0 if it never was.
+   * Entries of the current epoch are pinned and not evicted */
+  guint              epoch;
+} PojkMenuItemCacheEntry;
+
+/* A desktop file being parsed by one thread, which other threads
+ * asking for the same URI wait for */
+typedef struct _PojkMenuItemCacheLoad
+{
+  PojkMenuItem *item;
+  gboolean      done;
+  guint         ref_count;
+} PojkMenuItemCacheLoad;
+
+/* Items written to the item database by a background thread */
+typedef struct _PojkMenuItemCacheSave
+{
+  PojkMenuItemCache    *cache;
+  PojkMenuItemDatabase *database;
+  GPtrArray            *items;
+} PojkMenuItemCacheSave;
 
 
 
 struct _PojkMenuItemCachePrivate
 {
-  /* Hash table for mapping absolute filenames to PojkMenuItem's */
+  /* Hash table for mapping URIs to PojkMenuItemCacheEntry's */
   GHashTable *items;
 
-#if GLIB_CHECK_VERSION (2, 32, 0)
+  /* Entries, most recently used first */
+  GQueue      lru;
+
+  /* Limits for the cache, 0 for none */
+  guint       max_items;
+  gsize       max_bytes;
+
+  /* Counters, see pojk_menu_item_cache_get_stats() */
+  guint64     n_hits;
+  guint64     n_misses;
+  guint64     n_evictions;
+  guint64     n_database_hits;
+  gsize       n_bytes;
+
+  /* Number of running menu loads, and the epoch which is incremented
+   * whenever the last of them finished */
+  guint       n_loads;
+  guint       epoch;
+
+  /* Shared database of the system items, if enabled */
+  PojkMenuItemDatabase *database;
+
+  /* Whether the database is being written, and when writing it may be
+   * tried again after it failed */
+  gboolean    database_saving;
+  gint64      database_retry_time;
+  gint64      database_retry_delay;
+
+  /* URIs being loaded without holding the lock => PojkMenuItemCacheLoad */
+  GHashTable *loads;
+
+  /* The lock only protects the hash tables, desktop files are parsed
+   * without holding it. Waiting threads are woken up by load_done */
   GMutex      lock;
-#endif
+  GCond       load_done;
 };
 
 
@@ -91,16 +167,23 @@ pojk_menu_item_cache_class_init (PojkMenuItemCacheClass *klass)
 static void
 pojk_menu_item_cache_init (PojkMenuItemCache *cache)
 {
+  const gchar *directory;
+
   cache->priv = pojk_menu_item_cache_get_instance_private (cache);
 
-#if GLIB_CHECK_VERSION (2, 32, 0)
   g_mutex_init (&cache->priv->lock);
-#endif
+  g_cond_init (&cache->priv->load_done);
 
   /* Create empty hash table */
-  cache->priv->items = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                              g_free,
-                                              (GDestroyNotify) pojk_menu_item_unref);
+  cache->priv->items = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                              (GDestroyNotify) pojk_menu_item_cache_entry_free);
+  cache->priv->loads = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  cache->priv->epoch = 1;
+
+  /* Share the system items with other processes if asked to */
+  directory = g_getenv ("POJK_MENU_ITEM_DATABASE");
+  if (directory != NULL && *directory != '\0')
+    cache->priv->database = _pojk_menu_item_database_new (directory);
 }
 
 
@@ -142,35 +225,215 @@ pojk_menu_item_cache_finalize (GObject *object)
 
   /* Free hash table */
   g_hash_table_unref (cache->priv->items);
+  g_hash_table_unref (cache->priv->loads);
+
+  if (cache->priv->database != NULL)
+    _pojk_menu_item_database_unref (cache->priv->database);
 
-#if GLIB_CHECK_VERSION (2, 32, 0)
   /*Release the mutex */
   g_mutex_clear (&cache->priv->lock);
-#endif
+  g_cond_clear (&cache->priv->load_done);
 
   (*G_OBJECT_CLASS (pojk_menu_item_cache_parent_class)->finalize) (object);
 }
 
 
 
-PojkMenuItem*
-pojk_menu_item_cache_lookup (PojkMenuItemCache *cache,
-                               const gchar         *uri,
-                               const gchar         *desktop_id)
+static void
+pojk_menu_item_cache_entry_free (gpointer data)
 {
-  PojkMenuItem *item = NULL;
+  PojkMenuItemCacheEntry   *entry = data;
+  PojkMenuItemCachePrivate *priv = entry->cache->priv;
+
+  g_queue_unlink (&priv->lru, &entry->link);
+  priv->n_bytes -= entry->size;
+
+  g_object_unref (entry->item);
+  g_free (entry->uri);
+  g_slice_free (PojkMenuItemCacheEntry, entry);
+}
+
+
+
+static PojkMenuItem *
+pojk_menu_item_cache_find (PojkMenuItemCache *cache,
+                           const gchar       *uri)
+{
+  PojkMenuItemCacheEntry *entry;
+
+  entry = g_hash_table_lookup (cache->priv->items, uri);
+
+  return entry != NULL ? entry->item : NULL;
+}
+
+
+
+/* Measures the item of @entry again if it changed since the last time */
+static void
+pojk_menu_item_cache_entry_update_size (PojkMenuItemCache      *cache,
+                                        PojkMenuItemCacheEntry *entry)
+{
+  gint serial;
+
+  serial = _pojk_menu_item_get_size_serial (entry->item);
+  if (serial == entry->size_serial)
+    return;
+
+  cache->priv->n_bytes -= entry->size;
+  entry->size_serial = serial;
+  entry->size = _pojk_menu_item_get_memory_size (entry->item);
+  cache->priv->n_bytes += entry->size;
+}
+
+
+
+/* Marks the entry of @uri as the most recently used one and pins it until
+ * the running menu loads finished. Items grow when they are materialized
+ * or reloaded, so the size is updated then */
+static void
+pojk_menu_item_cache_touch (PojkMenuItemCache *cache,
+                            const gchar       *uri)
+{
+  PojkMenuItemCacheEntry *entry;
+
+  entry = g_hash_table_lookup (cache->priv->items, uri);
+
+  g_queue_unlink (&cache->priv->lru, &entry->link);
+  g_queue_push_head_link (&cache->priv->lru, &entry->link);
+  entry->epoch = cache->priv->epoch;
+
+  pojk_menu_item_cache_entry_update_size (cache, entry);
+}
 
-  g_return_val_if_fail (POJK_IS_MENU_ITEM_CACHE (cache), NULL);
-  g_return_val_if_fail (uri != NULL, NULL);
-  g_return_val_if_fail (desktop_id != NULL, NULL);
 
-  /* Acquire lock on the item cache as it's likely that we need to load
-   * items from the hard drive and store it in the hash table of the
-   * item cache */
+
+/* Evicts the least recently used items until the cache is within its
+ * limits again. Items which are allocated to a menu stay, and so does
+ * @keep. Items returned since the last menu load finished are pinned by
+ * their epoch, so the loads can allocate them first */
+static void
+pojk_menu_item_cache_evict (PojkMenuItemCache *cache,
+                            PojkMenuItem      *keep)
+{
+  PojkMenuItemCachePrivate *priv = cache->priv;
+  PojkMenuItemCacheEntry   *entry;
+  GList                    *link;
+  GList                    *prev;
+
+  for (link = priv->lru.tail; link != NULL; link = prev)
+    {
+      if ((priv->max_items == 0 || g_hash_table_size (priv->items) <= priv->max_items)
+          && (priv->max_bytes == 0 || priv->n_bytes <= priv->max_bytes))
+        break;
+
+      prev = link->prev;
+      entry = link->data;
+
+      if (entry->item != keep
+          && entry->epoch != priv->epoch
+          && pojk_menu_item_get_allocated (entry->item) == 0)
+        {
+          g_hash_table_remove (priv->items, entry->uri);
+          priv->n_evictions++;
+        }
+    }
+}
+
+
+
+/* Adds @item to the cache, taking over the reference of the caller, and
+ * replaces a possible item that was cached for @uri before */
+static void
+pojk_menu_item_cache_add (PojkMenuItemCache *cache,
+                          const gchar       *uri,
+                          PojkMenuItem      *item)
+{
+  PojkMenuItemCacheEntry *entry;
+
+  entry = g_slice_new (PojkMenuItemCacheEntry);
+  entry->cache = cache;
+  entry->item = item;
+  entry->uri = g_strdup (uri);
+  entry->size_serial = _pojk_menu_item_get_size_serial (item);
+  entry->size = _pojk_menu_item_get_memory_size (item);
+  entry->link.data = entry;
+  entry->link.prev = NULL;
+  entry->link.next = NULL;
+  entry->epoch = cache->priv->epoch;
+
+  g_hash_table_replace (cache->priv->items, entry->uri, entry);
+  g_queue_push_head_link (&cache->priv->lru, &entry->link);
+  cache->priv->n_bytes += entry->size;
+
+  pojk_menu_item_cache_evict (cache, item);
+}
+
+
+
+static void
+pojk_menu_item_cache_load_unref (PojkMenuItemCacheLoad *load)
+{
+  if (--load->ref_count > 0)
+    return;
+
+  if (load->item != NULL)
+    g_object_unref (load->item);
+  g_slice_free (PojkMenuItemCacheLoad, load);
+}
+
+
+
+/* Returns a new reference on the cached item for @uri, parsing the
+ * desktop file if there is none or, with @revalidate, if the file changed
+ * since the item was read. The lock is only held to access the hash
+ * tables: the file is checked and parsed without it, and threads asking
+ * for a URI that is being parsed already wait for that instead of parsing
+ * it again. The reference is taken while holding the lock, so the item
+ * cannot be evicted in between */
+static PojkMenuItem *
+pojk_menu_item_cache_get (PojkMenuItemCache       *cache,
+                          const gchar             *uri,
+                          const gchar             *desktop_id,
+                          gboolean                 revalidate,
+                          PojkMenuItemCacheResult *result)
+{
+  PojkMenuItemDatabase  *database = NULL;
+  PojkMenuItemCacheLoad *load;
+  PojkMenuItem          *item;
+  PojkFileStampState     state = POJK_FILE_STAMP_UNKNOWN;
+  GFile                 *file;
+  gboolean               replaced;
+  gboolean               parsed = FALSE;
+
   _item_cache_lock (cache);
 
-  /* Search uri in the hash table */
-  item = g_hash_table_lookup (cache->priv->items, uri);
+  do
+    {
+      replaced = FALSE;
+
+      /* Search uri in the hash table */
+      item = pojk_menu_item_cache_find (cache, uri);
+      if (item != NULL && revalidate)
+        {
+          /* Stat the file without holding the lock */
+          g_object_ref (item);
+          _item_cache_unlock (cache);
+          state = _pojk_menu_item_check_file (item);
+          _item_cache_lock (cache);
+
+          /* Start over if the item was replaced in the meantime */
+          replaced = (pojk_menu_item_cache_find (cache, uri) != item);
+          g_object_unref (item);
+
+          /* Threads asking in the meantime wait for the new item */
+          if (!replaced && state == POJK_FILE_STAMP_CHANGED)
+            {
+              g_hash_table_remove (cache->priv->items, uri);
+              item = NULL;
+            }
+        }
+    }
+  while (replaced);
 
   /* Return the item if we we found one */
   if (item != NULL)
@@ -178,27 +441,112 @@ pojk_menu_item_cache_lookup (PojkMenuItemCache *cache,
       /* Update desktop id, if necessary */
       pojk_menu_item_set_desktop_id (item, desktop_id);
 
-      /* Release item cache lock */
+      pojk_menu_item_cache_touch (cache, uri);
+      cache->priv->n_hits++;
+      g_object_ref (item);
       _item_cache_unlock (cache);
 
+      *result = (state == POJK_FILE_STAMP_UNCHANGED) ? ITEM_CACHE_HIT_UNCHANGED : ITEM_CACHE_HIT;
       return item;
     }
 
-  /* Last chance is to load it directly from the file */
-  item = pojk_menu_item_new_for_uri (uri);
+  load = g_hash_table_lookup (cache->priv->loads, uri);
+  if (load != NULL)
+    {
+      /* Another thread is parsing the file, wait for its result */
+      load->ref_count++;
+      while (!load->done)
+        g_cond_wait (&cache->priv->load_done, &cache->priv->lock);
+
+      item = load->item;
+      if (item != NULL)
+        {
+          pojk_menu_item_set_desktop_id (item, desktop_id);
+          g_object_ref (item);
+        }
+
+      pojk_menu_item_cache_load_unref (load);
+      cache->priv->n_hits++;
+      _item_cache_unlock (cache);
 
-  if (G_LIKELY (item != NULL))
+      *result = ITEM_CACHE_HIT;
+      return item;
+    }
+
+  /* Tell other threads that we are parsing the file */
+  load = g_slice_new0 (PojkMenuItemCacheLoad);
+  load->ref_count = 1;
+  g_hash_table_insert (cache->priv->loads, g_strdup (uri), load);
+
+  if (cache->priv->database != NULL)
+    database = _pojk_menu_item_database_ref (cache->priv->database);
+
+  _item_cache_unlock (cache);
+
+  /* Try the shared item database first */
+  if (database != NULL)
     {
-      /* Update desktop id */
-      pojk_menu_item_set_desktop_id (item, desktop_id);
+      item = _pojk_menu_item_database_lookup (database, uri);
+      if (item != NULL)
+        pojk_menu_item_set_desktop_id (item, desktop_id);
+      _pojk_menu_item_database_unref (database);
+    }
 
-      /* The file has been loaded, add the item to the hash table */
-      g_hash_table_replace (cache->priv->items, g_strdup (uri), item);
+  /* Last chance is to load it directly from the file */
+  if (item == NULL)
+    {
+      file = g_file_new_for_uri (uri);
+      item = _pojk_menu_item_new_lazy (file, desktop_id);
+      g_object_unref (file);
+
+      parsed = TRUE;
     }
 
-  /* Release item cache lock */
+  _item_cache_lock (cache);
+
+  g_hash_table_remove (cache->priv->loads, uri);
+
+  /* The file has been loaded, add the item to the hash table, which
+   * takes over the reference we return */
+  if (G_LIKELY (item != NULL))
+    pojk_menu_item_cache_add (cache, uri, g_object_ref (item));
+
+  if (parsed)
+    cache->priv->n_misses++;
+  else
+    cache->priv->n_database_hits++;
+
+  /* Wake up the waiting threads */
+  load->item = item != NULL ? g_object_ref (item) : NULL;
+  load->done = TRUE;
+  g_cond_broadcast (&cache->priv->load_done);
+  pojk_menu_item_cache_load_unref (load);
+
   _item_cache_unlock (cache);
 
+  *result = ITEM_CACHE_LOADED;
+  return item;
+}
+
+
+
+PojkMenuItem*
+pojk_menu_item_cache_lookup (PojkMenuItemCache *cache,
+                               const gchar         *uri,
+                               const gchar         *desktop_id)
+{
+  PojkMenuItem *item;
+
+  g_return_val_if_fail (POJK_IS_MENU_ITEM_CACHE (cache), NULL);
+  g_return_val_if_fail (uri != NULL, NULL);
+  g_return_val_if_fail (desktop_id != NULL, NULL);
+
+  /* The caller does not get a reference, the item is pinned in the
+   * cache until the next menu load finished */
+  item = _pojk_menu_item_cache_lookup (cache, uri, desktop_id);
+  if (item != NULL)
+    g_object_unref (item);
+
   return item;
 }
 
@@ -209,12 +557,22 @@ pojk_menu_item_cache_foreach (PojkMenuItemCache *cache,
                                 GHFunc               func,
                                 gpointer             user_data)
 {
+  PojkMenuItemCacheEntry *entry;
+  GHashTableIter          iter;
+  gpointer                uri;
+  gpointer                value;
+
   g_return_if_fail (POJK_IS_MENU_ITEM_CACHE (cache));
 
   /* Acquire lock on the item cache */
   _item_cache_lock (cache);
 
-  g_hash_table_foreach (cache->priv->items, func, user_data);
+  g_hash_table_iter_init (&iter, cache->priv->items);
+  while (g_hash_table_iter_next (&iter, &uri, &value))
+    {
+      entry = value;
+      func (uri, entry->item, user_data);
+    }
 
   /* Release item cache lock */
   _item_cache_unlock (cache);
@@ -261,3 +619,345 @@ pojk_menu_item_cache_invalidate_file (PojkMenuItemCache *cache,
 
   g_free (uri);
 }
+
+
+
+/**
+ * pojk_menu_item_cache_set_budget:
+ * @cache     : a #PojkMenuItemCache.
+ * @max_items : maximum number of items to keep, or 0 for no limit.
+ * @max_bytes : maximum estimated memory used by the items, or 0 for no
+ *              limit.
+ *
+ * Limits the size of @cache. Once a limit is exceeded, the least recently
+ * used items are removed from the cache until it is within its limits
+ * again. Items that are used by a menu, or were looked up since the last
+ * menu load finished, are never removed, so the cache may stay above its
+ * limits while many menus are loaded. Items referenced by someone else
+ * may be removed; they stay valid, but a later lookup returns a new item.
+ * There are no limits by default.
+ **/
+void
+pojk_menu_item_cache_set_budget (PojkMenuItemCache *cache,
+                                 guint              max_items,
+                                 gsize              max_bytes)
+{
+  g_return_if_fail (POJK_IS_MENU_ITEM_CACHE (cache));
+
+  _item_cache_lock (cache);
+
+  cache->priv->max_items = max_items;
+  cache->priv->max_bytes = max_bytes;
+  pojk_menu_item_cache_evict (cache, NULL);
+
+  _item_cache_unlock (cache);
+}
+
+
+
+/**
+ * pojk_menu_item_cache_get_stats:
+ * @cache : a #PojkMenuItemCache.
+ * @stats : return location for the counters.
+ *
+ * Copies the current counters of @cache to @stats. This is meant for
+ * diagnostics only.
+ **/
+void
+pojk_menu_item_cache_get_stats (PojkMenuItemCache      *cache,
+                                PojkMenuItemCacheStats *stats)
+{
+  g_return_if_fail (POJK_IS_MENU_ITEM_CACHE (cache));
+  g_return_if_fail (stats != NULL);
+
+  _item_cache_lock (cache);
+
+  stats->n_hits = cache->priv->n_hits;
+  stats->n_misses = cache->priv->n_misses;
+  stats->n_evictions = cache->priv->n_evictions;
+  stats->n_database_hits = cache->priv->n_database_hits;
+  stats->n_items = g_hash_table_size (cache->priv->items);
+  stats->n_bytes = cache->priv->n_bytes;
+
+  _item_cache_unlock (cache);
+}
+
+
+
+/* Adds an already loaded item to the cache, taking over the reference of
+ * the caller. If the cache already holds an item for @uri, that one wins
+ * and @item is released. Returns a new reference on the cached item */
+PojkMenuItem *
+_pojk_menu_item_cache_insert (PojkMenuItemCache *cache,
+                              const gchar       *uri,
+                              PojkMenuItem      *item)
+{
+  PojkMenuItem *cached;
+
+  g_return_val_if_fail (POJK_IS_MENU_ITEM_CACHE (cache), NULL);
+  g_return_val_if_fail (uri != NULL, NULL);
+  g_return_val_if_fail (POJK_IS_MENU_ITEM (item), NULL);
+
+  /* Acquire a lock on the item cache */
+  _item_cache_lock (cache);
+
+  cached = pojk_menu_item_cache_find (cache, uri);
+
+  if (G_LIKELY (cached == NULL))
+    {
+      /* The hash table owns the reference we got from the caller */
+      pojk_menu_item_cache_add (cache, uri, item);
+      cached = item;
+    }
+  else
+    {
+      /* Keep the item which is possibly in use already */
+      pojk_menu_item_cache_touch (cache, uri);
+      g_object_unref (item);
+    }
+
+  g_object_ref (cached);
+
+  /* Release the item cache lock */
+  _item_cache_unlock (cache);
+
+  return cached;
+}
+
+
+
+/* Loads the item for @uri into the cache unless it is there already
+ * and its file did not change. Returns %TRUE if the desktop file had to
+ * be parsed. @unchanged is set if a cached item was checked against its
+ * file and kept */
+gboolean
+_pojk_menu_item_cache_preload (PojkMenuItemCache *cache,
+                               const gchar       *uri,
+                               const gchar       *desktop_id,
+                               gboolean          *unchanged)
+{
+  PojkMenuItemCacheResult result;
+  PojkMenuItem           *item;
+
+  g_return_val_if_fail (POJK_IS_MENU_ITEM_CACHE (cache), FALSE);
+  g_return_val_if_fail (uri != NULL, FALSE);
+  g_return_val_if_fail (desktop_id != NULL, FALSE);
+  g_return_val_if_fail (unchanged != NULL, FALSE);
+
+  item = pojk_menu_item_cache_get (cache, uri, desktop_id, TRUE, &result);
+  if (item != NULL)
+    g_object_unref (item);
+  *unchanged = (result == ITEM_CACHE_HIT_UNCHANGED);
+
+  return result == ITEM_CACHE_LOADED;
+}
+
+
+
+/* Same as pojk_menu_item_cache_lookup(), but returns a new reference
+ * on the item */
+PojkMenuItem *
+_pojk_menu_item_cache_lookup (PojkMenuItemCache *cache,
+                              const gchar       *uri,
+                              const gchar       *desktop_id)
+{
+  PojkMenuItemCacheResult result;
+
+  g_return_val_if_fail (POJK_IS_MENU_ITEM_CACHE (cache), NULL);
+  g_return_val_if_fail (uri != NULL, NULL);
+  g_return_val_if_fail (desktop_id != NULL, NULL);
+
+  return pojk_menu_item_cache_get (cache, uri, desktop_id, TRUE, &result);
+}
+
+
+
+/* Same as _pojk_menu_item_cache_lookup(), but without checking the file
+ * of a cached item again. Used for items that were preloaded by the
+ * same menu load */
+PojkMenuItem *
+_pojk_menu_item_cache_lookup_preloaded (PojkMenuItemCache *cache,
+                                        const gchar       *uri,
+                                        const gchar       *desktop_id)
+{
+  PojkMenuItemCacheResult result;
+
+  g_return_val_if_fail (POJK_IS_MENU_ITEM_CACHE (cache), NULL);
+  g_return_val_if_fail (uri != NULL, NULL);
+  g_return_val_if_fail (desktop_id != NULL, NULL);
+
+  return pojk_menu_item_cache_get (cache, uri, desktop_id, FALSE, &result);
+}
+
+
+
+/* Called before a menu load or update looks up items, which stay pinned
+ * until it called _pojk_menu_item_cache_finish_load() */
+void
+_pojk_menu_item_cache_begin_load (PojkMenuItemCache *cache)
+{
+  g_return_if_fail (POJK_IS_MENU_ITEM_CACHE (cache));
+
+  _item_cache_lock (cache);
+  cache->priv->n_loads++;
+  _item_cache_unlock (cache);
+}
+
+
+
+/* Lets the items returned before be evicted again once no other menu
+ * load is running, which allocated the items it needed by then */
+void
+_pojk_menu_item_cache_finish_load (PojkMenuItemCache *cache)
+{
+  g_return_if_fail (POJK_IS_MENU_ITEM_CACHE (cache));
+
+  _item_cache_lock (cache);
+
+  g_assert (cache->priv->n_loads > 0);
+
+  /* Skip 0, which marks entries that were never pinned */
+  if (--cache->priv->n_loads == 0 && ++cache->priv->epoch == 0)
+    cache->priv->epoch = 1;
+
+  _item_cache_unlock (cache);
+}
+
+
+
+/* Maps the item database again if another process replaced it */
+void
+_pojk_menu_item_cache_sync_database (PojkMenuItemCache *cache)
+{
+  PojkMenuItemDatabase *database;
+
+  g_return_if_fail (POJK_IS_MENU_ITEM_CACHE (cache));
+
+  _item_cache_lock (cache);
+
+  database = cache->priv->database;
+  if (database != NULL && !_pojk_menu_item_database_is_current (database))
+    {
+      cache->priv->database =
+        _pojk_menu_item_database_new (_pojk_menu_item_database_get_directory (database));
+      _pojk_menu_item_database_unref (database);
+    }
+
+  _item_cache_unlock (cache);
+}
+
+
+
+/* Stores the cached system items in the item database if lookups found
+ * it to be missing or outdated. Serializing the items reads the fields
+ * they did not load yet, so the database is written by a background
+ * thread. After a failure, the next attempt is delayed */
+void
+_pojk_menu_item_cache_save_database (PojkMenuItemCache *cache)
+{
+  PojkMenuItemCacheEntry *entry;
+  PojkMenuItemCacheSave  *save;
+  PojkMenuItemDatabase   *database;
+  GHashTableIter          iter;
+  GThread                *thread;
+  gpointer                value;
+  GError                 *error = NULL;
+
+  g_return_if_fail (POJK_IS_MENU_ITEM_CACHE (cache));
+
+  _item_cache_lock (cache);
+
+  database = cache->priv->database;
+  if (database == NULL
+      || cache->priv->database_saving
+      || g_get_monotonic_time () < cache->priv->database_retry_time
+      || !_pojk_menu_item_database_is_outdated (database))
+    {
+      _item_cache_unlock (cache);
+      return;
+    }
+
+  save = g_slice_new (PojkMenuItemCacheSave);
+  save->cache = g_object_ref (cache);
+  save->database = _pojk_menu_item_database_ref (database);
+  save->items = g_ptr_array_new_with_free_func (g_object_unref);
+
+  g_hash_table_iter_init (&iter, cache->priv->items);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      entry = value;
+      if (_pojk_menu_item_database_covers (database, entry->uri))
+        g_ptr_array_add (save->items, g_object_ref (entry->item));
+    }
+
+  cache->priv->database_saving = TRUE;
+
+  _item_cache_unlock (cache);
+
+  thread = g_thread_try_new ("pojk-item-database", pojk_menu_item_cache_write_database, save, &error);
+  if (G_LIKELY (thread != NULL))
+    {
+      g_thread_unref (thread);
+    }
+  else
+    {
+      /* Write it on this thread then */
+      g_debug ("Failed to start item database thread: %s", error->message);
+      g_error_free (error);
+
+      pojk_menu_item_cache_write_database (save);
+    }
+}
+
+
+
+static gpointer
+pojk_menu_item_cache_write_database (gpointer data)
+{
+  PojkMenuItemCacheSave *save = data;
+  PojkMenuItemCache     *cache = save->cache;
+  gboolean               success;
+  GError                *error = NULL;
+
+  success = _pojk_menu_item_database_save (save->database, save->items, &error);
+
+  _item_cache_lock (cache);
+
+  cache->priv->database_saving = FALSE;
+
+  if (success)
+    {
+      /* Use the new database from now on, unless it was replaced */
+      if (cache->priv->database == save->database)
+        {
+          cache->priv->database =
+            _pojk_menu_item_database_new (_pojk_menu_item_database_get_directory (save->database));
+          _pojk_menu_item_database_unref (save->database);
+        }
+
+      cache->priv->database_retry_delay = 0;
+    }
+  else
+    {
+      /* Not fatal, the items are simply parsed again. The directory is
+       * most likely not writable, so do not try again on every load */
+      g_debug ("Failed to write item database: %s", error->message);
+      g_error_free (error);
+
+      if (cache->priv->database_retry_delay == 0)
+        cache->priv->database_retry_delay = ITEM_DATABASE_RETRY_DELAY;
+      else
+        cache->priv->database_retry_delay = MIN (cache->priv->database_retry_delay * 2,
+                                                 ITEM_DATABASE_MAX_RETRY_DELAY);
+      cache->priv->database_retry_time = g_get_monotonic_time () + cache->priv->database_retry_delay;
+    }
+
+  _item_cache_unlock (cache);
+
+  _pojk_menu_item_database_unref (save->database);
+  g_ptr_array_unref (save->items);
+  g_object_unref (save->cache);
+  g_slice_free (PojkMenuItemCacheSave, save);
+
+  return NULL;
+}
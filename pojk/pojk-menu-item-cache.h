@@ -34,6 +34,8 @@ typedef struct _PojkMenuItemCachePrivate PojkMenuItemCachePrivate;
 typedef struct _PojkMenuItemCacheClass   PojkMenuItemCacheClass;
 typedef struct _PojkMenuItemCache        PojkMenuItemCache;
 
+typedef struct _PojkMenuItemCacheStats   PojkMenuItemCacheStats;
+
 #define POJK_TYPE_MENU_ITEM_CACHE            (pojk_menu_item_cache_get_type ())
 #define POJK_MENU_ITEM_CACHE(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), POJK_TYPE_MENU_ITEM_CACHE, PojkMenuItemCache))
 #define POJK_MENU_ITEM_CACHE_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), POJK_TYPE_MENU_ITEM_CACHE, PojkMenuItemCacheClass))
@@ -54,6 +56,32 @@ struct _PojkMenuItemCache
   PojkMenuItemCachePrivate *priv;
 };
 
+/**
+ * PojkMenuItemCacheStats:
+ * @n_hits          : number of lookups answered from the cache.
+ * @n_misses        : number of lookups that parsed a desktop file.
+ * @n_evictions     : number of items removed to stay within the budget.
+ * @n_database_hits : number of lookups answered from the item database
+ *                    shared with other processes, which is enabled by
+ *                    setting <envar>POJK_MENU_ITEM_DATABASE</envar> to a
+ *                    directory. Only a database written by root or the
+ *                    current user is used.
+ * @n_items         : number of items in the cache.
+ * @n_bytes         : estimated memory used by the items in the cache.
+ *
+ * Counters of a #PojkMenuItemCache, see pojk_menu_item_cache_get_stats().
+ * The counters are never reset.
+ **/
+struct _PojkMenuItemCacheStats
+{
+  guint64 n_hits;
+  guint64 n_misses;
+  guint64 n_evictions;
+  guint64 n_database_hits;
+  guint   n_items;
+  gsize   n_bytes;
+};
+
 
 
 GType                pojk_menu_item_cache_get_type        (void) G_GNUC_CONST;
@@ -69,6 +97,11 @@ void                 pojk_menu_item_cache_foreach         (PojkMenuItemCache *ca
 void                 pojk_menu_item_cache_invalidate      (PojkMenuItemCache *cache);
 void                 pojk_menu_item_cache_invalidate_file (PojkMenuItemCache *cache,
                                                              GFile               *file);
+void                 pojk_menu_item_cache_set_budget      (PojkMenuItemCache *cache,
+                                                             guint                max_items,
+                                                             gsize                max_bytes);
+void                 pojk_menu_item_cache_get_stats       (PojkMenuItemCache *cache,
+                                                             PojkMenuItemCacheStats *stats);
 
 G_END_DECLS
 
@@ -0,0 +1,725 @@
+/* vi:set et ai sw=2 sts=2 ts=2: */
+/*-
+ * Copyright (c) 2026 The pojk developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include <pojk/pojk-menu-item.h>
+#include <pojk/pojk-menu-item-database.h>
+#include <pojk/pojk-private.h>
+
+
+
+/* The item database holds the parsed items of the desktop files in the
+ * applications directories of the system data dirs. It is mapped
+ * read-only by every process using it, so the pages of the database are
+ * shared through the page cache. Items are only deserialized when they
+ * are looked up, and only if their desktop file still has the device,
+ * inode, size and modification time recorded in the database.
+ *
+ * Desktop files in the user data dir are never stored; they are parsed
+ * privately by every process. A process that finds files which are not
+ * in the database or changed since it was written stores a new database,
+ * which replaces the old file atomically. Other processes notice the new
+ * file with _pojk_menu_item_database_is_current() and map it again.
+ *
+ * Processes only use a database written by root or their own user, so
+ * the processes of one user share a database. A database is only shared
+ * by all users of a host if root keeps it up to date, by loading a menu
+ * with the same data dirs and language. A directory that the other users
+ * cannot write to makes their processes give up writing it for a while,
+ * see _pojk_menu_item_cache_save_database(). */
+
+
+
+/* Bump this whenever the layout below or the item layout changes */
+#define POJK_MENU_ITEM_DATABASE_VERSION 2
+
+/* Layout of the database. The URIs are sorted, the stamps and items are
+ * in the same order as the URIs */
+#define POJK_MENU_ITEM_DATABASE_TYPE \
+  "(usasa(ttxx)a" _POJK_MENU_ITEM_VARIANT_TYPE ")"
+
+enum
+{
+  DATABASE_VERSION,
+  DATABASE_KEY,
+  DATABASE_URIS,
+  DATABASE_STAMPS,
+  DATABASE_ITEMS,
+};
+
+
+
+typedef struct
+{
+  const gchar   *uri;
+  PojkFileStamp  stamp;
+  GVariant      *item;
+} PojkMenuItemDatabaseRecord;
+
+
+
+struct _PojkMenuItemDatabase
+{
+  gint           ref_count;
+
+  /* Directory and file of the database, and the key describing the
+   * environment the items were parsed in */
+  gchar         *directory;
+  gchar         *filename;
+  gchar         *key;
+
+  /* URIs of the system applications directories, with a trailing slash */
+  gchar        **prefixes;
+
+  /* The database file as it was when it was mapped */
+  PojkFileStamp  file_stamp;
+
+  /* Mapped database and its members, %NULL if there is no usable one */
+  GVariant      *data;
+  GVariant      *uris;
+  GVariant      *stamps;
+  GVariant      *items;
+
+  /* Number of lookups of system desktop files which were not found in
+   * the database or changed since it was written */
+  gint           n_stale;
+};
+
+
+
+static gchar *
+pojk_menu_item_database_build_key (void)
+{
+  const gchar * const *dirs;
+  GString             *key;
+
+  /* Everything that changes the parsed (localized) item values has to
+   * be part of the key */
+  key = g_string_new (NULL);
+  g_string_append_printf (key, "%d\n%s\n", G_BYTE_ORDER, g_get_language_names ()[0]);
+
+  for (dirs = g_get_system_data_dirs (); *dirs != NULL; ++dirs)
+    g_string_append_printf (key, ":%s", *dirs);
+
+  return g_string_free (key, FALSE);
+}
+
+
+
+static gchar **
+pojk_menu_item_database_build_prefixes (void)
+{
+  const gchar * const *dirs;
+  GPtrArray           *prefixes;
+  gchar               *path;
+  gchar               *uri;
+
+  prefixes = g_ptr_array_new ();
+
+  for (dirs = g_get_system_data_dirs (); *dirs != NULL; ++dirs)
+    {
+      path = g_build_filename (*dirs, "applications", NULL);
+      uri = g_filename_to_uri (path, NULL, NULL);
+      g_free (path);
+
+      if (G_LIKELY (uri != NULL))
+        {
+          g_ptr_array_add (prefixes, g_strconcat (uri, "/", NULL));
+          g_free (uri);
+        }
+    }
+
+  g_ptr_array_add (prefixes, NULL);
+
+  return (gchar **) g_ptr_array_free (prefixes, FALSE);
+}
+
+
+
+#ifdef G_OS_UNIX
+#ifndef O_NOFOLLOW
+#define O_NOFOLLOW 0
+#endif
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0
+#endif
+
+
+
+static gboolean
+pojk_menu_item_database_is_trusted (gint      fd,
+                                    GStatBuf *statb)
+{
+  if (fstat (fd, statb) != 0)
+    return FALSE;
+
+  return (statb->st_uid == 0 || statb->st_uid == getuid ())
+         && (statb->st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+
+
+/* The stored items carry the commands that are run, so a database in a
+ * shared directory is only used if nobody but root or the current user
+ * could have written it, or replaced it in its directory. The checks are
+ * made on the opened file, which is then mapped, so the file cannot be
+ * swapped in between. Returns the file descriptor of the database if
+ * it is trusted, -1 otherwise */
+static gint
+pojk_menu_item_database_open_trusted (PojkMenuItemDatabase *database)
+{
+  GStatBuf statb;
+  gchar   *basename;
+  gint     dir_fd;
+  gint     fd = -1;
+
+  dir_fd = g_open (database->directory, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC, 0);
+  if (dir_fd < 0)
+    return -1;
+
+  if (pojk_menu_item_database_is_trusted (dir_fd, &statb)
+      && S_ISDIR (statb.st_mode))
+    {
+#ifdef HAVE_OPENAT
+      basename = g_path_get_basename (database->filename);
+      fd = openat (dir_fd, basename, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+      g_free (basename);
+#else
+      fd = g_open (database->filename, O_RDONLY | O_NOFOLLOW | O_CLOEXEC, 0);
+#endif
+
+      if (fd >= 0
+          && (!pojk_menu_item_database_is_trusted (fd, &statb)
+              || !S_ISREG (statb.st_mode)))
+        {
+          close (fd);
+          fd = -1;
+        }
+    }
+
+  close (dir_fd);
+
+  /* Describe the file that is actually mapped, so a file replaced in
+   * the meantime is noticed by _pojk_menu_item_database_is_current() */
+  if (fd >= 0)
+    _pojk_file_stamp_set_stat (&database->file_stamp, &statb);
+
+  return fd;
+}
+#endif
+
+
+
+static void
+pojk_menu_item_database_map (PojkMenuItemDatabase *database)
+{
+  GMappedFile *mapped;
+  const gchar *stored_key;
+  GVariant    *data;
+  gsize        n_items;
+  guint32      version;
+#ifdef G_OS_UNIX
+  gint         fd;
+#endif
+
+  /* Stat before mapping, so a file replaced in between is noticed by
+   * the next _pojk_menu_item_database_is_current() */
+  _pojk_file_stamp_get (&database->file_stamp, database->filename);
+
+#ifdef G_OS_UNIX
+  fd = pojk_menu_item_database_open_trusted (database);
+  if (fd < 0)
+    return;
+
+  mapped = g_mapped_file_new_from_fd (fd, FALSE, NULL);
+  close (fd);
+#else
+  mapped = g_mapped_file_new (database->filename, FALSE, NULL);
+#endif
+  if (mapped == NULL)
+    return;
+
+  if (g_mapped_file_get_length (mapped) == 0)
+    {
+      g_mapped_file_unref (mapped);
+      return;
+    }
+
+  /* The variant keeps the mapping alive until it is released */
+  data = g_variant_new_from_data (G_VARIANT_TYPE (POJK_MENU_ITEM_DATABASE_TYPE),
+                                  g_mapped_file_get_contents (mapped),
+                                  g_mapped_file_get_length (mapped),
+                                  FALSE,
+                                  (GDestroyNotify) g_mapped_file_unref,
+                                  mapped);
+  g_variant_ref_sink (data);
+
+  g_variant_get_child (data, DATABASE_VERSION, "u", &version);
+  g_variant_get_child (data, DATABASE_KEY, "&s", &stored_key);
+
+  if (version == POJK_MENU_ITEM_DATABASE_VERSION
+      && g_strcmp0 (stored_key, database->key) == 0)
+    {
+      database->uris = g_variant_get_child_value (data, DATABASE_URIS);
+      database->stamps = g_variant_get_child_value (data, DATABASE_STAMPS);
+      database->items = g_variant_get_child_value (data, DATABASE_ITEMS);
+
+      n_items = g_variant_n_children (database->uris);
+
+      /* Give up on truncated or corrupted data */
+      if (G_LIKELY (g_variant_n_children (database->stamps) == n_items
+                    && g_variant_n_children (database->items) == n_items))
+        {
+          database->data = data;
+          return;
+        }
+
+      g_variant_unref (database->uris);
+      g_variant_unref (database->stamps);
+      g_variant_unref (database->items);
+      database->uris = NULL;
+      database->stamps = NULL;
+      database->items = NULL;
+    }
+
+  g_variant_unref (data);
+}
+
+
+
+/* Opens the item database in @directory. The result is usable even if
+ * there is no database yet, it just finds no items then */
+PojkMenuItemDatabase *
+_pojk_menu_item_database_new (const gchar *directory)
+{
+  PojkMenuItemDatabase *database;
+  gchar                *checksum;
+  gchar                *basename;
+
+  g_return_val_if_fail (directory != NULL, NULL);
+
+  database = g_slice_new0 (PojkMenuItemDatabase);
+  database->ref_count = 1;
+  database->directory = g_strdup (directory);
+  database->key = pojk_menu_item_database_build_key ();
+  database->prefixes = pojk_menu_item_database_build_prefixes ();
+
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, database->key, -1);
+  basename = g_strconcat ("items-", checksum, ".db", NULL);
+  database->filename = g_build_filename (directory, basename, NULL);
+  g_free (basename);
+  g_free (checksum);
+
+  pojk_menu_item_database_map (database);
+
+  return database;
+}
+
+
+
+PojkMenuItemDatabase *
+_pojk_menu_item_database_ref (PojkMenuItemDatabase *database)
+{
+  g_return_val_if_fail (database != NULL, NULL);
+
+  g_atomic_int_inc (&database->ref_count);
+
+  return database;
+}
+
+
+
+void
+_pojk_menu_item_database_unref (PojkMenuItemDatabase *database)
+{
+  g_return_if_fail (database != NULL);
+
+  if (!g_atomic_int_dec_and_test (&database->ref_count))
+    return;
+
+  if (database->data != NULL)
+    {
+      g_variant_unref (database->uris);
+      g_variant_unref (database->stamps);
+      g_variant_unref (database->items);
+      g_variant_unref (database->data);
+    }
+
+  g_strfreev (database->prefixes);
+  g_free (database->key);
+  g_free (database->filename);
+  g_free (database->directory);
+
+  g_slice_free (PojkMenuItemDatabase, database);
+}
+
+
+
+const gchar *
+_pojk_menu_item_database_get_directory (PojkMenuItemDatabase *database)
+{
+  g_return_val_if_fail (database != NULL, NULL);
+
+  return database->directory;
+}
+
+
+
+/* Whether the database file is still the one that was mapped, or is
+ * still missing. Otherwise another process replaced it */
+gboolean
+_pojk_menu_item_database_is_current (PojkMenuItemDatabase *database)
+{
+  PojkFileStamp stamp;
+
+  g_return_val_if_fail (database != NULL, FALSE);
+
+  _pojk_file_stamp_get (&stamp, database->filename);
+
+  if (stamp.inode == 0 && database->file_stamp.inode == 0)
+    return TRUE;
+
+  return _pojk_file_stamp_equal (&database->file_stamp, &stamp);
+}
+
+
+
+/* Whether a new database should be written, because there is none or
+ * lookups found desktop files that are missing in it or changed */
+gboolean
+_pojk_menu_item_database_is_outdated (PojkMenuItemDatabase *database)
+{
+  g_return_val_if_fail (database != NULL, FALSE);
+
+  return database->data == NULL || g_atomic_int_get (&database->n_stale) > 0;
+}
+
+
+
+/* Whether @uri is in one of the system applications directories */
+gboolean
+_pojk_menu_item_database_covers (PojkMenuItemDatabase *database,
+                                 const gchar          *uri)
+{
+  guint n;
+
+  g_return_val_if_fail (database != NULL, FALSE);
+  g_return_val_if_fail (uri != NULL, FALSE);
+
+  for (n = 0; database->prefixes[n] != NULL; n++)
+    if (g_str_has_prefix (uri, database->prefixes[n]))
+      return TRUE;
+
+  return FALSE;
+}
+
+
+
+static gboolean
+pojk_menu_item_database_find (PojkMenuItemDatabase *database,
+                              const gchar          *uri,
+                              gsize                *index)
+{
+  const gchar *stored;
+  gsize        lower = 0;
+  gsize        upper;
+  gsize        middle;
+  gint         result;
+
+  upper = g_variant_n_children (database->uris);
+
+  while (lower < upper)
+    {
+      middle = lower + (upper - lower) / 2;
+      g_variant_get_child (database->uris, middle, "&s", &stored);
+
+      result = strcmp (uri, stored);
+      if (result == 0)
+        {
+          *index = middle;
+          return TRUE;
+        }
+
+      if (result < 0)
+        upper = middle;
+      else
+        lower = middle + 1;
+    }
+
+  return FALSE;
+}
+
+
+
+static void
+pojk_menu_item_database_get_stamp (PojkMenuItemDatabase *database,
+                                   gsize                 index,
+                                   PojkFileStamp        *stamp)
+{
+  guint64 device;
+  guint64 inode;
+  gint64  size;
+  gint64  mtime;
+
+  g_variant_get_child (database->stamps, index, "(ttxx)", &device, &inode, &size, &mtime);
+
+  stamp->device = device;
+  stamp->inode = inode;
+  stamp->size = size;
+  stamp->mtime = mtime;
+}
+
+
+
+static void
+pojk_menu_item_database_get_file_stamp (const gchar   *uri,
+                                        PojkFileStamp *stamp)
+{
+  gchar *filename;
+
+  filename = g_filename_from_uri (uri, NULL, NULL);
+  _pojk_file_stamp_get (stamp, filename);
+  g_free (filename);
+}
+
+
+
+/* Returns a new item for the desktop file @uri if it is stored in the
+ * database and did not change since, %NULL otherwise */
+PojkMenuItem *
+_pojk_menu_item_database_lookup (PojkMenuItemDatabase *database,
+                                 const gchar          *uri)
+{
+  PojkMenuItem  *item;
+  PojkFileStamp  stored;
+  PojkFileStamp  stamp;
+  GVariant      *variant;
+  gsize          index;
+
+  g_return_val_if_fail (database != NULL, NULL);
+  g_return_val_if_fail (uri != NULL, NULL);
+
+  if (!_pojk_menu_item_database_covers (database, uri))
+    return NULL;
+
+  if (database->data == NULL
+      || !pojk_menu_item_database_find (database, uri, &index))
+    {
+      g_atomic_int_inc (&database->n_stale);
+      return NULL;
+    }
+
+  pojk_menu_item_database_get_stamp (database, index, &stored);
+  pojk_menu_item_database_get_file_stamp (uri, &stamp);
+
+  if (!_pojk_file_stamp_equal (&stored, &stamp))
+    {
+      g_atomic_int_inc (&database->n_stale);
+      return NULL;
+    }
+
+  variant = g_variant_get_child_value (database->items, index);
+  item = _pojk_menu_item_deserialize (variant);
+  g_variant_unref (variant);
+
+  if (G_LIKELY (item != NULL))
+    _pojk_menu_item_set_stamp (item, &stamp);
+
+  return item;
+}
+
+
+
+static gint
+pojk_menu_item_database_compare_records (gconstpointer a,
+                                         gconstpointer b)
+{
+  const PojkMenuItemDatabaseRecord *record_a = *(PojkMenuItemDatabaseRecord * const *) a;
+  const PojkMenuItemDatabaseRecord *record_b = *(PojkMenuItemDatabaseRecord * const *) b;
+
+  return strcmp (record_a->uri, record_b->uri);
+}
+
+
+
+static void
+pojk_menu_item_database_record_free (PojkMenuItemDatabaseRecord *record)
+{
+  g_variant_unref (record->item);
+  g_slice_free (PojkMenuItemDatabaseRecord, record);
+}
+
+
+
+/* Writes a new database with the system items of @items, which are
+ * parsed from their desktop files, and the entries of the current
+ * database whose desktop files did not change since. Processes with
+ * different menus thereby add up their items instead of replacing each
+ * other's */
+gboolean
+_pojk_menu_item_database_save (PojkMenuItemDatabase *database,
+                               GPtrArray            *items,
+                               GError              **error)
+{
+  PojkMenuItemDatabaseRecord *record;
+  GVariantBuilder             uris;
+  GVariantBuilder             stamps;
+  GVariantBuilder             variants;
+  PojkFileStamp               stored;
+  PojkFileStamp               stamp;
+  GHashTable                 *uri_table;
+  GPtrArray                  *records;
+  const gchar                *uri;
+  GVariant                   *data;
+  gboolean                    success;
+  gchar                      *item_uri;
+  gsize                       n_items;
+  guint                       n;
+
+  g_return_val_if_fail (database != NULL, FALSE);
+  g_return_val_if_fail (items != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  /* The records point to the URIs owned by this table */
+  uri_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  records = g_ptr_array_new_with_free_func ((GDestroyNotify) pojk_menu_item_database_record_free);
+
+  for (n = 0; n < items->len; n++)
+    {
+      item_uri = pojk_menu_item_get_uri (g_ptr_array_index (items, n));
+      _pojk_menu_item_get_stamp (g_ptr_array_index (items, n), &stamp);
+
+      /* Only items read from a desktop file can be checked later */
+      if (stamp.inode == 0
+          || !_pojk_menu_item_database_covers (database, item_uri)
+          || g_hash_table_lookup (uri_table, item_uri) != NULL)
+        {
+          g_free (item_uri);
+          continue;
+        }
+
+      record = g_slice_new (PojkMenuItemDatabaseRecord);
+      record->uri = item_uri;
+      record->stamp = stamp;
+      record->item = g_variant_ref_sink (_pojk_menu_item_serialize (g_ptr_array_index (items, n)));
+
+      g_hash_table_insert (uri_table, item_uri, record);
+      g_ptr_array_add (records, record);
+    }
+
+  /* Keep the stored entries whose desktop files did not change */
+  n_items = database->data != NULL ? g_variant_n_children (database->uris) : 0;
+  for (n = 0; n < n_items; n++)
+    {
+      g_variant_get_child (database->uris, n, "&s", &uri);
+      if (g_hash_table_lookup (uri_table, uri) != NULL)
+        continue;
+
+      pojk_menu_item_database_get_stamp (database, n, &stored);
+      pojk_menu_item_database_get_file_stamp (uri, &stamp);
+      if (!_pojk_file_stamp_equal (&stored, &stamp))
+        continue;
+
+      record = g_slice_new (PojkMenuItemDatabaseRecord);
+      record->uri = g_strdup (uri);
+      record->stamp = stamp;
+      record->item = g_variant_get_child_value (database->items, n);
+
+      g_hash_table_insert (uri_table, (gchar *) record->uri, record);
+      g_ptr_array_add (records, record);
+    }
+
+  g_ptr_array_sort (records, pojk_menu_item_database_compare_records);
+
+  g_variant_builder_init (&uris, G_VARIANT_TYPE_STRING_ARRAY);
+  g_variant_builder_init (&stamps, G_VARIANT_TYPE ("a(ttxx)"));
+  g_variant_builder_init (&variants, G_VARIANT_TYPE ("a" _POJK_MENU_ITEM_VARIANT_TYPE));
+
+  for (n = 0; n < records->len; n++)
+    {
+      record = g_ptr_array_index (records, n);
+
+      g_variant_builder_add (&uris, "s", record->uri);
+      g_variant_builder_add (&stamps, "(ttxx)",
+                             record->stamp.device, record->stamp.inode,
+                             record->stamp.size, record->stamp.mtime);
+      g_variant_builder_add_value (&variants, record->item);
+    }
+
+  data = g_variant_new ("(us@as@a(ttxx)@a" _POJK_MENU_ITEM_VARIANT_TYPE ")",
+                        POJK_MENU_ITEM_DATABASE_VERSION,
+                        database->key,
+                        g_variant_builder_end (&uris),
+                        g_variant_builder_end (&stamps),
+                        g_variant_builder_end (&variants));
+  g_variant_ref_sink (data);
+
+  g_ptr_array_unref (records);
+  g_hash_table_unref (uri_table);
+
+  /* Write the database, replacing the old one atomically */
+  if (g_mkdir_with_parents (database->directory, 0755) == 0)
+    {
+      success = g_file_set_contents (database->filename, g_variant_get_data (data),
+                                     g_variant_get_size (data), error);
+
+      /* Other users only trust files nobody else can write */
+      if (success)
+        g_chmod (database->filename, 0644);
+    }
+  else
+    {
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                   "Failed to create directory \"%s\"", database->directory);
+      success = FALSE;
+    }
+
+  g_variant_unref (data);
+
+  return success;
+}
@@ -0,0 +1,51 @@
+/* vi:set et ai sw=2 sts=2 ts=2: */
+/*-
+ * Copyright (c) 2026 The pojk developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#if !defined(POJK_INSIDE_POJK_H) && !defined(POJK_COMPILATION)
+#error "Only <pojk/pojk.h> can be included directly. This file may disappear or change contents."
+#endif
+
+#ifndef __POJK_MENU_ITEM_DATABASE_H__
+#define __POJK_MENU_ITEM_DATABASE_H__
+
+#include <gio/gio.h>
+#include <pojk/pojk-menu-item.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PojkMenuItemDatabase PojkMenuItemDatabase;
+
+PojkMenuItemDatabase *_pojk_menu_item_database_new          (const gchar           *directory) G_GNUC_MALLOC;
+PojkMenuItemDatabase *_pojk_menu_item_database_ref          (PojkMenuItemDatabase  *database);
+void                  _pojk_menu_item_database_unref        (PojkMenuItemDatabase  *database);
+const gchar          *_pojk_menu_item_database_get_directory (PojkMenuItemDatabase *database);
+gboolean              _pojk_menu_item_database_is_current   (PojkMenuItemDatabase  *database);
+gboolean              _pojk_menu_item_database_is_outdated  (PojkMenuItemDatabase  *database);
+gboolean              _pojk_menu_item_database_covers       (PojkMenuItemDatabase  *database,
+                                                             const gchar           *uri);
+PojkMenuItem         *_pojk_menu_item_database_lookup       (PojkMenuItemDatabase  *database,
+                                                             const gchar           *uri) G_GNUC_MALLOC;
+gboolean              _pojk_menu_item_database_save         (PojkMenuItemDatabase  *database,
+                                                             GPtrArray             *items,
+                                                             GError               **error);
+
+G_END_DECLS
+
+#endif /* !__POJK_MENU_ITEM_DATABASE_H__ */
@@ -0,0 +1,348 @@
+/* vi:set et ai sw=2 sts=2 ts=2: */
+/*-
+ * Copyright (c) 2026 The pojk developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include <pojk/pojk-menu-item.h>
+#include <pojk/pojk-menu-item-index.h>
+#include <pojk/pojk-private.h>
+
+
+
+/* Inverted index from categories and desktop ids to items, built once per
+ * menu load so rules can be resolved with set operations instead of being
+ * tested against every item. Ids are handed out in ascending order, so
+ * appending an item to the posting lists of its categories keeps them
+ * sorted */
+
+struct _PojkMenuItemIndex
+{
+  /* Item id => item */
+  GPtrArray  *items;
+
+  /* Item id => desktop id the item was added for. An item can be found
+   * under several desktop ids, so its own desktop id is not used */
+  GPtrArray  *item_desktop_ids;
+
+  /* Category id => GArray of item ids, NULL for unused categories */
+  GPtrArray  *categories;
+
+  /* Desktop id => item id + 1, the keys belong to item_desktop_ids */
+  GHashTable *desktop_ids;
+};
+
+
+
+PojkMenuItemIndex *
+_pojk_menu_item_index_new (void)
+{
+  PojkMenuItemIndex *index;
+
+  index = g_slice_new (PojkMenuItemIndex);
+  index->items = g_ptr_array_new_with_free_func (g_object_unref);
+  index->item_desktop_ids = g_ptr_array_new_with_free_func (g_free);
+  index->categories = g_ptr_array_new ();
+  index->desktop_ids = g_hash_table_new (g_str_hash, g_str_equal);
+
+  return index;
+}
+
+
+
+void
+_pojk_menu_item_index_free (PojkMenuItemIndex *index)
+{
+  guint n;
+
+  if (index == NULL)
+    return;
+
+  for (n = 0; n < index->categories->len; n++)
+    if (g_ptr_array_index (index->categories, n) != NULL)
+      g_array_free (g_ptr_array_index (index->categories, n), TRUE);
+
+  g_hash_table_destroy (index->desktop_ids);
+  g_ptr_array_free (index->categories, TRUE);
+  g_ptr_array_free (index->item_desktop_ids, TRUE);
+  g_ptr_array_free (index->items, TRUE);
+  g_slice_free (PojkMenuItemIndex, index);
+}
+
+
+
+void
+_pojk_menu_item_index_add (PojkMenuItemIndex *index,
+                           const gchar       *desktop_id,
+                           PojkMenuItem      *item)
+{
+  const PojkCategorySet *categories;
+  GArray                *posting;
+  gchar                 *key;
+  gulong                 word;
+  guint                  id;
+  guint                  category_id;
+  guint                  n;
+  guint                  bit;
+
+  g_return_if_fail (index != NULL);
+  g_return_if_fail (desktop_id != NULL);
+  g_return_if_fail (POJK_IS_MENU_ITEM (item));
+
+  id = index->items->len;
+  g_ptr_array_add (index->items, g_object_ref (item));
+
+  key = g_strdup (desktop_id);
+  g_ptr_array_add (index->item_desktop_ids, key);
+  g_hash_table_replace (index->desktop_ids, key, GUINT_TO_POINTER (id + 1));
+
+  categories = _pojk_menu_item_get_category_set (item);
+  if (categories == NULL)
+    return;
+
+  for (n = 0; n < categories->n_words; n++)
+    {
+      word = categories->words[n];
+      for (bit = 0; word != 0; bit++, word >>= 1)
+        {
+          if ((word & 1) == 0)
+            continue;
+
+          category_id = n * POJK_CATEGORY_SET_WORD_BITS + bit;
+          if (category_id >= index->categories->len)
+            g_ptr_array_set_size (index->categories, category_id + 1);
+
+          posting = g_ptr_array_index (index->categories, category_id);
+          if (posting == NULL)
+            {
+              posting = g_array_new (FALSE, FALSE, sizeof (guint));
+              g_ptr_array_index (index->categories, category_id) = posting;
+            }
+
+          g_array_append_val (posting, id);
+        }
+    }
+}
+
+
+
+PojkMenuItem *
+_pojk_menu_item_index_get_item (PojkMenuItemIndex *index,
+                                guint              id)
+{
+  g_return_val_if_fail (index != NULL, NULL);
+  g_return_val_if_fail (id < index->items->len, NULL);
+
+  return g_ptr_array_index (index->items, id);
+}
+
+
+
+const gchar *
+_pojk_menu_item_index_get_item_desktop_id (PojkMenuItemIndex *index,
+                                           guint              id)
+{
+  g_return_val_if_fail (index != NULL, NULL);
+  g_return_val_if_fail (id < index->item_desktop_ids->len, NULL);
+
+  return g_ptr_array_index (index->item_desktop_ids, id);
+}
+
+
+
+guint
+_pojk_menu_item_index_get_n_items (PojkMenuItemIndex *index)
+{
+  g_return_val_if_fail (index != NULL, 0);
+
+  return index->items->len;
+}
+
+
+
+GArray *
+_pojk_menu_item_index_get_all (PojkMenuItemIndex *index)
+{
+  GArray *set;
+  guint   id;
+
+  g_return_val_if_fail (index != NULL, NULL);
+
+  set = g_array_sized_new (FALSE, FALSE, sizeof (guint), index->items->len);
+  for (id = 0; id < index->items->len; id++)
+    g_array_append_val (set, id);
+
+  return set;
+}
+
+
+
+GArray *
+_pojk_menu_item_index_get_category (PojkMenuItemIndex *index,
+                                    guint              category_id)
+{
+  GArray *posting = NULL;
+  GArray *set;
+
+  g_return_val_if_fail (index != NULL, NULL);
+
+  if (category_id < index->categories->len)
+    posting = g_ptr_array_index (index->categories, category_id);
+
+  if (posting == NULL)
+    return g_array_new (FALSE, FALSE, sizeof (guint));
+
+  set = g_array_sized_new (FALSE, FALSE, sizeof (guint), posting->len);
+  g_array_append_vals (set, posting->data, posting->len);
+
+  return set;
+}
+
+
+
+GArray *
+_pojk_menu_item_index_get_desktop_id (PojkMenuItemIndex *index,
+                                      const gchar       *desktop_id)
+{
+  GArray *set;
+  guint   id;
+
+  g_return_val_if_fail (index != NULL, NULL);
+  g_return_val_if_fail (desktop_id != NULL, NULL);
+
+  set = g_array_sized_new (FALSE, FALSE, sizeof (guint), 1);
+
+  id = GPOINTER_TO_UINT (g_hash_table_lookup (index->desktop_ids, desktop_id));
+  if (id != 0)
+    {
+      id--;
+      g_array_append_val (set, id);
+    }
+
+  return set;
+}
+
+
+
+GArray *
+_pojk_menu_item_set_union (GArray *a,
+                           GArray *b)
+{
+  GArray *set;
+  guint   i = 0;
+  guint   j = 0;
+  guint   id;
+
+  /* Nothing to merge */
+  if (b->len == 0)
+    {
+      g_array_free (b, TRUE);
+      return a;
+    }
+  if (a->len == 0)
+    {
+      g_array_free (a, TRUE);
+      return b;
+    }
+
+  set = g_array_sized_new (FALSE, FALSE, sizeof (guint), a->len + b->len);
+
+  while (i < a->len || j < b->len)
+    {
+      if (j == b->len
+          || (i < a->len && g_array_index (a, guint, i) < g_array_index (b, guint, j)))
+        {
+          id = g_array_index (a, guint, i++);
+        }
+      else
+        {
+          id = g_array_index (b, guint, j++);
+          if (i < a->len && g_array_index (a, guint, i) == id)
+            i++;
+        }
+
+      g_array_append_val (set, id);
+    }
+
+  g_array_free (a, TRUE);
+  g_array_free (b, TRUE);
+
+  return set;
+}
+
+
+
+GArray *
+_pojk_menu_item_set_intersect (GArray *a,
+                               GArray *b)
+{
+  guint i = 0;
+  guint j = 0;
+  guint n = 0;
+
+  /* Keep the matching ids in the first set */
+  while (i < a->len && j < b->len)
+    {
+      if (g_array_index (a, guint, i) < g_array_index (b, guint, j))
+        i++;
+      else if (g_array_index (a, guint, i) > g_array_index (b, guint, j))
+        j++;
+      else
+        {
+          g_array_index (a, guint, n++) = g_array_index (a, guint, i);
+          i++;
+          j++;
+        }
+    }
+
+  g_array_set_size (a, n);
+  g_array_free (b, TRUE);
+
+  return a;
+}
+
+
+
+GArray *
+_pojk_menu_item_set_subtract (GArray *a,
+                              GArray *b)
+{
+  guint i;
+  guint j = 0;
+  guint n = 0;
+
+  /* Keep the ids of the first set that are not in the second */
+  for (i = 0; i < a->len; i++)
+    {
+      while (j < b->len && g_array_index (b, guint, j) < g_array_index (a, guint, i))
+        j++;
+
+      if (j == b->len || g_array_index (b, guint, j) != g_array_index (a, guint, i))
+        g_array_index (a, guint, n++) = g_array_index (a, guint, i);
+    }
+
+  g_array_set_size (a, n);
+  g_array_free (b, TRUE);
+
+  return a;
+}
@@ -0,0 +1,63 @@
+/* vi:set et ai sw=2 sts=2 ts=2: */
+/*-
+ * Copyright (c) 2026 The pojk developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#if !defined(POJK_INSIDE_POJK_H) && !defined(POJK_COMPILATION)
+#error "Only <pojk/pojk.h> can be included directly. This file may disappear or change contents."
+#endif
+
+#ifndef __POJK_MENU_ITEM_INDEX_H__
+#define __POJK_MENU_ITEM_INDEX_H__
+
+#include <pojk/pojk-menu-item.h>
+
+G_BEGIN_DECLS
+
+/* Items of a menu load, numbered in the order they were added. Item sets
+ * are GArrays of item ids in ascending order */
+typedef struct _PojkMenuItemIndex PojkMenuItemIndex;
+
+PojkMenuItemIndex *_pojk_menu_item_index_new            (void) G_GNUC_MALLOC;
+void               _pojk_menu_item_index_free           (PojkMenuItemIndex *index);
+void               _pojk_menu_item_index_add            (PojkMenuItemIndex *index,
+                                                         const gchar       *desktop_id,
+                                                         PojkMenuItem      *item);
+PojkMenuItem      *_pojk_menu_item_index_get_item       (PojkMenuItemIndex *index,
+                                                         guint              id);
+const gchar       *_pojk_menu_item_index_get_item_desktop_id (PojkMenuItemIndex *index,
+                                                              guint              id);
+guint              _pojk_menu_item_index_get_n_items    (PojkMenuItemIndex *index);
+
+GArray            *_pojk_menu_item_index_get_all        (PojkMenuItemIndex *index) G_GNUC_MALLOC;
+GArray            *_pojk_menu_item_index_get_category   (PojkMenuItemIndex *index,
+                                                         guint              category_id) G_GNUC_MALLOC;
+GArray            *_pojk_menu_item_index_get_desktop_id (PojkMenuItemIndex *index,
+                                                         const gchar       *desktop_id) G_GNUC_MALLOC;
+
+/* These free both arguments and return a new set */
+GArray            *_pojk_menu_item_set_union            (GArray            *a,
+                                                         GArray            *b) G_GNUC_MALLOC;
+GArray            *_pojk_menu_item_set_intersect        (GArray            *a,
+                                                         GArray            *b) G_GNUC_MALLOC;
+GArray            *_pojk_menu_item_set_subtract         (GArray            *a,
+                                                         GArray            *b) G_GNUC_MALLOC;
+
+G_END_DECLS
+
+#endif /* !__POJK_MENU_ITEM_INDEX_H__ */
@@ -24,6 +24,7 @@
 
 #include <pojk/pojk-menu-node.h>
 #include <pojk/pojk-menu-item-pool.h>
+#include <pojk/pojk-private.h>
 
 
 
@@ -108,8 +109,25 @@ pojk_menu_item_pool_insert (PojkMenuItemPool *pool,
   g_return_if_fail (POJK_IS_MENU_ITEM_POOL (pool));
   g_return_if_fail (POJK_IS_MENU_ITEM (item));
 
+  _pojk_menu_item_pool_insert (pool, pojk_menu_item_get_desktop_id (item), item);
+}
+
+
+
+/* Same as pojk_menu_item_pool_insert(), but inserts @item under
+ * @desktop_id, which an item found under several desktop ids may not
+ * currently carry */
+void
+_pojk_menu_item_pool_insert (PojkMenuItemPool *pool,
+                             const gchar      *desktop_id,
+                             PojkMenuItem     *item)
+{
+  g_return_if_fail (POJK_IS_MENU_ITEM_POOL (pool));
+  g_return_if_fail (desktop_id != NULL);
+  g_return_if_fail (POJK_IS_MENU_ITEM (item));
+
   /* Insert into the hash table and remove old item (if any) */
-  g_hash_table_replace (pool->priv->items, g_strdup (pojk_menu_item_get_desktop_id (item)), item);
+  g_hash_table_replace (pool->priv->items, g_strdup (desktop_id), item);
 
   /* Grab a reference on the item */
   pojk_menu_item_ref (item);
@@ -182,6 +200,43 @@ pojk_menu_item_pool_apply_exclude_rule (PojkMenuItemPool *pool,
 
 
 
+/* Removes the item with @desktop_id from the pool */
+void
+_pojk_menu_item_pool_remove (PojkMenuItemPool *pool,
+                             const gchar      *desktop_id)
+{
+  g_return_if_fail (POJK_IS_MENU_ITEM_POOL (pool));
+  g_return_if_fail (desktop_id != NULL);
+
+  g_hash_table_remove (pool->priv->items, desktop_id);
+}
+
+
+
+/* Removes @item from the pool if it is in there under @desktop_id and
+ * matches the compiled exclude rule @program, or the rule it is known to
+ * match if @program is %NULL. This is the same as
+ * pojk_menu_item_pool_apply_exclude_rule() limited to a single item */
+void
+_pojk_menu_item_pool_exclude_item (PojkMenuItemPool          *pool,
+                                   const gchar               *desktop_id,
+                                   PojkMenuItem              *item,
+                                   const PojkMenuRuleProgram *program)
+{
+  g_return_if_fail (POJK_IS_MENU_ITEM_POOL (pool));
+  g_return_if_fail (desktop_id != NULL);
+  g_return_if_fail (POJK_IS_MENU_ITEM (item));
+
+  if (g_hash_table_lookup (pool->priv->items, desktop_id) == item
+      && (program == NULL || _pojk_menu_rule_program_matches (program, item)))
+    {
+      pojk_menu_item_increment_allocated (item);
+      g_hash_table_remove (pool->priv->items, desktop_id);
+    }
+}
+
+
+
 static gboolean
 pojk_menu_item_pool_filter_exclude (const gchar    *desktop_id,
                                       PojkMenuItem *item,
@@ -25,9 +25,14 @@
 #include <config.h>
 #endif
 
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
 #include <gio/gio.h>
-#include <libbladeutil/libbladeutil.h>
 
+#include <pojk/pojk-category-set.h>
+#include <pojk/pojk-desktop-entry.h>
 #include <pojk/pojk-environment.h>
 #include <pojk/pojk-menu-element.h>
 #include <pojk/pojk-menu-item.h>
@@ -62,6 +67,19 @@ enum
   LAST_SIGNAL,
 };
 
+/* String fields, see pojk_menu_item_set_strings() */
+typedef enum
+{
+  STRING_NAME,
+  STRING_GENERIC_NAME,
+  STRING_COMMENT,
+  STRING_COMMAND,
+  STRING_TRY_EXEC,
+  STRING_ICON_NAME,
+  STRING_PATH,
+  N_STRINGS,
+} PojkMenuItemString;
+
 
 
 static void         pojk_menu_item_element_init                    (PojkMenuElementIface *iface);
@@ -84,11 +102,39 @@ static gboolean     pojk_menu_item_get_element_equal               (PojkMenuElem
                                                                       PojkMenuElement      *other);
 static gboolean     pojk_menu_item_lists_equal                     (GList                  *list1,
                                                                       GList                  *list2);
+static void         pojk_menu_item_clear_actions                   (PojkMenuItem           *item);
 
 
 
 static guint item_signals[LAST_SIGNAL];
 
+/* Properties of the string fields */
+static const gchar *string_properties[N_STRINGS] =
+{
+  "name", "generic-name", "comment", "command", "try-exec", "icon-name", "path",
+};
+
+/* Desktop file keys of the string fields. Translated values are only
+ * used if they are valid UTF-8 */
+static const struct
+{
+  const gchar *key;
+  gboolean     translated;
+}
+string_keys[N_STRINGS] =
+{
+  { G_KEY_FILE_DESKTOP_KEY_NAME, TRUE },
+  { G_KEY_FILE_DESKTOP_KEY_GENERIC_NAME, TRUE },
+  { G_KEY_FILE_DESKTOP_KEY_COMMENT, TRUE },
+  { G_KEY_FILE_DESKTOP_KEY_EXEC, FALSE },
+  { G_KEY_FILE_DESKTOP_KEY_TRY_EXEC, FALSE },
+  { G_KEY_FILE_DESKTOP_KEY_ICON, FALSE },
+  { G_KEY_FILE_DESKTOP_KEY_PATH, FALSE },
+};
+
+/* Serializes reading the remaining fields of lazily loaded items */
+G_LOCK_DEFINE_STATIC (materialize);
+
 
 
 struct _PojkMenuItemPrivate
@@ -99,10 +145,14 @@ struct _PojkMenuItemPrivate
   /* Desktop file id */
   gchar      *desktop_id;
 
-  /* List of categories */
+  /* List of interned categories */
   GList      *categories;
 
-  /* List of keywords */
+  /* Ids of the categories, for the menu rules */
+  PojkCategorySet *category_set;
+
+  /* List of keywords. Unlike categories, they are not interned, as
+   * their number is not bounded */
   GList      *keywords;
 
   /* Whether this application requires a terminal to be started in */
@@ -114,43 +164,50 @@ struct _PojkMenuItemPrivate
   /* Whether this application supports startup notification */
   guint       supports_startup_notification : 1;
 
-  /* Name to be displayed for the menu item */
-  gchar      *name;
-
-  /* Generic name of the menu item */
-  gchar      *generic_name;
-
-  /* Comment/description of the item */
-  gchar      *comment;
-
-  /* Command to be executed when the menu item is clicked */
-  gchar      *command;
+  /* Name to be displayed, generic name, comment, command to be executed
+   * when the menu item is clicked, TryExec value, icon name and working
+   * directory, one after the other in a single block. The offsets are
+   * counted from 1, 0 stands for %NULL */
+  gchar      *strings;
+  guint32     string_offsets[N_STRINGS];
 
-  /* TryExec value */
-  gchar      *try_exec;
+  /* The block replaced by the current one, which is kept for one more
+   * change so that strings returned just before a change stay valid */
+  gchar      *old_strings;
 
-  /* Menu item icon name */
-  gchar      *icon_name;
+  /* Interned environments in which the menu item should be displayed only */
+  const gchar **only_show_in;
 
-  /* Environments in which the menu item should be displayed only */
-  gchar     **only_show_in;
+  /* Interned environments in which the menu item should be hidden */
+  const gchar **not_show_in;
 
-  /* Environments in which the menu item should be hidden */
-  gchar     **not_show_in;
-
-  /* Working directory */
-  gchar      *path;
-
-  /* List of application actions of type PojkMenuItemAction */
-  GList      *actions;
+  /* Application actions of type PojkMenuItemAction in the order of the
+   * desktop file, and the first action of every name. Only read from the
+   * desktop file once they are asked for */
+  GPtrArray  *actions;
+  GHashTable *action_names;
+  gint        actions_loaded;
 
   /* Hidden value */
   guint       hidden : 1;
 
+  /* The desktop file as it was when the item was read from it */
+  PojkFileStamp stamp;
+
+  /* Whether the fields that are only needed for displaying and launching
+   * the item have been read. Items loaded by the item cache only read the
+   * fields needed by the menu rules at first */
+  gint        materialized;
+
   /* Counter keeping the number of menus which use this item. This works
    * like a reference counter and should be increased / decreased by PojkMenu
-   * items whenever the item is added to or removed from the menu. */
-  guint       num_allocated;
+   * items whenever the item is added to or removed from the menu. Menus
+   * may be resolved on several threads, so it is only accessed atomically */
+  gint        num_allocated;
+
+  /* Incremented whenever the memory used by the item changed, so the
+   * item cache knows when to measure it again */
+  gint        size_serial;
 };
 
 
@@ -398,6 +455,8 @@ static void
 pojk_menu_item_init (PojkMenuItem *item)
 {
   item->priv = pojk_menu_item_get_instance_private (item);
+  item->priv->materialized = TRUE;
+  item->priv->actions_loaded = TRUE;
 }
 
 
@@ -408,20 +467,16 @@ pojk_menu_item_finalize (GObject *object)
   PojkMenuItem *item = POJK_MENU_ITEM (object);
 
   g_free (item->priv->desktop_id);
-  g_free (item->priv->name);
-  g_free (item->priv->generic_name);
-  g_free (item->priv->comment);
-  g_free (item->priv->command);
-  g_free (item->priv->try_exec);
-  g_free (item->priv->icon_name);
-  g_free (item->priv->path);
-
-  g_strfreev (item->priv->only_show_in);
-  g_strfreev (item->priv->not_show_in);
-
-  _pojk_g_list_free_full (item->priv->categories, g_free);
+  g_free (item->priv->strings);
+  g_free (item->priv->old_strings);
+
+  g_free (item->priv->only_show_in);
+  g_free (item->priv->not_show_in);
+
+  g_list_free (item->priv->categories);
   _pojk_g_list_free_full (item->priv->keywords, g_free);
-  _pojk_g_list_free_full (item->priv->actions, pojk_menu_item_action_unref);
+  _pojk_category_set_free (item->priv->category_set);
+  pojk_menu_item_clear_actions (item);
 
   if (item->priv->file != NULL)
     g_object_unref (G_OBJECT (item->priv->file));
@@ -648,7 +703,7 @@ static const gchar*
 pojk_menu_item_get_element_name (PojkMenuElement *element)
 {
   g_return_val_if_fail (POJK_IS_MENU_ITEM (element), NULL);
-  return POJK_MENU_ITEM (element)->priv->name;
+  return pojk_menu_item_get_name (POJK_MENU_ITEM (element));
 }
 
 
@@ -657,7 +712,7 @@ static const gchar*
 pojk_menu_item_get_element_comment (PojkMenuElement *element)
 {
   g_return_val_if_fail (POJK_IS_MENU_ITEM (element), NULL);
-  return POJK_MENU_ITEM (element)->priv->comment;
+  return pojk_menu_item_get_comment (POJK_MENU_ITEM (element));
 }
 
 
@@ -666,7 +721,7 @@ static const gchar*
 pojk_menu_item_get_element_icon_name (PojkMenuElement *element)
 {
   g_return_val_if_fail (POJK_IS_MENU_ITEM (element), NULL);
-  return POJK_MENU_ITEM (element)->priv->icon_name;
+  return pojk_menu_item_get_icon_name (POJK_MENU_ITEM (element));
 }
 
 
@@ -692,554 +747,830 @@ pojk_menu_item_lists_equal (GList *list1,
 
 
 
-static gchar *
-pojk_menu_item_url_exec (XfceRc *rc)
+static inline const gchar *
+pojk_menu_item_get_string (PojkMenuItem       *item,
+                           PojkMenuItemString  field)
 {
-  const gchar *url;
-  gchar       *url_exec = NULL;
-
-  /* Support Type=Link items */
-  url = xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_URL, NULL);
-  if (url != NULL)
-    url_exec = g_strdup_printf ("blxo-open '%s'", url);
+  guint32 offset = item->priv->string_offsets[field];
 
-  return url_exec;
+  return offset != 0 ? item->priv->strings + offset - 1 : NULL;
 }
 
 
 
-PojkMenuItem *
-pojk_menu_item_new (GFile *file)
+/* Keeps the string block of @item until the next change, before a new
+ * block replaces it. The block kept before is freed */
+static void
+pojk_menu_item_retire_strings (PojkMenuItem *item)
 {
-  PojkMenuItem       *item = NULL;
-  PojkMenuItemAction *action = NULL;
-  XfceRc               *rc;
-  GList                *categories = NULL;
-  GList                *keywords = NULL;
-  gchar                *filename;
-  gboolean              terminal;
-  gboolean              no_display;
-  gboolean              startup_notify;
-  gboolean              hidden;
-  const gchar          *path;
-  const gchar          *name;
-  const gchar          *generic_name;
-  const gchar          *comment;
-  const gchar          *exec;
-  const gchar          *try_exec;
-  const gchar          *icon;
-  gchar                *action_group;
-  gchar               **mt;
-  gchar               **str_list;
-  gchar                *url_exec = NULL;
+  g_free (item->priv->old_strings);
+  item->priv->old_strings = item->priv->strings;
+  item->priv->strings = NULL;
+}
 
-  g_return_val_if_fail (G_IS_FILE (file), NULL);
-  g_return_val_if_fail (g_file_is_native (file), NULL);
 
-  /* Open the rc file */
-  filename = g_file_get_path (file);
-  rc = xfce_rc_simple_open (filename, TRUE);
-  g_free (filename);
-  if (G_UNLIKELY (rc == NULL))
-    return NULL;
 
-  xfce_rc_set_group (rc, G_KEY_FILE_DESKTOP_GROUP);
+/* Replaces all string fields of @item with copies of @values, which are
+ * packed into one allocation. @values may point into the old block */
+static void
+pojk_menu_item_set_strings (PojkMenuItem        *item,
+                            const gchar * const *values)
+{
+  gchar *strings;
+  gsize  lengths[N_STRINGS];
+  gsize  size = 0;
+  gsize  offset = 0;
+  guint  n;
 
-  /* Parse name and exec command */
-  name = xfce_rc_read_entry (rc, G_KEY_FILE_DESKTOP_KEY_NAME, NULL);
-  exec = xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_EXEC, NULL);
+  for (n = 0; n < N_STRINGS; n++)
+    {
+      lengths[n] = values[n] != NULL ? strlen (values[n]) + 1 : 0;
+      size += lengths[n];
+    }
 
-  /* Support Type=Link items */
-  if (G_UNLIKELY (exec == NULL))
-    exec = url_exec = pojk_menu_item_url_exec (rc);
+  strings = size > 0 ? g_malloc (size) : NULL;
 
-  /* Validate Name and Exec fields */
-  if (G_LIKELY (exec != NULL && name != NULL))
+  for (n = 0; n < N_STRINGS; n++)
     {
-      /* Determine other application properties */
-      generic_name = xfce_rc_read_entry (rc, G_KEY_FILE_DESKTOP_KEY_GENERIC_NAME, NULL);
-      comment = xfce_rc_read_entry (rc, G_KEY_FILE_DESKTOP_KEY_COMMENT, NULL);
-      try_exec = xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_TRY_EXEC, NULL);
-      icon = xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_ICON, NULL);
-      path = xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_PATH, NULL);
-      terminal = xfce_rc_read_bool_entry (rc, G_KEY_FILE_DESKTOP_KEY_TERMINAL, FALSE);
-      no_display = xfce_rc_read_bool_entry (rc, G_KEY_FILE_DESKTOP_KEY_NO_DISPLAY, FALSE);
-      startup_notify = xfce_rc_read_bool_entry (rc, G_KEY_FILE_DESKTOP_KEY_STARTUP_NOTIFY, FALSE)
-                       || xfce_rc_read_bool_entry (rc, "X-KDE-StartupNotify", FALSE);
-      hidden = xfce_rc_read_bool_entry (rc, G_KEY_FILE_DESKTOP_KEY_HIDDEN, FALSE);
-
-      /* Allocate a new menu item instance */
-      item = g_object_new (POJK_TYPE_MENU_ITEM,
-                           "file", file,
-                           "command", exec,
-                           "try-exec", try_exec,
-                           "name", name,
-                           "generic-name", generic_name,
-                           "comment", comment,
-                           "icon-name", icon,
-                           "requires-terminal", terminal,
-                           "no-display", no_display,
-                           "supports-startup-notification", startup_notify,
-                           "path", path,
-                           "hidden", hidden,
-                           NULL);
-
-      /* Determine the categories this application should be shown in */
-      str_list = xfce_rc_read_list_entry (rc, G_KEY_FILE_DESKTOP_KEY_CATEGORIES, ";");
-      if (G_LIKELY (str_list != NULL))
+      if (values[n] != NULL)
         {
-          for (mt = str_list; *mt != NULL; ++mt)
-            {
-              /* Try to steal the values */
-              if (**mt != '\0')
-                categories = g_list_prepend (categories, *mt);
-              else
-                g_free (*mt);
-            }
+          memcpy (strings + offset, values[n], lengths[n]);
+          item->priv->string_offsets[n] = offset + 1;
+          offset += lengths[n];
+        }
+      else
+        {
+          item->priv->string_offsets[n] = 0;
+        }
+    }
 
-          /* Cleanup */
-          g_free (str_list);
+  pojk_menu_item_retire_strings (item);
+  item->priv->strings = strings;
+  g_atomic_int_inc (&item->priv->size_serial);
+}
 
-          /* Assign categories list to the menu item */
-          pojk_menu_item_set_categories (item, categories);
-        }
 
-      /* Determine the keywords this application should be shown in */
-      str_list = xfce_rc_read_list_entry (rc, G_KEY_FILE_DESKTOP_KEY_KEYWORDS, ";");
-      if (G_LIKELY (str_list != NULL))
-        {
-          for (mt = str_list; *mt != NULL; ++mt)
-            {
-              /* Try to steal the values */
-              if (**mt != '\0')
-                keywords = g_list_prepend (keywords, *mt);
-              else
-                g_free (*mt);
-            }
 
-          /* Cleanup */
-          g_free (str_list);
+static void
+pojk_menu_item_set_string (PojkMenuItem       *item,
+                           PojkMenuItemString  field,
+                           const gchar        *value)
+{
+  const gchar *values[N_STRINGS];
+  guint        n;
 
-          /* Assign keywords list to the menu item */
-          pojk_menu_item_set_keywords (item, keywords);
-        }
+  for (n = 0; n < N_STRINGS; n++)
+    values[n] = n == field ? value : pojk_menu_item_get_string (item, n);
 
-      /* Set the rest of the private data directly */
-      item->priv->only_show_in = xfce_rc_read_list_entry (rc, G_KEY_FILE_DESKTOP_KEY_ONLY_SHOW_IN, ";");
-      item->priv->not_show_in = xfce_rc_read_list_entry (rc, G_KEY_FILE_DESKTOP_KEY_NOT_SHOW_IN, ";");
+  pojk_menu_item_set_strings (item, values);
+}
 
-      /* Determine this application actions */
-      str_list = xfce_rc_read_list_entry (rc, G_KEY_FILE_DESKTOP_KEY_ACTIONS, ";");
-      if (G_LIKELY (str_list != NULL))
-        {
-          for (mt = str_list; *mt != NULL; ++mt)
-            {
-              if (**mt != '\0')
-                {
-                  /* Set current desktop action group */
-                  action_group = g_strdup_printf ("Desktop Action %s", *mt);
-                  xfce_rc_set_group (rc, action_group);
-
-                  /* Parse name and exec command */
-                  name = xfce_rc_read_entry (rc, G_KEY_FILE_DESKTOP_KEY_NAME, NULL);
-                  exec = xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_EXEC, NULL);
-                  icon = xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_ICON, NULL);
-
-                  /* Validate Name and Exec fields, icon is optional */
-                  if (G_LIKELY (exec != NULL && name != NULL))
-                    {
-                      /* Allocate a new action instance */
-                      action = g_object_new (POJK_TYPE_MENU_ITEM_ACTION,
-                                             "name", name,
-                                             "command", exec,
-                                             "icon-name", icon,
-                                             NULL);
-
-                      pojk_menu_item_set_action (item, *mt, action);
-                    }
-
-                  g_free (action_group);
-                }
-              else
-                g_free (*mt);
-            }
 
-          /* Cleanup */
-          g_free (str_list);
-        }
 
-      else
-        {
-          str_list = xfce_rc_read_list_entry (rc, "X-Ayatana-Desktop-Shortcuts", ";");
-          if (G_LIKELY (str_list != NULL))
-            {
-              for (mt = str_list; *mt != NULL; ++mt)
-                {
-                  if (**mt != '\0')
-                    {
-                      action_group = g_strdup_printf ("%s Shortcut Group", *mt);
-                      xfce_rc_set_group (rc, action_group);
-
-                      name = xfce_rc_read_entry (rc, G_KEY_FILE_DESKTOP_KEY_NAME, NULL);
-                      exec = xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_EXEC, NULL);
-                      icon = xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_ICON, NULL);
-
-                      /* Validate Name and Exec fields, icon is optional */
-                      if (G_LIKELY (exec != NULL && name != NULL))
-                        {
-                          action = g_object_new (POJK_TYPE_MENU_ITEM_ACTION,
-                                                 "name", name,
-                                                 "command", exec,
-                                                 "icon-name", icon,
-                                                 NULL);
-
-                          pojk_menu_item_set_action (item, *mt, action);
-                        }
-
-                      g_free (action_group);
-                    }
-                  else
-                    g_free (*mt);
-                }
-
-              g_free (str_list);
-            }
-        }
+/* Appends the command of a Type=Link item to @block */
+static gboolean
+pojk_menu_item_append_url_exec (PojkDesktopEntry *entry,
+                                GString          *block)
+{
+  gsize start = block->len;
+
+  g_string_append (block, "blxo-open '");
+  if (!_pojk_desktop_entry_append_string (entry, G_KEY_FILE_DESKTOP_KEY_URL, FALSE, block))
+    {
+      g_string_truncate (block, start);
+      return FALSE;
     }
 
-  /* Cleanup */
-  xfce_rc_close (rc);
-  g_free (url_exec);
+  g_string_append_c (block, '\'');
 
-  return item;
+  return TRUE;
 }
 
 
 
-PojkMenuItem *
-pojk_menu_item_new_for_path (const gchar *filename)
+/* Reads the list of strings of @key, which are interned if @intern is
+ * %TRUE and owned by the list otherwise */
+static GList *
+pojk_menu_item_read_list (PojkDesktopEntry *entry,
+                          const gchar      *key,
+                          gboolean          intern)
 {
-  GFile          *file;
-  PojkMenuItem *item;
+  GList  *list = NULL;
+  gchar **str_list;
+  gchar **mt;
 
-  g_return_val_if_fail (filename != NULL, NULL);
+  str_list = _pojk_desktop_entry_get_list (entry, key);
+  if (G_LIKELY (str_list != NULL))
+    {
+      for (mt = str_list; *mt != NULL; ++mt)
+        {
+          if (intern)
+            {
+              list = g_list_prepend (list, (gchar *) g_intern_string (*mt));
+              g_free (*mt);
+            }
+          else
+            {
+              list = g_list_prepend (list, *mt);
+            }
+        }
 
-  file = g_file_new_for_path (filename);
-  item = pojk_menu_item_new (file);
-  g_object_unref (G_OBJECT (file));
+      /* Cleanup */
+      g_free (str_list);
+    }
 
-  return item;
+  return list;
 }
 
 
 
-PojkMenuItem *
-pojk_menu_item_new_for_uri (const gchar *uri)
+/* Replaces the strings in @list, which are freed, by interned ones */
+static GList *
+pojk_menu_item_intern_list (GList *list)
 {
-  GFile          *file;
-  PojkMenuItem *item;
+  GList *lp;
+  gchar *string;
 
-  g_return_val_if_fail (uri != NULL, NULL);
-
-  file = g_file_new_for_uri (uri);
-  item = pojk_menu_item_new (file);
-  g_object_unref (G_OBJECT (file));
+  for (lp = list; lp != NULL; lp = lp->next)
+    {
+      string = lp->data;
+      lp->data = (gchar *) g_intern_string (string);
+      g_free (string);
+    }
 
-  return item;
+  return list;
 }
 
 
 
-gboolean
-pojk_menu_item_reload (PojkMenuItem  *item,
-                         gboolean        *affects_the_outside,
-                         GError         **error)
+static void
+pojk_menu_item_clear_actions (PojkMenuItem *item)
 {
-  g_return_val_if_fail (POJK_IS_MENU_ITEM (item), FALSE);
-  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+  if (item->priv->actions != NULL)
+    {
+      g_ptr_array_unref (item->priv->actions);
+      item->priv->actions = NULL;
+    }
 
-  return pojk_menu_item_reload_from_file (item, item->priv->file, affects_the_outside, error);
+  if (item->priv->action_names != NULL)
+    {
+      g_hash_table_destroy (item->priv->action_names);
+      item->priv->action_names = NULL;
+    }
 }
 
 
 
-gboolean
-pojk_menu_item_reload_from_file (PojkMenuItem  *item,
-                                   GFile           *file,
-                                   gboolean        *affects_the_outside,
-                                   GError         **error)
+/* Maps the names of the actions to the first action with that name. The
+ * names are copied, so renaming an action afterwards is not noticed */
+static void
+pojk_menu_item_index_action (PojkMenuItem       *item,
+                             PojkMenuItemAction *action)
 {
-  XfceRc               *rc;
-  PojkMenuItemAction *action = NULL;
-  gboolean              boolean;
-  GList                *categories = NULL;
-  GList                *old_categories = NULL;
-  GList                *keywords = NULL;
-  GList                *old_keywords = NULL;
-  GList                *lp;
-  gchar               **mt;
-  gchar               **str_list;
-  const gchar          *string;
-  const gchar          *name;
-  const gchar          *exec;
-  const gchar          *icon;
-  gchar                *filename;
-  gchar                *action_group;
-  gchar                *url_exec = NULL;
+  const gchar *name;
 
-  g_return_val_if_fail (POJK_IS_MENU_ITEM (item), FALSE);
-  g_return_val_if_fail (G_IS_FILE (file), FALSE);
-  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
-  g_return_val_if_fail (g_file_is_native (file), FALSE);
+  name = pojk_menu_item_action_get_name (action);
+  if (name != NULL && !g_hash_table_contains (item->priv->action_names, name))
+    g_hash_table_insert (item->priv->action_names, g_strdup (name), action);
+}
 
-  /* Open the rc file */
-  filename = g_file_get_path (file);
-  rc = xfce_rc_simple_open (filename, TRUE);
-  g_free (filename);
-  if (G_UNLIKELY (rc == NULL))
-    return FALSE;
 
-  xfce_rc_set_group (rc, G_KEY_FILE_DESKTOP_GROUP);
 
-  /* Check if there is a name and exec key */
-  name = xfce_rc_read_entry (rc, G_KEY_FILE_DESKTOP_KEY_NAME, NULL);
-  exec = xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_EXEC, NULL);
+static void
+pojk_menu_item_add_action (PojkMenuItem       *item,
+                           const gchar        *action_name,
+                           PojkMenuItemAction *action)
+{
+  PojkMenuItemAction *old_action;
+  guint               n;
+
+  if (item->priv->actions == NULL)
+    {
+      item->priv->actions = g_ptr_array_new_with_free_func ((GDestroyNotify) pojk_menu_item_action_unref);
+      item->priv->action_names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    }
 
-  /* Support Type=Link items */
-  if (G_UNLIKELY (exec == NULL))
-    exec = url_exec = pojk_menu_item_url_exec (rc);
+  /* Grab a reference on the new action */
+  pojk_menu_item_action_ref (action);
 
-  if (G_UNLIKELY (name == NULL || exec == NULL))
+  /* If an action with this name exists, the new action takes its place */
+  old_action = g_hash_table_lookup (item->priv->action_names, action_name);
+  if (old_action != NULL)
     {
-      g_set_error_literal (error, G_KEY_FILE_ERROR,
-                           G_KEY_FILE_ERROR_KEY_NOT_FOUND,
-                           "Either the name or exec key was not defined.");
-      xfce_rc_close (rc);
+      for (n = 0; g_ptr_array_index (item->priv->actions, n) != old_action; n++);
+      g_ptr_array_index (item->priv->actions, n) = action;
 
-      return FALSE;
+      /* Release reference on the replaced action */
+      pojk_menu_item_action_unref (old_action);
+
+      /* The new action may have another name */
+      g_hash_table_remove_all (item->priv->action_names);
+      for (n = 0; n < item->priv->actions->len; n++)
+        pojk_menu_item_index_action (item, g_ptr_array_index (item->priv->actions, n));
+    }
+  else
+    {
+      g_ptr_array_add (item->priv->actions, action);
+      pojk_menu_item_index_action (item, action);
     }
+}
 
-  /* Queue property notifications */
-  g_object_freeze_notify (G_OBJECT (item));
 
-  /* Set the new file if needed */
-  if (!g_file_equal (file, item->priv->file))
+
+static void
+pojk_menu_item_read_action_groups (PojkMenuItem     *item,
+                                   PojkDesktopEntry *entry,
+                                   gchar           **str_list,
+                                   const gchar      *group_format)
+{
+  PojkMenuItemAction *action;
+  gchar                *name;
+  gchar                *exec;
+  gchar                *icon;
+  gchar                *action_group;
+  gchar               **mt;
+
+  for (mt = str_list; *mt != NULL; ++mt)
     {
-      if (G_LIKELY (item->priv->file != NULL))
-        g_object_unref (G_OBJECT (item->priv->file));
-      item->priv->file = G_FILE (g_object_ref (G_OBJECT (file)));
+      /* Set current desktop action group */
+      action_group = g_strdup_printf (group_format, *mt);
+      if (_pojk_desktop_entry_set_group (entry, action_group))
+        {
+          /* Parse name and exec command */
+          name = _pojk_desktop_entry_get_string (entry, G_KEY_FILE_DESKTOP_KEY_NAME, TRUE);
+          exec = _pojk_desktop_entry_get_string (entry, G_KEY_FILE_DESKTOP_KEY_EXEC, FALSE);
+          icon = _pojk_desktop_entry_get_string (entry, G_KEY_FILE_DESKTOP_KEY_ICON, FALSE);
 
-      g_object_notify (G_OBJECT (item), "file");
-    }
+          /* Validate Name and Exec fields, icon is optional */
+          if (G_LIKELY (exec != NULL && name != NULL && g_utf8_validate (name, -1, NULL)))
+            {
+              /* Allocate a new action instance, which owns the strings */
+              action = _pojk_menu_item_action_new_take (name, exec, icon);
+
+              pojk_menu_item_add_action (item, *mt, action);
+              pojk_menu_item_action_unref (action);
+            }
+          else
+            {
+              g_free (name);
+              g_free (exec);
+              g_free (icon);
+            }
+        }
 
-  /* Update properties */
-  pojk_menu_item_set_name (item, name);
+      g_free (action_group);
+    }
 
-  pojk_menu_item_set_command (item, exec);
+  g_strfreev (str_list);
+}
 
-  string = xfce_rc_read_entry (rc, G_KEY_FILE_DESKTOP_KEY_GENERIC_NAME, NULL);
-  pojk_menu_item_set_generic_name (item, string);
 
-  string = xfce_rc_read_entry (rc, G_KEY_FILE_DESKTOP_KEY_COMMENT, NULL);
-  pojk_menu_item_set_comment (item, string);
 
-  string = xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_TRY_EXEC, NULL);
-  pojk_menu_item_set_try_exec (item, string);
+/* Reads what the menu rules and the visibility checks need: the
+ * categories, NoDisplay, Hidden and the environments. The desktop-file id
+ * is set by the caller. @entry has to be in the desktop entry group */
+static void
+pojk_menu_item_read_rule_fields (PojkMenuItem     *item,
+                                 PojkDesktopEntry *entry)
+{
+  item->priv->no_display = _pojk_desktop_entry_get_boolean (entry, G_KEY_FILE_DESKTOP_KEY_NO_DISPLAY, FALSE);
+  item->priv->hidden = _pojk_desktop_entry_get_boolean (entry, G_KEY_FILE_DESKTOP_KEY_HIDDEN, FALSE);
 
-  string = xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_ICON, NULL);
-  pojk_menu_item_set_icon_name (item, string);
+  /* Determine the categories this application should be shown in */
+  item->priv->categories = pojk_menu_item_read_list (entry, G_KEY_FILE_DESKTOP_KEY_CATEGORIES, TRUE);
+  item->priv->category_set = _pojk_category_set_new (item->priv->categories);
 
-  string = xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_PATH, NULL);
-  pojk_menu_item_set_path (item, string);
+  item->priv->only_show_in = _pojk_intern_strv (_pojk_desktop_entry_get_list (entry, G_KEY_FILE_DESKTOP_KEY_ONLY_SHOW_IN));
+  item->priv->not_show_in = _pojk_intern_strv (_pojk_desktop_entry_get_list (entry, G_KEY_FILE_DESKTOP_KEY_NOT_SHOW_IN));
+}
 
-  boolean = xfce_rc_read_bool_entry (rc, G_KEY_FILE_DESKTOP_KEY_TERMINAL, FALSE);
-  pojk_menu_item_set_requires_terminal (item, boolean);
 
-  boolean = xfce_rc_read_bool_entry (rc, G_KEY_FILE_DESKTOP_KEY_NO_DISPLAY, FALSE);
-  pojk_menu_item_set_no_display (item, boolean);
 
-  boolean = xfce_rc_read_bool_entry (rc, G_KEY_FILE_DESKTOP_KEY_STARTUP_NOTIFY, FALSE)
-            || xfce_rc_read_bool_entry (rc, "X-KDE-StartupNotify", FALSE);
-  pojk_menu_item_set_supports_startup_notification (item, boolean);
+/* Reads the string fields from @entry, which has to be in the desktop
+ * entry group, straight into a string block like the one of
+ * pojk_menu_item_set_strings(). The block is freed by the caller */
+static void
+pojk_menu_item_read_strings (PojkDesktopEntry  *entry,
+                             gchar            **strings,
+                             guint32           *offsets)
+{
+  GString *block;
+  gsize    start;
+  gsize    len;
+  gboolean found;
+  guint    n;
 
-  boolean = xfce_rc_read_bool_entry (rc, G_KEY_FILE_DESKTOP_KEY_HIDDEN, FALSE);
-  pojk_menu_item_set_hidden (item, boolean);
+  block = g_string_sized_new (256);
 
-  if (affects_the_outside != NULL)
+  for (n = 0; n < N_STRINGS; n++)
     {
-      /* create a deep copy the old categories list */
-      old_categories = g_list_copy (item->priv->categories);
-      for (lp = old_categories; lp != NULL; lp = lp->next)
-        lp->data = g_strdup (lp->data);
-    }
+      start = block->len;
+      found = _pojk_desktop_entry_append_string (entry, string_keys[n].key,
+                                                 string_keys[n].translated, block);
 
-  /* Determine the categories this application should be shown in */
-  str_list = xfce_rc_read_list_entry (rc, G_KEY_FILE_DESKTOP_KEY_CATEGORIES, ";");
-  if (G_LIKELY (str_list != NULL))
-    {
-      for (mt = str_list; *mt != NULL; ++mt)
+      /* Support Type=Link items */
+      if (G_UNLIKELY (!found && n == STRING_COMMAND))
+        found = pojk_menu_item_append_url_exec (entry, block);
+
+      if (found
+          && string_keys[n].translated
+          && !g_utf8_validate (block->str + start, block->len - start, NULL))
         {
-          /* Try to steal the values */
-          if (**mt != '\0')
-            categories = g_list_prepend (categories, *mt);
-          else
-            g_free (*mt);
+          g_string_truncate (block, start);
+          found = FALSE;
         }
 
-      /* Cleanup */
-      g_free (str_list);
+      if (found)
+        {
+          g_string_append_c (block, '\0');
+          offsets[n] = start + 1;
+        }
+      else
+        {
+          offsets[n] = 0;
+        }
+    }
 
-      /* Assign categories list to the menu item */
-      pojk_menu_item_set_categories (item, categories);
+  /* Give back what the block did not grow into */
+  len = block->len;
+  *strings = g_string_free (block, FALSE);
+  if (len > 0)
+    {
+      *strings = g_realloc (*strings, len);
     }
   else
     {
-      /* Assign empty categories list to the menu item */
-      pojk_menu_item_set_categories (item, NULL);
+      g_free (*strings);
+      *strings = NULL;
     }
+}
 
-  if (affects_the_outside != NULL)
-    {
-      if (!pojk_menu_item_lists_equal (old_categories, categories))
-        *affects_the_outside = TRUE;
 
-      _pojk_g_list_free_full (old_categories, g_free);
-    }
 
+/* Reads everything else, which is only needed once the item is displayed
+ * or launched, except for the actions. @entry has to be in the desktop
+ * entry group */
+static void
+pojk_menu_item_read_display_fields (PojkMenuItem     *item,
+                                    PojkDesktopEntry *entry)
+{
+  pojk_menu_item_retire_strings (item);
+  pojk_menu_item_read_strings (entry, &item->priv->strings, item->priv->string_offsets);
 
-  if (affects_the_outside != NULL)
-    {
-      /* create a deep copy the old keywords list */
-      old_keywords = g_list_copy (item->priv->keywords);
-      for (lp = old_keywords; lp != NULL; lp = lp->next)
-        lp->data = g_strdup (lp->data);
-    }
+  item->priv->requires_terminal = _pojk_desktop_entry_get_boolean (entry, G_KEY_FILE_DESKTOP_KEY_TERMINAL, FALSE);
+  item->priv->supports_startup_notification =
+    _pojk_desktop_entry_get_boolean (entry, G_KEY_FILE_DESKTOP_KEY_STARTUP_NOTIFY, FALSE)
+    || _pojk_desktop_entry_get_boolean (entry, "X-KDE-StartupNotify", FALSE);
 
   /* Determine the keywords this application should be shown in */
-  str_list = xfce_rc_read_list_entry (rc, G_KEY_FILE_DESKTOP_KEY_KEYWORDS, ";");
-  if (G_LIKELY (str_list != NULL))
-    {
-      for (mt = str_list; *mt != NULL; ++mt)
-        {
-          /* Try to steal the values */
-          if (**mt != '\0')
-            keywords = g_list_prepend (keywords, *mt);
-          else
-            g_free (*mt);
-        }
+  item->priv->keywords = pojk_menu_item_read_list (entry, G_KEY_FILE_DESKTOP_KEY_KEYWORDS, FALSE);
+}
 
-      /* Cleanup */
-      g_free (str_list);
 
-      /* Assign keywords list to the menu item */
-      pojk_menu_item_set_keywords (item, keywords);
+
+/* Determines the application actions. @entry has to be in the desktop
+ * entry group and is left in an undefined group */
+static void
+pojk_menu_item_read_actions (PojkMenuItem     *item,
+                             PojkDesktopEntry *entry)
+{
+  gchar **str_list;
+
+  str_list = _pojk_desktop_entry_get_list (entry, G_KEY_FILE_DESKTOP_KEY_ACTIONS);
+  if (G_LIKELY (str_list != NULL))
+    {
+      pojk_menu_item_read_action_groups (item, entry, str_list, "Desktop Action %s");
     }
   else
     {
-      /* Assign empty keywords list to the menu item */
-      pojk_menu_item_set_keywords (item, NULL);
+      str_list = _pojk_desktop_entry_get_list (entry, "X-Ayatana-Desktop-Shortcuts");
+      if (G_LIKELY (str_list != NULL))
+        pojk_menu_item_read_action_groups (item, entry, str_list, "%s Shortcut Group");
     }
+}
 
-  if (affects_the_outside != NULL)
-    {
-      if (!pojk_menu_item_lists_equal (old_keywords, keywords))
-        *affects_the_outside = TRUE;
 
-      _pojk_g_list_free_full (old_keywords, g_free);
-    }
 
-  /* Set the rest of the private data directly */
-  item->priv->only_show_in = xfce_rc_read_list_entry (rc, G_KEY_FILE_DESKTOP_KEY_ONLY_SHOW_IN, ";");
-  item->priv->not_show_in = xfce_rc_read_list_entry (rc, G_KEY_FILE_DESKTOP_KEY_NOT_SHOW_IN, ";");
+/* Creates an empty item for @file. Unlike g_object_new() with
+ * properties, this does not go through GValues, property setters and
+ * notifications; the loaders fill in the private fields directly */
+static PojkMenuItem *
+pojk_menu_item_alloc (GFile *file)
+{
+  PojkMenuItem *item;
 
-  /* Update application actions */
-  _pojk_g_list_free_full (item->priv->actions, pojk_menu_item_action_unref);
-  item->priv->actions = NULL;
+  item = g_object_new (POJK_TYPE_MENU_ITEM, NULL);
+  item->priv->file = g_object_ref (file);
 
-  str_list = xfce_rc_read_list_entry (rc, G_KEY_FILE_DESKTOP_KEY_ACTIONS, ";");
-  if (G_LIKELY (str_list != NULL))
-    {
-      for (mt = str_list; *mt != NULL; ++mt)
+  return item;
+}
+
+
+
+static PojkMenuItem *
+pojk_menu_item_new_internal (GFile       *file,
+                             const gchar *desktop_id,
+                             gboolean     lazy)
+{
+  PojkMenuItem     *item = NULL;
+  PojkDesktopEntry *entry;
+  PojkFileStamp     stamp;
+  gchar            *filename;
+
+  g_return_val_if_fail (G_IS_FILE (file), NULL);
+  g_return_val_if_fail (g_file_is_native (file), NULL);
+
+  /* Open the desktop file. It is stat'ed first, so a change while it is
+   * read makes the stamp outdated rather than wrong */
+  filename = g_file_get_path (file);
+  _pojk_file_stamp_get (&stamp, filename);
+  entry = _pojk_desktop_entry_new (filename);
+  g_free (filename);
+  if (G_UNLIKELY (entry == NULL))
+    return NULL;
+
+  /* Validate Name and Exec fields, support Type=Link items */
+  if (G_LIKELY (_pojk_desktop_entry_has_key (entry, G_KEY_FILE_DESKTOP_KEY_NAME)
+                && (_pojk_desktop_entry_has_key (entry, G_KEY_FILE_DESKTOP_KEY_EXEC)
+                    || _pojk_desktop_entry_has_key (entry, G_KEY_FILE_DESKTOP_KEY_URL))))
+    {
+      /* Allocate a new menu item instance */
+      item = pojk_menu_item_alloc (file);
+      item->priv->desktop_id = g_strdup (desktop_id);
+      item->priv->stamp = stamp;
+
+      pojk_menu_item_read_rule_fields (item, entry);
+
+      /* Most items never show their actions */
+      item->priv->actions_loaded = FALSE;
+
+      if (lazy)
+        item->priv->materialized = FALSE;
+      else
+        pojk_menu_item_read_display_fields (item, entry);
+    }
+
+  /* Cleanup */
+  _pojk_desktop_entry_free (entry);
+
+  return item;
+}
+
+
+
+PojkMenuItem *
+pojk_menu_item_new (GFile *file)
+{
+  return pojk_menu_item_new_internal (file, NULL, FALSE);
+}
+
+
+
+/* Same as pojk_menu_item_new(), but only reads the fields needed to
+ * resolve the menu rules and sets the desktop-file id right away. The
+ * other fields are read from @file when they are accessed for the first
+ * time */
+PojkMenuItem *
+_pojk_menu_item_new_lazy (GFile       *file,
+                          const gchar *desktop_id)
+{
+  return pojk_menu_item_new_internal (file, desktop_id, TRUE);
+}
+
+
+
+/* Tells whether the desktop file of @item changed since the item was
+ * read from it, by comparing its device, inode, size and modification
+ * time. Items that were not read from a local file or were restored from
+ * a snapshot have no stamp to compare to */
+PojkFileStampState
+_pojk_menu_item_check_file (PojkMenuItem *item)
+{
+  PojkFileStamp stamp;
+  gchar        *filename;
+
+  g_return_val_if_fail (POJK_IS_MENU_ITEM (item), POJK_FILE_STAMP_UNKNOWN);
+
+  if (item->priv->stamp.inode == 0)
+    return POJK_FILE_STAMP_UNKNOWN;
+
+  filename = g_file_get_path (item->priv->file);
+  _pojk_file_stamp_get (&stamp, filename);
+  g_free (filename);
+
+  if (_pojk_file_stamp_equal (&item->priv->stamp, &stamp))
+    return POJK_FILE_STAMP_UNCHANGED;
+
+  return POJK_FILE_STAMP_CHANGED;
+}
+
+
+
+/* The stamp of the desktop file as it was when @item was read from it */
+void
+_pojk_menu_item_get_stamp (PojkMenuItem  *item,
+                           PojkFileStamp *stamp)
+{
+  g_return_if_fail (POJK_IS_MENU_ITEM (item));
+  g_return_if_fail (stamp != NULL);
+
+  *stamp = item->priv->stamp;
+}
+
+
+
+/* Used for items restored from a file which recorded the stamp of their
+ * desktop file, so they can be checked against the file later */
+void
+_pojk_menu_item_set_stamp (PojkMenuItem        *item,
+                           const PojkFileStamp *stamp)
+{
+  g_return_if_fail (POJK_IS_MENU_ITEM (item));
+  g_return_if_fail (stamp != NULL);
+
+  item->priv->stamp = *stamp;
+}
+
+
+
+static void
+pojk_menu_item_materialize_from_file (PojkMenuItem *item)
+{
+  PojkDesktopEntry *entry;
+  gchar            *filename;
+  gchar            *basename;
+
+  G_LOCK (materialize);
+
+  /* Another thread may have been faster */
+  if (!g_atomic_int_get (&item->priv->materialized))
+    {
+      filename = g_file_get_path (item->priv->file);
+      entry = _pojk_desktop_entry_new (filename);
+      g_free (filename);
+
+      if (G_LIKELY (entry != NULL))
         {
-          if (**mt != '\0')
-            {
-              /* Set current desktop action group */
-              action_group = g_strdup_printf ("Desktop Action %s", *mt);
-              xfce_rc_set_group (rc, action_group);
-
-              /* Parse name and exec command */
-              name = xfce_rc_read_entry (rc, G_KEY_FILE_DESKTOP_KEY_NAME, NULL);
-              exec = xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_EXEC, NULL);
-              icon = xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_ICON, NULL);
-
-              /* Validate Name and Exec fields, icon is optional */
-              if (G_LIKELY (exec != NULL && name != NULL))
-                {
-                  /* Allocate a new action instance */
-                  action = g_object_new (POJK_TYPE_MENU_ITEM_ACTION,
-                                         "name", name,
-                                         "command", exec,
-                                         "icon-name", icon,
-                                         NULL);
-
-                  pojk_menu_item_set_action (item, *mt, action);
-                }
-              g_free (action_group);
-            }
-          else
-            g_free (*mt);
+          pojk_menu_item_read_display_fields (item, entry);
+          _pojk_desktop_entry_free (entry);
         }
 
-      /* Cleanup */
-      g_free (str_list);
+      /* The file was removed or broken since the item was loaded. Keep
+       * the item usable until the menu notices that */
+      if (G_UNLIKELY (pojk_menu_item_get_string (item, STRING_NAME) == NULL))
+        {
+          basename = g_file_get_basename (item->priv->file);
+          pojk_menu_item_set_string (item, STRING_NAME, basename);
+          g_free (basename);
+        }
+      if (G_UNLIKELY (pojk_menu_item_get_string (item, STRING_COMMAND) == NULL))
+        pojk_menu_item_set_string (item, STRING_COMMAND, "");
+
+      g_atomic_int_inc (&item->priv->size_serial);
+      g_atomic_int_set (&item->priv->materialized, TRUE);
     }
 
-  else
+  G_UNLOCK (materialize);
+}
+
+
+
+/* Called by all getters and setters of the fields read by
+ * pojk_menu_item_read_display_fields() */
+static inline void
+pojk_menu_item_materialize (PojkMenuItem *item)
+{
+  if (G_UNLIKELY (!g_atomic_int_get (&item->priv->materialized)))
+    pojk_menu_item_materialize_from_file (item);
+}
+
+
+
+static void
+pojk_menu_item_load_actions_from_file (PojkMenuItem *item)
+{
+  PojkDesktopEntry *entry;
+  gchar            *filename;
+
+  G_LOCK (materialize);
+
+  if (!g_atomic_int_get (&item->priv->actions_loaded))
     {
-      str_list = xfce_rc_read_list_entry (rc, "X-Ayatana-Desktop-Shortcuts", ";");
-      if (G_LIKELY (str_list != NULL))
-        {
-          for (mt = str_list; *mt != NULL; ++mt)
-            {
-              if (**mt != '\0')
-                {
-                  action_group = g_strdup_printf ("%s Shortcut Group", *mt);
-                  xfce_rc_set_group (rc, action_group);
-
-                  name = xfce_rc_read_entry (rc, G_KEY_FILE_DESKTOP_KEY_NAME, NULL);
-                  exec = xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_EXEC, NULL);
-                  icon = xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_ICON, NULL);
-
-                  /* Validate Name and Exec fields, icon is optional */
-                  if (G_LIKELY (exec != NULL && name != NULL))
-                    {
-                      action = g_object_new (POJK_TYPE_MENU_ITEM_ACTION,
-                                             "name", name,
-                                             "command", exec,
-                                             "icon-name", icon,
-                                             NULL);
-
-                      pojk_menu_item_set_action (item, *mt, action);
-                    }
-
-                  g_free (action_group);
-                }
-              else
-                g_free (*mt);
-            }
+      filename = g_file_get_path (item->priv->file);
+      entry = _pojk_desktop_entry_new (filename);
+      g_free (filename);
 
-          g_free (str_list);
+      /* Without the file, the item just has no actions */
+      if (G_LIKELY (entry != NULL))
+        {
+          pojk_menu_item_read_actions (item, entry);
+          _pojk_desktop_entry_free (entry);
         }
+
+      g_atomic_int_inc (&item->priv->size_serial);
+      g_atomic_int_set (&item->priv->actions_loaded, TRUE);
+    }
+
+  G_UNLOCK (materialize);
+}
+
+
+
+/* Called by all functions that access the actions */
+static inline void
+pojk_menu_item_load_actions (PojkMenuItem *item)
+{
+  if (G_UNLIKELY (!g_atomic_int_get (&item->priv->actions_loaded)))
+    pojk_menu_item_load_actions_from_file (item);
+}
+
+
+
+PojkMenuItem *
+pojk_menu_item_new_for_path (const gchar *filename)
+{
+  GFile          *file;
+  PojkMenuItem *item;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  file = g_file_new_for_path (filename);
+  item = pojk_menu_item_new (file);
+  g_object_unref (G_OBJECT (file));
+
+  return item;
+}
+
+
+
+PojkMenuItem *
+pojk_menu_item_new_for_uri (const gchar *uri)
+{
+  GFile          *file;
+  PojkMenuItem *item;
+
+  g_return_val_if_fail (uri != NULL, NULL);
+
+  file = g_file_new_for_uri (uri);
+  item = pojk_menu_item_new (file);
+  g_object_unref (G_OBJECT (file));
+
+  return item;
+}
+
+
+
+gboolean
+pojk_menu_item_reload (PojkMenuItem  *item,
+                         gboolean        *affects_the_outside,
+                         GError         **error)
+{
+  g_return_val_if_fail (POJK_IS_MENU_ITEM (item), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  return pojk_menu_item_reload_from_file (item, item->priv->file, affects_the_outside, error);
+}
+
+
+
+gboolean
+pojk_menu_item_reload_from_file (PojkMenuItem  *item,
+                                   GFile           *file,
+                                   gboolean        *affects_the_outside,
+                                   GError         **error)
+{
+  PojkDesktopEntry     *entry;
+  PojkFileStamp         stamp;
+  gboolean              boolean;
+  GList                *categories = NULL;
+  GList                *old_categories = NULL;
+  GList                *keywords = NULL;
+  GList                *old_keywords = NULL;
+  gchar                *strings;
+  guint32               offsets[N_STRINGS];
+  gboolean              changed[N_STRINGS];
+  gchar                *filename;
+  guint                 n;
+
+  g_return_val_if_fail (POJK_IS_MENU_ITEM (item), FALSE);
+  g_return_val_if_fail (G_IS_FILE (file), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+  g_return_val_if_fail (g_file_is_native (file), FALSE);
+
+  filename = g_file_get_path (file);
+  _pojk_file_stamp_get (&stamp, filename);
+
+  /* Nothing to do if the file is still the one the item was read from.
+   * File monitors also report touched files and changed permissions */
+  if (g_file_equal (file, item->priv->file)
+      && _pojk_file_stamp_equal (&item->priv->stamp, &stamp))
+    {
+      g_free (filename);
+      return TRUE;
     }
 
+  /* Read the old values before they are replaced and compared */
+  pojk_menu_item_materialize (item);
+
+  /* Open the desktop file */
+  entry = _pojk_desktop_entry_new (filename);
+  g_free (filename);
+  if (G_UNLIKELY (entry == NULL))
+    return FALSE;
+
+  pojk_menu_item_read_strings (entry, &strings, offsets);
+
+  /* Check if there is a name and exec key */
+  if (G_UNLIKELY (offsets[STRING_NAME] == 0 || offsets[STRING_COMMAND] == 0))
+    {
+      g_set_error_literal (error, G_KEY_FILE_ERROR,
+                           G_KEY_FILE_ERROR_KEY_NOT_FOUND,
+                           "Either the name or exec key was not defined.");
+      _pojk_desktop_entry_free (entry);
+      g_free (strings);
+
+      return FALSE;
+    }
+
+  /* Queue property notifications */
+  g_object_freeze_notify (G_OBJECT (item));
+
+  /* Set the new file if needed */
+  if (!g_file_equal (file, item->priv->file))
+    {
+      if (G_LIKELY (item->priv->file != NULL))
+        g_object_unref (G_OBJECT (item->priv->file));
+      item->priv->file = G_FILE (g_object_ref (G_OBJECT (file)));
+
+      g_object_notify (G_OBJECT (item), "file");
+    }
+
+  /* Replace all strings at once, then tell which ones changed */
+  for (n = 0; n < N_STRINGS; n++)
+    changed[n] = g_strcmp0 (pojk_menu_item_get_string (item, n),
+                            offsets[n] != 0 ? strings + offsets[n] - 1 : NULL) != 0;
+
+  pojk_menu_item_retire_strings (item);
+  item->priv->strings = strings;
+  memcpy (item->priv->string_offsets, offsets, sizeof (offsets));
+
+  for (n = 0; n < N_STRINGS; n++)
+    if (changed[n])
+      g_object_notify (G_OBJECT (item), string_properties[n]);
+
+  boolean = _pojk_desktop_entry_get_boolean (entry, G_KEY_FILE_DESKTOP_KEY_TERMINAL, FALSE);
+  pojk_menu_item_set_requires_terminal (item, boolean);
+
+  boolean = _pojk_desktop_entry_get_boolean (entry, G_KEY_FILE_DESKTOP_KEY_NO_DISPLAY, FALSE);
+  pojk_menu_item_set_no_display (item, boolean);
+
+  boolean = _pojk_desktop_entry_get_boolean (entry, G_KEY_FILE_DESKTOP_KEY_STARTUP_NOTIFY, FALSE)
+            || _pojk_desktop_entry_get_boolean (entry, "X-KDE-StartupNotify", FALSE);
+  pojk_menu_item_set_supports_startup_notification (item, boolean);
+
+  boolean = _pojk_desktop_entry_get_boolean (entry, G_KEY_FILE_DESKTOP_KEY_HIDDEN, FALSE);
+  pojk_menu_item_set_hidden (item, boolean);
+
+  /* Determine the categories and keywords of this application. The old
+   * lists are compared with the new ones before they are freed */
+  old_categories = item->priv->categories;
+  categories = pojk_menu_item_read_list (entry, G_KEY_FILE_DESKTOP_KEY_CATEGORIES, TRUE);
+  item->priv->categories = categories;
+  _pojk_category_set_free (item->priv->category_set);
+  item->priv->category_set = _pojk_category_set_new (categories);
+
+  old_keywords = item->priv->keywords;
+  keywords = pojk_menu_item_read_list (entry, G_KEY_FILE_DESKTOP_KEY_KEYWORDS, FALSE);
+  item->priv->keywords = keywords;
+
+  if (affects_the_outside != NULL
+      && (!pojk_menu_item_lists_equal (old_categories, categories)
+          || !pojk_menu_item_lists_equal (old_keywords, keywords)))
+    *affects_the_outside = TRUE;
+
+  g_list_free (old_categories);
+  _pojk_g_list_free_full (old_keywords, g_free);
+
+  /* Set the rest of the private data directly */
+  g_free (item->priv->only_show_in);
+  g_free (item->priv->not_show_in);
+  item->priv->only_show_in = _pojk_intern_strv (_pojk_desktop_entry_get_list (entry, G_KEY_FILE_DESKTOP_KEY_ONLY_SHOW_IN));
+  item->priv->not_show_in = _pojk_intern_strv (_pojk_desktop_entry_get_list (entry, G_KEY_FILE_DESKTOP_KEY_NOT_SHOW_IN));
+
+  /* Read the application actions again when they are asked for */
+  pojk_menu_item_clear_actions (item);
+  g_atomic_int_set (&item->priv->actions_loaded, FALSE);
+
+  item->priv->stamp = stamp;
+  g_atomic_int_inc (&item->priv->size_serial);
+
   /* Flush property notifications */
   g_object_thaw_notify (G_OBJECT (item));
 
   /* Emit signal to everybody knows we reloaded the file */
   g_signal_emit (G_OBJECT (item), item_signals[CHANGED], 0);
 
-  xfce_rc_close (rc);
-  g_free (url_exec);
+  _pojk_desktop_entry_free (entry);
 
   return TRUE;
 }
@@ -1294,6 +1625,7 @@ pojk_menu_item_set_desktop_id (PojkMenuItem *item,
   /* Assign the new desktop_id */
   g_free (item->priv->desktop_id);
   item->priv->desktop_id = g_strdup (desktop_id);
+  g_atomic_int_inc (&item->priv->size_serial);
 
   /* Notify listeners */
   g_object_notify (G_OBJECT (item), "desktop-id");
@@ -1321,10 +1653,12 @@ pojk_menu_item_set_categories (PojkMenuItem *item,
     return;
 
   /* Free old list */
-  _pojk_g_list_free_full (item->priv->categories, g_free);
+  g_list_free (item->priv->categories);
+  _pojk_category_set_free (item->priv->category_set);
 
   /* Assign new list */
-  item->priv->categories = categories;
+  item->priv->categories = pojk_menu_item_intern_list (categories);
+  item->priv->category_set = _pojk_category_set_new (item->priv->categories);
 }
 
 
@@ -1333,6 +1667,7 @@ GList*
 pojk_menu_item_get_keywords (PojkMenuItem *item)
 {
   g_return_val_if_fail (POJK_IS_MENU_ITEM (item), NULL);
+  pojk_menu_item_materialize (item);
   return item->priv->keywords;
 }
 
@@ -1344,6 +1679,8 @@ pojk_menu_item_set_keywords (PojkMenuItem *item,
 {
   g_return_if_fail (POJK_IS_MENU_ITEM (item));
 
+  pojk_menu_item_materialize (item);
+
   /* Abort if lists are equal */
   if (G_UNLIKELY (item->priv->keywords == keywords))
     return;
@@ -1361,7 +1698,8 @@ const gchar*
 pojk_menu_item_get_command (PojkMenuItem *item)
 {
   g_return_val_if_fail (POJK_IS_MENU_ITEM (item), NULL);
-  return item->priv->command;
+  pojk_menu_item_materialize (item);
+  return pojk_menu_item_get_string (item, STRING_COMMAND);
 }
 
 
@@ -1373,13 +1711,14 @@ pojk_menu_item_set_command (PojkMenuItem *item,
   g_return_if_fail (POJK_IS_MENU_ITEM (item));
   g_return_if_fail (command != NULL);
 
+  pojk_menu_item_materialize (item);
+
   /* Abort if old and new command are equal */
-  if (g_strcmp0 (item->priv->command, command) == 0)
+  if (g_strcmp0 (pojk_menu_item_get_string (item, STRING_COMMAND), command) == 0)
     return;
 
   /* Assign new command */
-  g_free (item->priv->command);
-  item->priv->command = g_strdup (command);
+  pojk_menu_item_set_string (item, STRING_COMMAND, command);
 
   /* Notify listeners */
   g_object_notify (G_OBJECT (item), "command");
@@ -1391,7 +1730,8 @@ const gchar*
 pojk_menu_item_get_try_exec (PojkMenuItem *item)
 {
   g_return_val_if_fail (POJK_IS_MENU_ITEM (item), NULL);
-  return item->priv->try_exec;
+  pojk_menu_item_materialize (item);
+  return pojk_menu_item_get_string (item, STRING_TRY_EXEC);
 }
 
 
@@ -1402,13 +1742,14 @@ pojk_menu_item_set_try_exec (PojkMenuItem *item,
 {
   g_return_if_fail (POJK_IS_MENU_ITEM (item));
 
+  pojk_menu_item_materialize (item);
+
   /* Abort if old and new try_exec are equal */
-  if (g_strcmp0 (item->priv->try_exec, try_exec) == 0)
+  if (g_strcmp0 (pojk_menu_item_get_string (item, STRING_TRY_EXEC), try_exec) == 0)
     return;
 
   /* Assign new try_exec */
-  g_free (item->priv->try_exec);
-  item->priv->try_exec = g_strdup (try_exec);
+  pojk_menu_item_set_string (item, STRING_TRY_EXEC, try_exec);
 
   /* Notify listeners */
   g_object_notify (G_OBJECT (item), "try-exec");
@@ -1420,7 +1761,8 @@ const gchar*
 pojk_menu_item_get_name (PojkMenuItem *item)
 {
   g_return_val_if_fail (POJK_IS_MENU_ITEM (item), NULL);
-  return item->priv->name;
+  pojk_menu_item_materialize (item);
+  return pojk_menu_item_get_string (item, STRING_NAME);
 }
 
 
@@ -1432,13 +1774,14 @@ pojk_menu_item_set_name (PojkMenuItem *item,
   g_return_if_fail (POJK_IS_MENU_ITEM (item));
   g_return_if_fail (g_utf8_validate (name, -1, NULL));
 
+  pojk_menu_item_materialize (item);
+
   /* Abort if old and new name are equal */
-  if (g_strcmp0 (item->priv->name, name) == 0)
+  if (g_strcmp0 (pojk_menu_item_get_string (item, STRING_NAME), name) == 0)
     return;
 
   /* Assign new name */
-  g_free (item->priv->name);
-  item->priv->name = g_strdup (name);
+  pojk_menu_item_set_string (item, STRING_NAME, name);
 
   /* Notify listeners */
   g_object_notify (G_OBJECT (item), "name");
@@ -1450,7 +1793,8 @@ const gchar*
 pojk_menu_item_get_generic_name (PojkMenuItem *item)
 {
   g_return_val_if_fail (POJK_IS_MENU_ITEM (item), NULL);
-  return item->priv->generic_name;
+  pojk_menu_item_materialize (item);
+  return pojk_menu_item_get_string (item, STRING_GENERIC_NAME);
 }
 
 
@@ -1462,13 +1806,14 @@ pojk_menu_item_set_generic_name (PojkMenuItem *item,
   g_return_if_fail (POJK_IS_MENU_ITEM (item));
   g_return_if_fail (generic_name == NULL || g_utf8_validate (generic_name, -1, NULL));
 
+  pojk_menu_item_materialize (item);
+
   /* Abort if old and new generic name are equal */
-  if (g_strcmp0 (item->priv->generic_name, generic_name) == 0)
+  if (g_strcmp0 (pojk_menu_item_get_string (item, STRING_GENERIC_NAME), generic_name) == 0)
     return;
 
   /* Assign new generic_name */
-  g_free (item->priv->generic_name);
-  item->priv->generic_name = g_strdup (generic_name);
+  pojk_menu_item_set_string (item, STRING_GENERIC_NAME, generic_name);
 
   /* Notify listeners */
   g_object_notify (G_OBJECT (item), "generic-name");
@@ -1480,7 +1825,8 @@ const gchar*
 pojk_menu_item_get_comment (PojkMenuItem *item)
 {
   g_return_val_if_fail (POJK_IS_MENU_ITEM (item), NULL);
-  return item->priv->comment;
+  pojk_menu_item_materialize (item);
+  return pojk_menu_item_get_string (item, STRING_COMMENT);
 }
 
 
@@ -1492,13 +1838,14 @@ pojk_menu_item_set_comment (PojkMenuItem *item,
   g_return_if_fail (POJK_IS_MENU_ITEM (item));
   g_return_if_fail (comment == NULL || g_utf8_validate (comment, -1, NULL));
 
+  pojk_menu_item_materialize (item);
+
   /* Abort if old and new comment are equal */
-  if (g_strcmp0 (item->priv->comment, comment) == 0)
+  if (g_strcmp0 (pojk_menu_item_get_string (item, STRING_COMMENT), comment) == 0)
     return;
 
   /* Assign new comment */
-  g_free (item->priv->comment);
-  item->priv->comment = g_strdup (comment);
+  pojk_menu_item_set_string (item, STRING_COMMENT, comment);
 
   /* Notify listeners */
   g_object_notify (G_OBJECT (item), "comment");
@@ -1510,7 +1857,8 @@ const gchar*
 pojk_menu_item_get_icon_name (PojkMenuItem *item)
 {
   g_return_val_if_fail (POJK_IS_MENU_ITEM (item), NULL);
-  return item->priv->icon_name;
+  pojk_menu_item_materialize (item);
+  return pojk_menu_item_get_string (item, STRING_ICON_NAME);
 }
 
 
@@ -1521,13 +1869,14 @@ pojk_menu_item_set_icon_name (PojkMenuItem *item,
 {
   g_return_if_fail (POJK_IS_MENU_ITEM (item));
 
+  pojk_menu_item_materialize (item);
+
   /* Abort if old and new icon name are equal */
-  if (g_strcmp0 (item->priv->icon_name, icon_name) == 0)
+  if (g_strcmp0 (pojk_menu_item_get_string (item, STRING_ICON_NAME), icon_name) == 0)
     return;
 
   /* Assign new icon name */
-  g_free (item->priv->icon_name);
-  item->priv->icon_name = g_strdup (icon_name);
+  pojk_menu_item_set_string (item, STRING_ICON_NAME, icon_name);
 
   /* Notify listeners */
   g_object_notify (G_OBJECT (item), "icon-name");
@@ -1539,7 +1888,8 @@ const gchar*
 pojk_menu_item_get_path (PojkMenuItem *item)
 {
   g_return_val_if_fail (POJK_IS_MENU_ITEM (item), NULL);
-  return item->priv->path;
+  pojk_menu_item_materialize (item);
+  return pojk_menu_item_get_string (item, STRING_PATH);
 }
 
 
@@ -1550,13 +1900,14 @@ pojk_menu_item_set_path (PojkMenuItem *item,
 {
   g_return_if_fail (POJK_IS_MENU_ITEM (item));
 
+  pojk_menu_item_materialize (item);
+
   /* Abort if old and new path are equal */
-  if (g_strcmp0 (item->priv->path, path) == 0)
+  if (g_strcmp0 (pojk_menu_item_get_string (item, STRING_PATH), path) == 0)
     return;
 
   /* Assign new path */
-  g_free (item->priv->path);
-  item->priv->path = g_strdup (path);
+  pojk_menu_item_set_string (item, STRING_PATH, path);
 
   /* Notify listeners */
   g_object_notify (G_OBJECT (item), "path");
@@ -1596,6 +1947,7 @@ gboolean
 pojk_menu_item_requires_terminal (PojkMenuItem *item)
 {
   g_return_val_if_fail (POJK_IS_MENU_ITEM (item), FALSE);
+  pojk_menu_item_materialize (item);
   return item->priv->requires_terminal;
 }
 
@@ -1607,6 +1959,8 @@ pojk_menu_item_set_requires_terminal (PojkMenuItem *item,
 {
   g_return_if_fail (POJK_IS_MENU_ITEM (item));
 
+  pojk_menu_item_materialize (item);
+
   /* Abort if old and new value are equal */
   if (item->priv->requires_terminal == requires_terminal)
     return;
@@ -1652,6 +2006,7 @@ gboolean
 pojk_menu_item_supports_startup_notification (PojkMenuItem *item)
 {
   g_return_val_if_fail (POJK_IS_MENU_ITEM (item), FALSE);
+  pojk_menu_item_materialize (item);
   return item->priv->supports_startup_notification;
 }
 
@@ -1663,6 +2018,8 @@ pojk_menu_item_set_supports_startup_notification (PojkMenuItem *item,
 {
   g_return_if_fail (POJK_IS_MENU_ITEM (item));
 
+  pojk_menu_item_materialize (item);
+
   /* Abort if old and new value are equal */
   if (item->priv->supports_startup_notification == supports_startup_notification)
     return;
@@ -1680,17 +2037,107 @@ gboolean
 pojk_menu_item_has_category (PojkMenuItem *item,
                                const gchar    *category)
 {
-  GList   *iter;
-  gboolean found = FALSE;
-
   g_return_val_if_fail (POJK_IS_MENU_ITEM (item), FALSE);
   g_return_val_if_fail (category != NULL, FALSE);
 
-  for (iter = item->priv->categories; !found && iter != NULL; iter = g_list_next (iter))
-    if (g_strcmp0 (iter->data, category) == 0)
-      found = TRUE;
+  category = _pojk_intern_lookup (category);
+  if (category == NULL)
+    return FALSE;
 
-  return found;
+  return _pojk_category_set_contains (item->priv->category_set,
+                                      _pojk_category_lookup_id (category));
+}
+
+
+
+/* The ids of the categories of @item, or %NULL if it has none */
+const PojkCategorySet *
+_pojk_menu_item_get_category_set (PojkMenuItem *item)
+{
+  return item->priv->category_set;
+}
+
+
+
+static gsize
+pojk_menu_item_strv_size (const gchar **strv)
+{
+  return strv != NULL ? (g_strv_length ((gchar **) strv) + 1) * sizeof (gchar *) : 0;
+}
+
+
+
+/* Estimates the memory used by @item, for the budget of the item cache.
+ * Interned strings are shared by all items and not counted */
+gsize
+_pojk_menu_item_get_memory_size (PojkMenuItem *item)
+{
+  PojkMenuItemPrivate *priv;
+  PojkMenuItemAction  *action;
+  GList               *lp;
+  const gchar         *last = NULL;
+  gsize                size;
+  guint                n;
+
+  g_return_val_if_fail (POJK_IS_MENU_ITEM (item), 0);
+
+  priv = item->priv;
+  size = sizeof (PojkMenuItem) + sizeof (PojkMenuItemPrivate);
+
+  G_LOCK (materialize);
+
+  /* The string block ends with the string at the highest offset */
+  for (n = 0; n < N_STRINGS; n++)
+    if (priv->string_offsets[n] != 0
+        && (last == NULL || priv->strings + priv->string_offsets[n] - 1 > last))
+      last = priv->strings + priv->string_offsets[n] - 1;
+  if (last != NULL)
+    size += last - priv->strings + strlen (last) + 1;
+
+  if (priv->desktop_id != NULL)
+    size += strlen (priv->desktop_id) + 1;
+
+  size += g_list_length (priv->categories) * sizeof (GList);
+  for (lp = priv->keywords; lp != NULL; lp = lp->next)
+    size += sizeof (GList) + strlen (lp->data) + 1;
+
+  if (priv->category_set != NULL)
+    size += G_STRUCT_OFFSET (PojkCategorySet, words)
+            + priv->category_set->n_words * sizeof (gulong);
+
+  size += pojk_menu_item_strv_size (priv->only_show_in);
+  size += pojk_menu_item_strv_size (priv->not_show_in);
+
+  if (priv->actions != NULL)
+    {
+      for (n = 0; n < priv->actions->len; n++)
+        {
+          action = g_ptr_array_index (priv->actions, n);
+          size += sizeof (PojkMenuItemAction) + 3 * sizeof (gchar *);
+          if (pojk_menu_item_action_get_name (action) != NULL)
+            size += strlen (pojk_menu_item_action_get_name (action)) + 1;
+          if (pojk_menu_item_action_get_command (action) != NULL)
+            size += strlen (pojk_menu_item_action_get_command (action)) + 1;
+          if (pojk_menu_item_action_get_icon_name (action) != NULL)
+            size += strlen (pojk_menu_item_action_get_icon_name (action)) + 1;
+        }
+    }
+
+  G_UNLOCK (materialize);
+
+  return size;
+}
+
+
+
+/* Returns a number that changes whenever the result of
+ * _pojk_menu_item_get_memory_size() may have changed */
+gint
+_pojk_menu_item_get_size_serial (PojkMenuItem *item)
+{
+  g_return_val_if_fail (POJK_IS_MENU_ITEM (item), 0);
+
+  return g_atomic_int_get (&item->priv->size_serial);
 }
 
 
@@ -1705,6 +2152,8 @@ pojk_menu_item_has_keyword (PojkMenuItem *item,
   g_return_val_if_fail (POJK_IS_MENU_ITEM (item), FALSE);
   g_return_val_if_fail (keyword != NULL, FALSE);
 
+  pojk_menu_item_materialize (item);
+
   for (iter = item->priv->keywords; !found && iter != NULL; iter = g_list_next (iter))
     if (g_strcmp0 (iter->data, keyword) == 0)
       found = TRUE;
@@ -1718,17 +2167,21 @@ GList *
 pojk_menu_item_get_actions (PojkMenuItem *item)
 {
   GList                *action_names = NULL;
-  GList                *iter;
   PojkMenuItemAction *action;
+  guint                 n;
 
   g_return_val_if_fail (POJK_IS_MENU_ITEM (item), NULL);
 
-  for (iter = item->priv->actions; iter != NULL ; iter = g_list_next (iter))
+  pojk_menu_item_load_actions (item);
+
+  if (item->priv->actions == NULL)
+    return NULL;
+
+  for (n = item->priv->actions->len; n > 0; n--)
     {
-      action = POJK_MENU_ITEM_ACTION (iter->data);
+      action = g_ptr_array_index (item->priv->actions, n - 1);
       action_names = g_list_prepend (action_names, (gchar*)pojk_menu_item_action_get_name (action));
     }
-  action_names = g_list_reverse (action_names);
 
   return action_names;
 }
@@ -1739,20 +2192,15 @@ PojkMenuItemAction *
 pojk_menu_item_get_action (PojkMenuItem *item,
                              const gchar    *action_name)
 {
-  GList                *iter;
-  PojkMenuItemAction *action;
-
   g_return_val_if_fail (POJK_IS_MENU_ITEM (item), NULL);
   g_return_val_if_fail (action_name != NULL, NULL);
 
-  for (iter = item->priv->actions; iter != NULL; iter = g_list_next (iter))
-    {
-      action = POJK_MENU_ITEM_ACTION (iter->data);
-      if (g_strcmp0 (pojk_menu_item_action_get_name (action), action_name) == 0)
-        return (action);
-    }
+  pojk_menu_item_load_actions (item);
 
-  return NULL;
+  if (item->priv->action_names == NULL)
+    return NULL;
+
+  return g_hash_table_lookup (item->priv->action_names, action_name);
 }
 
 
@@ -1763,39 +2211,12 @@ pojk_menu_item_set_action (PojkMenuItem       *item,
                              const gchar          *action_name,
                              PojkMenuItemAction *action)
 {
-  GList                *iter;
-  PojkMenuItemAction *old_action;
-  gboolean             found = FALSE;
-
   g_return_if_fail (POJK_IS_MENU_ITEM (item));
   g_return_if_fail (POJK_IS_MENU_ITEM_ACTION (action));
 
-  /* If action name is found in list, then insert new action into the list and
-   * remove old action */
-  for (iter = item->priv->actions; !found && iter != NULL; iter = g_list_next (iter))
-    {
-      old_action = POJK_MENU_ITEM_ACTION (iter->data);
-      if (g_strcmp0 (pojk_menu_item_action_get_name (old_action), action_name) == 0)
-        {
-           /* Release reference on action currently stored at action name */
-           pojk_menu_item_action_unref (old_action);
-
-           /* Replace action in list at action name and grab a reference */
-           iter->data = action;
-           pojk_menu_item_action_ref (action);
+  pojk_menu_item_load_actions (item);
 
-           /* Set flag that action was found */
-           found = TRUE;
-        }
-    }
-
-  /* If action name was not found in list, then simply add it to list */
-  if (found == FALSE)
-    {
-      /* Add action to list and grab a reference */
-      item->priv->actions=g_list_append (item->priv->actions, action);
-      pojk_menu_item_action_ref (action);
-    }
+  pojk_menu_item_add_action (item, action_name, action);
 }
 
 
@@ -1804,21 +2225,7 @@ gboolean
 pojk_menu_item_has_action (PojkMenuItem  *item,
                              const gchar     *action_name)
 {
-  GList                *iter;
-  PojkMenuItemAction *action;
-  gboolean             found = FALSE;
-
-  g_return_val_if_fail (POJK_IS_MENU_ITEM (item), FALSE);
-  g_return_val_if_fail (action_name != NULL, FALSE);
-
-  for (iter = item->priv->actions; !found && iter != NULL; iter = g_list_next (iter))
-    {
-      action = POJK_MENU_ITEM_ACTION (iter->data);
-      if (g_strcmp0 (pojk_menu_item_action_get_name (action), action_name) == 0)
-        found = TRUE;
-    }
-
-  return found;
+  return pojk_menu_item_get_action (item, action_name) != NULL;
 }
 
 
@@ -1826,19 +2233,18 @@ pojk_menu_item_has_action (PojkMenuItem  *item,
 gboolean
 pojk_menu_item_get_show_in_environment (PojkMenuItem *item)
 {
-  const gchar *env;
-  guint        i, j;
-  gboolean     show = TRUE;
-  gchar**      path = NULL;
+  const gchar * const *names;
+  guint                j;
+  gboolean             show = TRUE;
 
   g_return_val_if_fail (POJK_IS_MENU_ITEM (item), FALSE);
 
   /* Determine current environment */
-  env = pojk_get_environment ();
+  names = _pojk_get_environment_names ();
 
   /* If no environment has been set, the menu is displayed no matter what
    * OnlyShowIn or NotShowIn contain */
-  if (G_UNLIKELY (env == NULL))
+  if (G_UNLIKELY (names == NULL))
     return TRUE;
 
   /* According to the spec there is either a OnlyShowIn or a NotShowIn list
@@ -1847,23 +2253,17 @@ pojk_menu_item_get_show_in_environment (PojkMenuItem *item)
     {
       /* Check if your environemnt is in OnlyShowIn list */
       show = FALSE;
-      path = g_strsplit(env, ":", 0);
-      for (j = 0; path[j] != NULL; j++)
-        for (i = 0; !show && item->priv->only_show_in[i] != NULL; i++)
-          if (g_strcmp0 (item->priv->only_show_in[i], path[j]) == 0)
-            show = TRUE;
-      g_strfreev(path);
+      for (j = 0; !show && names[j] != NULL; j++)
+        if (_pojk_intern_strv_contains (item->priv->only_show_in, names[j]))
+          show = TRUE;
     }
   else if (G_UNLIKELY (item->priv->not_show_in != NULL))
     {
       /* Check if your environemnt is in NotShowIn list */
       show = TRUE;
-      path = g_strsplit(env, ":", 0);
-      for (j = 0; path[j] != NULL; j++)
-        for (i = 0; show && item->priv->not_show_in[i] != NULL; i++)
-          if (g_strcmp0 (item->priv->not_show_in[i], path[j]) == 0)
-            show = FALSE;
-      g_strfreev(path);
+      for (j = 0; show && names[j] != NULL; j++)
+        if (_pojk_intern_strv_contains (item->priv->not_show_in, names[j]))
+          show = FALSE;
     }
 
   return show;
@@ -1874,30 +2274,26 @@ pojk_menu_item_get_show_in_environment (PojkMenuItem *item)
 gboolean
 pojk_menu_item_only_show_in_environment (PojkMenuItem *item)
 {
-  const gchar *env;
-  guint        i, j;
-  gboolean     show = FALSE;
-  gchar**      path = NULL;
+  const gchar * const *names;
+  guint                j;
+  gboolean             show = FALSE;
 
   g_return_val_if_fail (POJK_IS_MENU_ITEM (item), FALSE);
 
   /* Determine current environment */
-  env = pojk_get_environment ();
+  names = _pojk_get_environment_names ();
 
   /* If no environment has been set, the contents of OnlyShowIn don't matter */
-  if (G_LIKELY (env == NULL))
+  if (G_LIKELY (names == NULL))
     return FALSE;
 
   /* Check if we have an OnlyShowIn list */
   if (G_UNLIKELY (item->priv->only_show_in != NULL))
     {
       /* Check if your environemnt is in OnlyShowIn list */
-      show = FALSE;
-      path = g_strsplit(env, ":", 0);
-      for (j= 0; path[j] != NULL; j++)
-        for (i = 0; !show && item->priv->only_show_in[i] != NULL; i++)
-          if (g_strcmp0 (item->priv->only_show_in[i], path[j]) == 0)
-            show = TRUE;
+      for (j = 0; !show && names[j] != NULL; j++)
+        if (_pojk_intern_strv_contains (item->priv->only_show_in, names[j]))
+          show = TRUE;
     }
 
   return show;
@@ -1936,7 +2332,7 @@ gint
 pojk_menu_item_get_allocated (PojkMenuItem *item)
 {
   g_return_val_if_fail (POJK_IS_MENU_ITEM (item), FALSE);
-  return item->priv->num_allocated;
+  return g_atomic_int_get (&item->priv->num_allocated);
 }
 
 
@@ -1945,7 +2341,7 @@ void
 pojk_menu_item_increment_allocated (PojkMenuItem *item)
 {
   g_return_if_fail (POJK_IS_MENU_ITEM (item));
-  item->priv->num_allocated++;
+  g_atomic_int_inc (&item->priv->num_allocated);
 }
 
 
@@ -1953,8 +2349,240 @@ pojk_menu_item_increment_allocated (PojkMenuItem *item)
 void
 pojk_menu_item_decrement_allocated (PojkMenuItem *item)
 {
+  gint allocated;
+
   g_return_if_fail (POJK_IS_MENU_ITEM (item));
 
-  if (item->priv->num_allocated > 0)
-    item->priv->num_allocated--;
+  do
+    {
+      allocated = g_atomic_int_get (&item->priv->num_allocated);
+      if (allocated <= 0)
+        return;
+    }
+  while (!g_atomic_int_compare_and_exchange (&item->priv->num_allocated,
+                                             allocated, allocated - 1));
+}
+
+
+
+static GVariant *
+pojk_menu_item_list_to_variant (GList *list)
+{
+  GVariantBuilder builder;
+  GList          *lp;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_STRING_ARRAY);
+
+  for (lp = list; lp != NULL; lp = lp->next)
+    g_variant_builder_add (&builder, "s", lp->data);
+
+  return g_variant_builder_end (&builder);
+}
+
+
+
+/* Same as pojk_menu_item_read_list(), but reads the list from @variant */
+static GList *
+pojk_menu_item_list_from_variant (GVariant *variant,
+                                  gboolean  intern)
+{
+  GVariantIter  iter;
+  GList        *list = NULL;
+  const gchar  *string;
+
+  g_variant_iter_init (&iter, variant);
+  while (g_variant_iter_next (&iter, "&s", &string))
+    list = g_list_prepend (list, intern ? (gchar *) g_intern_string (string) : g_strdup (string));
+
+  return g_list_reverse (list);
+}
+
+
+
+static GVariant *
+pojk_menu_item_strv_to_variant (const gchar **strv)
+{
+  GVariant *value = NULL;
+
+  if (strv != NULL)
+    value = g_variant_new_strv ((const gchar * const *) strv, -1);
+
+  return g_variant_new_maybe (G_VARIANT_TYPE_STRING_ARRAY, value);
+}
+
+
+
+static const gchar **
+pojk_menu_item_strv_from_variant (GVariant *variant)
+{
+  GVariant     *value;
+  const gchar **strv = NULL;
+  guint         n;
+
+  value = g_variant_get_maybe (variant);
+  if (value != NULL)
+    {
+      strv = g_variant_get_strv (value, NULL);
+      for (n = 0; strv[n] != NULL; n++)
+        strv[n] = g_intern_string (strv[n]);
+      g_variant_unref (value);
+    }
+
+  return strv;
+}
+
+
+
+/* Stores the fields read from the desktop file of @item in a floating
+ * GVariant of type _POJK_MENU_ITEM_VARIANT_TYPE, so that the item can be
+ * recreated by _pojk_menu_item_deserialize() without reading the file.
+ * Fields a lazily loaded item did not read yet are stored empty, together
+ * with what was read, so storing the item does not load them */
+GVariant *
+_pojk_menu_item_serialize (PojkMenuItem *item)
+{
+  PojkMenuItemAction *action;
+  GVariantBuilder       builder;
+  GVariantBuilder       actions;
+  GVariant             *variant;
+  gchar                *uri;
+  guint                 n;
+
+  g_return_val_if_fail (POJK_IS_MENU_ITEM (item), NULL);
+
+  uri = g_file_get_uri (item->priv->file);
+
+  /* Don't let another thread load the remaining fields halfway through */
+  G_LOCK (materialize);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE (_POJK_MENU_ITEM_VARIANT_TYPE));
+  g_variant_builder_add (&builder, "s", uri);
+  g_variant_builder_add (&builder, "ms", item->priv->desktop_id);
+  g_variant_builder_add (&builder, "ms", pojk_menu_item_get_string (item, STRING_NAME));
+  g_variant_builder_add (&builder, "ms", pojk_menu_item_get_string (item, STRING_GENERIC_NAME));
+  g_variant_builder_add (&builder, "ms", pojk_menu_item_get_string (item, STRING_COMMENT));
+  g_variant_builder_add (&builder, "ms", pojk_menu_item_get_string (item, STRING_COMMAND));
+  g_variant_builder_add (&builder, "ms", pojk_menu_item_get_string (item, STRING_TRY_EXEC));
+  g_variant_builder_add (&builder, "ms", pojk_menu_item_get_string (item, STRING_ICON_NAME));
+  g_variant_builder_add (&builder, "ms", pojk_menu_item_get_string (item, STRING_PATH));
+  g_variant_builder_add (&builder, "b", (gboolean) item->priv->requires_terminal);
+  g_variant_builder_add (&builder, "b", (gboolean) item->priv->no_display);
+  g_variant_builder_add (&builder, "b", (gboolean) item->priv->supports_startup_notification);
+  g_variant_builder_add (&builder, "b", (gboolean) item->priv->hidden);
+  g_variant_builder_add (&builder, "b", (gboolean) g_atomic_int_get (&item->priv->materialized));
+  g_variant_builder_add (&builder, "b", (gboolean) g_atomic_int_get (&item->priv->actions_loaded));
+  g_variant_builder_add_value (&builder, pojk_menu_item_list_to_variant (item->priv->categories));
+  g_variant_builder_add_value (&builder, pojk_menu_item_list_to_variant (item->priv->keywords));
+  g_variant_builder_add_value (&builder, pojk_menu_item_strv_to_variant (item->priv->only_show_in));
+  g_variant_builder_add_value (&builder, pojk_menu_item_strv_to_variant (item->priv->not_show_in));
+
+  g_variant_builder_init (&actions, G_VARIANT_TYPE ("a(msmsms)"));
+  for (n = 0; item->priv->actions != NULL && n < item->priv->actions->len; n++)
+    {
+      action = g_ptr_array_index (item->priv->actions, n);
+      g_variant_builder_add (&actions, "(msmsms)",
+                             pojk_menu_item_action_get_name (action),
+                             pojk_menu_item_action_get_command (action),
+                             pojk_menu_item_action_get_icon_name (action));
+    }
+  g_variant_builder_add_value (&builder, g_variant_builder_end (&actions));
+  variant = g_variant_builder_end (&builder);
+
+  G_UNLOCK (materialize);
+
+  g_free (uri);
+
+  return variant;
+}
+
+
+
+/* Recreates an item from the output of _pojk_menu_item_serialize(). Only
+ * the values stored in the variant are copied; fields that were not loaded
+ * when the item was stored are read from its file on first use. Returns
+ * NULL if the stored item lacks a name or command */
+PojkMenuItem *
+_pojk_menu_item_deserialize (GVariant *variant)
+{
+  PojkMenuItem       *item;
+  PojkMenuItemAction *action;
+  GVariantIter          iter;
+  GVariant             *categories;
+  GVariant             *keywords;
+  GVariant             *only_show_in;
+  GVariant             *not_show_in;
+  GVariant             *actions;
+  GFile                *file;
+  const gchar          *uri;
+  const gchar          *desktop_id;
+  const gchar          *values[N_STRINGS];
+  const gchar          *name;
+  const gchar          *command;
+  const gchar          *icon;
+  gboolean              terminal;
+  gboolean              no_display;
+  gboolean              startup_notify;
+  gboolean              hidden;
+  gboolean              materialized;
+  gboolean              actions_loaded;
+
+  g_return_val_if_fail (variant != NULL, NULL);
+  g_return_val_if_fail (g_variant_is_of_type (variant, G_VARIANT_TYPE (_POJK_MENU_ITEM_VARIANT_TYPE)), NULL);
+
+  g_variant_get (variant, "(&sm&sm&sm&sm&sm&sm&sm&sm&sbbbbbb@as@as@mas@mas@a(msmsms))",
+                 &uri, &desktop_id, &values[STRING_NAME], &values[STRING_GENERIC_NAME],
+                 &values[STRING_COMMENT], &values[STRING_COMMAND], &values[STRING_TRY_EXEC],
+                 &values[STRING_ICON_NAME], &values[STRING_PATH], &terminal, &no_display, &startup_notify,
+                 &hidden, &materialized, &actions_loaded, &categories, &keywords, &only_show_in,
+                 &not_show_in, &actions);
+
+  /* Items without name or command are never loaded, so don't restore them either */
+  if (G_UNLIKELY (materialized && (values[STRING_NAME] == NULL || values[STRING_COMMAND] == NULL)))
+    {
+      item = NULL;
+    }
+  else
+    {
+      file = g_file_new_for_uri (uri);
+      item = pojk_menu_item_alloc (file);
+      g_object_unref (file);
+
+      item->priv->requires_terminal = terminal;
+      item->priv->no_display = no_display;
+      item->priv->supports_startup_notification = startup_notify;
+      item->priv->hidden = hidden;
+      item->priv->desktop_id = g_strdup (desktop_id);
+      item->priv->materialized = materialized;
+      item->priv->actions_loaded = actions_loaded;
+
+      pojk_menu_item_set_strings (item, values);
+
+      item->priv->categories = pojk_menu_item_list_from_variant (categories, TRUE);
+      item->priv->category_set = _pojk_category_set_new (item->priv->categories);
+      item->priv->keywords = pojk_menu_item_list_from_variant (keywords, FALSE);
+      item->priv->only_show_in = pojk_menu_item_strv_from_variant (only_show_in);
+      item->priv->not_show_in = pojk_menu_item_strv_from_variant (not_show_in);
+
+      g_variant_iter_init (&iter, actions);
+      while (g_variant_iter_next (&iter, "(m&sm&sm&s)", &name, &command, &icon))
+        {
+          if (G_LIKELY (name != NULL && command != NULL))
+            {
+              action = _pojk_menu_item_action_new_take (g_strdup (name),
+                                                        g_strdup (command),
+                                                        g_strdup (icon));
+
+              pojk_menu_item_set_action (item, name, action);
+              pojk_menu_item_action_unref (action);
+            }
+        }
+    }
+
+  g_variant_unref (categories);
+  g_variant_unref (keywords);
+  g_variant_unref (only_show_in);
+  g_variant_unref (not_show_in);
+  g_variant_unref (actions);
+
+  return item;
 }
@@ -88,6 +88,10 @@ const gchar          *pojk_menu_item_get_desktop_id                    (PojkMenu
 void                  pojk_menu_item_set_desktop_id                    (PojkMenuItem  *item,
                                                                           const gchar     *desktop_id);
 
+/* The strings returned by the getters below stay valid until the item
+ * is changed or reloaded twice, so copy them to keep them for longer.
+ * Loading the remaining fields of a lazily loaded item counts as one
+ * change */
 const gchar          *pojk_menu_item_get_command                       (PojkMenuItem  *item);
 void                  pojk_menu_item_set_command                       (PojkMenuItem  *item,
                                                                           const gchar     *command);
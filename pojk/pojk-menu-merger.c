@@ -405,7 +405,7 @@ pojk_menu_merger_insert_default_dirs (GNode *parent,
       kde_data_dir = g_build_filename (kde_dir, "share", base_name, NULL);
 
       /* Add it as a directory dir */
-      node = g_node_new (pojk_menu_node_create (type, kde_data_dir));
+      node = g_node_new (_pojk_menu_tree_node_new (NULL, type, kde_data_dir));
       prev_node = g_node_insert_after (parent, prev_node, node);
 
       /* Free the KDE data dir */
@@ -419,14 +419,14 @@ pojk_menu_merger_insert_default_dirs (GNode *parent,
   for (i = 0; dirs[i] != NULL; i++)
     {
       path = g_build_path (G_DIR_SEPARATOR_S, dirs[i], base_name, NULL);
-      node = g_node_new (pojk_menu_node_create (type, path));
+      node = g_node_new (_pojk_menu_tree_node_new (NULL, type, path));
       g_node_insert_after (parent, prev_node, node);
       g_free (path);
     }
 
   /* Append user data dir */
   path = g_build_path (G_DIR_SEPARATOR_S, g_get_user_data_dir (), base_name, NULL);
-  node = g_node_new (pojk_menu_node_create (type, path));
+  node = g_node_new (_pojk_menu_tree_node_new (NULL, type, path));
   prev_node = g_node_append (parent, node);
   g_free (path);
 }
@@ -466,7 +466,7 @@ pojk_menu_merger_insert_default_merge_dirs (GNode       *parent,
     {
       path = g_build_path (G_DIR_SEPARATOR_S, dirs[i], "menus", 
                            merge_dir_basename, NULL);
-      node = g_node_new (pojk_menu_node_create (POJK_MENU_NODE_TYPE_MERGE_DIR, path));
+      node = g_node_new (_pojk_menu_tree_node_new (NULL, POJK_MENU_NODE_TYPE_MERGE_DIR, path));
       g_node_insert_after (parent, prev_node, node);
       g_free (path);
     }
@@ -474,7 +474,7 @@ pojk_menu_merger_insert_default_merge_dirs (GNode       *parent,
   /* Append user config dir */
   path = g_build_path (G_DIR_SEPARATOR_S, g_get_user_config_dir (), "menus",
                        merge_dir_basename, NULL);
-  node = g_node_new (pojk_menu_node_create (POJK_MENU_NODE_TYPE_MERGE_DIR, path));
+  node = g_node_new (_pojk_menu_tree_node_new (NULL, POJK_MENU_NODE_TYPE_MERGE_DIR, path));
   prev_node = g_node_append (parent, node);
   g_free (path);
 }
@@ -624,8 +624,8 @@ pojk_menu_merger_resolve_relative_paths (GNode                   *node,
                       pojk_menu_node_tree_free_data (node);
 
                       /* Replace it with a MergeFile type="path" element */
-                      node->data = pojk_menu_node_create (POJK_MENU_NODE_TYPE_MERGE_FILE,
-                                                            GUINT_TO_POINTER (POJK_MENU_MERGE_FILE_PATH));
+                      node->data = _pojk_menu_tree_node_new (NULL, POJK_MENU_NODE_TYPE_MERGE_FILE,
+                                                               GUINT_TO_POINTER (POJK_MENU_MERGE_FILE_PATH));
                       pojk_menu_node_tree_set_merge_file_filename (node, absolute_path);
                       break;
                     }
@@ -824,8 +824,8 @@ pojk_menu_merger_resolve_merge_dirs (GNode                   *node,
 
           if (G_LIKELY (g_str_has_suffix (g_file_info_get_name (file_info), ".menu")))
             {
-              file_node = g_node_new (pojk_menu_node_create (POJK_MENU_NODE_TYPE_MERGE_FILE,
-                                                               POJK_MENU_MERGE_FILE_PATH));
+              file_node = g_node_new (_pojk_menu_tree_node_new (NULL, POJK_MENU_NODE_TYPE_MERGE_FILE,
+                                                                  GUINT_TO_POINTER (POJK_MENU_MERGE_FILE_PATH)));
 
               file = g_file_resolve_relative_path (dir, g_file_info_get_name (file_info));
               uri = g_file_get_uri (file);
@@ -953,10 +953,10 @@ static void
 pojk_menu_merger_clean_up_elements (GNode             *node,
                                       PojkMenuNodeType type)
 {
-  PojkMenuNode *node_;
-  GNode          *child;
-  GNode          *remaining_node = NULL;
-  GList          *destroy_list = NULL;
+  PojkMenuTreeNode *node_;
+  GNode            *child;
+  GNode            *remaining_node = NULL;
+  GList            *destroy_list = NULL;
 
   for (child = g_node_last_child (node); child != NULL; child = g_node_prev_sibling (child))
     {
@@ -1014,11 +1014,11 @@ pojk_menu_merger_clean_up_elements (GNode             *node,
       /* FIXME Fix empty <DefaultLayout> elements created due to a bug in
        * alacarte. See http://bugzilla.xfce.org/show_bug.cgi?id=6882#c2
        * for more information */
-      node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_MERGE, 
-                                       GUINT_TO_POINTER (POJK_MENU_LAYOUT_MERGE_MENUS));
+      node_ = _pojk_menu_tree_node_new (NULL, POJK_MENU_NODE_TYPE_MERGE,
+                                          GUINT_TO_POINTER (POJK_MENU_LAYOUT_MERGE_MENUS));
       g_node_append_data (remaining_node, node_);
-      node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_MERGE, 
-                                       GUINT_TO_POINTER (POJK_MENU_LAYOUT_MERGE_FILES));
+      node_ = _pojk_menu_tree_node_new (NULL, POJK_MENU_NODE_TYPE_MERGE,
+                                          GUINT_TO_POINTER (POJK_MENU_LAYOUT_MERGE_FILES));
       g_node_append_data (remaining_node, node_);
     }
 }
@@ -1151,8 +1151,8 @@ pojk_menu_merger_create_menu (GNode  *node,
   if (G_LIKELY (child == NULL))
     {
       child = g_node_append_data (node, NULL);
-      g_node_append_data (child, pojk_menu_node_create (POJK_MENU_NODE_TYPE_NAME,
-                                                          path[position]));
+      g_node_append_data (child, _pojk_menu_tree_node_new (NULL, POJK_MENU_NODE_TYPE_NAME,
+                                                             path[position]));
     }
 
   if (G_LIKELY (position == depth))
@@ -1239,20 +1239,20 @@ pojk_menu_merger_resolve_moves (GNode *node)
 static void
 pojk_menu_merger_prepend_default_layout (GNode *node)
 {
-  PojkMenuNode *node_;
-  GNode        *layout;
+  PojkMenuTreeNode *node_;
+  GNode            *layout;
 
   if (pojk_menu_node_tree_get_node_type (node) == POJK_MENU_NODE_TYPE_MENU)
     {
-      node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_DEFAULT_LAYOUT, NULL);
+      node_ = _pojk_menu_tree_node_new (NULL, POJK_MENU_NODE_TYPE_DEFAULT_LAYOUT, NULL);
       layout = g_node_prepend_data (node, node_);
 
-      node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_MERGE,
-                                       GUINT_TO_POINTER (POJK_MENU_LAYOUT_MERGE_MENUS));
+      node_ = _pojk_menu_tree_node_new (NULL, POJK_MENU_NODE_TYPE_MERGE,
+                                          GUINT_TO_POINTER (POJK_MENU_LAYOUT_MERGE_MENUS));
       g_node_append_data (layout, node_);
 
-      node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_MERGE,
-                                       GUINT_TO_POINTER (POJK_MENU_LAYOUT_MERGE_FILES));
+      node_ = _pojk_menu_tree_node_new (NULL, POJK_MENU_NODE_TYPE_MERGE,
+                                          GUINT_TO_POINTER (POJK_MENU_LAYOUT_MERGE_FILES));
       g_node_append_data (layout, node_);
     }
 }
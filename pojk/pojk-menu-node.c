@@ -22,11 +22,16 @@
 #include <config.h>
 #endif
 
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
 #include <glib.h>
 #include <glib-object.h>
 
 #include <pojk/pojk-menu-item.h>
 #include <pojk/pojk-menu-node.h>
+#include <pojk/pojk-private.h>
 
 
 
@@ -39,16 +44,32 @@ enum
 
 
 
-static void pojk_menu_node_finalize     (GObject             *object);
-static void pojk_menu_node_get_property (GObject             *object,
-                                           guint                prop_id,
-                                           GValue              *value,
-                                           GParamSpec          *pspec);
-static void pojk_menu_node_set_property (GObject             *object,
-                                           guint                prop_id,
-                                           const GValue        *value,
-                                           GParamSpec          *pspec);
-static void pojk_menu_node_free_data    (PojkMenuNode      *node);
+/* Number of nodes in a slab chunk */
+#define POJK_MENU_NODE_CHUNK_SIZE 128
+
+
+
+typedef struct _PojkMenuNodeChunk PojkMenuNodeChunk;
+
+
+
+static void pojk_menu_node_finalize        (GObject          *object);
+static void pojk_menu_node_get_property    (GObject          *object,
+                                            guint             prop_id,
+                                            GValue           *value,
+                                            GParamSpec       *pspec);
+static void pojk_menu_node_set_property    (GObject          *object,
+                                            guint             prop_id,
+                                            const GValue     *value,
+                                            GParamSpec       *pspec);
+static void pojk_menu_tree_node_init       (PojkMenuTreeNode *node,
+                                            PojkMenuNodeType  node_type,
+                                            gconstpointer     value);
+static void pojk_menu_tree_node_copy_data  (PojkMenuTreeNode *copy,
+                                            PojkMenuTreeNode *node);
+static void pojk_menu_tree_node_free_data  (PojkMenuTreeNode *node);
+static void pojk_menu_tree_node_set_string (PojkMenuTreeNode *node,
+                                            const gchar      *value);
 
 
 
@@ -68,16 +89,57 @@ union _PojkMenuNodeData
   gchar                    *string;
 };
 
+/* The nodes of menu trees are plain structs, most of them allocated from
+ * the chunks of a slab. A GObject is only created for the nodes handed
+ * out through the PojkMenuNode API, but trees built by applications may
+ * hold PojkMenuNodes as well */
+struct _PojkMenuTreeNode
+{
+  /* Always &pojk_menu_tree_node_tag. It is where GObjects keep their
+   * class, so plain nodes and PojkMenuNodes can be told apart */
+  gconstpointer      tag;
+
+  PojkMenuNodeType   node_type;
+  PojkMenuNodeData   data;
+
+  /* Id of the category of Category nodes */
+  guint              category_id;
+
+  /* Categories of rule nodes whose children are all Category
+   * nodes, see _pojk_menu_node_tree_prepare_rule() */
+  PojkCategorySet   *category_mask;
+
+  /* Chunk the node was allocated from, or %NULL */
+  PojkMenuNodeChunk *chunk;
+};
+
 struct _PojkMenuNode
 {
-  GObject            __parent__;
+  GObject          __parent__;
+
+  PojkMenuTreeNode node;
+};
 
-  PojkMenuNodeType node_type;
-  PojkMenuNodeData data;
+/* A chunk is freed in one go once all of its nodes are freed. The slab
+ * holds a reference on the chunk it allocates from */
+struct _PojkMenuNodeChunk
+{
+  gint             ref_count;
+  guint            n_nodes;
+  PojkMenuTreeNode nodes[POJK_MENU_NODE_CHUNK_SIZE];
+};
+
+struct _PojkMenuNodeSlab
+{
+  PojkMenuNodeChunk *chunk;
 };
 
 
 
+static const gint pojk_menu_tree_node_tag;
+
+
+
 GType
 pojk_menu_node_type_get_type (void)
 {
@@ -156,6 +218,7 @@ pojk_menu_node_class_init (PojkMenuNodeClass *klass)
 static void
 pojk_menu_node_init (PojkMenuNode *node)
 {
+  node->node.tag = &pojk_menu_tree_node_tag;
 }
 
 
@@ -165,7 +228,7 @@ pojk_menu_node_finalize (GObject *object)
 {
   PojkMenuNode *node = POJK_MENU_NODE (object);
 
-  pojk_menu_node_free_data (node);
+  pojk_menu_tree_node_free_data (&node->node);
 
   (*G_OBJECT_CLASS (pojk_menu_node_parent_class)->finalize) (object);
 }
@@ -183,7 +246,7 @@ pojk_menu_node_get_property (GObject    *object,
   switch (prop_id)
     {
     case PROP_NODE_TYPE:
-      g_value_set_enum (value, node->node_type);
+      g_value_set_enum (value, node->node.node_type);
       break;
 
     default:
@@ -205,7 +268,7 @@ pojk_menu_node_set_property (GObject      *object,
   switch (prop_id)
     {
     case PROP_NODE_TYPE:
-      node->node_type = g_value_get_enum (value);
+      node->node.node_type = g_value_get_enum (value);
       g_object_notify (G_OBJECT (node), "node-type");
       break;
 
@@ -228,7 +291,7 @@ pojk_menu_node_new (PojkMenuNodeType node_type)
 PojkMenuNodeType pojk_menu_node_get_node_type (PojkMenuNode *node)
 {
   g_return_val_if_fail (POJK_IS_MENU_NODE (node), 0);
-  return node->node_type;
+  return node->node.node_type;
 }
 
 
@@ -241,6 +304,102 @@ pojk_menu_node_create (PojkMenuNodeType node_type,
   PojkMenuNode *node;
 
   node = pojk_menu_node_new (node_type);
+  pojk_menu_tree_node_init (&node->node, node_type, first_value);
+
+  return node;
+}
+
+
+
+PojkMenuNode *
+pojk_menu_node_copy (PojkMenuNode *node,
+                       gpointer        data)
+{
+  PojkMenuNode *copy;
+
+  if (node == NULL || !POJK_IS_MENU_NODE (node))
+    return NULL;
+
+  copy = pojk_menu_node_new (node->node.node_type);
+  pojk_menu_tree_node_copy_data (&copy->node, &node->node);
+
+  return copy;
+}
+
+
+
+const gchar *
+pojk_menu_node_get_string (PojkMenuNode *node)
+{
+  g_return_val_if_fail (POJK_IS_MENU_NODE (node), NULL);
+  return node->node.data.string;
+}
+
+
+
+void
+pojk_menu_node_set_string (PojkMenuNode *node,
+                             const gchar    *value)
+{
+  g_return_if_fail (POJK_IS_MENU_NODE (node));
+  g_return_if_fail (value != NULL);
+
+  pojk_menu_tree_node_set_string (&node->node, value);
+}
+
+
+
+PojkMenuMergeFileType
+pojk_menu_node_get_merge_file_type (PojkMenuNode *node)
+{
+  g_return_val_if_fail (POJK_IS_MENU_NODE (node), 0);
+  g_return_val_if_fail (node->node.node_type == POJK_MENU_NODE_TYPE_MERGE_FILE, 0);
+  return node->node.data.merge_file.type;
+}
+
+
+
+void
+pojk_menu_node_set_merge_file_type (PojkMenuNode         *node,
+                                      PojkMenuMergeFileType type)
+{
+  g_return_if_fail (POJK_IS_MENU_NODE (node));
+  g_return_if_fail (node->node.node_type == POJK_MENU_NODE_TYPE_MERGE_FILE);
+  node->node.data.merge_file.type = type;
+}
+
+
+
+const gchar *
+pojk_menu_node_get_merge_file_filename (PojkMenuNode *node)
+{
+  g_return_val_if_fail (POJK_IS_MENU_NODE (node), NULL);
+  g_return_val_if_fail (node->node.node_type == POJK_MENU_NODE_TYPE_MERGE_FILE, NULL);
+  return node->node.data.merge_file.filename;
+}
+
+
+
+void
+pojk_menu_node_set_merge_file_filename (PojkMenuNode *node,
+                                          const gchar    *filename)
+{
+  g_return_if_fail (POJK_IS_MENU_NODE (node));
+  g_return_if_fail (filename != NULL);
+  g_return_if_fail (node->node.node_type == POJK_MENU_NODE_TYPE_MERGE_FILE);
+
+  g_free (node->node.data.merge_file.filename);
+  node->node.data.merge_file.filename = g_strdup (filename);
+}
+
+
+
+static void
+pojk_menu_tree_node_init (PojkMenuTreeNode *node,
+                          PojkMenuNodeType  node_type,
+                          gconstpointer     value)
+{
+  node->node_type = node_type;
 
   switch (node_type)
     {
@@ -249,51 +408,47 @@ pojk_menu_node_create (PojkMenuNodeType node_type,
     case POJK_MENU_NODE_TYPE_DIRECTORY_DIR:
     case POJK_MENU_NODE_TYPE_APP_DIR:
     case POJK_MENU_NODE_TYPE_FILENAME:
-    case POJK_MENU_NODE_TYPE_CATEGORY:
     case POJK_MENU_NODE_TYPE_OLD:
     case POJK_MENU_NODE_TYPE_NEW:
     case POJK_MENU_NODE_TYPE_MENUNAME:
     case POJK_MENU_NODE_TYPE_MERGE_DIR:
-      node->data.string = g_strdup (first_value);
+      node->data.string = g_strdup (value);
+      break;
+
+    case POJK_MENU_NODE_TYPE_CATEGORY:
+      /* Interned like the categories of the items, so that matching
+       * only compares pointers */
+      node->data.string = (gchar *) g_intern_string (value);
+      node->category_id = _pojk_category_get_id (node->data.string);
       break;
 
     case POJK_MENU_NODE_TYPE_MERGE:
-      node->data.layout_merge_type = GPOINTER_TO_UINT (first_value);
+      node->data.layout_merge_type = GPOINTER_TO_UINT (value);
       break;
 
     case POJK_MENU_NODE_TYPE_MERGE_FILE:
-      node->data.merge_file.type = GPOINTER_TO_UINT (first_value);
+      node->data.merge_file.type = GPOINTER_TO_UINT (value);
       node->data.merge_file.filename = NULL;
       break;
 
     default:
       break;
     }
-
-  return node;
 }
 
 
 
-PojkMenuNode *
-pojk_menu_node_copy (PojkMenuNode *node,
-                       gpointer        data)
+static void
+pojk_menu_tree_node_copy_data (PojkMenuTreeNode *copy,
+                               PojkMenuTreeNode *node)
 {
-  PojkMenuNode *copy;
-
-  if (node == NULL || !POJK_IS_MENU_NODE (node))
-    return NULL;
-
-  copy = pojk_menu_node_new (node->node_type);
-
-  switch (copy->node_type)
+  switch (node->node_type)
     {
     case POJK_MENU_NODE_TYPE_NAME:
     case POJK_MENU_NODE_TYPE_DIRECTORY:
     case POJK_MENU_NODE_TYPE_DIRECTORY_DIR:
     case POJK_MENU_NODE_TYPE_APP_DIR:
     case POJK_MENU_NODE_TYPE_FILENAME:
-    case POJK_MENU_NODE_TYPE_CATEGORY:
     case POJK_MENU_NODE_TYPE_OLD:
     case POJK_MENU_NODE_TYPE_NEW:
     case POJK_MENU_NODE_TYPE_MENUNAME:
@@ -301,6 +456,11 @@ pojk_menu_node_copy (PojkMenuNode *node,
       copy->data.string = g_strdup (node->data.string);
       break;
 
+    case POJK_MENU_NODE_TYPE_CATEGORY:
+      copy->data.string = node->data.string;
+      copy->category_id = node->category_id;
+      break;
+
     case POJK_MENU_NODE_TYPE_MERGE:
       copy->data.layout_merge_type = node->data.layout_merge_type;
       break;
@@ -313,17 +473,13 @@ pojk_menu_node_copy (PojkMenuNode *node,
     default:
       break;
     }
-
-  return copy;
 }
 
 
 
 static void
-pojk_menu_node_free_data (PojkMenuNode *node)
+pojk_menu_tree_node_free_data (PojkMenuTreeNode *node)
 {
-  g_return_if_fail (POJK_IS_MENU_NODE (node));
-
   switch (node->node_type)
     {
     case POJK_MENU_NODE_TYPE_NAME:
@@ -331,7 +487,6 @@ pojk_menu_node_free_data (PojkMenuNode *node)
     case POJK_MENU_NODE_TYPE_DIRECTORY_DIR:
     case POJK_MENU_NODE_TYPE_APP_DIR:
     case POJK_MENU_NODE_TYPE_FILENAME:
-    case POJK_MENU_NODE_TYPE_CATEGORY:
     case POJK_MENU_NODE_TYPE_OLD:
     case POJK_MENU_NODE_TYPE_NEW:
     case POJK_MENU_NODE_TYPE_MENUNAME:
@@ -346,73 +501,152 @@ pojk_menu_node_free_data (PojkMenuNode *node)
     default:
       break;
     }
+
+  _pojk_category_set_free (node->category_mask);
 }
 
 
 
-const gchar *
-pojk_menu_node_get_string (PojkMenuNode *node)
+static void
+pojk_menu_tree_node_set_string (PojkMenuTreeNode *node,
+                                const gchar      *value)
 {
-  g_return_val_if_fail (POJK_IS_MENU_NODE (node), NULL);
-  return node->data.string;
+  if (node->node_type == POJK_MENU_NODE_TYPE_CATEGORY)
+    {
+      node->data.string = (gchar *) g_intern_string (value);
+      node->category_id = _pojk_category_get_id (node->data.string);
+    }
+  else
+    {
+      g_free (node->data.string);
+      node->data.string = g_strdup (value);
+    }
+}
+
+
+
+PojkMenuNodeSlab *
+_pojk_menu_node_slab_new (void)
+{
+  return g_slice_new0 (PojkMenuNodeSlab);
 }
 
 
 
 void
-pojk_menu_node_set_string (PojkMenuNode *node,
-                             const gchar    *value)
+_pojk_menu_node_slab_free (PojkMenuNodeSlab *slab)
 {
-  g_return_if_fail (POJK_IS_MENU_NODE (node));
-  g_return_if_fail (value != NULL);
+  if (slab == NULL)
+    return;
+
+  if (slab->chunk != NULL && g_atomic_int_dec_and_test (&slab->chunk->ref_count))
+    g_free (slab->chunk);
 
-  g_free (node->data.string);
-  node->data.string = g_strdup (value);
+  g_slice_free (PojkMenuNodeSlab, slab);
 }
 
 
 
-PojkMenuMergeFileType
-pojk_menu_node_get_merge_file_type (PojkMenuNode *node)
+static PojkMenuTreeNode *
+pojk_menu_tree_node_alloc (PojkMenuNodeSlab *slab)
 {
-  g_return_val_if_fail (POJK_IS_MENU_NODE (node), 0);
-  g_return_val_if_fail (node->node_type == POJK_MENU_NODE_TYPE_MERGE_FILE, 0);
-  return node->data.merge_file.type;
+  PojkMenuTreeNode *node;
+
+  /* Nodes that do not belong to a tree being built */
+  if (slab == NULL)
+    {
+      node = g_slice_new0 (PojkMenuTreeNode);
+      node->tag = &pojk_menu_tree_node_tag;
+      return node;
+    }
+
+  if (slab->chunk == NULL || slab->chunk->n_nodes == POJK_MENU_NODE_CHUNK_SIZE)
+    {
+      if (slab->chunk != NULL && g_atomic_int_dec_and_test (&slab->chunk->ref_count))
+        g_free (slab->chunk);
+
+      slab->chunk = g_new (PojkMenuNodeChunk, 1);
+      slab->chunk->ref_count = 1;
+      slab->chunk->n_nodes = 0;
+    }
+
+  node = &slab->chunk->nodes[slab->chunk->n_nodes++];
+  memset (node, 0, sizeof (*node));
+  node->tag = &pojk_menu_tree_node_tag;
+  node->chunk = slab->chunk;
+  g_atomic_int_inc (&slab->chunk->ref_count);
+
+  return node;
 }
 
 
 
-void
-pojk_menu_node_set_merge_file_type (PojkMenuNode         *node,
-                                      PojkMenuMergeFileType type)
+/* Returns a new node for a menu tree, allocated from @slab if it is not
+ * %NULL. The node is freed with pojk_menu_node_tree_free_data() */
+PojkMenuTreeNode *
+_pojk_menu_tree_node_new (PojkMenuNodeSlab *slab,
+                          PojkMenuNodeType  node_type,
+                          gconstpointer     value)
 {
-  g_return_if_fail (POJK_IS_MENU_NODE (node));
-  g_return_if_fail (node->node_type == POJK_MENU_NODE_TYPE_MERGE_FILE);
-  node->data.merge_file.type = type;
+  PojkMenuTreeNode *node;
+
+  node = pojk_menu_tree_node_alloc (slab);
+  pojk_menu_tree_node_init (node, node_type, value);
+
+  return node;
 }
 
 
 
-const gchar *
-pojk_menu_node_get_merge_file_filename (PojkMenuNode *node)
+static PojkMenuTreeNode *
+pojk_menu_tree_node_copy (PojkMenuTreeNode *node,
+                          PojkMenuNodeSlab *slab)
 {
-  g_return_val_if_fail (POJK_IS_MENU_NODE (node), NULL);
-  g_return_val_if_fail (node->node_type == POJK_MENU_NODE_TYPE_MERGE_FILE, NULL);
-  return node->data.merge_file.filename;
+  PojkMenuTreeNode *copy;
+
+  if (node == NULL)
+    return NULL;
+
+  copy = pojk_menu_tree_node_alloc (slab);
+  copy->node_type = node->node_type;
+  pojk_menu_tree_node_copy_data (copy, node);
+
+  return copy;
 }
 
 
 
-void
-pojk_menu_node_set_merge_file_filename (PojkMenuNode *node,
-                                          const gchar    *filename)
+/* Returns the node stored in @tree, which is either a plain node or a
+ * PojkMenuNode, or %NULL for the root of trees without data */
+static PojkMenuTreeNode *
+pojk_menu_tree_node_get (GNode *tree)
 {
-  g_return_if_fail (POJK_IS_MENU_NODE (node));
-  g_return_if_fail (filename != NULL);
-  g_return_if_fail (node->node_type == POJK_MENU_NODE_TYPE_MERGE_FILE);
+  PojkMenuTreeNode *node;
 
-  g_free (node->data.merge_file.filename);
-  node->data.merge_file.filename = g_strdup (filename);
+  if (tree == NULL || tree->data == NULL)
+    return NULL;
+
+  node = tree->data;
+  if (G_LIKELY (node->tag == &pojk_menu_tree_node_tag))
+    return node;
+
+  if (POJK_IS_MENU_NODE (tree->data))
+    return &POJK_MENU_NODE (tree->data)->node;
+
+  return NULL;
+}
+
+
+
+static void
+pojk_menu_tree_node_free (PojkMenuTreeNode *node)
+{
+  pojk_menu_tree_node_free_data (node);
+
+  if (node->chunk == NULL)
+    g_slice_free (PojkMenuTreeNode, node);
+  else if (g_atomic_int_dec_and_test (&node->chunk->ref_count))
+    g_free (node->chunk);
 }
 
 
@@ -615,25 +849,72 @@ pojk_menu_node_tree_get_string_child (GNode             *tree,
 
 
 
+/* Collects the categories of the children of rule nodes that only
+ * contain Category nodes, so that pojk_menu_node_tree_rule_matches()
+ * can test them all at once. Has to be called again if the rule is
+ * modified */
+void
+_pojk_menu_node_tree_prepare_rule (GNode *tree)
+{
+  PojkMenuTreeNode *node;
+  GNode            *child;
+  gboolean          only_categories = TRUE;
+
+  node = pojk_menu_tree_node_get (tree);
+  if (node == NULL)
+    return;
+
+  for (child = g_node_first_child (tree); child != NULL; child = g_node_next_sibling (child))
+    {
+      if (pojk_menu_node_tree_get_node_type (child) != POJK_MENU_NODE_TYPE_CATEGORY)
+        {
+          only_categories = FALSE;
+          _pojk_menu_node_tree_prepare_rule (child);
+        }
+    }
+
+  _pojk_category_set_free (node->category_mask);
+  node->category_mask = NULL;
+
+  if (only_categories)
+    {
+      for (child = g_node_first_child (tree); child != NULL; child = g_node_next_sibling (child))
+        _pojk_category_set_add (&node->category_mask,
+                                pojk_menu_tree_node_get (child)->category_id);
+    }
+}
+
+
+
 gboolean
 pojk_menu_node_tree_rule_matches (GNode          *node,
                                     PojkMenuItem *item)
 {
-  GNode   *child;
-  gboolean matches = FALSE;
-  gboolean child_matches = FALSE;
+  const PojkCategorySet *mask = NULL;
+  PojkMenuTreeNode      *data;
+  GNode                 *child;
+  gboolean               matches = FALSE;
+  gboolean               child_matches = FALSE;
+
+  data = pojk_menu_tree_node_get (node);
+  if (data != NULL)
+    mask = data->category_mask;
 
   switch (pojk_menu_node_tree_get_node_type (node))
     {
     case POJK_MENU_NODE_TYPE_CATEGORY:
-      matches = pojk_menu_item_has_category (item, pojk_menu_node_tree_get_string (node));
+      matches = _pojk_category_set_contains (_pojk_menu_item_get_category_set (item),
+                                             data->category_id);
       break;
 
     case POJK_MENU_NODE_TYPE_INCLUDE:
     case POJK_MENU_NODE_TYPE_EXCLUDE:
     case POJK_MENU_NODE_TYPE_OR:
-      for (child = g_node_first_child (node); child != NULL; child = g_node_next_sibling (child))
-        matches = matches || pojk_menu_node_tree_rule_matches (child, item);
+      if (mask != NULL)
+        matches = _pojk_category_set_intersects (_pojk_menu_item_get_category_set (item), mask);
+      else
+        for (child = g_node_first_child (node); child != NULL; child = g_node_next_sibling (child))
+          matches = matches || pojk_menu_node_tree_rule_matches (child, item);
       break;
 
     case POJK_MENU_NODE_TYPE_FILENAME:
@@ -643,13 +924,19 @@ pojk_menu_node_tree_rule_matches (GNode          *node,
 
     case POJK_MENU_NODE_TYPE_AND:
       matches = TRUE;
-      for (child = g_node_first_child (node); child != NULL; child = g_node_next_sibling (child))
-        matches = matches && pojk_menu_node_tree_rule_matches (child, item);
+      if (mask != NULL)
+        matches = _pojk_category_set_contains_all (_pojk_menu_item_get_category_set (item), mask);
+      else
+        for (child = g_node_first_child (node); child != NULL; child = g_node_next_sibling (child))
+          matches = matches && pojk_menu_node_tree_rule_matches (child, item);
       break;
 
     case POJK_MENU_NODE_TYPE_NOT:
-      for (child = g_node_first_child (node); child != NULL; child = g_node_next_sibling (child))
-        child_matches = child_matches || pojk_menu_node_tree_rule_matches (child, item);
+      if (mask != NULL)
+        child_matches = _pojk_category_set_intersects (_pojk_menu_item_get_category_set (item), mask);
+      else
+        for (child = g_node_first_child (node); child != NULL; child = g_node_next_sibling (child))
+          child_matches = child_matches || pojk_menu_node_tree_rule_matches (child, item);
       matches = !child_matches;
       break;
 
@@ -666,19 +953,481 @@ pojk_menu_node_tree_rule_matches (GNode          *node,
 
 
 
+/* Rules are compiled to a flat program for an accumulator machine. Every
+ * instruction except the jumps sets the accumulator, which holds the
+ * result of the last evaluated rule node. The children of Or and And
+ * nodes are joined by conditional jumps to the end of the node, so the
+ * remaining children are skipped once the result is known. Not nodes
+ * evaluate their children like an Or node and invert the result */
+
+typedef enum
+{
+  RULE_OP_TRUE,
+  RULE_OP_FALSE,
+  RULE_OP_NOT,
+  RULE_OP_CATEGORY,       /* operand: category id */
+  RULE_OP_CATEGORIES_ANY, /* operand: index of the category mask */
+  RULE_OP_CATEGORIES_ALL, /* operand: index of the category mask */
+  RULE_OP_FILENAME,       /* operand: index of the desktop id */
+  RULE_OP_JUMP_IF_TRUE,   /* operand: instruction to jump to */
+  RULE_OP_JUMP_IF_FALSE,  /* operand: instruction to jump to */
+} PojkMenuRuleOp;
+
+typedef struct
+{
+  guint32 op;
+  guint32 operand;
+} PojkMenuRuleInsn;
+
+struct _PojkMenuRuleProgram
+{
+  /* Whether the rule is an <Exclude> rule */
+  gboolean          exclude;
+
+  PojkMenuRuleInsn *insns;
+  guint             n_insns;
+
+  /* Operands of RULE_OP_CATEGORIES_* and RULE_OP_FILENAME */
+  PojkCategorySet **masks;
+  gchar           **filenames;
+
+  /* The rule the program was compiled from, and whether every result
+   * is compared to the one of pojk_menu_node_tree_rule_matches() */
+  GNode            *tree;
+  gboolean          check;
+};
+
+typedef struct
+{
+  GArray    *insns;
+  GPtrArray *masks;
+  GPtrArray *filenames;
+} PojkMenuRuleCompiler;
+
+
+
+static guint
+pojk_menu_rule_emit (PojkMenuRuleCompiler *compiler,
+                     PojkMenuRuleOp        op,
+                     guint                 operand)
+{
+  PojkMenuRuleInsn insn;
+
+  insn.op = op;
+  insn.operand = operand;
+  g_array_append_val (compiler->insns, insn);
+
+  return compiler->insns->len - 1;
+}
+
+
+
+static void pojk_menu_rule_compile_node (PojkMenuRuleCompiler *compiler,
+                                         GNode                *node);
+
+
+
+/* Compiles the children of @node, which are or'ed if @jump is
+ * RULE_OP_JUMP_IF_TRUE and and'ed if it is RULE_OP_JUMP_IF_FALSE */
+static void
+pojk_menu_rule_compile_children (PojkMenuRuleCompiler *compiler,
+                                 GNode                *node,
+                                 PojkMenuRuleOp        jump)
+{
+  PojkCategorySet *mask = NULL;
+  GArray          *jumps;
+  GNode           *child;
+  gboolean         only_categories = TRUE;
+  guint            n_children;
+  guint            n;
+
+  n_children = g_node_n_children (node);
+
+  /* Empty Or nodes match nothing, empty And nodes everything */
+  if (n_children == 0)
+    {
+      pojk_menu_rule_emit (compiler, jump == RULE_OP_JUMP_IF_TRUE ? RULE_OP_FALSE : RULE_OP_TRUE, 0);
+      return;
+    }
+
+  for (child = g_node_first_child (node); only_categories && child != NULL; child = g_node_next_sibling (child))
+    only_categories = (pojk_menu_node_tree_get_node_type (child) == POJK_MENU_NODE_TYPE_CATEGORY);
+
+  /* A single child needs no joining */
+  if (n_children == 1)
+    {
+      pojk_menu_rule_compile_node (compiler, g_node_first_child (node));
+    }
+  else if (only_categories)
+    {
+      /* Test all categories at once */
+      for (child = g_node_first_child (node); child != NULL; child = g_node_next_sibling (child))
+        _pojk_category_set_add (&mask, pojk_menu_tree_node_get (child)->category_id);
+
+      pojk_menu_rule_emit (compiler,
+                           jump == RULE_OP_JUMP_IF_TRUE ? RULE_OP_CATEGORIES_ANY : RULE_OP_CATEGORIES_ALL,
+                           compiler->masks->len);
+      g_ptr_array_add (compiler->masks, mask);
+    }
+  else
+    {
+      jumps = g_array_sized_new (FALSE, FALSE, sizeof (guint), n_children - 1);
+
+      for (child = g_node_first_child (node); child != NULL; child = g_node_next_sibling (child))
+        {
+          pojk_menu_rule_compile_node (compiler, child);
+
+          if (g_node_next_sibling (child) != NULL)
+            {
+              n = pojk_menu_rule_emit (compiler, jump, 0);
+              g_array_append_val (jumps, n);
+            }
+        }
+
+      /* All jumps go to the end of the node */
+      for (n = 0; n < jumps->len; n++)
+        g_array_index (compiler->insns, PojkMenuRuleInsn, g_array_index (jumps, guint, n)).operand =
+          compiler->insns->len;
+
+      g_array_free (jumps, TRUE);
+    }
+}
+
+
+
+static void
+pojk_menu_rule_compile_node (PojkMenuRuleCompiler *compiler,
+                             GNode                *node)
+{
+  switch (pojk_menu_node_tree_get_node_type (node))
+    {
+    case POJK_MENU_NODE_TYPE_CATEGORY:
+      pojk_menu_rule_emit (compiler, RULE_OP_CATEGORY, pojk_menu_tree_node_get (node)->category_id);
+      break;
+
+    case POJK_MENU_NODE_TYPE_FILENAME:
+      pojk_menu_rule_emit (compiler, RULE_OP_FILENAME, compiler->filenames->len);
+      g_ptr_array_add (compiler->filenames, g_strdup (pojk_menu_node_tree_get_string (node)));
+      break;
+
+    case POJK_MENU_NODE_TYPE_INCLUDE:
+    case POJK_MENU_NODE_TYPE_EXCLUDE:
+    case POJK_MENU_NODE_TYPE_OR:
+      pojk_menu_rule_compile_children (compiler, node, RULE_OP_JUMP_IF_TRUE);
+      break;
+
+    case POJK_MENU_NODE_TYPE_AND:
+      pojk_menu_rule_compile_children (compiler, node, RULE_OP_JUMP_IF_FALSE);
+      break;
+
+    case POJK_MENU_NODE_TYPE_NOT:
+      pojk_menu_rule_compile_children (compiler, node, RULE_OP_JUMP_IF_TRUE);
+      pojk_menu_rule_emit (compiler, RULE_OP_NOT, 0);
+      break;
+
+    case POJK_MENU_NODE_TYPE_ALL:
+      pojk_menu_rule_emit (compiler, RULE_OP_TRUE, 0);
+      break;
+
+    default:
+      pojk_menu_rule_emit (compiler, RULE_OP_FALSE, 0);
+      break;
+    }
+}
+
+
+
+/* Compiles the <Include> or <Exclude> rule @tree. The program matches
+ * the same items as pojk_menu_node_tree_rule_matches(), which is used
+ * instead to check every result if POJK_MENU_CHECK_RULES is set to 1.
+ * The item sets of _pojk_menu_node_tree_resolve_rule() are checked with
+ * _pojk_menu_rule_program_check_set() then.
+ * The program refers to @tree in that case, so it has to be freed with
+ * _pojk_menu_rule_program_free() before the tree */
+PojkMenuRuleProgram *
+_pojk_menu_node_tree_compile_rule (GNode *tree)
+{
+  PojkMenuRuleCompiler compiler;
+  PojkMenuRuleProgram *program;
+
+  g_return_val_if_fail (tree != NULL, NULL);
+
+  compiler.insns = g_array_new (FALSE, FALSE, sizeof (PojkMenuRuleInsn));
+  compiler.masks = g_ptr_array_new ();
+  compiler.filenames = g_ptr_array_new ();
+
+  pojk_menu_rule_compile_node (&compiler, tree);
+
+  g_ptr_array_add (compiler.masks, NULL);
+  g_ptr_array_add (compiler.filenames, NULL);
+
+  program = g_slice_new (PojkMenuRuleProgram);
+  program->exclude = (pojk_menu_node_tree_get_node_type (tree) == POJK_MENU_NODE_TYPE_EXCLUDE);
+  program->n_insns = compiler.insns->len;
+  program->insns = (PojkMenuRuleInsn *) g_array_free (compiler.insns, FALSE);
+  program->masks = (PojkCategorySet **) g_ptr_array_free (compiler.masks, FALSE);
+  program->filenames = (gchar **) g_ptr_array_free (compiler.filenames, FALSE);
+  program->tree = tree;
+  program->check = (g_strcmp0 (g_getenv ("POJK_MENU_CHECK_RULES"), "1") == 0);
+
+  return program;
+}
+
+
+
+void
+_pojk_menu_rule_program_free (PojkMenuRuleProgram *program)
+{
+  guint n;
+
+  if (program == NULL)
+    return;
+
+  for (n = 0; program->masks[n] != NULL; n++)
+    _pojk_category_set_free (program->masks[n]);
+
+  g_free (program->masks);
+  g_strfreev (program->filenames);
+  g_free (program->insns);
+  g_slice_free (PojkMenuRuleProgram, program);
+}
+
+
+
+gboolean
+_pojk_menu_rule_program_is_exclude (const PojkMenuRuleProgram *program)
+{
+  return program->exclude;
+}
+
+
+
+gboolean
+_pojk_menu_rule_program_matches (const PojkMenuRuleProgram *program,
+                                 PojkMenuItem              *item)
+{
+  const PojkMenuRuleInsn *insn;
+  const PojkCategorySet  *categories;
+  const gchar            *desktop_id = NULL;
+  gboolean                result = FALSE;
+  gboolean                reference;
+  guint                   pc = 0;
+
+  categories = _pojk_menu_item_get_category_set (item);
+
+  while (pc < program->n_insns)
+    {
+      insn = &program->insns[pc++];
+
+      switch (insn->op)
+        {
+        case RULE_OP_TRUE:
+          result = TRUE;
+          break;
+
+        case RULE_OP_FALSE:
+          result = FALSE;
+          break;
+
+        case RULE_OP_NOT:
+          result = !result;
+          break;
+
+        case RULE_OP_CATEGORY:
+          result = _pojk_category_set_contains (categories, insn->operand);
+          break;
+
+        case RULE_OP_CATEGORIES_ANY:
+          result = _pojk_category_set_intersects (categories, program->masks[insn->operand]);
+          break;
+
+        case RULE_OP_CATEGORIES_ALL:
+          result = _pojk_category_set_contains_all (categories, program->masks[insn->operand]);
+          break;
+
+        case RULE_OP_FILENAME:
+          if (desktop_id == NULL)
+            desktop_id = pojk_menu_item_get_desktop_id (item);
+          result = (g_strcmp0 (program->filenames[insn->operand], desktop_id) == 0);
+          break;
+
+        case RULE_OP_JUMP_IF_TRUE:
+          if (result)
+            pc = insn->operand;
+          break;
+
+        case RULE_OP_JUMP_IF_FALSE:
+          if (!result)
+            pc = insn->operand;
+          break;
+
+        default:
+          g_assert_not_reached ();
+        }
+    }
+
+  if (G_UNLIKELY (program->check))
+    {
+      reference = pojk_menu_node_tree_rule_matches (program->tree, item);
+      if (reference != result)
+        {
+          g_warning ("Compiled rule and rule tree disagree on \"%s\"",
+                     pojk_menu_item_get_desktop_id (item));
+          result = reference;
+        }
+    }
+
+  return result;
+}
+
+
+
+static GArray *
+pojk_menu_node_tree_resolve_children (GNode             *tree,
+                                      PojkMenuItemIndex *index,
+                                      gboolean           intersect)
+{
+  GArray *set = NULL;
+  GNode  *child;
+
+  for (child = g_node_first_child (tree); child != NULL; child = g_node_next_sibling (child))
+    {
+      if (set == NULL)
+        set = _pojk_menu_node_tree_resolve_rule (child, index);
+      else if (intersect)
+        set = _pojk_menu_item_set_intersect (set, _pojk_menu_node_tree_resolve_rule (child, index));
+      else
+        set = _pojk_menu_item_set_union (set, _pojk_menu_node_tree_resolve_rule (child, index));
+
+      /* Nothing left to intersect with */
+      if (intersect && set->len == 0)
+        break;
+    }
+
+  /* Empty Or nodes match nothing, empty And nodes everything */
+  if (set == NULL)
+    set = intersect ? _pojk_menu_item_index_get_all (index) : g_array_new (FALSE, FALSE, sizeof (guint));
+
+  return set;
+}
+
+
+
+/* Returns the ids of the items in @index that match the rule @tree, as
+ * the union, intersection or difference of the items of the Category
+ * and Filename nodes. This matches the same items as
+ * pojk_menu_node_tree_rule_matches() */
+GArray *
+_pojk_menu_node_tree_resolve_rule (GNode             *tree,
+                                   PojkMenuItemIndex *index)
+{
+  GArray *set;
+
+  g_return_val_if_fail (tree != NULL, NULL);
+  g_return_val_if_fail (index != NULL, NULL);
+
+  switch (pojk_menu_node_tree_get_node_type (tree))
+    {
+    case POJK_MENU_NODE_TYPE_CATEGORY:
+      set = _pojk_menu_item_index_get_category (index, pojk_menu_tree_node_get (tree)->category_id);
+      break;
+
+    case POJK_MENU_NODE_TYPE_FILENAME:
+      set = _pojk_menu_item_index_get_desktop_id (index, pojk_menu_node_tree_get_string (tree));
+      break;
+
+    case POJK_MENU_NODE_TYPE_INCLUDE:
+    case POJK_MENU_NODE_TYPE_EXCLUDE:
+    case POJK_MENU_NODE_TYPE_OR:
+      set = pojk_menu_node_tree_resolve_children (tree, index, FALSE);
+      break;
+
+    case POJK_MENU_NODE_TYPE_AND:
+      set = pojk_menu_node_tree_resolve_children (tree, index, TRUE);
+      break;
+
+    case POJK_MENU_NODE_TYPE_NOT:
+      set = _pojk_menu_item_set_subtract (_pojk_menu_item_index_get_all (index),
+                                          pojk_menu_node_tree_resolve_children (tree, index, FALSE));
+      break;
+
+    case POJK_MENU_NODE_TYPE_ALL:
+      set = _pojk_menu_item_index_get_all (index);
+      break;
+
+    default:
+      set = g_array_new (FALSE, FALSE, sizeof (guint));
+      break;
+    }
+
+  return set;
+}
+
+
+
+/* Checks @set, which _pojk_menu_node_tree_resolve_rule() returned for
+ * the rule of @program, and the program itself against
+ * pojk_menu_node_tree_rule_matches() for every item of @index. Does
+ * nothing unless POJK_MENU_CHECK_RULES was set to 1 when @program was
+ * compiled */
+void
+_pojk_menu_rule_program_check_set (const PojkMenuRuleProgram *program,
+                                   GArray                    *set,
+                                   PojkMenuItemIndex         *index)
+{
+  PojkMenuItem *item;
+  const gchar  *desktop_id;
+  gboolean      reference;
+  gboolean      in_set;
+  guint         n_items;
+  guint         id;
+  guint         j = 0;
+
+  if (G_LIKELY (!program->check))
+    return;
+
+  n_items = _pojk_menu_item_index_get_n_items (index);
+  for (id = 0; id < n_items; id++)
+    {
+      /* The set is in ascending order */
+      while (j < set->len && g_array_index (set, guint, j) < id)
+        j++;
+      in_set = (j < set->len && g_array_index (set, guint, j) == id);
+
+      item = _pojk_menu_item_index_get_item (index, id);
+      desktop_id = _pojk_menu_item_index_get_item_desktop_id (index, id);
+
+      /* The rule tree only knows the desktop id of the item, which is not
+       * the one of the entry if the item is reachable under several */
+      if (g_strcmp0 (desktop_id, pojk_menu_item_get_desktop_id (item)) != 0)
+        continue;
+
+      /* Warns by itself if the program disagrees with the tree */
+      reference = _pojk_menu_rule_program_matches (program, item);
+
+      if (in_set != reference)
+        g_warning ("Resolved rule and rule tree disagree on \"%s\"", desktop_id);
+    }
+}
 
 
 
 PojkMenuNodeType
 pojk_menu_node_tree_get_node_type (GNode *tree)
 {
+  PojkMenuTreeNode *node;
+
   if (tree == NULL)
     return POJK_MENU_NODE_TYPE_INVALID;
 
   if (tree->data == NULL)
     return POJK_MENU_NODE_TYPE_MENU;
 
-  return pojk_menu_node_get_node_type (tree->data);
+  node = pojk_menu_tree_node_get (tree);
+  if (G_UNLIKELY (node == NULL))
+    return POJK_MENU_NODE_TYPE_INVALID;
+
+  return node->node_type;
 }
 
 
@@ -686,10 +1435,13 @@ pojk_menu_node_tree_get_node_type (GNode *tree)
 const gchar *
 pojk_menu_node_tree_get_string (GNode *tree)
 {
-  if (tree == NULL || tree->data == NULL)
+  PojkMenuTreeNode *node;
+
+  node = pojk_menu_tree_node_get (tree);
+  if (node == NULL)
     return NULL;
   else
-    return pojk_menu_node_get_string (tree->data);
+    return node->data.string;
 }
 
 
@@ -713,7 +1465,9 @@ pojk_menu_node_tree_set_string (GNode       *tree,
                     type == POJK_MENU_NODE_TYPE_MENUNAME ||
                     type == POJK_MENU_NODE_TYPE_MERGE_DIR);
 
-  pojk_menu_node_set_string (tree->data, value);
+  g_return_if_fail (value != NULL);
+
+  pojk_menu_tree_node_set_string (pojk_menu_tree_node_get (tree), value);
 }
 
 
@@ -721,7 +1475,7 @@ PojkMenuLayoutMergeType
 pojk_menu_node_tree_get_layout_merge_type (GNode *tree)
 {
   g_return_val_if_fail (pojk_menu_node_tree_get_node_type (tree) == POJK_MENU_NODE_TYPE_MERGE, 0);
-  return ((PojkMenuNode *)tree->data)->data.layout_merge_type;
+  return pojk_menu_tree_node_get (tree)->data.layout_merge_type;
 }
 
 
@@ -730,7 +1484,7 @@ PojkMenuMergeFileType
 pojk_menu_node_tree_get_merge_file_type (GNode *tree)
 {
   g_return_val_if_fail (pojk_menu_node_tree_get_node_type (tree) == POJK_MENU_NODE_TYPE_MERGE_FILE, 0);
-  return pojk_menu_node_get_merge_file_type (tree->data);
+  return pojk_menu_tree_node_get (tree)->data.merge_file.type;
 }
 
 
@@ -739,7 +1493,7 @@ const gchar *
 pojk_menu_node_tree_get_merge_file_filename (GNode *tree)
 {
   g_return_val_if_fail (pojk_menu_node_tree_get_node_type (tree) == POJK_MENU_NODE_TYPE_MERGE_FILE, NULL);
-  return pojk_menu_node_get_merge_file_filename (tree->data);
+  return pojk_menu_tree_node_get (tree)->data.merge_file.filename;
 }
 
 
@@ -748,8 +1502,14 @@ void
 pojk_menu_node_tree_set_merge_file_filename (GNode       *tree,
                                                   const gchar *filename)
 {
+  PojkMenuTreeNode *node;
+
   g_return_if_fail (pojk_menu_node_tree_get_node_type (tree) == POJK_MENU_NODE_TYPE_MERGE_FILE);
-  pojk_menu_node_set_merge_file_filename (tree->data, filename);
+  g_return_if_fail (filename != NULL);
+
+  node = pojk_menu_tree_node_get (tree);
+  g_free (node->data.merge_file.filename);
+  node->data.merge_file.filename = g_strdup (filename);
 }
 
 
@@ -758,14 +1518,17 @@ gint
 pojk_menu_node_tree_compare (GNode *tree,
                                GNode *other_tree)
 {
-  PojkMenuNode *node;
-  PojkMenuNode *other_node;
+  PojkMenuTreeNode *node;
+  PojkMenuTreeNode *other_node;
 
   if (tree == NULL || other_tree == NULL)
     return 0;
 
-  node = tree->data;
-  other_node = other_tree->data;
+  node = pojk_menu_tree_node_get (tree);
+  other_node = pojk_menu_tree_node_get (other_tree);
+
+  if (node == NULL || other_node == NULL)
+    return 0;
 
   if (node->node_type != other_node->node_type)
     return 0;
@@ -800,10 +1563,36 @@ pojk_menu_node_tree_compare (GNode *tree,
 
 
 
+static gpointer
+copy_data (gconstpointer     data,
+           PojkMenuNodeSlab *slab)
+{
+  const PojkMenuTreeNode *node = data;
+
+  if (node == NULL)
+    return NULL;
+
+  if (G_LIKELY (node->tag == &pojk_menu_tree_node_tag))
+    return pojk_menu_tree_node_copy ((PojkMenuTreeNode *) node, slab);
+
+  return pojk_menu_node_copy ((gpointer) data, NULL);
+}
+
+
+
 GNode *
 pojk_menu_node_tree_copy (GNode *tree)
 {
-  return g_node_copy_deep (tree, (GCopyFunc) pojk_menu_node_copy, NULL);
+  PojkMenuNodeSlab *slab;
+  GNode            *copy;
+
+  /* The copy gets chunks of its own, so they are released together
+   * when the copy is freed */
+  slab = _pojk_menu_node_slab_new ();
+  copy = g_node_copy_deep (tree, (GCopyFunc) copy_data, slab);
+  _pojk_menu_node_slab_free (slab);
+
+  return copy;
 }
 
 
@@ -835,7 +1624,15 @@ pojk_menu_node_tree_free (GNode *tree)
 void
 pojk_menu_node_tree_free_data (GNode *tree)
 {
-  if (tree != NULL && tree->data != NULL)
+  PojkMenuTreeNode *node;
+
+  if (tree == NULL || tree->data == NULL)
+    return;
+
+  node = tree->data;
+  if (G_LIKELY (node->tag == &pojk_menu_tree_node_tag))
+    pojk_menu_tree_node_free (node);
+  else if (POJK_IS_MENU_NODE (tree->data))
     g_object_unref (tree->data);
 }
 
@@ -113,6 +113,9 @@ const gchar              *pojk_menu_node_get_merge_file_filename      (PojkMenuN
 void                      pojk_menu_node_set_merge_file_filename      (PojkMenuNode         *node,
                                                                          const gchar            *filename);
 
+/* The data of the nodes of trees built by pojk is private, use the
+ * functions below to access it. Trees built by applications may also
+ * hold PojkMenuNodes */
 GNode                    *pojk_menu_node_tree_get_child_node          (GNode                  *tree,
                                                                          PojkMenuNodeType      type,
                                                                          gboolean                reverse);
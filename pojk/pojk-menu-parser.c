@@ -31,6 +31,7 @@
 #include <pojk/pojk-menu-node.h>
 #include <pojk/pojk-menu-tree-provider.h>
 #include <pojk/pojk-menu-parser.h>
+#include <pojk/pojk-private.h>
 
 
 
@@ -71,6 +72,7 @@ struct _PojkMenuParserContext
   PojkMenuParserState    state;
   PojkMenuParser        *parser;
   GNode                   *node;
+  PojkMenuNodeSlab      *slab;
 };
 
 
@@ -294,6 +296,7 @@ pojk_menu_parser_run (PojkMenuParser *parser,
   parser_context.node_type = POJK_MENU_PARSER_NODE_TYPE_NONE;
   parser_context.state = POJK_MENU_PARSER_STATE_START;
   parser_context.node = NULL;
+  parser_context.slab = _pojk_menu_node_slab_new ();
 
   /* Create markup parse context */
   context = g_markup_parse_context_new (&markup_parser, 0, &parser_context, NULL);
@@ -306,6 +309,7 @@ pojk_menu_parser_run (PojkMenuParser *parser,
     }
 
   g_markup_parse_context_free (context);
+  _pojk_menu_node_slab_free (parser_context.slab);
   g_free (data);
 
   return result;
@@ -340,7 +344,7 @@ pojk_menu_parser_start_element (GMarkupParseContext *context,
                                   GError             **error)
 {
   PojkMenuParserContext *parser_context = (PojkMenuParserContext *)user_data;
-  PojkMenuNode          *node_;
+  PojkMenuTreeNode      *node_;
 
   switch (parser_context->state)
     {
@@ -365,7 +369,7 @@ pojk_menu_parser_start_element (GMarkupParseContext *context,
         parser_context->node_type = POJK_MENU_PARSER_NODE_TYPE_DIRECTORY_DIR;
       else if (g_str_equal (element_name, "DefaultDirectoryDirs"))
         {
-          node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_DEFAULT_DIRECTORY_DIRS, NULL);
+          node_ = _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_DEFAULT_DIRECTORY_DIRS, NULL);
           g_node_append_data (parser_context->node, node_);
         }
 
@@ -373,40 +377,40 @@ pojk_menu_parser_start_element (GMarkupParseContext *context,
         parser_context->node_type = POJK_MENU_PARSER_NODE_TYPE_APP_DIR;
       else if (g_str_equal (element_name, "DefaultAppDirs"))
         {
-          node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_DEFAULT_APP_DIRS, NULL);
+          node_ = _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_DEFAULT_APP_DIRS, NULL);
           g_node_append_data (parser_context->node, node_);
         }
 
       else if (g_str_equal (element_name, "Deleted"))
         {
-          node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_DELETED, NULL);
+          node_ = _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_DELETED, NULL);
           g_node_append_data (parser_context->node, node_);
         }
       else if (g_str_equal (element_name, "NotDeleted"))
         {
-          node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_NOT_DELETED, NULL);
+          node_ = _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_NOT_DELETED, NULL);
           g_node_append_data (parser_context->node, node_);
         }
       else if (g_str_equal (element_name, "OnlyUnallocated"))
         {
-          node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_ONLY_UNALLOCATED, NULL);
+          node_ = _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_ONLY_UNALLOCATED, NULL);
           g_node_append_data (parser_context->node, node_);
         }
       else if (g_str_equal (element_name, "NotOnlyUnallocated"))
         {
-          node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_NOT_ONLY_UNALLOCATED, NULL);
+          node_ = _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_NOT_ONLY_UNALLOCATED, NULL);
           g_node_append_data (parser_context->node, node_);
         }
 
       else if (g_str_equal (element_name, "Include"))
         {
-          node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_INCLUDE, NULL);
+          node_ = _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_INCLUDE, NULL);
           parser_context->node = g_node_append_data (parser_context->node, node_);
           parser_context->state = POJK_MENU_PARSER_STATE_RULE;
         }
       else if (g_str_equal (element_name, "Exclude"))
         {
-          node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_EXCLUDE, NULL);
+          node_ = _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_EXCLUDE, NULL);
           parser_context->node = g_node_append_data (parser_context->node, node_);
           parser_context->state = POJK_MENU_PARSER_STATE_RULE;
         }
@@ -419,7 +423,7 @@ pojk_menu_parser_start_element (GMarkupParseContext *context,
 
       else if (g_str_equal (element_name, "Move"))
         {
-          node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_MOVE, NULL);
+          node_ = _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_MOVE, NULL);
           parser_context->node = g_node_append_data (parser_context->node, node_);
           parser_context->state = POJK_MENU_PARSER_STATE_MOVE;
         }
@@ -427,13 +431,13 @@ pojk_menu_parser_start_element (GMarkupParseContext *context,
       else if (g_str_equal (element_name, "DefaultLayout"))
         {
           /* TODO Parse attributes */
-          node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_DEFAULT_LAYOUT, NULL);
+          node_ = _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_DEFAULT_LAYOUT, NULL);
           parser_context->node = g_node_append_data (parser_context->node, node_);
           parser_context->state = POJK_MENU_PARSER_STATE_LAYOUT;
         }
       else if (g_str_equal (element_name, "Layout"))
         {
-          node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_LAYOUT, NULL);
+          node_ = _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_LAYOUT, NULL);
           parser_context->node = g_node_append_data (parser_context->node, node_);
           parser_context->state = POJK_MENU_PARSER_STATE_LAYOUT;
         }
@@ -449,7 +453,7 @@ pojk_menu_parser_start_element (GMarkupParseContext *context,
                 type = POJK_MENU_MERGE_FILE_PARENT;
             }
 
-          node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_MERGE_FILE, GUINT_TO_POINTER (type));
+          node_ = _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_MERGE_FILE, GUINT_TO_POINTER (type));
           parser_context->node = g_node_append_data (parser_context->node, node_);
           parser_context->node_type = POJK_MENU_PARSER_NODE_TYPE_MERGE_FILE;
         }
@@ -457,7 +461,7 @@ pojk_menu_parser_start_element (GMarkupParseContext *context,
         parser_context->node_type = POJK_MENU_PARSER_NODE_TYPE_MERGE_DIR;
       else if (g_str_equal (element_name, "DefaultMergeDirs"))
         {
-          node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_DEFAULT_MERGE_DIRS, NULL);
+          node_ = _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_DEFAULT_MERGE_DIRS, NULL);
           g_node_append_data (parser_context->node, node_);
         }
       break;
@@ -465,7 +469,7 @@ pojk_menu_parser_start_element (GMarkupParseContext *context,
     case POJK_MENU_PARSER_STATE_RULE:
       if (g_str_equal (element_name, "All"))
         {
-          node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_ALL, NULL);
+          node_ = _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_ALL, NULL);
           g_node_append_data (parser_context->node, node_);
         }
       else if (g_str_equal (element_name, "Filename"))
@@ -474,17 +478,17 @@ pojk_menu_parser_start_element (GMarkupParseContext *context,
         parser_context->node_type = POJK_MENU_PARSER_NODE_TYPE_CATEGORY;
       else if (g_str_equal (element_name, "Or"))
         {
-          node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_OR, NULL);
+          node_ = _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_OR, NULL);
           parser_context->node = g_node_append_data (parser_context->node, node_);
         }
       else if (g_str_equal (element_name, "And"))
         {
-          node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_AND, NULL);
+          node_ = _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_AND, NULL);
           parser_context->node = g_node_append_data (parser_context->node, node_);
         }
       else if (g_str_equal (element_name, "Not"))
         {
-          node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_NOT, NULL);
+          node_ = _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_NOT, NULL);
           parser_context->node = g_node_append_data (parser_context->node, node_);
         }
       break;
@@ -506,7 +510,7 @@ pojk_menu_parser_start_element (GMarkupParseContext *context,
         }
       else if (g_str_equal (element_name, "Separator"))
         {
-          node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_SEPARATOR, NULL);
+          node_ = _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_SEPARATOR, NULL);
           g_node_append_data (parser_context->node, node_);
         }
       else if (g_str_equal (element_name, "Merge"))
@@ -522,7 +526,7 @@ pojk_menu_parser_start_element (GMarkupParseContext *context,
                 type = POJK_MENU_LAYOUT_MERGE_FILES;
             }
 
-          node_ = pojk_menu_node_create (POJK_MENU_NODE_TYPE_MERGE, GUINT_TO_POINTER (type));
+          node_ = _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_MERGE, GUINT_TO_POINTER (type));
           g_node_append_data (parser_context->node, node_);
         }
       break;
@@ -648,57 +652,57 @@ pojk_menu_parser_characters (GMarkupParseContext *context,
     {
     case POJK_MENU_PARSER_NODE_TYPE_NAME:
       g_node_append_data (parser_context->node,
-                          pojk_menu_node_create (POJK_MENU_NODE_TYPE_NAME, data));
+                          _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_NAME, data));
       break;
 
     case POJK_MENU_PARSER_NODE_TYPE_DIRECTORY:
       g_node_append_data (parser_context->node,
-                          pojk_menu_node_create (POJK_MENU_NODE_TYPE_DIRECTORY, data));
+                          _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_DIRECTORY, data));
       break;
 
     case POJK_MENU_PARSER_NODE_TYPE_DIRECTORY_DIR:
       g_node_append_data (parser_context->node,
-                          pojk_menu_node_create (POJK_MENU_NODE_TYPE_DIRECTORY_DIR, data));
+                          _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_DIRECTORY_DIR, data));
       break;
 
     case POJK_MENU_PARSER_NODE_TYPE_APP_DIR:
       g_node_append_data (parser_context->node,
-                          pojk_menu_node_create (POJK_MENU_NODE_TYPE_APP_DIR, data));
+                          _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_APP_DIR, data));
       break;
 
     case POJK_MENU_PARSER_NODE_TYPE_FILENAME:
       g_node_append_data (parser_context->node,
-                          pojk_menu_node_create (POJK_MENU_NODE_TYPE_FILENAME, data));
+                          _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_FILENAME, data));
       break;
 
     case POJK_MENU_PARSER_NODE_TYPE_CATEGORY:
       g_node_append_data (parser_context->node,
-                          pojk_menu_node_create (POJK_MENU_NODE_TYPE_CATEGORY, data));
+                          _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_CATEGORY, data));
       break;
 
     case POJK_MENU_PARSER_NODE_TYPE_OLD:
       g_node_append_data (parser_context->node,
-                          pojk_menu_node_create (POJK_MENU_NODE_TYPE_OLD, data));
+                          _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_OLD, data));
       break;
 
     case POJK_MENU_PARSER_NODE_TYPE_NEW:
       g_node_append_data (parser_context->node,
-                          pojk_menu_node_create (POJK_MENU_NODE_TYPE_NEW, data));
+                          _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_NEW, data));
       break;
 
     case POJK_MENU_PARSER_NODE_TYPE_MENUNAME:
       g_node_append_data (parser_context->node,
-                          pojk_menu_node_create (POJK_MENU_NODE_TYPE_MENUNAME, data));
+                          _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_MENUNAME, data));
       break;
 
     case POJK_MENU_PARSER_NODE_TYPE_MERGE_FILE:
       if (pojk_menu_node_tree_get_node_type (parser_context->node) == POJK_MENU_NODE_TYPE_MERGE_FILE)
-        pojk_menu_node_set_merge_file_filename (parser_context->node->data, data);
+        pojk_menu_node_tree_set_merge_file_filename (parser_context->node, data);
       break;
 
     case POJK_MENU_PARSER_NODE_TYPE_MERGE_DIR:
       g_node_append_data (parser_context->node,
-                          pojk_menu_node_create (POJK_MENU_NODE_TYPE_MERGE_DIR, data));
+                          _pojk_menu_tree_node_new (parser_context->slab, POJK_MENU_NODE_TYPE_MERGE_DIR, data));
       break;
 
     default:
@@ -0,0 +1,831 @@
+/* vi:set et ai sw=2 sts=2 ts=2: */
+/*-
+ * Copyright (c) 2026 The pojk developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include <pojk/pojk-menu-item.h>
+#include <pojk/pojk-menu-item-cache.h>
+#include <pojk/pojk-menu-item-pool.h>
+#include <pojk/pojk-menu-node.h>
+#include <pojk/pojk-menu-snapshot.h>
+#include <pojk/pojk-private.h>
+
+
+
+/* A snapshot stores everything pojk_menu_load() computes from the .menu
+ * files and the desktop entries: the merged menu tree, the merge files
+ * and directories to monitor, the parsed items, the items allocated to
+ * each menu and the desktop file used for each desktop id, which single
+ * changed desktop files are applied with. It is written to the user cache dir after a successful load
+ * and mapped read-only on the next load. It is only used if none of the
+ * menu and merge files or application directories (including their
+ * subdirectories) changed their modification time since it was written.
+ *
+ * .directory files are not part of the snapshot; they are few and are
+ * always resolved from disk. */
+
+
+
+/* Bump this whenever the layout below or the item layout changes */
+#define POJK_MENU_SNAPSHOT_VERSION 3
+
+/* Layout of the snapshot, the members are indexed by the enum below */
+#define POJK_MENU_SNAPSHOT_TYPE \
+  "(usa(sx)asasa(uuums)a" _POJK_MENU_ITEM_VARIANT_TYPE "a(uas)a{ss})"
+
+enum
+{
+  SNAPSHOT_VERSION,
+  SNAPSHOT_KEY,
+  SNAPSHOT_STAMPS,
+  SNAPSHOT_MERGE_FILES,
+  SNAPSHOT_MERGE_DIRS,
+  SNAPSHOT_NODES,
+  SNAPSHOT_ITEMS,
+  SNAPSHOT_MENUS,
+  SNAPSHOT_DESKTOP_FILES,
+};
+
+
+
+typedef struct
+{
+  GVariantBuilder *nodes;
+  GVariantBuilder *menus;
+  GHashTable      *memberships;
+  GHashTable      *items;
+  guint32          index;
+} PojkMenuSnapshotWriter;
+
+
+
+struct _PojkMenuSnapshot
+{
+  /* Mapped snapshot data */
+  GVariant *data;
+};
+
+
+
+static gchar *
+pojk_menu_snapshot_build_key (GFile *file)
+{
+  const gchar * const *dirs;
+  GString             *key;
+  gchar               *uri;
+
+  /* Everything that changes the outcome of the merge or the parsed
+   * (localized) item values has to be part of the key */
+  uri = g_file_get_uri (file);
+  key = g_string_new (uri);
+  g_free (uri);
+
+  g_string_append_printf (key, "\n%d\n%s\n%s\n%s", G_BYTE_ORDER,
+                          g_get_language_names ()[0],
+                          g_get_user_config_dir (),
+                          g_get_user_data_dir ());
+
+  for (dirs = g_get_system_config_dirs (); *dirs != NULL; ++dirs)
+    g_string_append_printf (key, ":%s", *dirs);
+
+  g_string_append_c (key, '\n');
+
+  for (dirs = g_get_system_data_dirs (); *dirs != NULL; ++dirs)
+    g_string_append_printf (key, ":%s", *dirs);
+
+  return g_string_free (key, FALSE);
+}
+
+
+
+static gchar *
+pojk_menu_snapshot_build_filename (const gchar *key)
+{
+  gchar *checksum;
+  gchar *basename;
+  gchar *filename;
+
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, key, -1);
+  basename = g_strconcat (checksum, ".snapshot", NULL);
+  filename = g_build_filename (g_get_user_cache_dir (), "pojk", basename, NULL);
+
+  g_free (basename);
+  g_free (checksum);
+
+  return filename;
+}
+
+
+
+static gint64
+pojk_menu_snapshot_get_stamp (const gchar *path)
+{
+  GStatBuf statb;
+
+  /* Missing files are recorded too, so that their creation is noticed */
+  if (g_stat (path, &statb) != 0)
+    return -1;
+
+  return _pojk_stat_get_mtime (&statb);
+}
+
+
+
+static gboolean
+pojk_menu_snapshot_add_stamp (GVariantBuilder *stamps,
+                              GHashTable      *seen,
+                              GFile           *file)
+{
+  gchar *path;
+
+  path = g_file_get_path (file);
+
+  /* Only local files can be validated by the snapshot */
+  if (G_UNLIKELY (path == NULL))
+    return FALSE;
+
+  if (g_hash_table_lookup (seen, path) == NULL)
+    {
+      g_variant_builder_add (stamps, "(sx)", path, pojk_menu_snapshot_get_stamp (path));
+      g_hash_table_insert (seen, path, GUINT_TO_POINTER (1));
+    }
+  else
+    g_free (path);
+
+  return TRUE;
+}
+
+
+
+static void
+pojk_menu_snapshot_add_dir_stamps (GVariantBuilder *stamps,
+                                   GHashTable      *seen,
+                                   const gchar     *path)
+{
+  const gchar *name;
+  GDir        *dir;
+  gchar       *child;
+
+  if (g_hash_table_lookup (seen, path) != NULL)
+    return;
+
+  g_variant_builder_add (stamps, "(sx)", path, pojk_menu_snapshot_get_stamp (path));
+  g_hash_table_insert (seen, g_strdup (path), GUINT_TO_POINTER (1));
+
+  /* Desktop-file ids are built from subdirectories, so those are
+   * recorded as well */
+  dir = g_dir_open (path, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      child = g_build_filename (path, name, NULL);
+
+      if (g_file_test (child, G_FILE_TEST_IS_DIR))
+        pojk_menu_snapshot_add_dir_stamps (stamps, seen, child);
+
+      g_free (child);
+    }
+
+  g_dir_close (dir);
+}
+
+
+
+static void
+pojk_menu_snapshot_write_item (const gchar            *desktop_id,
+                               PojkMenuItem           *item,
+                               PojkMenuSnapshotWriter *writer)
+{
+  g_variant_builder_add (writer->menus, "s", desktop_id);
+  g_hash_table_insert (writer->items, (gpointer) desktop_id, item);
+}
+
+
+
+static void
+pojk_menu_snapshot_write_node (PojkMenuSnapshotWriter *writer,
+                               GNode                  *node)
+{
+  PojkMenuItemPool *pool;
+  PojkMenuNodeType  type;
+  const gchar      *string = NULL;
+  guint32           value = 0;
+  GNode            *child;
+
+  type = pojk_menu_node_tree_get_node_type (node);
+
+  switch (type)
+    {
+    case POJK_MENU_NODE_TYPE_NAME:
+    case POJK_MENU_NODE_TYPE_DIRECTORY:
+    case POJK_MENU_NODE_TYPE_DIRECTORY_DIR:
+    case POJK_MENU_NODE_TYPE_APP_DIR:
+    case POJK_MENU_NODE_TYPE_FILENAME:
+    case POJK_MENU_NODE_TYPE_CATEGORY:
+    case POJK_MENU_NODE_TYPE_OLD:
+    case POJK_MENU_NODE_TYPE_NEW:
+    case POJK_MENU_NODE_TYPE_MENUNAME:
+    case POJK_MENU_NODE_TYPE_MERGE_DIR:
+      string = pojk_menu_node_tree_get_string (node);
+      break;
+
+    case POJK_MENU_NODE_TYPE_MERGE:
+      value = pojk_menu_node_tree_get_layout_merge_type (node);
+      break;
+
+    case POJK_MENU_NODE_TYPE_MERGE_FILE:
+      value = pojk_menu_node_tree_get_merge_file_type (node);
+      string = pojk_menu_node_tree_get_merge_file_filename (node);
+      break;
+
+    default:
+      break;
+    }
+
+  g_variant_builder_add (writer->nodes, "(uuums)", g_node_n_children (node),
+                         type, value, string);
+
+  /* Store the items of the menu this node belongs to */
+  if (type == POJK_MENU_NODE_TYPE_MENU)
+    {
+      pool = g_hash_table_lookup (writer->memberships, node);
+      if (pool != NULL)
+        {
+          g_variant_builder_open (writer->menus, G_VARIANT_TYPE ("(uas)"));
+          g_variant_builder_add (writer->menus, "u", writer->index);
+          g_variant_builder_open (writer->menus, G_VARIANT_TYPE_STRING_ARRAY);
+          pojk_menu_item_pool_foreach (pool, (GHFunc) pojk_menu_snapshot_write_item, writer);
+          g_variant_builder_close (writer->menus);
+          g_variant_builder_close (writer->menus);
+        }
+    }
+
+  writer->index++;
+
+  for (child = g_node_first_child (node); child != NULL; child = g_node_next_sibling (child))
+    pojk_menu_snapshot_write_node (writer, child);
+}
+
+
+
+static GVariant *
+pojk_menu_snapshot_write_files (GList *files)
+{
+  GVariantBuilder builder;
+  GList          *lp;
+  gchar          *uri;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_STRING_ARRAY);
+
+  for (lp = files; lp != NULL; lp = lp->next)
+    {
+      uri = g_file_get_uri (lp->data);
+      g_variant_builder_add (&builder, "s", uri);
+      g_free (uri);
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+
+
+static GList *
+pojk_menu_snapshot_read_files (GVariant *variant)
+{
+  GVariantIter iter;
+  const gchar *uri;
+  GList       *files = NULL;
+
+  g_variant_iter_init (&iter, variant);
+  while (g_variant_iter_next (&iter, "&s", &uri))
+    files = g_list_prepend (files, g_file_new_for_uri (uri));
+
+  return g_list_reverse (files);
+}
+
+
+
+static GNode *
+pojk_menu_snapshot_read_node (GVariant         *nodes,
+                              gsize            *index,
+                              GPtrArray        *index_nodes,
+                              PojkMenuNodeSlab *slab)
+{
+  PojkMenuTreeNode *node = NULL;
+  const gchar      *string;
+  guint32           n_children;
+  guint32           type;
+  guint32           value;
+  guint32           n;
+  GNode            *tree;
+  GNode            *child;
+
+  if (G_UNLIKELY (*index >= g_variant_n_children (nodes)))
+    return NULL;
+
+  g_variant_get_child (nodes, *index, "(uuum&s)", &n_children, &type, &value, &string);
+  *index += 1;
+
+  if (G_UNLIKELY (type == POJK_MENU_NODE_TYPE_INVALID
+                  || type > POJK_MENU_NODE_TYPE_DEFAULT_MERGE_DIRS))
+    return NULL;
+
+  switch (type)
+    {
+    case POJK_MENU_NODE_TYPE_MENU:
+      break;
+
+    case POJK_MENU_NODE_TYPE_MERGE:
+    case POJK_MENU_NODE_TYPE_MERGE_FILE:
+      node = _pojk_menu_tree_node_new (slab, type, GUINT_TO_POINTER (value));
+      break;
+
+    default:
+      node = _pojk_menu_tree_node_new (slab, type, string);
+      break;
+    }
+
+  tree = g_node_new (node);
+
+  if (type == POJK_MENU_NODE_TYPE_MERGE_FILE && string != NULL)
+    pojk_menu_node_tree_set_merge_file_filename (tree, string);
+  g_ptr_array_add (index_nodes, tree);
+
+  for (n = 0; n < n_children; ++n)
+    {
+      child = pojk_menu_snapshot_read_node (nodes, index, index_nodes, slab);
+
+      /* Give up on truncated or corrupted data */
+      if (G_UNLIKELY (child == NULL))
+        {
+          pojk_menu_node_tree_free (tree);
+          return NULL;
+        }
+
+      g_node_append (tree, child);
+    }
+
+  return tree;
+}
+
+
+
+static GHashTable *
+pojk_menu_snapshot_read_items (PojkMenuSnapshot  *snapshot,
+                               PojkMenuItemCache *cache)
+{
+  PojkMenuItem *item;
+  GVariantIter  iter;
+  GHashTable   *items;
+  GVariant     *variant;
+  GVariant     *child;
+  gchar        *desktop_id;
+  gchar        *uri;
+
+  items = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+
+  variant = g_variant_get_child_value (snapshot->data, SNAPSHOT_ITEMS);
+
+  g_variant_iter_init (&iter, variant);
+  while ((child = g_variant_iter_next_value (&iter)) != NULL)
+    {
+      item = _pojk_menu_item_deserialize (child);
+
+      if (G_LIKELY (item != NULL && pojk_menu_item_get_desktop_id (item) != NULL))
+        {
+          uri = pojk_menu_item_get_uri (item);
+          desktop_id = g_strdup (pojk_menu_item_get_desktop_id (item));
+
+          /* Prefer items which are already cached in this process */
+          item = _pojk_menu_item_cache_insert (cache, uri, item);
+          pojk_menu_item_set_desktop_id (item, desktop_id);
+
+          g_hash_table_replace (items, desktop_id, item);
+
+          g_free (uri);
+        }
+      else if (item != NULL)
+        {
+          g_object_unref (item);
+        }
+
+      g_variant_unref (child);
+    }
+
+  g_variant_unref (variant);
+
+  return items;
+}
+
+
+
+/* Maps the snapshot for the menu @file, if there is one and it is still
+ * up to date. Returns NULL otherwise */
+PojkMenuSnapshot *
+_pojk_menu_snapshot_load (GFile *file)
+{
+  PojkMenuSnapshot *snapshot = NULL;
+  GMappedFile      *mapped;
+  GVariantIter      iter;
+  const gchar      *stored_key;
+  const gchar      *path;
+  GVariant         *data;
+  GVariant         *stamps;
+  gboolean          valid;
+  guint32           version;
+  gint64            stamp;
+  gchar            *filename;
+  gchar            *key;
+
+  g_return_val_if_fail (G_IS_FILE (file), NULL);
+
+  key = pojk_menu_snapshot_build_key (file);
+  filename = pojk_menu_snapshot_build_filename (key);
+
+  mapped = g_mapped_file_new (filename, FALSE, NULL);
+  g_free (filename);
+
+  if (mapped == NULL || g_mapped_file_get_length (mapped) == 0)
+    {
+      if (mapped != NULL)
+        g_mapped_file_unref (mapped);
+      g_free (key);
+      return NULL;
+    }
+
+  /* The variant keeps the mapping alive until it is released */
+  data = g_variant_new_from_data (G_VARIANT_TYPE (POJK_MENU_SNAPSHOT_TYPE),
+                                  g_mapped_file_get_contents (mapped),
+                                  g_mapped_file_get_length (mapped),
+                                  FALSE,
+                                  (GDestroyNotify) g_mapped_file_unref,
+                                  mapped);
+  g_variant_ref_sink (data);
+
+  g_variant_get_child (data, SNAPSHOT_VERSION, "u", &version);
+  g_variant_get_child (data, SNAPSHOT_KEY, "&s", &stored_key);
+
+  valid = (version == POJK_MENU_SNAPSHOT_VERSION && g_strcmp0 (stored_key, key) == 0);
+
+  /* Check that none of the files and directories changed since the
+   * snapshot was written */
+  if (valid)
+    {
+      stamps = g_variant_get_child_value (data, SNAPSHOT_STAMPS);
+
+      g_variant_iter_init (&iter, stamps);
+      while (valid && g_variant_iter_next (&iter, "(&sx)", &path, &stamp))
+        valid = (pojk_menu_snapshot_get_stamp (path) == stamp);
+
+      g_variant_unref (stamps);
+    }
+
+  if (valid)
+    {
+      snapshot = g_slice_new0 (PojkMenuSnapshot);
+      snapshot->data = data;
+    }
+  else
+    g_variant_unref (data);
+
+  g_free (key);
+
+  return snapshot;
+}
+
+
+
+void
+_pojk_menu_snapshot_free (PojkMenuSnapshot *snapshot)
+{
+  if (snapshot == NULL)
+    return;
+
+  g_variant_unref (snapshot->data);
+  g_slice_free (PojkMenuSnapshot, snapshot);
+}
+
+
+
+/* Rebuilds the merged menu tree stored in @snapshot and loads the stored
+ * items into @cache. For each <Menu> node of the new tree that had items,
+ * a GList of the cached items, each referenced, is inserted into
+ * @memberships. Returns NULL if the stored tree is not usable */
+GNode *
+_pojk_menu_snapshot_get_tree (PojkMenuSnapshot  *snapshot,
+                              PojkMenuItemCache *cache,
+                              GHashTable        *memberships)
+{
+  PojkMenuItem     *item;
+  GVariantIter      iter;
+  GVariantIter     *ids;
+  GHashTable       *items;
+  GPtrArray        *index_nodes;
+  PojkMenuNodeSlab *slab;
+  const gchar      *desktop_id;
+  GVariant         *nodes;
+  GVariant         *menus;
+  GList            *list;
+  GNode            *tree;
+  GNode            *node;
+  guint32           index;
+  gsize             n = 0;
+
+  g_return_val_if_fail (snapshot != NULL, NULL);
+  g_return_val_if_fail (POJK_IS_MENU_ITEM_CACHE (cache), NULL);
+  g_return_val_if_fail (memberships != NULL, NULL);
+
+  nodes = g_variant_get_child_value (snapshot->data, SNAPSHOT_NODES);
+  index_nodes = g_ptr_array_new ();
+
+  slab = _pojk_menu_node_slab_new ();
+  tree = pojk_menu_snapshot_read_node (nodes, &n, index_nodes, slab);
+  _pojk_menu_node_slab_free (slab);
+
+  /* All stored nodes must belong to the tree */
+  if (tree != NULL && n != g_variant_n_children (nodes))
+    {
+      pojk_menu_node_tree_free (tree);
+      tree = NULL;
+    }
+
+  g_variant_unref (nodes);
+
+  if (G_LIKELY (tree != NULL))
+    {
+      items = pojk_menu_snapshot_read_items (snapshot, cache);
+
+      menus = g_variant_get_child_value (snapshot->data, SNAPSHOT_MENUS);
+
+      g_variant_iter_init (&iter, menus);
+      while (g_variant_iter_next (&iter, "(uas)", &index, &ids))
+        {
+          node = index < index_nodes->len ? g_ptr_array_index (index_nodes, index) : NULL;
+
+          if (G_LIKELY (pojk_menu_node_tree_get_node_type (node) == POJK_MENU_NODE_TYPE_MENU))
+            {
+              list = NULL;
+
+              while (g_variant_iter_next (ids, "&s", &desktop_id))
+                {
+                  item = g_hash_table_lookup (items, desktop_id);
+                  if (G_LIKELY (item != NULL))
+                    list = g_list_prepend (list, g_object_ref (item));
+                }
+
+              g_hash_table_replace (memberships, node, list);
+            }
+
+          g_variant_iter_free (ids);
+        }
+
+      g_variant_unref (menus);
+      g_hash_table_unref (items);
+    }
+
+  g_ptr_array_free (index_nodes, TRUE);
+
+  return tree;
+}
+
+
+
+GList *
+_pojk_menu_snapshot_get_merge_files (PojkMenuSnapshot *snapshot)
+{
+  GVariant *variant;
+  GList    *files;
+
+  g_return_val_if_fail (snapshot != NULL, NULL);
+
+  variant = g_variant_get_child_value (snapshot->data, SNAPSHOT_MERGE_FILES);
+  files = pojk_menu_snapshot_read_files (variant);
+  g_variant_unref (variant);
+
+  return files;
+}
+
+
+
+GList *
+_pojk_menu_snapshot_get_merge_dirs (PojkMenuSnapshot *snapshot)
+{
+  GVariant *variant;
+  GList    *dirs;
+
+  g_return_val_if_fail (snapshot != NULL, NULL);
+
+  variant = g_variant_get_child_value (snapshot->data, SNAPSHOT_MERGE_DIRS);
+  dirs = pojk_menu_snapshot_read_files (variant);
+  g_variant_unref (variant);
+
+  return dirs;
+}
+
+
+
+/* Returns a new table which maps each desktop id to the URI of the
+ * desktop file that was used for it */
+GHashTable *
+_pojk_menu_snapshot_get_desktop_id_table (PojkMenuSnapshot *snapshot)
+{
+  GVariantIter iter;
+  const gchar *desktop_id;
+  const gchar *uri;
+  GHashTable  *table;
+  GVariant    *variant;
+
+  g_return_val_if_fail (snapshot != NULL, NULL);
+
+  table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  variant = g_variant_get_child_value (snapshot->data, SNAPSHOT_DESKTOP_FILES);
+
+  g_variant_iter_init (&iter, variant);
+  while (g_variant_iter_next (&iter, "{&s&s}", &desktop_id, &uri))
+    g_hash_table_replace (table, g_strdup (desktop_id), g_strdup (uri));
+
+  g_variant_unref (variant);
+
+  return table;
+}
+
+
+
+/* Writes the result of loading the menu @file to its snapshot. @app_dirs
+ * is a list of AppDir URIs, @memberships maps the <Menu> nodes of
+ * @tree to the PojkMenuItemPool of the corresponding menu and
+ * @desktop_id_table maps desktop ids to the URIs of their desktop files */
+gboolean
+_pojk_menu_snapshot_save (GFile       *file,
+                          GNode       *tree,
+                          GList       *merge_files,
+                          GList       *merge_dirs,
+                          GList       *app_dirs,
+                          GHashTable  *memberships,
+                          GHashTable  *desktop_id_table,
+                          GError     **error)
+{
+  PojkMenuSnapshotWriter writer;
+  GVariantBuilder        stamps;
+  GVariantBuilder        nodes;
+  GVariantBuilder        menus;
+  GVariantBuilder        items;
+  GVariantBuilder        desktop_files;
+  GHashTableIter         iter;
+  GHashTable            *seen;
+  gpointer               desktop_id;
+  gpointer               uri;
+  gpointer               item;
+  GVariant              *data;
+  gboolean               success = TRUE;
+  GList                 *lp;
+  GFile                 *dir;
+  gchar                 *path;
+  gchar                 *key;
+  gchar                 *filename;
+  gchar                 *dirname;
+
+  g_return_val_if_fail (G_IS_FILE (file), FALSE);
+  g_return_val_if_fail (tree != NULL, FALSE);
+  g_return_val_if_fail (memberships != NULL, FALSE);
+  g_return_val_if_fail (desktop_id_table != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  /* Record the modification times of everything the result depends on */
+  g_variant_builder_init (&stamps, G_VARIANT_TYPE ("a(sx)"));
+
+  success = pojk_menu_snapshot_add_stamp (&stamps, seen, file);
+
+  for (lp = merge_files; success && lp != NULL; lp = lp->next)
+    success = pojk_menu_snapshot_add_stamp (&stamps, seen, lp->data);
+
+  for (lp = merge_dirs; success && lp != NULL; lp = lp->next)
+    success = pojk_menu_snapshot_add_stamp (&stamps, seen, lp->data);
+
+  for (lp = app_dirs; success && lp != NULL; lp = lp->next)
+    {
+      dir = _pojk_file_new_relative_to_file (lp->data, file);
+      path = g_file_get_path (dir);
+
+      if (G_LIKELY (path != NULL))
+        pojk_menu_snapshot_add_dir_stamps (&stamps, seen, path);
+      else
+        success = FALSE;
+
+      g_free (path);
+      g_object_unref (dir);
+    }
+
+  g_hash_table_unref (seen);
+
+  if (G_UNLIKELY (!success))
+    {
+      g_variant_builder_clear (&stamps);
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                           "Menus with non-local files cannot be stored in a snapshot");
+      return FALSE;
+    }
+
+  /* Serialize the tree and the items allocated to each menu */
+  g_variant_builder_init (&nodes, G_VARIANT_TYPE ("a(uuums)"));
+  g_variant_builder_init (&menus, G_VARIANT_TYPE ("a(uas)"));
+
+  writer.nodes = &nodes;
+  writer.menus = &menus;
+  writer.memberships = memberships;
+  writer.items = g_hash_table_new (g_str_hash, g_str_equal);
+  writer.index = 0;
+
+  pojk_menu_snapshot_write_node (&writer, tree);
+
+  g_variant_builder_init (&items, G_VARIANT_TYPE ("a" _POJK_MENU_ITEM_VARIANT_TYPE));
+
+  g_hash_table_iter_init (&iter, writer.items);
+  while (g_hash_table_iter_next (&iter, NULL, &item))
+    g_variant_builder_add_value (&items, _pojk_menu_item_serialize (item));
+
+  g_hash_table_unref (writer.items);
+
+  g_variant_builder_init (&desktop_files, G_VARIANT_TYPE ("a{ss}"));
+
+  g_hash_table_iter_init (&iter, desktop_id_table);
+  while (g_hash_table_iter_next (&iter, &desktop_id, &uri))
+    g_variant_builder_add (&desktop_files, "{ss}", desktop_id, uri);
+
+  key = pojk_menu_snapshot_build_key (file);
+
+  data = g_variant_new ("(us@a(sx)@as@as@a(uuums)@a" _POJK_MENU_ITEM_VARIANT_TYPE "@a(uas)@a{ss})",
+                        POJK_MENU_SNAPSHOT_VERSION,
+                        key,
+                        g_variant_builder_end (&stamps),
+                        pojk_menu_snapshot_write_files (merge_files),
+                        pojk_menu_snapshot_write_files (merge_dirs),
+                        g_variant_builder_end (&nodes),
+                        g_variant_builder_end (&items),
+                        g_variant_builder_end (&menus),
+                        g_variant_builder_end (&desktop_files));
+  g_variant_ref_sink (data);
+
+  /* Write the snapshot, replacing the old one atomically */
+  filename = pojk_menu_snapshot_build_filename (key);
+  dirname = g_path_get_dirname (filename);
+
+  if (g_mkdir_with_parents (dirname, 0700) == 0)
+    {
+      success = g_file_set_contents (filename, g_variant_get_data (data),
+                                     g_variant_get_size (data), error);
+    }
+  else
+    {
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                   "Failed to create directory \"%s\"", dirname);
+      success = FALSE;
+    }
+
+  g_free (dirname);
+  g_free (filename);
+  g_free (key);
+  g_variant_unref (data);
+
+  return success;
+}
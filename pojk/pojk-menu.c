@@ -22,6 +22,15 @@
 #include <config.h>
 #endif
 
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -35,10 +44,12 @@
 #include <pojk/pojk-menu-item.h>
 #include <pojk/pojk-menu-directory.h>
 #include <pojk/pojk-menu-item-cache.h>
+#include <pojk/pojk-menu-app-dir-scan.h>
 #include <pojk/pojk-menu-separator.h>
 #include <pojk/pojk-menu-node.h>
 #include <pojk/pojk-menu-parser.h>
 #include <pojk/pojk-menu-merger.h>
+#include <pojk/pojk-menu-snapshot.h>
 #include <pojk/pojk-private.h>
 
 
@@ -63,11 +74,87 @@
 
 
 
-typedef struct _PojkMenuPair
+/* Shared by the desktop file parser threads */
+typedef struct _PojkMenuPreload
+{
+  PojkMenuItemCache *cache;
+  GHashTable        *desktop_id_table;
+  gint               n_parsed;
+  gint               n_unchanged;
+} PojkMenuPreload;
+
+
+
+/* Attributes of a menu, read from its tree once after merging, with the
+ * inherited ones completed from the parent menu. Strings and nodes
+ * belong to the tree, lists are in order of priority */
+typedef struct _PojkMenuDescriptor
+{
+  const gchar *name;
+  guint        deleted : 1;
+  guint        only_unallocated : 1;
+
+  /* .directory file names and DirectoryDirs of the menu and its parents */
+  GList       *directories;
+  GList       *directory_dirs;
+
+  /* AppDirs of the menu itself */
+  GList       *app_dirs;
+
+  /* Layout of the menu elements, and the DefaultLayout for submenus */
+  GNode       *layout;
+  GNode       *default_layout;
+
+  /* Include and Exclude rule nodes, in document order */
+  GPtrArray   *rules;
+} PojkMenuDescriptor;
+
+
+
+/* Include and Exclude rules of a menu, in document order. The rule nodes
+ * are resolved against the item index on load, the programs compiled
+ * with _pojk_menu_node_tree_compile_rule() match single items later */
+typedef struct _PojkMenuRules
 {
-  gpointer first;
-  gpointer second;
-} PojkMenuPair;
+  PojkMenu  *menu;
+  gboolean   only_unallocated;
+  GPtrArray *nodes;
+  GPtrArray *rules;
+} PojkMenuRules;
+
+
+
+/* Shared by the threads resolving the rules of several menus at once */
+typedef struct _PojkMenuResolve
+{
+  PojkMenuItemIndex *index;
+  GPtrArray         *compiled;
+  gboolean           only_unallocated;
+
+  /* Position in compiled => item sets of the rules of the menu */
+  GPtrArray        **sets;
+
+  /* Item id => position of the first menu that includes the item in
+   * the OnlyUnallocated pass, or NULL if menus are resolved one by one */
+  gint              *claims;
+
+  gint               n_rules;
+} PojkMenuResolve;
+
+
+
+/* Item loaded from a desktop file and the number of menus it is in, for
+ * finding the item of a changed file without walking all menus */
+typedef struct _PojkMenuFileEntry
+{
+  PojkMenuItem *item;
+  guint         n_menus;
+} PojkMenuFileEntry;
+
+
+
+/* Upper limit for the number of desktop file parser threads */
+#define POJK_MENU_MAX_PARSE_THREADS 64
 
 
 
@@ -78,6 +165,10 @@ enum
   PROP_ENVIRONMENT,
   PROP_FILE,
   PROP_DIRECTORY,
+  PROP_SNAPSHOT,
+  PROP_PARSE_THREADS,
+  PROP_APP_DIR_CACHE,
+  PROP_PARALLEL_RESOLVE,
   PROP_PARENT, /* TODO */
 };
 
@@ -88,6 +179,8 @@ enum
 {
   RELOAD_REQUIRED,
   DIRECTORY_CHANGED,
+  ITEM_ADDED,
+  ITEM_REMOVED,
   LAST_SIGNAL
 };
 
@@ -106,27 +199,70 @@ static void                 pojk_menu_set_property                    (GObject
                                                                          GParamSpec              *pspec);
 static void                 pojk_menu_set_directory                   (PojkMenu              *menu,
                                                                          PojkMenuDirectory     *directory);
+static void                 pojk_menu_start_load                      (PojkMenu              *menu,
+                                                                         GTask                   *task);
+static void                 pojk_menu_start_pending_loads             (PojkMenu              *menu);
+static void                 pojk_menu_load_thread                     (GTask                   *task,
+                                                                         gpointer                 source_object,
+                                                                         gpointer                 task_data,
+                                                                         GCancellable            *cancellable);
+static void                 pojk_menu_load_ready                      (GObject                 *source_object,
+                                                                         GAsyncResult            *result,
+                                                                         gpointer                 user_data);
+static gboolean             pojk_menu_load_internal                   (PojkMenu              *menu,
+                                                                         GCancellable            *cancellable,
+                                                                         GError                 **error);
+static gboolean             pojk_menu_load_items                      (PojkMenu              *menu,
+                                                                         GCancellable            *cancellable,
+                                                                         GError                 **error);
+static gboolean             pojk_menu_load_tree                       (PojkMenu              *menu,
+                                                                         GCancellable            *cancellable,
+                                                                         GError                 **error);
+static void                 pojk_menu_restore_items                   (PojkMenu              *menu,
+                                                                         GHashTable              *memberships);
+static void                 pojk_menu_item_list_free                  (GList                   *items);
+static void                 pojk_menu_save_snapshot                   (PojkMenu              *menu);
+static void                 pojk_menu_keep_update_state               (PojkMenu              *menu,
+                                                                         GHashTable              *desktop_id_table,
+                                                                         GPtrArray               *compiled);
 static void                 pojk_menu_resolve_menus                   (PojkMenu              *menu);
+static void                 pojk_menu_describe                        (PojkMenu              *menu);
+static void                 pojk_menu_descriptor_clear                (PojkMenuDescriptor    *desc);
+static guint                pojk_menu_get_n_parse_threads             (PojkMenu              *menu);
+static void                 pojk_menu_preload_items                   (PojkMenu              *menu,
+                                                                         GHashTable              *desktop_id_table);
+static void                 pojk_menu_preload_item                    (const gchar             *desktop_id,
+                                                                         PojkMenuPreload       *data);
 static void                 pojk_menu_resolve_directory               (PojkMenu              *menu,
                                                                          GCancellable            *cancellable,
                                                                          gboolean                 recursive);
 static PojkMenuDirectory *pojk_menu_lookup_directory                (PojkMenu              *menu,
                                                                          const gchar             *filename);
 static void                 pojk_menu_collect_files                   (PojkMenu              *menu,
-                                                                         GHashTable              *desktop_id_table);
-static void                 pojk_menu_collect_files_from_path         (PojkMenu              *menu,
+                                                                         PojkMenu              *root,
                                                                          GHashTable              *desktop_id_table,
-                                                                         GFile                   *path,
-                                                                         const gchar             *id_prefix);
+                                                                         GHashTable              *scanned_dirs);
+static void                 pojk_menu_compile_rules                   (PojkMenu              *menu,
+                                                                         GPtrArray               *compiled);
+static void                 pojk_menu_rules_free                      (PojkMenuRules         *rules);
+static PojkMenuItemIndex   *pojk_menu_index_items                     (PojkMenu              *menu,
+                                                                         GHashTable              *desktop_id_table);
 static void                 pojk_menu_resolve_items                   (PojkMenu              *menu,
-                                                                         GHashTable              *desktop_id_table,
+                                                                         PojkMenuItemIndex     *index,
+                                                                         GPtrArray               *compiled,
                                                                          gboolean                 only_unallocated);
-static void                 pojk_menu_resolve_items_by_rule           (PojkMenu              *menu,
-                                                                         GHashTable              *desktop_id_table,
-                                                                         GNode                   *node);
-static void                 pojk_menu_resolve_item_by_rule            (const gchar             *desktop_id,
-                                                                         const gchar             *uri,
-                                                                         PojkMenuPair          *data);
+static void                 pojk_menu_resolve_parallel                (PojkMenu              *menu,
+                                                                         GFunc                    func,
+                                                                         PojkMenuResolve       *data);
+static void                 pojk_menu_claim_item                      (gint                    *claim,
+                                                                         gint                     position);
+static void                 pojk_menu_resolve_rules                   (gpointer                 position,
+                                                                         PojkMenuResolve       *data);
+static void                 pojk_menu_apply_rules                     (gpointer                 position,
+                                                                         PojkMenuResolve       *data);
+static void                 pojk_menu_resolve_item                    (PojkMenuRules         *rules,
+                                                                         const gchar           *desktop_id,
+                                                                         PojkMenuItem          *item);
 static void                 pojk_menu_remove_deleted_menus            (PojkMenu              *menu);
 static gint                 pojk_menu_compare_items                   (gconstpointer           *a,
                                                                          gconstpointer           *b);
@@ -139,6 +275,8 @@ static gboolean             pojk_menu_get_element_no_display          (PojkMenuE
 static gboolean             pojk_menu_get_element_equal               (PojkMenuElement       *element,
                                                                          PojkMenuElement       *other);
 static void                 pojk_menu_start_monitoring                (PojkMenu              *menu);
+static void                 pojk_menu_start_monitoring_timed          (PojkMenu              *menu);
+static guint                pojk_menu_count_monitors                  (PojkMenu              *menu);
 static void                 pojk_menu_stop_monitoring                 (PojkMenu              *menu);
 static void                 pojk_menu_monitor_menu_files              (PojkMenu              *menu);
 static void                 pojk_menu_monitor_files                   (PojkMenu              *menu,
@@ -173,6 +311,35 @@ static void                 pojk_menu_directory_file_changed          (PojkMenu
                                                                          GFileMonitor            *monitor);
 static PojkMenuItem      *pojk_menu_find_file_item                  (PojkMenu              *menu,
                                                                          GFile                   *file);
+static void                 pojk_menu_file_entry_free                 (PojkMenuFileEntry     *entry);
+static void                 pojk_menu_index_files                     (PojkMenu              *menu);
+static void                 pojk_menu_index_pool_item                 (const gchar             *desktop_id,
+                                                                         PojkMenuItem          *item,
+                                                                         PojkMenu              *menu);
+static void                 pojk_menu_index_add_item                  (PojkMenu              *menu,
+                                                                         PojkMenuItem          *item);
+static void                 pojk_menu_index_remove_item               (PojkMenu              *menu,
+                                                                         PojkMenuItem          *item);
+static void                 pojk_menu_collect_app_dir_roots           (PojkMenu              *menu,
+                                                                         GPtrArray               *roots);
+static gboolean             pojk_menu_update_file                     (PojkMenu              *menu,
+                                                                         GFile                   *file,
+                                                                         gboolean                 deleted,
+                                                                         PojkMenuItem          *reloaded);
+static gboolean             pojk_menu_update_desktop_file             (PojkMenu              *menu,
+                                                                         const gchar             *desktop_id,
+                                                                         GFile                   *file,
+                                                                         guint                    rank,
+                                                                         gboolean                 deleted,
+                                                                         PojkMenuItem          *reloaded);
+static void                 pojk_menu_update_desktop_id               (PojkMenu              *menu,
+                                                                         const gchar             *desktop_id,
+                                                                         GFile                   *file,
+                                                                         PojkMenuItem          *reloaded);
+static void                 pojk_menu_replace_item                    (PojkMenu              *menu,
+                                                                         const gchar             *desktop_id,
+                                                                         PojkMenuItem          *old_item,
+                                                                         PojkMenuItem          *new_item);
 
 
 
@@ -184,6 +351,9 @@ struct _PojkMenuPrivate
   /* DOM tree */
   GNode               *tree;
 
+  /* Attributes of the menu, see pojk_menu_describe() */
+  PojkMenuDescriptor   desc;
+
   /* Merged menu files and merge directories */
   GList               *merge_files;
   GList               *merge_dirs;
@@ -213,8 +383,39 @@ struct _PojkMenuPrivate
   /* Flag for marking custom path menus */
   guint                uses_custom_path : 1;
 
+  /* Whether the load result is stored in and restored from a snapshot */
+  guint                use_snapshot : 1;
+
+  /* Number of threads used for parsing desktop files while loading,
+   * 0 to choose it in pojk_menu_get_n_parse_threads() */
+  guint                parse_threads;
+
+  /* Whether application directory scans are reused across loads */
+  guint                use_app_dir_cache : 1;
+
+  /* Whether the rules of the menus are resolved on the parser threads */
+  guint                parallel_resolve : 1;
+
+  /* Timings and counters of the last load */
+  PojkMenuLoadStats    load_stats;
+
+  /* Desktop id table, compiled rules and application directories (in
+   * order of priority) of the last load, for updating single items */
+  GHashTable          *desktop_id_table;
+  GPtrArray           *rules;
+  GPtrArray           *app_dir_roots;
+
+  /* URIs of the desktop files of the items in the menus of the last
+   * load => PojkMenuFileEntry */
+  GHashTable          *file_index;
+
   /* idle reload-required to group events */
   guint                idle_reload_required_id;
+
+  /* Outer task of the asynchronous load that is running, and the ones
+   * waiting for it to finish */
+  GTask               *load_task;
+  GQueue               pending_loads;
 };
 
 
@@ -270,6 +471,88 @@ pojk_menu_class_init (PojkMenuClass *klass)
                                                         G_PARAM_READWRITE |
                                                         G_PARAM_STATIC_STRINGS));
 
+  /**
+   * PojkMenu:snapshot:
+   *
+   * Whether pojk_menu_load() stores the loaded menu in a snapshot in
+   * the user cache directory and restores it from there on the next
+   * load, as long as none of the menu files and application directories
+   * changed in the meantime. This avoids parsing the menu and desktop
+   * files on every start of an application.
+   *
+   * Defaults to %TRUE if the environment variable POJK_MENU_SNAPSHOT
+   * is set to 1, %FALSE otherwise.
+   **/
+  g_object_class_install_property (gobject_class,
+                                   PROP_SNAPSHOT,
+                                   g_param_spec_boolean ("snapshot",
+                                                         "Snapshot",
+                                                         "Store and restore the loaded menu using a snapshot",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE |
+                                                         G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PojkMenu:parse-threads:
+   *
+   * The number of threads pojk_menu_load() uses to parse the desktop
+   * files of the application directories before the menu rules are
+   * applied. With a value of 1, desktop files are parsed one by one on
+   * the calling thread.
+   *
+   * The default value 0 uses the value of the environment variable
+   * POJK_MENU_PARSE_THREADS or, if that is not set, the number of
+   * processors, but at most 8.
+   **/
+  g_object_class_install_property (gobject_class,
+                                   PROP_PARSE_THREADS,
+                                   g_param_spec_uint ("parse-threads",
+                                                      "Parse threads",
+                                                      "Number of threads used to parse desktop files, 0 to choose automatically",
+                                                      0, POJK_MENU_MAX_PARSE_THREADS, 0,
+                                                      G_PARAM_READWRITE |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PojkMenu:app-dir-cache:
+   *
+   * Whether the desktop files found in the application directories are
+   * remembered for later loads of this or any other menu. A directory
+   * is only scanned again if it or one of its subdirectories changed its
+   * modification time. Within a single load, every directory is scanned
+   * only once, no matter how many menus list it.
+   *
+   * Defaults to %TRUE if the environment variable POJK_MENU_APP_DIR_CACHE
+   * is set to 1, %FALSE otherwise.
+   **/
+  g_object_class_install_property (gobject_class,
+                                   PROP_APP_DIR_CACHE,
+                                   g_param_spec_boolean ("app-dir-cache",
+                                                         "App dir cache",
+                                                         "Reuse application directory scans across loads",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE |
+                                                         G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PojkMenu:parallel-resolve:
+   *
+   * Whether pojk_menu_load() resolves the Include and Exclude rules of
+   * the menus on as many threads as #PojkMenu:parse-threads, instead of
+   * one menu after another. The menus get the same items either way.
+   *
+   * Defaults to %TRUE if the environment variable
+   * POJK_MENU_PARALLEL_RESOLVE is set to 1, %FALSE otherwise.
+   **/
+  g_object_class_install_property (gobject_class,
+                                   PROP_PARALLEL_RESOLVE,
+                                   g_param_spec_boolean ("parallel-resolve",
+                                                         "Parallel resolve",
+                                                         "Resolve the rules of several menus at once",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE |
+                                                         G_PARAM_STATIC_STRINGS));
+
   menu_signals[RELOAD_REQUIRED] =
     g_signal_new ("reload-required",
                   POJK_TYPE_MENU,
@@ -294,6 +577,46 @@ pojk_menu_class_init (PojkMenuClass *klass)
                   POJK_TYPE_MENU_DIRECTORY,
                   POJK_TYPE_MENU_DIRECTORY);
 
+  /**
+   * PojkMenu::item-added:
+   * @menu : the #PojkMenu
+   * @item : the #PojkMenuItem that was added
+   *
+   * Emitted when a desktop file was added or changed and @item now
+   * belongs to @menu, without reloading the menu.
+   **/
+  menu_signals[ITEM_ADDED] =
+    g_signal_new ("item-added",
+                  POJK_TYPE_MENU,
+                  G_SIGNAL_RUN_LAST | G_SIGNAL_NO_HOOKS,
+                  0,
+                  NULL,
+                  NULL,
+                  g_cclosure_marshal_VOID__OBJECT,
+                  G_TYPE_NONE,
+                  1,
+                  POJK_TYPE_MENU_ITEM);
+
+  /**
+   * PojkMenu::item-removed:
+   * @menu : the #PojkMenu
+   * @item : the #PojkMenuItem that was removed
+   *
+   * Emitted when a desktop file was removed or changed and @item no
+   * longer belongs to @menu, without reloading the menu.
+   **/
+  menu_signals[ITEM_REMOVED] =
+    g_signal_new ("item-removed",
+                  POJK_TYPE_MENU,
+                  G_SIGNAL_RUN_LAST | G_SIGNAL_NO_HOOKS,
+                  0,
+                  NULL,
+                  NULL,
+                  g_cclosure_marshal_VOID__OBJECT,
+                  G_TYPE_NONE,
+                  1,
+                  POJK_TYPE_MENU_ITEM);
+
   pojk_menu_file_quark = g_quark_from_string ("pojk-menu-file-quark");
 }
 
@@ -329,6 +652,12 @@ pojk_menu_init (PojkMenu *menu)
   menu->priv->uses_custom_path = TRUE;
   menu->priv->changed_files = NULL;
   menu->priv->idle_reload_required_id = 0;
+  menu->priv->use_snapshot = (g_strcmp0 (g_getenv ("POJK_MENU_SNAPSHOT"), "1") == 0);
+  menu->priv->use_app_dir_cache = (g_strcmp0 (g_getenv ("POJK_MENU_APP_DIR_CACHE"), "1") == 0);
+  menu->priv->parallel_resolve = (g_strcmp0 (g_getenv ("POJK_MENU_PARALLEL_RESOLVE"), "1") == 0);
+  menu->priv->parse_threads = 0;
+  menu->priv->load_task = NULL;
+  g_queue_init (&menu->priv->pending_loads);
 
   /* Take reference on the menu item cache */
   menu->priv->cache = pojk_menu_item_cache_get_default ();
@@ -347,6 +676,31 @@ pojk_menu_clear (PojkMenu *menu)
       /* Stop monitoring recursively */
       pojk_menu_stop_monitoring (menu);
 
+      /* Release the state for updating single items */
+      if (menu->priv->rules != NULL)
+        {
+          g_ptr_array_unref (menu->priv->rules);
+          menu->priv->rules = NULL;
+        }
+
+      if (menu->priv->desktop_id_table != NULL)
+        {
+          g_hash_table_unref (menu->priv->desktop_id_table);
+          menu->priv->desktop_id_table = NULL;
+        }
+
+      if (menu->priv->app_dir_roots != NULL)
+        {
+          g_ptr_array_unref (menu->priv->app_dir_roots);
+          menu->priv->app_dir_roots = NULL;
+        }
+
+      if (menu->priv->file_index != NULL)
+        {
+          g_hash_table_unref (menu->priv->file_index);
+          menu->priv->file_index = NULL;
+        }
+
       /* Destroy the menu tree */
       pojk_menu_node_tree_free (menu->priv->tree);
       menu->priv->tree = NULL;
@@ -364,6 +718,9 @@ pojk_menu_clear (PojkMenu *menu)
   _pojk_g_list_free_full (menu->priv->submenus, g_object_unref);
   menu->priv->submenus = NULL;
 
+  /* Forget the attributes read from the tree */
+  pojk_menu_descriptor_clear (&menu->priv->desc);
+
   /* Free directory */
   if (G_LIKELY (menu->priv->directory != NULL))
     {
@@ -425,6 +782,22 @@ pojk_menu_get_property (GObject    *object,
       g_value_set_object (value, menu->priv->directory);
       break;
 
+    case PROP_SNAPSHOT:
+      g_value_set_boolean (value, menu->priv->use_snapshot);
+      break;
+
+    case PROP_PARSE_THREADS:
+      g_value_set_uint (value, menu->priv->parse_threads);
+      break;
+
+    case PROP_APP_DIR_CACHE:
+      g_value_set_boolean (value, menu->priv->use_app_dir_cache);
+      break;
+
+    case PROP_PARALLEL_RESOLVE:
+      g_value_set_boolean (value, menu->priv->parallel_resolve);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -451,6 +824,22 @@ pojk_menu_set_property (GObject      *object,
       pojk_menu_set_directory (menu, g_value_get_object (value));
       break;
 
+    case PROP_SNAPSHOT:
+      menu->priv->use_snapshot = g_value_get_boolean (value);
+      break;
+
+    case PROP_PARSE_THREADS:
+      menu->priv->parse_threads = g_value_get_uint (value);
+      break;
+
+    case PROP_APP_DIR_CACHE:
+      menu->priv->use_app_dir_cache = g_value_get_boolean (value);
+      break;
+
+    case PROP_PARALLEL_RESOLVE:
+      menu->priv->parallel_resolve = g_value_get_boolean (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -574,8 +963,7 @@ static const gchar *
 pojk_menu_get_name (PojkMenu *menu)
 {
   g_return_val_if_fail (POJK_IS_MENU (menu), NULL);
-  return pojk_menu_node_tree_get_string_child (menu->priv->tree,
-                                                 POJK_MENU_NODE_TYPE_NAME);
+  return menu->priv->desc.name;
 }
 
 
@@ -657,17 +1045,220 @@ pojk_menu_load (PojkMenu   *menu,
                   GCancellable *cancellable,
                   GError      **error)
 {
-  PojkMenuParser *parser;
-  PojkMenuMerger *merger;
-  GHashTable       *desktop_id_table;
-  const gchar      *prefix;
-  gboolean          success = TRUE;
-  gchar            *filename;
-  gchar            *relative_filename;
+  gboolean success;
+
+  g_return_val_if_fail (POJK_IS_MENU (menu), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  _pojk_menu_item_cache_begin_load (menu->priv->cache);
+  success = pojk_menu_load_internal (menu, cancellable, error);
+  _pojk_menu_item_cache_finish_load (menu->priv->cache);
+
+  if (!success)
+    return FALSE;
+
+  /* Initiate file system monitoring */
+  pojk_menu_start_monitoring_timed (menu);
+
+  return TRUE;
+}
+
+
+
+/**
+ * pojk_menu_load_async:
+ * @menu        : a #PojkMenu
+ * @cancellable : (allow-none): a #GCancellable
+ * @callback    : a #GAsyncReadyCallback to call when the menu is loaded
+ * @user_data   : data to pass to @callback
+ *
+ * Asynchronously loads the entire menu tree from the file referred to
+ * by @menu, like pojk_menu_load() does. Parsing, merging and resolving
+ * the menu happens in a separate thread, so the caller's main loop is
+ * not blocked.
+ *
+ * When the menu is loaded, @callback is called in the thread-default
+ * main context of the thread this function was called from. File
+ * system monitoring is started in that context as well, before
+ * @callback is called. Call pojk_menu_load_finish() from @callback
+ * to get the result of the operation.
+ *
+ * @menu must not be accessed or modified until @callback is called.
+ *
+ * @cancellable is checked between all phases of the loading process.
+ * If a previous load of @menu is still running, for example because it
+ * was cancelled but did not reach the next phase yet, this load only
+ * starts once the previous one finished.
+ **/
+void
+pojk_menu_load_async (PojkMenu          *menu,
+                      GCancellable        *cancellable,
+                      GAsyncReadyCallback  callback,
+                      gpointer             user_data)
+{
+  GTask *task;
+  GTask *load_task;
+
+  g_return_if_fail (POJK_IS_MENU (menu));
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (menu, cancellable, callback, user_data);
+  g_task_set_source_tag (task, pojk_menu_load_async);
+
+  /* The running loader thread still modifies the menu */
+  if (menu->priv->load_task != NULL)
+    g_queue_push_tail (&menu->priv->pending_loads, task);
+  else
+    pojk_menu_start_load (menu, task);
+}
+
+
+
+static void
+pojk_menu_start_load (PojkMenu *menu,
+                      GTask    *task)
+{
+  GTask *load_task;
+
+  menu->priv->load_task = task;
+
+  /* Drop the monitors and pending idle sources here, they belong to
+   * the main context of the caller and not to the loader thread. The
+   * rest of the menu is cleared by the loader thread */
+  pojk_menu_stop_monitoring (menu);
+
+  if (menu->priv->idle_reload_required_id != 0)
+    {
+      g_source_remove (menu->priv->idle_reload_required_id);
+      menu->priv->idle_reload_required_id = 0;
+    }
+
+  /* The load task completes in the caller's main context, where we start
+   * monitoring before the result is passed on to the outer task */
+  load_task = g_task_new (menu, g_task_get_cancellable (task), pojk_menu_load_ready, task);
+  g_task_run_in_thread (load_task, pojk_menu_load_thread);
+  g_object_unref (load_task);
+}
+
+
+
+/* Starts the next load that waited for the previous one, unless the
+ * callback of the previous one already started another */
+static void
+pojk_menu_start_pending_loads (PojkMenu *menu)
+{
+  GTask *task;
 
+  while (menu->priv->load_task == NULL
+         && (task = g_queue_pop_head (&menu->priv->pending_loads)) != NULL)
+    {
+      if (g_task_return_error_if_cancelled (task))
+        g_object_unref (task);
+      else
+        pojk_menu_start_load (menu, task);
+    }
+}
+
+
+
+/**
+ * pojk_menu_load_finish:
+ * @menu   : a #PojkMenu
+ * @result : the #GAsyncResult passed to the callback of
+ *           pojk_menu_load_async()
+ * @error  : #GError return location
+ *
+ * Finishes an asynchronous load started with pojk_menu_load_async().
+ *
+ * Returns: %TRUE if the menu was loaded successfully or
+ *          %FALSE if there was an error or the process was
+ *          cancelled.
+ **/
+gboolean
+pojk_menu_load_finish (PojkMenu   *menu,
+                       GAsyncResult *result,
+                       GError      **error)
+{
   g_return_val_if_fail (POJK_IS_MENU (menu), FALSE);
+  g_return_val_if_fail (g_task_is_valid (result, menu), FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+
+
+static void
+pojk_menu_load_thread (GTask        *task,
+                       gpointer      source_object,
+                       gpointer      task_data,
+                       GCancellable *cancellable)
+{
+  PojkMenu *menu = POJK_MENU (source_object);
+  GError   *error = NULL;
+  gboolean  success;
+
+  _pojk_menu_item_cache_begin_load (menu->priv->cache);
+  success = pojk_menu_load_internal (menu, cancellable, &error);
+  _pojk_menu_item_cache_finish_load (menu->priv->cache);
+
+  if (success)
+    g_task_return_boolean (task, TRUE);
+  else
+    g_task_return_error (task, error);
+}
+
+
+
+static void
+pojk_menu_load_ready (GObject      *source_object,
+                      GAsyncResult *result,
+                      gpointer      user_data)
+{
+  PojkMenu *menu = POJK_MENU (source_object);
+  GTask    *task = G_TASK (user_data);
+  GError   *error = NULL;
+
+  /* The loader thread is done with the menu */
+  menu->priv->load_task = NULL;
+
+  if (g_task_propagate_boolean (G_TASK (result), &error))
+    {
+      /* Initiate file system monitoring in the caller's context */
+      pojk_menu_start_monitoring_timed (menu);
+
+      g_task_return_boolean (task, TRUE);
+    }
+  else
+    g_task_return_error (task, error);
+
+  g_object_unref (task);
+
+  pojk_menu_start_pending_loads (menu);
+}
+
+
+
+static gboolean
+pojk_menu_load_internal (PojkMenu     *menu,
+                         GCancellable *cancellable,
+                         GError      **error)
+{
+  PojkMenuLoadStats *stats = &menu->priv->load_stats;
+  PojkMenuSnapshot  *snapshot = NULL;
+  GHashTable        *memberships = NULL;
+  GHashTable        *desktop_id_table = NULL;
+  GPtrArray         *compiled;
+  const gchar       *prefix;
+  gchar             *filename;
+  gchar             *relative_filename;
+  gboolean           success;
+  gint64             start_time;
+  gint64             phase_time;
+
+  start_time = g_get_monotonic_time ();
+  memset (stats, 0, sizeof (*stats));
+
   /* Make sure to reset the menu to a loadable state */
   pojk_menu_clear (menu);
 
@@ -709,61 +1300,311 @@ pojk_menu_load (PojkMenu   *menu,
 
     }
 
-  parser = pojk_menu_parser_new (menu->priv->file);
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    return FALSE;
+
+  /* Try to restore the merged tree and the items from an up to date snapshot */
+  phase_time = g_get_monotonic_time ();
+  if (menu->priv->use_snapshot)
+    snapshot = _pojk_menu_snapshot_load (menu->priv->file);
 
-  if (pojk_menu_parser_run (parser, cancellable, error))
+  if (snapshot != NULL)
     {
-      merger = pojk_menu_merger_new (POJK_MENU_TREE_PROVIDER (parser));
+      memberships = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                           NULL, (GDestroyNotify) pojk_menu_item_list_free);
 
-      if (pojk_menu_merger_run (merger,
-                                  &menu->priv->merge_files,
-                                  &menu->priv->merge_dirs,
-                                  cancellable, error))
+      menu->priv->tree = _pojk_menu_snapshot_get_tree (snapshot, menu->priv->cache,
+                                                       memberships);
+
+      if (G_LIKELY (menu->priv->tree != NULL))
         {
-          menu->priv->tree =
-            pojk_menu_tree_provider_get_tree (POJK_MENU_TREE_PROVIDER (merger));
+          menu->priv->merge_files = _pojk_menu_snapshot_get_merge_files (snapshot);
+          menu->priv->merge_dirs = _pojk_menu_snapshot_get_merge_dirs (snapshot);
+          desktop_id_table = _pojk_menu_snapshot_get_desktop_id_table (snapshot);
         }
       else
         {
-          success = FALSE;
+          g_hash_table_unref (memberships);
+          memberships = NULL;
         }
 
-      g_object_unref (merger);
+      _pojk_menu_snapshot_free (snapshot);
     }
-  else
-    success = FALSE;
-
-  g_object_unref (parser);
+  stats->snapshot_time = g_get_monotonic_time () - phase_time;
+  stats->from_snapshot = (memberships != NULL);
 
-  if (!success)
+  /* Parse and merge the menu files otherwise */
+  if (menu->priv->tree == NULL
+      && !pojk_menu_load_tree (menu, cancellable, error))
     return FALSE;
 
   /* Generate submenus */
   pojk_menu_resolve_menus (menu);
 
   /* Resolve the menu directory */
-  pojk_menu_resolve_directory (menu, cancellable, TRUE);
+  phase_time = g_get_monotonic_time ();
+  if (!g_cancellable_is_cancelled (cancellable))
+    pojk_menu_resolve_directory (menu, cancellable, TRUE);
+  stats->directory_time = g_get_monotonic_time () - phase_time;
 
   /* Abort if the cancellable was cancelled */
   if (g_cancellable_set_error_if_cancelled (cancellable, error))
-    return FALSE;
+    {
+      if (memberships != NULL)
+        {
+          g_hash_table_unref (memberships);
+          g_hash_table_unref (desktop_id_table);
+        }
+      return FALSE;
+    }
 
-  desktop_id_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  if (memberships != NULL)
+    {
+      /* Fill the item pools with the items from the snapshot */
+      phase_time = g_get_monotonic_time ();
+      pojk_menu_restore_items (menu, memberships);
+      g_hash_table_unref (memberships);
+
+      /* Compile the rules of the restored tree, so that single changed
+       * desktop files can be applied as after a full load */
+      compiled = g_ptr_array_new_with_free_func ((GDestroyNotify) pojk_menu_rules_free);
+      pojk_menu_compile_rules (menu, compiled);
+      pojk_menu_keep_update_state (menu, desktop_id_table, compiled);
+      stats->snapshot_time += g_get_monotonic_time () - phase_time;
+
+      /* Remove deleted menus */
+      pojk_menu_remove_deleted_menus (menu);
+
+      success = TRUE;
+    }
+  else
+    {
+      success = pojk_menu_load_items (menu, cancellable, error);
+      if (success)
+        {
+          /* Remove deleted menus */
+          pojk_menu_remove_deleted_menus (menu);
 
-  /* Load menu items */
-  pojk_menu_collect_files (menu, desktop_id_table);
-  pojk_menu_resolve_items (menu, desktop_id_table, FALSE);
-  pojk_menu_resolve_items (menu, desktop_id_table, TRUE);
+          /* Store the result for the next load */
+          if (menu->priv->use_snapshot)
+            pojk_menu_save_snapshot (menu);
+        }
+    }
 
-  /* Remove deleted menus */
-  pojk_menu_remove_deleted_menus (menu);
+  /* Remember which items the menus got from which files */
+  if (success)
+    pojk_menu_index_files (menu);
 
-  g_hash_table_unref (desktop_id_table);
+  stats->total_time = g_get_monotonic_time () - start_time;
 
-  /* Initiate file system monitoring */
-  pojk_menu_start_monitoring (menu);
+  return success;
+}
 
-  return TRUE;
+
+
+static gboolean
+pojk_menu_load_items (PojkMenu     *menu,
+                      GCancellable *cancellable,
+                      GError      **error)
+{
+  PojkMenuLoadStats *stats = &menu->priv->load_stats;
+  GHashTable        *desktop_id_table;
+  GHashTable        *scanned_dirs;
+  PojkMenuItemIndex *index = NULL;
+  GPtrArray         *compiled;
+  gboolean           success;
+  gint64             phase_time;
+
+  desktop_id_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  /* Collect the desktop files from the application directories */
+  phase_time = g_get_monotonic_time ();
+  scanned_dirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  pojk_menu_collect_files (menu, menu, desktop_id_table, scanned_dirs);
+  g_hash_table_destroy (scanned_dirs);
+  stats->collect_time = g_get_monotonic_time () - phase_time;
+  stats->n_desktop_files = g_hash_table_size (desktop_id_table);
+
+  /* Load menu items, checking for cancellation after each step */
+  success = !g_cancellable_set_error_if_cancelled (cancellable, error);
+  if (success)
+    {
+      /* Pick up an item database written by another process */
+      _pojk_menu_item_cache_sync_database (menu->priv->cache);
+
+      phase_time = g_get_monotonic_time ();
+      pojk_menu_preload_items (menu, desktop_id_table);
+      stats->preload_time = g_get_monotonic_time () - phase_time;
+      success = !g_cancellable_set_error_if_cancelled (cancellable, error);
+    }
+
+  /* Collect the rules of all menus once for both passes */
+  compiled = g_ptr_array_new_with_free_func ((GDestroyNotify) pojk_menu_rules_free);
+  pojk_menu_compile_rules (menu, compiled);
+
+  if (success)
+    {
+      phase_time = g_get_monotonic_time ();
+      index = pojk_menu_index_items (menu, desktop_id_table);
+      pojk_menu_resolve_items (menu, index, compiled, FALSE);
+      stats->resolve_time = g_get_monotonic_time () - phase_time;
+      success = !g_cancellable_set_error_if_cancelled (cancellable, error);
+    }
+  if (success)
+    {
+      phase_time = g_get_monotonic_time ();
+      pojk_menu_resolve_items (menu, index, compiled, TRUE);
+      stats->resolve_unallocated_time = g_get_monotonic_time () - phase_time;
+      success = !g_cancellable_set_error_if_cancelled (cancellable, error);
+    }
+
+  _pojk_menu_item_index_free (index);
+
+  if (success)
+    {
+      pojk_menu_keep_update_state (menu, desktop_id_table, compiled);
+
+      /* Share the parsed system items with other processes */
+      _pojk_menu_item_cache_save_database (menu->priv->cache);
+    }
+  else
+    {
+      g_ptr_array_unref (compiled);
+      g_hash_table_unref (desktop_id_table);
+    }
+
+  return success;
+}
+
+
+
+static gboolean
+pojk_menu_load_tree (PojkMenu     *menu,
+                     GCancellable *cancellable,
+                     GError      **error)
+{
+  PojkMenuLoadStats *stats = &menu->priv->load_stats;
+  PojkMenuParser    *parser;
+  PojkMenuMerger    *merger;
+  gboolean           success = TRUE;
+  gint64             phase_time;
+
+  parser = pojk_menu_parser_new (menu->priv->file);
+
+  phase_time = g_get_monotonic_time ();
+  success = pojk_menu_parser_run (parser, cancellable, error);
+  stats->parse_time = g_get_monotonic_time () - phase_time;
+
+  if (success)
+    {
+      merger = pojk_menu_merger_new (POJK_MENU_TREE_PROVIDER (parser));
+
+      phase_time = g_get_monotonic_time ();
+      if (pojk_menu_merger_run (merger,
+                                  &menu->priv->merge_files,
+                                  &menu->priv->merge_dirs,
+                                  cancellable, error))
+        {
+          menu->priv->tree =
+            pojk_menu_tree_provider_get_tree (POJK_MENU_TREE_PROVIDER (merger));
+        }
+      else
+        {
+          success = FALSE;
+        }
+      stats->merge_time = g_get_monotonic_time () - phase_time;
+
+      g_object_unref (merger);
+    }
+
+  g_object_unref (parser);
+
+  return success;
+}
+
+
+
+static void
+pojk_menu_restore_items (PojkMenu   *menu,
+                         GHashTable *memberships)
+{
+  GList *lp;
+
+  /* Insert the items the snapshot recorded for this menu */
+  for (lp = g_hash_table_lookup (memberships, menu->priv->tree); lp != NULL; lp = lp->next)
+    pojk_menu_item_pool_insert (menu->priv->pool, lp->data);
+
+  for (lp = menu->priv->submenus; lp != NULL; lp = lp->next)
+    pojk_menu_restore_items (lp->data, memberships);
+}
+
+
+
+/* Keeps what is needed to update single items when desktop files
+ * change. Takes ownership of @desktop_id_table and @compiled */
+static void
+pojk_menu_keep_update_state (PojkMenu   *menu,
+                             GHashTable *desktop_id_table,
+                             GPtrArray  *compiled)
+{
+  menu->priv->desktop_id_table = desktop_id_table;
+  menu->priv->rules = compiled;
+
+  menu->priv->app_dir_roots = g_ptr_array_new_with_free_func (g_object_unref);
+  pojk_menu_collect_app_dir_roots (menu, menu->priv->app_dir_roots);
+}
+
+
+
+static void
+pojk_menu_item_list_free (GList *items)
+{
+  _pojk_g_list_free_full (items, g_object_unref);
+}
+
+
+
+static void
+pojk_menu_collect_pools (PojkMenu   *menu,
+                         GHashTable *memberships)
+{
+  GList *lp;
+
+  g_hash_table_insert (memberships, menu->priv->tree, menu->priv->pool);
+
+  for (lp = menu->priv->submenus; lp != NULL; lp = lp->next)
+    pojk_menu_collect_pools (lp->data, memberships);
+}
+
+
+
+static void
+pojk_menu_save_snapshot (PojkMenu *menu)
+{
+  GHashTable *memberships;
+  GError     *error = NULL;
+  GList      *app_dirs;
+
+  g_return_if_fail (POJK_IS_MENU (menu));
+  g_return_if_fail (menu->priv->parent == NULL);
+
+  memberships = g_hash_table_new (g_direct_hash, g_direct_equal);
+  pojk_menu_collect_pools (menu, memberships);
+
+  app_dirs = pojk_menu_get_app_dirs (menu, TRUE);
+
+  if (!_pojk_menu_snapshot_save (menu->priv->file, menu->priv->tree,
+                                 menu->priv->merge_files, menu->priv->merge_dirs,
+                                 app_dirs, memberships,
+                                 menu->priv->desktop_id_table, &error))
+    {
+      /* Not fatal, the menu is simply loaded from the files next time */
+      g_debug ("Failed to write menu snapshot: %s", error->message);
+      g_error_free (error);
+    }
+
+  g_list_free (app_dirs);
+  g_hash_table_unref (memberships);
 }
 
 
@@ -879,6 +1720,9 @@ pojk_menu_resolve_menus (PojkMenu *menu)
 
   g_return_if_fail (POJK_IS_MENU (menu));
 
+  /* Parents are described before their submenus */
+  pojk_menu_describe (menu);
+
   menus = pojk_menu_node_tree_get_child_nodes (menu->priv->tree,
                                                  POJK_MENU_NODE_TYPE_MENU,
                                                  FALSE);
@@ -899,20 +1743,109 @@ pojk_menu_resolve_menus (PojkMenu *menu)
 
 
 
-static GList *
-pojk_menu_get_directories (PojkMenu *menu)
+static void
+pojk_menu_describe (PojkMenu *menu)
 {
-  GList *dirs = NULL;
+  PojkMenuDescriptor *desc = &menu->priv->desc;
+  PojkMenuDescriptor *parent_desc;
+  GNode              *child;
+  gpointer            string;
 
-  /* Fetch all application directories */
-  dirs = pojk_menu_node_tree_get_string_children (menu->priv->tree,
-                                                    POJK_MENU_NODE_TYPE_DIRECTORY,
-                                                    TRUE);
+  pojk_menu_descriptor_clear (desc);
+
+  desc->rules = g_ptr_array_new ();
+
+  for (child = g_node_first_child (menu->priv->tree); child != NULL; child = g_node_next_sibling (child))
+    {
+      string = (gpointer) pojk_menu_node_tree_get_string (child);
+
+      /* The lists are built in reverse, the last element has priority */
+      switch (pojk_menu_node_tree_get_node_type (child))
+        {
+        case POJK_MENU_NODE_TYPE_NAME:
+          if (desc->name == NULL)
+            desc->name = string;
+          break;
+
+        case POJK_MENU_NODE_TYPE_DELETED:
+          desc->deleted = TRUE;
+          break;
+
+        case POJK_MENU_NODE_TYPE_ONLY_UNALLOCATED:
+          desc->only_unallocated = TRUE;
+          break;
+
+        case POJK_MENU_NODE_TYPE_DIRECTORY:
+          desc->directories = g_list_prepend (desc->directories, string);
+          break;
+
+        case POJK_MENU_NODE_TYPE_DIRECTORY_DIR:
+          desc->directory_dirs = g_list_prepend (desc->directory_dirs, string);
+          break;
+
+        case POJK_MENU_NODE_TYPE_APP_DIR:
+          desc->app_dirs = g_list_prepend (desc->app_dirs, string);
+          break;
+
+        case POJK_MENU_NODE_TYPE_LAYOUT:
+          desc->layout = child;
+          break;
+
+        case POJK_MENU_NODE_TYPE_DEFAULT_LAYOUT:
+          desc->default_layout = child;
+          break;
+
+        case POJK_MENU_NODE_TYPE_INCLUDE:
+        case POJK_MENU_NODE_TYPE_EXCLUDE:
+          g_ptr_array_add (desc->rules, child);
+          break;
+
+        default:
+          break;
+        }
+    }
 
+  /* Inherit from the parent menu, which was described already */
   if (menu->priv->parent != NULL)
-    dirs = g_list_concat (dirs, pojk_menu_get_directories (menu->priv->parent));
+    {
+      parent_desc = &menu->priv->parent->priv->desc;
 
-  return dirs;
+      desc->directories = g_list_concat (desc->directories,
+                                         g_list_copy (parent_desc->directories));
+      desc->directory_dirs = g_list_concat (desc->directory_dirs,
+                                            g_list_copy (parent_desc->directory_dirs));
+
+      if (desc->default_layout == NULL)
+        desc->default_layout = parent_desc->default_layout;
+    }
+
+  if (desc->layout == NULL)
+    desc->layout = desc->default_layout;
+}
+
+
+
+static void
+pojk_menu_descriptor_clear (PojkMenuDescriptor *desc)
+{
+  g_list_free (desc->directories);
+  g_list_free (desc->directory_dirs);
+  g_list_free (desc->app_dirs);
+
+  if (desc->rules != NULL)
+    g_ptr_array_unref (desc->rules);
+
+  memset (desc, 0, sizeof (*desc));
+}
+
+
+
+/* Returns the .directory file names to try for @menu. The list belongs
+ * to the menu */
+static GList *
+pojk_menu_get_directories (PojkMenu *menu)
+{
+  return menu->priv->desc.directories;
 }
 
 
@@ -952,9 +1885,6 @@ pojk_menu_resolve_directory (PojkMenu   *menu,
       menu->priv->directory = directory;
     }
 
-  /* Free reverse list copy */
-  g_list_free (directories);
-
   if (recursive)
     {
       /* Resolve directories of submenus recursively */
@@ -965,20 +1895,12 @@ pojk_menu_resolve_directory (PojkMenu   *menu,
 
 
 
+/* Returns the directories to look up .directory files for @menu in. The
+ * list belongs to the menu */
 static GList *
 pojk_menu_get_directory_dirs (PojkMenu *menu)
 {
-  GList *dirs = NULL;
-
-  /* Fetch all application directories */
-  dirs = pojk_menu_node_tree_get_string_children (menu->priv->tree,
-                                                    POJK_MENU_NODE_TYPE_DIRECTORY_DIR,
-                                                    TRUE);
-
-  if (menu->priv->parent != NULL)
-    dirs = g_list_concat (dirs, pojk_menu_get_directory_dirs (menu->priv->parent));
-
-  return dirs;
+  return menu->priv->desc.directory_dirs;
 }
 
 
@@ -1020,9 +1942,6 @@ pojk_menu_lookup_directory (PojkMenu  *menu,
       g_object_unref (dir);
     }
 
-  /* Free reverse copy */
-  g_list_free (dirs);
-
   return directory;
 }
 
@@ -1038,9 +1957,7 @@ pojk_menu_get_app_dirs (PojkMenu *menu,
   GList *submenu_app_dirs;
 
   /* Fetch all application directories */
-  dirs = pojk_menu_node_tree_get_string_children (menu->priv->tree,
-                                                    POJK_MENU_NODE_TYPE_APP_DIR,
-                                                    TRUE);
+  dirs = g_list_copy (menu->priv->desc.app_dirs);
 
   if (recursive)
     {
@@ -1060,12 +1977,17 @@ pojk_menu_get_app_dirs (PojkMenu *menu,
 
 
 static void
-pojk_menu_collect_files (PojkMenu *menu,
-                           GHashTable *desktop_id_table)
+pojk_menu_collect_files (PojkMenu   *menu,
+                         PojkMenu   *root,
+                         GHashTable *desktop_id_table,
+                         GHashTable *scanned_dirs)
 {
-  GList *app_dirs = NULL;
-  GList *iter;
-  GFile *file;
+  PojkMenuAppDirScan *scan;
+  gboolean            cache_hit;
+  GList              *app_dirs = NULL;
+  GList              *iter;
+  GFile              *file;
+  gchar              *uri;
 
   g_return_if_fail (POJK_IS_MENU (menu));
 
@@ -1075,7 +1997,30 @@ pojk_menu_collect_files (PojkMenu *menu,
   for (iter = app_dirs; iter != NULL; iter = g_list_next (iter))
     {
       file = g_file_new_for_uri (iter->data);
-      pojk_menu_collect_files_from_path (menu, desktop_id_table, file, NULL);
+      uri = g_file_get_uri (file);
+
+      /* Directories listed by several menus only need to be scanned once,
+       * all desktop-file ids found there are taken already */
+      if (g_hash_table_lookup (scanned_dirs, uri) != NULL)
+        {
+          root->priv->load_stats.n_app_dir_scan_hits++;
+          g_free (uri);
+        }
+      else
+        {
+          g_hash_table_insert (scanned_dirs, uri, GUINT_TO_POINTER (1));
+
+          scan = _pojk_menu_app_dir_scan_lookup (file, root->priv->use_app_dir_cache,
+                                                 &cache_hit);
+          if (cache_hit)
+            root->priv->load_stats.n_app_dir_scan_hits++;
+          else
+            root->priv->load_stats.n_app_dir_scans++;
+
+          _pojk_menu_app_dir_scan_merge (scan, desktop_id_table);
+          _pojk_menu_app_dir_scan_unref (scan);
+        }
+
       g_object_unref (file);
     }
 
@@ -1084,226 +2029,460 @@ pojk_menu_collect_files (PojkMenu *menu,
 
   /* Collect filenames for submenus */
   for (iter = menu->priv->submenus; iter != NULL; iter = g_list_next (iter))
-    pojk_menu_collect_files (iter->data, desktop_id_table);
+    pojk_menu_collect_files (iter->data, root, desktop_id_table, scanned_dirs);
 }
 
 
 
 static void
-pojk_menu_collect_files_from_path (PojkMenu  *menu,
-                                     GHashTable  *desktop_id_table,
-                                     GFile       *dir,
-                                     const gchar *id_prefix)
-{
-  GFileEnumerator *enumerator;
-  GFileInfo       *file_info;
-  GFile           *file;
-  gchar           *base_name;
-  gchar           *new_id_prefix;
-  gchar           *desktop_id;
+pojk_menu_collect_app_dir_roots (PojkMenu  *menu,
+                                 GPtrArray *roots)
+{
+  GList *app_dirs;
+  GList *iter;
+  GFile *file;
+  guint  n;
 
   g_return_if_fail (POJK_IS_MENU (menu));
 
-  /* Skip directory if it doesn't exist */
-  if (G_UNLIKELY (!g_file_query_exists (dir, NULL)))
-    return;
+  /* Same order as in pojk_menu_collect_files(), so desktop files in
+   * directories added earlier win */
+  app_dirs = pojk_menu_get_app_dirs (menu, FALSE);
 
-  /* Skip directory if it's not a directory */
-  if (G_UNLIKELY (g_file_query_file_type (dir, G_FILE_QUERY_INFO_NONE,
-                                          NULL) != G_FILE_TYPE_DIRECTORY))
+  for (iter = app_dirs; iter != NULL; iter = g_list_next (iter))
     {
-      return;
+      file = g_file_new_for_uri (iter->data);
+
+      for (n = 0; n < roots->len; n++)
+        if (g_file_equal (g_ptr_array_index (roots, n), file))
+          break;
+
+      if (n == roots->len)
+        g_ptr_array_add (roots, file);
+      else
+        g_object_unref (file);
     }
 
-  /* Open directory for reading */
-  enumerator = g_file_enumerate_children (dir, "standard::name,standard::type",
-                                          G_FILE_QUERY_INFO_NONE, NULL, NULL);
+  g_list_free (app_dirs);
 
-  /* Abort if directory cannot be opened */
-  if (G_UNLIKELY (enumerator == NULL))
-    return;
+  for (iter = menu->priv->submenus; iter != NULL; iter = g_list_next (iter))
+    pojk_menu_collect_app_dir_roots (iter->data, roots);
+}
 
-  /* Read file by file */
-  while (TRUE)
-    {
-      file_info = g_file_enumerator_next_file (enumerator, NULL, NULL);
 
-      if (G_UNLIKELY (file_info == NULL))
-        break;
 
-      file = g_file_resolve_relative_path (dir, g_file_info_get_name (file_info));
-      base_name = g_file_get_basename (file);
+/* Returns the number of threads for parsing desktop files and resolving
+ * rules, see the PojkMenu:parse-threads property */
+static guint
+pojk_menu_get_n_parse_threads (PojkMenu *menu)
+{
+  const gchar *threads;
+  guint        n_threads;
 
-      /* Treat files and directories differently */
-      if (g_file_info_get_file_type (file_info) == G_FILE_TYPE_DIRECTORY)
-        {
-          /* Create new desktop-file id prefix */
-          if (G_LIKELY (id_prefix == NULL))
-            new_id_prefix = g_strdup (base_name);
-          else
-            new_id_prefix = g_strjoin ("-", id_prefix, base_name, NULL);
+  if (menu->priv->parse_threads != 0)
+    return menu->priv->parse_threads;
 
-          /* Collect files in the directory */
-          pojk_menu_collect_files_from_path (menu, desktop_id_table, file, new_id_prefix);
+  threads = g_getenv ("POJK_MENU_PARSE_THREADS");
+  if (threads != NULL)
+    n_threads = g_ascii_strtoull (threads, NULL, 10);
+  else
+    n_threads = MIN (g_get_num_processors (), 8);
 
-          /* Free id prefix */
-          g_free (new_id_prefix);
-        }
-      else if (G_LIKELY (g_str_has_suffix (base_name, ".desktop")))
-        {
-          /* Create desktop-file id */
-          if (G_LIKELY (id_prefix == NULL))
-            desktop_id = g_strdup (base_name);
-          else
-            desktop_id = g_strjoin ("-", id_prefix, base_name, NULL);
+  return CLAMP (n_threads, 1, POJK_MENU_MAX_PARSE_THREADS);
+}
 
-          /* Insert into the files hash table if the desktop-file id does not exist there yet */
-          if (G_LIKELY (g_hash_table_lookup (desktop_id_table, desktop_id) == NULL))
-            g_hash_table_insert (desktop_id_table, desktop_id, g_file_get_uri (file));
-          else
-            g_free (desktop_id);
+
+
+static void
+pojk_menu_preload_items (PojkMenu   *menu,
+                         GHashTable *desktop_id_table)
+{
+  PojkMenuPreload data;
+  GHashTableIter  iter;
+  GThreadPool    *pool = NULL;
+  gpointer        desktop_id;
+  GError         *error = NULL;
+  guint           n_threads;
+
+  g_return_if_fail (POJK_IS_MENU (menu));
+
+  /* The workers only read the table, which is not modified until
+   * the pool has been shut down again */
+  data.cache = menu->priv->cache;
+  data.desktop_id_table = desktop_id_table;
+  data.n_parsed = 0;
+  data.n_unchanged = 0;
+
+  n_threads = pojk_menu_get_n_parse_threads (menu);
+  if (n_threads > 1)
+    {
+      pool = g_thread_pool_new ((GFunc) pojk_menu_preload_item, &data,
+                                n_threads, TRUE, &error);
+      if (G_UNLIKELY (pool == NULL))
+        {
+          /* Parse the desktop files on this thread then */
+          g_warning ("Failed to start desktop file parser threads: %s", error->message);
+          g_error_free (error);
         }
+    }
+
+  g_hash_table_iter_init (&iter, desktop_id_table);
+  while (g_hash_table_iter_next (&iter, &desktop_id, NULL))
+    {
+      if (pool != NULL)
+        g_thread_pool_push (pool, desktop_id, NULL);
+      else
+        pojk_menu_preload_item (desktop_id, &data);
+    }
+
+  /* Wait until all desktop files are in the item cache */
+  if (pool != NULL)
+    g_thread_pool_free (pool, FALSE, TRUE);
+
+  menu->priv->load_stats.n_items_parsed = data.n_parsed;
+  menu->priv->load_stats.n_item_cache_hits = g_hash_table_size (desktop_id_table) - data.n_parsed;
+  menu->priv->load_stats.n_reparses_avoided = data.n_unchanged;
+}
 
-      /* Free absolute path */
-      g_free (base_name);
 
-      /* Destroy file */
-      g_object_unref (file);
 
-      /* Destroy info */
-      g_object_unref (file_info);
+static void
+pojk_menu_preload_item (const gchar     *desktop_id,
+                        PojkMenuPreload *data)
+{
+  const gchar *uri;
+  gboolean     unchanged;
+
+  uri = g_hash_table_lookup (data->desktop_id_table, desktop_id);
+  if (_pojk_menu_item_cache_preload (data->cache, uri, desktop_id, &unchanged))
+    g_atomic_int_inc (&data->n_parsed);
+  else if (unchanged)
+    g_atomic_int_inc (&data->n_unchanged);
+}
+
+
+
+static void
+pojk_menu_compile_rules (PojkMenu  *menu,
+                         GPtrArray *compiled)
+{
+  PojkMenuRules *rules;
+  GPtrArray     *nodes = menu->priv->desc.rules;
+  GList         *submenu;
+  guint          n;
+
+  g_return_if_fail (POJK_IS_MENU (menu));
+
+  /* Menus without rules never get any items */
+  if (nodes != NULL && nodes->len > 0)
+    {
+      rules = g_slice_new (PojkMenuRules);
+      rules->menu = g_object_ref (menu);
+      rules->only_unallocated = menu->priv->desc.only_unallocated;
+      rules->nodes = g_ptr_array_ref (nodes);
+      rules->rules = g_ptr_array_new_full (nodes->len,
+                                           (GDestroyNotify) _pojk_menu_rule_program_free);
+
+      for (n = 0; n < nodes->len; n++)
+        {
+          _pojk_menu_node_tree_prepare_rule (g_ptr_array_index (nodes, n));
+          g_ptr_array_add (rules->rules,
+                           _pojk_menu_node_tree_compile_rule (g_ptr_array_index (nodes, n)));
+        }
+
+      g_ptr_array_add (compiled, rules);
     }
 
-  g_object_unref (enumerator);
+  /* Submenus follow their parent, in the same order the
+   * rules used to be resolved menu by menu */
+  for (submenu = menu->priv->submenus; submenu != NULL; submenu = g_list_next (submenu))
+    pojk_menu_compile_rules (submenu->data, compiled);
 }
 
 
 
-static gboolean
-collect_rules (GNode   *node,
-               GSList **list)
+static void
+pojk_menu_rules_free (PojkMenuRules *rules)
 {
-  PojkMenuNodeType type;
+  /* The reference keeps deleted menus around, their items still count
+   * as allocated when single items are updated */
+  g_object_unref (rules->menu);
+  g_ptr_array_free (rules->rules, TRUE);
+  g_ptr_array_unref (rules->nodes);
+  g_slice_free (PojkMenuRules, rules);
+}
+
 
-  type = pojk_menu_node_tree_get_node_type (node);
 
-  if (type == POJK_MENU_NODE_TYPE_INCLUDE ||
-      type == POJK_MENU_NODE_TYPE_EXCLUDE)
+static PojkMenuItemIndex *
+pojk_menu_index_items (PojkMenu   *menu,
+                       GHashTable *desktop_id_table)
+{
+  PojkMenuItemIndex *index;
+  PojkMenuItem      *item;
+  GHashTableIter     iter;
+  gpointer           desktop_id;
+  gpointer           uri;
+
+  index = _pojk_menu_item_index_new ();
+
+  g_hash_table_iter_init (&iter, desktop_id_table);
+  while (g_hash_table_iter_next (&iter, &desktop_id, &uri))
     {
-      *list = g_slist_append (*list, node);
+      /* Try to load the menu item from the cache, where it was checked
+       * against its file by pojk_menu_preload_items() already */
+      item = _pojk_menu_item_cache_lookup_preloaded (menu->priv->cache, uri, desktop_id);
+      if (G_LIKELY (item != NULL))
+        {
+          _pojk_menu_item_index_add (index, desktop_id, item);
+          g_object_unref (item);
+        }
     }
 
-  return FALSE;
+  return index;
 }
 
 
 
 static void
-pojk_menu_resolve_items (PojkMenu *menu,
-                           GHashTable *desktop_id_table,
-                           gboolean    only_unallocated)
+pojk_menu_resolve_items (PojkMenu          *menu,
+                         PojkMenuItemIndex *index,
+                         GPtrArray         *compiled,
+                         gboolean           only_unallocated)
 {
-  GSList  *rules = NULL;
-  GSList  *iter;
-  GList   *submenu;
-  gboolean menu_only_unallocated = FALSE;
+  PojkMenuResolve data;
+  PojkMenuRules  *rules;
+  guint           n;
 
   g_return_if_fail (POJK_IS_MENU (menu));
 
-  menu_only_unallocated =
-    pojk_menu_node_tree_get_boolean_child (menu->priv->tree,
-                                             POJK_MENU_NODE_TYPE_ONLY_UNALLOCATED);
-
-  /* Resolve items in this menu (if it matches the only_unallocated argument.
-   * This means that in the first pass, all items of menus without
-   * <OnlyUnallocated /> are resolved and in the second pass, only items of
-   * menus with <OnlyUnallocated /> are resolved */
-  if (menu_only_unallocated == only_unallocated)
+  data.index = index;
+  data.compiled = compiled;
+  data.only_unallocated = only_unallocated;
+  data.sets = g_new0 (GPtrArray *, compiled->len);
+  data.claims = NULL;
+  data.n_rules = 0;
+
+  /* In the first pass, all menus without <OnlyUnallocated /> are resolved
+   * and in the second pass, only menus with <OnlyUnallocated /> are. Every
+   * rule is resolved to the set of items it matches, which are then added
+   * to or removed from the pool in the same order pojk_menu_resolve_item()
+   * would do it item by item */
+  if (menu->priv->parallel_resolve && pojk_menu_get_n_parse_threads (menu) > 1)
     {
-      g_node_traverse (menu->priv->tree, G_IN_ORDER, G_TRAVERSE_ALL, 2,
-                       (GNodeTraverseFunc) collect_rules, &rules);
+      /* The menus of the first pass only change their own pools and the
+       * allocation counters, which they do not read. In the second pass,
+       * an unallocated item goes to the first menu including it, so the
+       * menus claim their items before any of them is added to a pool */
+      if (only_unallocated)
+        {
+          n = _pojk_menu_item_index_get_n_items (index);
+          data.claims = g_new (gint, MAX (n, 1));
+          while (n-- > 0)
+            data.claims[n] = G_MAXINT;
+        }
 
-      /* Iterate over all rules */
-      for (iter = rules; iter != NULL; iter = g_slist_next (iter))
+      pojk_menu_resolve_parallel (menu, (GFunc) pojk_menu_resolve_rules, &data);
+
+      if (data.claims != NULL)
         {
-          if (G_LIKELY (pojk_menu_node_tree_get_node_type (iter->data) == POJK_MENU_NODE_TYPE_INCLUDE))
-            {
-              /* Resolve available items and match them against this rule */
-              pojk_menu_resolve_items_by_rule (menu, desktop_id_table, iter->data);
-            }
-          else
-            {
-              /* Remove all items matching this exclude rule from the item pool */
-              pojk_menu_item_pool_apply_exclude_rule (menu->priv->pool, iter->data);
-            }
+          pojk_menu_resolve_parallel (menu, (GFunc) pojk_menu_apply_rules, &data);
+          g_free (data.claims);
+        }
+    }
+  else
+    {
+      for (n = 0; n < compiled->len; n++)
+        {
+          rules = g_ptr_array_index (compiled, n);
+          if (rules->only_unallocated == only_unallocated)
+            pojk_menu_resolve_rules (GUINT_TO_POINTER (n + 1), &data);
         }
+    }
+
+  g_free (data.sets);
+
+  menu->priv->load_stats.n_rules_evaluated += data.n_rules;
+}
+
+
+
+static void
+pojk_menu_resolve_parallel (PojkMenu        *menu,
+                            GFunc            func,
+                            PojkMenuResolve *data)
+{
+  PojkMenuRules *rules;
+  GThreadPool   *pool;
+  GError        *error = NULL;
+  guint          n;
 
-      /* Cleanup */
-      g_slist_free (rules);
+  pool = g_thread_pool_new (func, data, pojk_menu_get_n_parse_threads (menu), TRUE, &error);
+  if (G_UNLIKELY (pool == NULL))
+    {
+      /* Resolve the menus on this thread then */
+      g_warning ("Failed to start rule resolver threads: %s", error->message);
+      g_error_free (error);
     }
 
-  /* Iterate over all submenus */
-  for (submenu = menu->priv->submenus; submenu != NULL; submenu = g_list_next (submenu))
+  /* Positions are pushed off by one, the pool does not take NULL */
+  for (n = 0; n < data->compiled->len; n++)
     {
-      /* Resolve items of the submenu */
-      pojk_menu_resolve_items (POJK_MENU (submenu->data), desktop_id_table,
-                                 only_unallocated);
+      rules = g_ptr_array_index (data->compiled, n);
+      if (rules->only_unallocated != data->only_unallocated)
+        continue;
+
+      if (pool != NULL)
+        g_thread_pool_push (pool, GUINT_TO_POINTER (n + 1), NULL);
+      else
+        func (GUINT_TO_POINTER (n + 1), data);
     }
+
+  /* Wait until all menus are done */
+  if (pool != NULL)
+    g_thread_pool_free (pool, FALSE, TRUE);
 }
 
 
 
 static void
-pojk_menu_resolve_items_by_rule (PojkMenu *menu,
-                                   GHashTable *desktop_id_table,
-                                   GNode      *node)
+pojk_menu_claim_item (gint *claim,
+                      gint  position)
 {
-  PojkMenuPair pair;
+  gint current;
 
-  g_return_if_fail (POJK_IS_MENU (menu));
+  do
+    {
+      current = g_atomic_int_get (claim);
+      if (current <= position)
+        return;
+    }
+  while (!g_atomic_int_compare_and_exchange (claim, current, position));
+}
+
+
+
+/* Resolves the rules of the menu at @position in the compiled rules, and
+ * applies them right away unless the items have to be claimed first */
+static void
+pojk_menu_resolve_rules (gpointer         position,
+                         PojkMenuResolve *data)
+{
+  PojkMenuRules *rules;
+  GPtrArray     *sets;
+  GArray        *set;
+  GNode         *node;
+  guint          n = GPOINTER_TO_UINT (position) - 1;
+  guint          i;
+  guint          j;
+  gint           n_rules = 0;
+
+  rules = g_ptr_array_index (data->compiled, n);
+  sets = g_ptr_array_new_full (rules->nodes->len, (GDestroyNotify) g_array_unref);
+
+  for (i = 0; i < rules->nodes->len; i++)
+    {
+      node = g_ptr_array_index (rules->nodes, i);
+      set = _pojk_menu_node_tree_resolve_rule (node, data->index);
+      _pojk_menu_rule_program_check_set (g_ptr_array_index (rules->rules, i), set, data->index);
+
+      if (data->claims != NULL
+          && pojk_menu_node_tree_get_node_type (node) == POJK_MENU_NODE_TYPE_INCLUDE)
+        {
+          for (j = 0; j < set->len; j++)
+            pojk_menu_claim_item (&data->claims[g_array_index (set, guint, j)], n);
+        }
+
+      n_rules += set->len;
+      g_ptr_array_add (sets, set);
+    }
 
-  /* Store menu and rule pointer in the pair */
-  pair.first = menu;
-  pair.second = node;
+  g_atomic_int_add (&data->n_rules, n_rules);
 
-  /* Try to insert each of the collected desktop entry filenames into the menu */
-  g_hash_table_foreach (desktop_id_table, (GHFunc) pojk_menu_resolve_item_by_rule, &pair);
+  data->sets[n] = sets;
+  if (data->claims == NULL)
+    pojk_menu_apply_rules (position, data);
 }
 
 
 
 static void
-pojk_menu_resolve_item_by_rule (const gchar    *desktop_id,
-                                  const gchar    *uri,
-                                  PojkMenuPair *data)
+pojk_menu_apply_rules (gpointer         position,
+                       PojkMenuResolve *data)
 {
-  PojkMenuItem *item = NULL;
-  PojkMenu     *menu = NULL;
-  GNode          *node = NULL;
-  gboolean        only_unallocated = FALSE;
+  PojkMenuItemPool *pool;
+  PojkMenuRules    *rules;
+  PojkMenuItem     *item;
+  const gchar      *desktop_id;
+  GArray           *set;
+  GNode            *node;
+  guint             n = GPOINTER_TO_UINT (position) - 1;
+  guint             i;
+  guint             j;
+  guint             id;
+
+  rules = g_ptr_array_index (data->compiled, n);
+  pool = rules->menu->priv->pool;
+
+  for (i = 0; i < rules->nodes->len; i++)
+    {
+      node = g_ptr_array_index (rules->nodes, i);
+      set = g_ptr_array_index (data->sets[n], i);
+
+      for (j = 0; j < set->len; j++)
+        {
+          id = g_array_index (set, guint, j);
+          item = _pojk_menu_item_index_get_item (data->index, id);
+          desktop_id = _pojk_menu_item_index_get_item_desktop_id (data->index, id);
+
+          if (G_LIKELY (pojk_menu_node_tree_get_node_type (node) == POJK_MENU_NODE_TYPE_INCLUDE))
+            {
+              if (!data->only_unallocated
+                  || ((data->claims == NULL || data->claims[id] == (gint) n)
+                      && pojk_menu_item_get_allocated (item) == 0))
+                _pojk_menu_item_pool_insert (pool, desktop_id, item);
+            }
+          else
+            {
+              _pojk_menu_item_pool_exclude_item (pool, desktop_id, item, NULL);
+            }
+        }
+    }
 
-  g_return_if_fail (POJK_IS_MENU (data->first));
-  g_return_if_fail (data->second != NULL);
+  g_ptr_array_unref (data->sets[n]);
+  data->sets[n] = NULL;
+}
 
-  /* Restore menu and rule from the data pair */
-  menu = data->first;
-  node = data->second;
 
-  /* Try to load the menu item from the cache */
-  item = pojk_menu_item_cache_lookup (menu->priv->cache, uri, desktop_id);
 
-  if (G_LIKELY (item != NULL))
+static void
+pojk_menu_resolve_item (PojkMenuRules *rules,
+                        const gchar   *desktop_id,
+                        PojkMenuItem  *item)
+{
+  PojkMenuItemPool    *pool = rules->menu->priv->pool;
+  PojkMenuRuleProgram *program;
+  guint                n;
+
+  for (n = 0; n < rules->rules->len; n++)
     {
-      only_unallocated = pojk_menu_node_tree_get_boolean_child (menu->priv->tree,
-                                                                  POJK_MENU_NODE_TYPE_ONLY_UNALLOCATED);
+      program = g_ptr_array_index (rules->rules, n);
 
-      /* Only include item if menu not only includes unallocated items
-       * or if the item is not allocated yet */
-      if (!only_unallocated || pojk_menu_item_get_allocated (item) == 0)
+      if (G_LIKELY (!_pojk_menu_rule_program_is_exclude (program)))
         {
-          /* Add item to the pool if it matches the include rule */
-          if (G_LIKELY (pojk_menu_node_tree_rule_matches (node, item)))
-            pojk_menu_item_pool_insert (menu->priv->pool, item);
+          /* Only include item if menu not only includes unallocated items
+           * or if the item is not allocated yet */
+          if (!rules->only_unallocated || pojk_menu_item_get_allocated (item) == 0)
+            {
+              /* Add item to the pool if it matches the include rule */
+              if (_pojk_menu_rule_program_matches (program, item))
+                _pojk_menu_item_pool_insert (pool, desktop_id, item);
+            }
+        }
+      else
+        {
+          /* Remove the item from the pool if it matches this exclude rule */
+          _pojk_menu_item_pool_exclude_item (pool, desktop_id, item, program);
         }
     }
 }
@@ -1327,8 +2506,7 @@ pojk_menu_remove_deleted_menus (PojkMenu *menu)
       submenu = iter->data;
 
       /* Check whether there is a <Deleted/> element */
-      deleted = pojk_menu_node_tree_get_boolean_child (submenu->priv->tree,
-                                                         POJK_MENU_NODE_TYPE_DELETED);
+      deleted = submenu->priv->desc.deleted;
 
       /* Determine whether this submenu was deleted */
       if (G_LIKELY (submenu->priv->directory != NULL))
@@ -1353,17 +2531,40 @@ pojk_menu_remove_deleted_menus (PojkMenu *menu)
  * pojk_menu_get_item_pool:
  * @menu : a #PojkMenu.
  *
- * Get the item pool of the menu. This pool contains all items in this
- * menu (for that of its submenus).
+ * Get the item pool of the menu. This pool contains all items in this
+ * menu (for that of its submenus).
+ *
+ * Returns: a #PojkMenuItemPool.
+ **/
+PojkMenuItemPool*
+pojk_menu_get_item_pool (PojkMenu *menu)
+{
+  g_return_val_if_fail (POJK_IS_MENU (menu), NULL);
+
+  return menu->priv->pool;
+}
+
+
+
+/**
+ * pojk_menu_get_load_stats:
+ * @menu : a #PojkMenu.
+ *
+ * Returns how long the phases of the last pojk_menu_load() or
+ * pojk_menu_load_async() of @menu took and how much work they did.
+ * This is meant for diagnosing slow menus. Only the phases that ran
+ * are filled in, the others are zero.
  *
- * Returns: a #PojkMenuItemPool.
+ * Returns: the #PojkMenuLoadStats of the last load. The structure is
+ *          owned by @menu and overwritten by the next load.
  **/
-PojkMenuItemPool*
-pojk_menu_get_item_pool (PojkMenu *menu)
+const PojkMenuLoadStats *
+pojk_menu_get_load_stats (PojkMenu *menu)
 {
   g_return_val_if_fail (POJK_IS_MENU (menu), NULL);
+  g_return_val_if_fail (menu->priv->parent == NULL, NULL);
 
-  return menu->priv->pool;
+  return &menu->priv->load_stats;
 }
 
 
@@ -1415,28 +2616,12 @@ static GNode *
 pojk_menu_get_layout (PojkMenu *menu,
                         gboolean    default_only)
 {
-  GNode *layout = NULL;
-
   g_return_val_if_fail (POJK_IS_MENU (menu), NULL);
 
-  if (G_LIKELY (!default_only))
-    {
-      layout = pojk_menu_node_tree_get_child_node (menu->priv->tree,
-                                                     POJK_MENU_NODE_TYPE_LAYOUT,
-                                                     TRUE);
-    }
-
-  if (layout == NULL)
-    {
-      layout = pojk_menu_node_tree_get_child_node (menu->priv->tree,
-                                                     POJK_MENU_NODE_TYPE_DEFAULT_LAYOUT,
-                                                     TRUE);
-
-      if (layout == NULL && menu->priv->parent != NULL)
-        layout = pojk_menu_get_layout (menu->priv->parent, TRUE);
-    }
+  if (G_UNLIKELY (default_only))
+    return menu->priv->desc.default_layout;
 
-  return layout;
+  return menu->priv->desc.layout;
 }
 
 
@@ -1816,6 +3001,39 @@ pojk_menu_start_monitoring (PojkMenu *menu)
 
 
 
+/* Starts monitoring after a load and adds that to the load statistics */
+static void
+pojk_menu_start_monitoring_timed (PojkMenu *menu)
+{
+  PojkMenuLoadStats *stats = &menu->priv->load_stats;
+  gint64             phase_time;
+
+  phase_time = g_get_monotonic_time ();
+  pojk_menu_start_monitoring (menu);
+  stats->monitor_time = g_get_monotonic_time () - phase_time;
+
+  stats->total_time += stats->monitor_time;
+  stats->n_monitors = pojk_menu_count_monitors (menu);
+}
+
+
+
+static guint
+pojk_menu_count_monitors (PojkMenu *menu)
+{
+  GList *lp;
+  guint  n_monitors;
+
+  n_monitors = g_list_length (menu->priv->monitors);
+
+  for (lp = menu->priv->submenus; lp != NULL; lp = lp->next)
+    n_monitors += pojk_menu_count_monitors (lp->data);
+
+  return n_monitors;
+}
+
+
+
 static void
 pojk_menu_stop_monitoring (PojkMenu *menu)
 {
@@ -1841,7 +3059,10 @@ pojk_menu_stop_monitoring (PojkMenu *menu)
 
   /* Stop the idle source for handling file changes from being invoked */
   if (menu->priv->file_changed_idle != 0)
-    g_source_remove (menu->priv->file_changed_idle);
+    {
+      g_source_remove (menu->priv->file_changed_idle);
+      menu->priv->file_changed_idle = 0;
+    }
 
   /* Free the hash table for merging consecutive file change events */
   _pojk_g_slist_free_full (menu->priv->changed_files, g_object_unref);
@@ -2050,10 +3271,6 @@ pojk_menu_monitor_directory_dirs (PojkMenu *menu)
           g_object_unref (dir);
         }
     }
-
-  /* Free lists */
-  g_list_free (directory_dirs);
-  g_list_free (directory_files);
 }
 
 
@@ -2269,17 +3486,28 @@ pojk_menu_process_file_changes (PojkMenu *menu)
               item = pojk_menu_find_file_item (menu, file);
               if (item != NULL)
                 {
+                  if (_pojk_menu_item_check_file (item) == POJK_FILE_STAMP_UNCHANGED)
+                    {
+                      /* the file was only touched or its permissions were
+                       * changed, nothing to reload */
+                      pojk_menu_debug (file, 0, "file unchanged, not reloaded");
+                      menu->priv->load_stats.n_reparses_avoided++;
+                    }
                   /* try to reload the item */
-                  if (pojk_menu_item_reload (item, &affects_the_outside, NULL))
+                  else if (pojk_menu_item_reload (item, &affects_the_outside, NULL))
                     {
                       if (affects_the_outside)
                         {
                           /* if the categories changed, the item might have to be
-                           * moved around between different menus. this is slightly
-                           * more complicated than one would first think, so just
-                           * enforce a complete menu reload for now */
-                          pojk_menu_file_emit_reload_required (menu);
-                          stop_processing = TRUE;
+                           * moved around between different menus. run it through
+                           * the rules again and fall back to a complete menu
+                           * reload if that is not possible */
+                          if (!pojk_menu_update_file (menu, file, FALSE, item))
+                            {
+                              pojk_menu_debug (file, 0, "update failed, full reload");
+                              pojk_menu_file_emit_reload_required (menu);
+                              stop_processing = TRUE;
+                            }
                         }
                       else
                         {
@@ -2299,22 +3527,27 @@ pojk_menu_process_file_changes (PojkMenu *menu)
 
                       /* failed to reload the menu item. this can have many reasons,
                        * one of them being that the file permissions might have changed
-                       * or that the file was deleted. handling most situations can be very
-                       * tricky, so, again, we just enfore a menu reload until we have
-                       * something better */
-                      pojk_menu_debug (file, 0, "auto reload failed");
-                      pojk_menu_file_emit_reload_required (menu);
-                      stop_processing = TRUE;
+                       * or that the file was deleted. the item is dropped from the
+                       * menus in that case, like a full reload would do */
+                      if (!pojk_menu_update_file (menu, file, FALSE, NULL))
+                        {
+                          pojk_menu_debug (file, 0, "auto reload failed");
+                          pojk_menu_file_emit_reload_required (menu);
+                          stop_processing = TRUE;
+                        }
                     }
                 }
               else
                 {
-                  /* there could be a lot of stuff happening here. seriously, this
-                   * stuff is complicated. for now, simply enforce a complete reload
-                   * of the menu structure */
-                  pojk_menu_debug (file, 0, "unknown file, full reload");
-                  pojk_menu_file_emit_reload_required (menu);
-                  stop_processing = TRUE;
+                  /* a new file, or one that did not match any menu so far. it
+                   * might hide a file with the same desktop id or match the
+                   * rules of some menus now */
+                  if (!pojk_menu_update_file (menu, file, FALSE, NULL))
+                    {
+                      pojk_menu_debug (file, 0, "unknown file, full reload");
+                      pojk_menu_file_emit_reload_required (menu);
+                      stop_processing = TRUE;
+                    }
                 }
             }
           g_free (path);
@@ -2350,7 +3583,6 @@ pojk_menu_app_dir_changed (PojkMenu       *menu,
                              GFileMonitorEvent event_type,
                              GFileMonitor     *monitor)
 {
-  PojkMenuItem *item;
   GFileType       file_type;
 
   g_return_if_fail (POJK_IS_MENU (menu));
@@ -2392,27 +3624,17 @@ pojk_menu_app_dir_changed (PojkMenu       *menu,
         }
       else
         {
-          /* a regular file was deleted, try to find the corresponding menu item */
-          item = pojk_menu_find_file_item (menu, file);
-          if (item != NULL)
-            {
-              /* remove the item from the desktop item cache so we are forced
-               * to reload it from disk the next time */
-              pojk_menu_item_cache_invalidate_file (menu->priv->cache, file);
-
-              /* ok, so a .desktop file was removed. of course we don't know
-               * yet whether there is a replacement in another app dir
-               * with lower priority. we could try to find out but for now
-               * it's easier to simply enforce a menu reload */
-              pojk_menu_debug (file, event_type, "file deleted");
-              pojk_menu_file_emit_reload_required (menu);
-            }
-          else
-            {
-              /* the deleted file hasn't been in use anyway, so removing it
-               * doesn't change anything. so we have nothing to do for a
-               * change, no f****ing menu reload! */
-            }
+          /* remove the item from the desktop item cache so we are forced
+           * to reload it from disk the next time */
+          pojk_menu_item_cache_invalidate_file (menu->priv->cache, file);
+
+          /* a regular file was deleted. remove its item from the menus and
+           * replace it with a file of the same desktop id in an app dir with
+           * lower priority, if there is one. if the file was not in use,
+           * nothing changes */
+          pojk_menu_debug (file, event_type, "file deleted");
+          if (!pojk_menu_update_file (menu, file, TRUE, NULL))
+            pojk_menu_file_emit_reload_required (menu);
         }
     }
 }
@@ -2466,20 +3688,508 @@ static PojkMenuItem *
 pojk_menu_find_file_item (PojkMenu *menu,
                             GFile      *file)
 {
-  PojkMenuItem *item = NULL;
-  GList          *lp;
+  PojkMenuFileEntry *entry = NULL;
+  gchar             *uri;
 
   g_return_val_if_fail (POJK_IS_MENU (menu), NULL);
+  g_return_val_if_fail (menu->priv->parent == NULL, NULL);
   g_return_val_if_fail (G_IS_FILE (file), NULL);
 
-  item = pojk_menu_item_pool_lookup_file (menu->priv->pool, file);
+  if (menu->priv->file_index != NULL)
+    {
+      uri = g_file_get_uri (file);
+      entry = g_hash_table_lookup (menu->priv->file_index, uri);
+      g_free (uri);
+    }
+
+  return entry != NULL ? entry->item : NULL;
+}
+
+
+
+static void
+pojk_menu_file_entry_free (PojkMenuFileEntry *entry)
+{
+  g_object_unref (entry->item);
+  g_slice_free (PojkMenuFileEntry, entry);
+}
+
+
+
+/* Builds the file index of the root menu @menu from the item pools of
+ * all its menus */
+static void
+pojk_menu_index_files (PojkMenu *menu)
+{
+  GList *lp;
+
+  if (menu->priv->parent == NULL)
+    {
+      if (menu->priv->file_index != NULL)
+        g_hash_table_unref (menu->priv->file_index);
+
+      menu->priv->file_index =
+        g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                               (GDestroyNotify) pojk_menu_file_entry_free);
+    }
+
+  pojk_menu_item_pool_foreach (menu->priv->pool, (GHFunc) pojk_menu_index_pool_item, menu);
+
+  for (lp = menu->priv->submenus; lp != NULL; lp = lp->next)
+    pojk_menu_index_files (lp->data);
+}
+
+
+
+static void
+pojk_menu_index_pool_item (const gchar  *desktop_id,
+                           PojkMenuItem *item,
+                           PojkMenu     *menu)
+{
+  pojk_menu_index_add_item (menu, item);
+}
+
+
+
+/* Records in the file index of the root menu that @menu contains @item.
+ * Like the menu tree walk this replaces, the first item found for a file
+ * wins if several items were loaded from it */
+static void
+pojk_menu_index_add_item (PojkMenu     *menu,
+                          PojkMenuItem *item)
+{
+  PojkMenuFileEntry *entry;
+  PojkMenu          *root;
+  gchar             *uri;
+
+  root = menu;
+  while (root->priv->parent != NULL)
+    root = root->priv->parent;
+
+  if (G_UNLIKELY (root->priv->file_index == NULL))
+    return;
+
+  uri = pojk_menu_item_get_uri (item);
+  entry = g_hash_table_lookup (root->priv->file_index, uri);
+
+  if (entry == NULL)
+    {
+      entry = g_slice_new (PojkMenuFileEntry);
+      entry->item = g_object_ref (item);
+      entry->n_menus = 0;
+      g_hash_table_insert (root->priv->file_index, uri, entry);
+    }
+  else
+    {
+      g_free (uri);
+    }
+
+  if (entry->item == item)
+    entry->n_menus++;
+}
+
+
+
+/* Records that @menu does not contain @item anymore. The entry of the
+ * file is dropped with the last menu */
+static void
+pojk_menu_index_remove_item (PojkMenu     *menu,
+                             PojkMenuItem *item)
+{
+  PojkMenuFileEntry *entry;
+  PojkMenu          *root;
+  gchar             *uri;
+
+  root = menu;
+  while (root->priv->parent != NULL)
+    root = root->priv->parent;
+
+  if (G_UNLIKELY (root->priv->file_index == NULL))
+    return;
+
+  uri = pojk_menu_item_get_uri (item);
+  entry = g_hash_table_lookup (root->priv->file_index, uri);
+
+  if (entry != NULL
+      && entry->item == item
+      && entry->n_menus > 0
+      && --entry->n_menus == 0)
+    g_hash_table_remove (root->priv->file_index, uri);
+
+  g_free (uri);
+}
+
+
+
+
+/* Returns the desktop id of @file inside the application directory @root,
+ * or %NULL if @file is not located in @root */
+static gchar *
+pojk_menu_get_desktop_id_in_dir (GFile *root,
+                                 GFile *file)
+{
+  gchar *desktop_id;
+
+  desktop_id = g_file_get_relative_path (root, file);
+  if (desktop_id != NULL)
+    g_strdelimit (desktop_id, G_DIR_SEPARATOR_S, '-');
+
+  return desktop_id;
+}
+
+
+
+/* Returns the index of the first application directory in which @file
+ * has @desktop_id, or -1 if there is none */
+static gint
+pojk_menu_get_desktop_id_rank (PojkMenu    *menu,
+                               GFile       *file,
+                               const gchar *desktop_id)
+{
+  gchar *file_id;
+  guint  n;
+  gint   rank = -1;
+
+  for (n = 0; rank < 0 && n < menu->priv->app_dir_roots->len; n++)
+    {
+      file_id = pojk_menu_get_desktop_id_in_dir (g_ptr_array_index (menu->priv->app_dir_roots, n),
+                                                 file);
+      if (g_strcmp0 (file_id, desktop_id) == 0)
+        rank = n;
+      g_free (file_id);
+    }
+
+  return rank;
+}
+
+
+
+/* Looks for a desktop file with @desktop_id in the application directories
+ * starting with the one at @rank. Returns %FALSE if the result is ambiguous
+ * because several files in one directory map to @desktop_id */
+static gboolean
+pojk_menu_find_desktop_file (PojkMenu    *menu,
+                             const gchar *desktop_id,
+                             guint        rank,
+                             GFile      **result)
+{
+  GString *path;
+  GFile   *file;
+  gchar  **parts;
+  guint    n_parts;
+  guint    n_found = 0;
+  guint    mask;
+  guint    n;
+  guint    i;
+
+  *result = NULL;
+
+  /* Every dash in a desktop id can be a directory separator */
+  parts = g_strsplit (desktop_id, "-", -1);
+  n_parts = g_strv_length (parts);
+
+  /* Give up on absurd numbers of candidates */
+  if (n_parts > 8)
+    {
+      g_strfreev (parts);
+      return FALSE;
+    }
+
+  path = g_string_new (NULL);
+
+  for (n = rank; *result == NULL && n < menu->priv->app_dir_roots->len; n++)
+    {
+      for (mask = 0; mask < (1u << (n_parts - 1)); mask++)
+        {
+          g_string_assign (path, parts[0]);
+          for (i = 1; i < n_parts; i++)
+            {
+              g_string_append_c (path, (mask & (1u << (i - 1))) != 0 ? G_DIR_SEPARATOR : '-');
+              g_string_append (path, parts[i]);
+            }
+
+          file = g_file_resolve_relative_path (g_ptr_array_index (menu->priv->app_dir_roots, n),
+                                               path->str);
+
+          if (g_file_query_file_type (file, G_FILE_QUERY_INFO_NONE, NULL) == G_FILE_TYPE_REGULAR)
+            {
+              n_found++;
+              if (*result == NULL)
+                *result = g_object_ref (file);
+            }
+
+          g_object_unref (file);
+        }
+
+      /* The order of the files inside a directory is undefined */
+      if (n_found > 1)
+        {
+          g_object_unref (*result);
+          *result = NULL;
+          break;
+        }
+    }
+
+  g_string_free (path, TRUE);
+  g_strfreev (parts);
+
+  return n_found <= 1;
+}
+
+
+
+/* Applies a created, changed or deleted desktop file to the loaded menu.
+ * @reloaded is the item of @file if it was already reloaded in place, or
+ * %NULL. Returns %FALSE if that is not possible and the menu needs to be
+ * reloaded */
+static gboolean
+pojk_menu_update_file (PojkMenu     *menu,
+                       GFile        *file,
+                       gboolean      deleted,
+                       PojkMenuItem *reloaded)
+{
+  gboolean success = TRUE;
+  gchar   *desktop_id;
+  gchar   *base_name;
+  guint    n;
+
+  g_return_val_if_fail (POJK_IS_MENU (menu), FALSE);
+  g_return_val_if_fail (menu->priv->parent == NULL, FALSE);
+
+  /* Menus that failed to load do not know their rules */
+  if (menu->priv->rules == NULL)
+    return FALSE;
+
+  base_name = g_file_get_basename (file);
+  if (!g_str_has_suffix (base_name, ".desktop"))
+    {
+      g_free (base_name);
+      return TRUE;
+    }
+  g_free (base_name);
+
+  /* The file has a desktop id for every application directory it is in */
+  for (n = 0; success && n < menu->priv->app_dir_roots->len; n++)
+    {
+      desktop_id = pojk_menu_get_desktop_id_in_dir (g_ptr_array_index (menu->priv->app_dir_roots, n),
+                                                    file);
+      if (desktop_id != NULL)
+        success = pojk_menu_update_desktop_file (menu, desktop_id, file, n, deleted, reloaded);
+      g_free (desktop_id);
+    }
+
+  return success;
+}
+
+
+
+static gboolean
+pojk_menu_update_desktop_file (PojkMenu     *menu,
+                               const gchar  *desktop_id,
+                               GFile        *file,
+                               guint         rank,
+                               gboolean      deleted,
+                               PojkMenuItem *reloaded)
+{
+  const gchar *current_uri;
+  gboolean     success = TRUE;
+  GFile       *current;
+  GFile       *replacement;
+  gchar       *uri;
+  gint         current_rank;
+
+  current_uri = g_hash_table_lookup (menu->priv->desktop_id_table, desktop_id);
+  uri = g_file_get_uri (file);
+
+  if (deleted)
+    {
+      /* Nothing changes if the file was hidden by another one */
+      if (g_strcmp0 (current_uri, uri) == 0)
+        {
+          /* Fall back to a file in a directory with lower priority */
+          success = pojk_menu_find_desktop_file (menu, desktop_id, rank, &replacement);
+          if (success)
+            {
+              pojk_menu_update_desktop_id (menu, desktop_id, replacement, NULL);
+              if (replacement != NULL)
+                g_object_unref (replacement);
+            }
+        }
+    }
+  else if (current_uri == NULL)
+    {
+      /* A new desktop id */
+      pojk_menu_update_desktop_id (menu, desktop_id, file, NULL);
+    }
+  else if (g_str_equal (current_uri, uri))
+    {
+      /* The file in use changed */
+      pojk_menu_update_desktop_id (menu, desktop_id, file, reloaded);
+    }
+  else
+    {
+      current = g_file_new_for_uri (current_uri);
+      current_rank = pojk_menu_get_desktop_id_rank (menu, current, desktop_id);
+      g_object_unref (current);
+
+      /* The order of the files inside a directory is undefined */
+      if (current_rank == (gint) rank)
+        success = FALSE;
+      else if (current_rank < 0 || (gint) rank < current_rank)
+        pojk_menu_update_desktop_id (menu, desktop_id, file, NULL);
+    }
+
+  g_free (uri);
+
+  return success;
+}
+
+
+
+/* Makes @file the desktop file for @desktop_id, or removes @desktop_id
+ * if @file is %NULL, and updates the menus accordingly. If the item in
+ * use for @desktop_id is @reloaded, it was already reloaded from @file
+ * and is only run through the rules again */
+static void
+pojk_menu_update_desktop_id (PojkMenu     *menu,
+                             const gchar  *desktop_id,
+                             GFile        *file,
+                             PojkMenuItem *reloaded)
+{
+  PojkMenuRules *rules;
+  PojkMenuItem  *old_item = NULL;
+  PojkMenuItem  *new_item = NULL;
+  gchar         *uri;
+  guint          n;
+
+  /* Find the item currently used for this desktop id */
+  for (n = 0; old_item == NULL && n < menu->priv->rules->len; n++)
+    {
+      rules = g_ptr_array_index (menu->priv->rules, n);
+      old_item = pojk_menu_item_pool_lookup (rules->menu->priv->pool, desktop_id);
+    }
+
+  /* Keep the new item in the cache until the menus allocated it */
+  _pojk_menu_item_cache_begin_load (menu->priv->cache);
+
+  if (file != NULL)
+    {
+      uri = g_file_get_uri (file);
+
+      if (reloaded != NULL && reloaded == old_item)
+        {
+          /* Keep the object, so listeners only see its changed signal
+           * and the menus it moves in or out of */
+          new_item = g_object_ref (reloaded);
+        }
+      else
+        {
+          /* Parse the file again */
+          pojk_menu_item_cache_invalidate_file (menu->priv->cache, file);
+          new_item = _pojk_menu_item_cache_lookup (menu->priv->cache, uri, desktop_id);
+        }
+
+      g_hash_table_replace (menu->priv->desktop_id_table, g_strdup (desktop_id), uri);
+    }
+  else
+    {
+      g_hash_table_remove (menu->priv->desktop_id_table, desktop_id);
+    }
+
+  pojk_menu_replace_item (menu, desktop_id, old_item, new_item);
+
+  _pojk_menu_item_cache_finish_load (menu->priv->cache);
+
+  if (new_item != NULL)
+    g_object_unref (new_item);
+}
+
+
+
+static void
+pojk_menu_replace_item (PojkMenu     *menu,
+                        const gchar  *desktop_id,
+                        PojkMenuItem *old_item,
+                        PojkMenuItem *new_item)
+{
+  PojkMenuRules *rules;
+  PojkMenuItem  *item;
+  gboolean      *had_item;
+  gboolean       has_item;
+  guint          pass;
+  guint          n;
+
+  had_item = g_new0 (gboolean, menu->priv->rules->len);
+
+  /* Keep the old item alive for the signal emissions */
+  if (old_item != NULL)
+    g_object_ref (old_item);
+
+  /* Take the old item out of all menus */
+  for (n = 0; n < menu->priv->rules->len; n++)
+    {
+      rules = g_ptr_array_index (menu->priv->rules, n);
+      item = pojk_menu_item_pool_lookup (rules->menu->priv->pool, desktop_id);
+      if (item != NULL && item == old_item)
+        {
+          had_item[n] = TRUE;
+          _pojk_menu_item_pool_remove (rules->menu->priv->pool, desktop_id);
+        }
+    }
+
+  /* Run the new item through the rules of all menus, the ones with
+   * <OnlyUnallocated /> last, exactly like pojk_menu_load() does */
+  if (new_item != NULL)
+    {
+      for (pass = 0; pass < 2; pass++)
+        for (n = 0; n < menu->priv->rules->len; n++)
+          {
+            rules = g_ptr_array_index (menu->priv->rules, n);
+            if (rules->only_unallocated == (pass == 1))
+              pojk_menu_resolve_item (rules, desktop_id, new_item);
+          }
+    }
+
+  /* Update the file index, dropping the old item first in case both
+   * items were loaded from the same file */
+  for (n = 0; n < menu->priv->rules->len; n++)
+    {
+      rules = g_ptr_array_index (menu->priv->rules, n);
+
+      item = pojk_menu_item_pool_lookup (rules->menu->priv->pool, desktop_id);
+      has_item = (new_item != NULL && item == new_item);
+
+      if (had_item[n] && (!has_item || old_item != new_item))
+        pojk_menu_index_remove_item (rules->menu, old_item);
+    }
+  for (n = 0; n < menu->priv->rules->len; n++)
+    {
+      rules = g_ptr_array_index (menu->priv->rules, n);
+
+      item = pojk_menu_item_pool_lookup (rules->menu->priv->pool, desktop_id);
+      has_item = (new_item != NULL && item == new_item);
+
+      if (has_item && (!had_item[n] || old_item != new_item))
+        pojk_menu_index_add_item (rules->menu, new_item);
+    }
 
-  if (item == NULL)
+  /* Tell the menus whose items changed */
+  for (n = 0; n < menu->priv->rules->len; n++)
     {
-      for (lp = menu->priv->submenus; item == NULL && lp != NULL; lp = lp->next)
-        item = pojk_menu_find_file_item (lp->data, file);
+      rules = g_ptr_array_index (menu->priv->rules, n);
+
+      item = pojk_menu_item_pool_lookup (rules->menu->priv->pool, desktop_id);
+      has_item = (new_item != NULL && item == new_item);
+
+      if (had_item[n] && (!has_item || old_item != new_item))
+        g_signal_emit (rules->menu, menu_signals[ITEM_REMOVED], 0, old_item);
+
+      if (has_item && (!had_item[n] || old_item != new_item))
+        g_signal_emit (rules->menu, menu_signals[ITEM_ADDED], 0, new_item);
     }
 
-  return item;
+  if (old_item != NULL)
+    g_object_unref (old_item);
 
+  g_free (had_item);
 }
@@ -41,6 +41,69 @@ typedef struct _PojkMenuPrivate PojkMenuPrivate;
 typedef struct _PojkMenuClass   PojkMenuClass;
 typedef struct _PojkMenu        PojkMenu;
 
+typedef struct _PojkMenuLoadStats PojkMenuLoadStats;
+
+/**
+ * PojkMenuLoadStats:
+ * @total_time               : time spent in the whole load.
+ * @snapshot_time            : time spent restoring the menu from a snapshot.
+ * @parse_time               : time spent parsing the menu files.
+ * @merge_time               : time spent merging the menu files.
+ * @collect_time             : time spent scanning the application directories.
+ * @preload_time             : time spent parsing desktop files.
+ * @resolve_time             : time spent in the first rule resolution pass.
+ * @resolve_unallocated_time : time spent in the second rule resolution pass,
+ *                             for menus with &lt;OnlyUnallocated/&gt;.
+ * @directory_time           : time spent resolving the .directory files.
+ * @monitor_time             : time spent setting up file monitors.
+ * @n_desktop_files          : number of desktop-file ids found in the
+ *                             application directories.
+ * @n_items_parsed           : number of desktop files parsed.
+ * @n_item_cache_hits        : number of desktop files found in the item cache.
+ * @n_app_dir_scans          : number of application directories scanned.
+ * @n_app_dir_scan_hits      : number of application directory scans reused.
+ * @n_rules_evaluated        : number of items matched by the Include and
+ *                             Exclude rules, summed over all rules. The
+ *                             rules are resolved to sets of items and are
+ *                             not applied to each item one by one, so
+ *                             items a rule does not match are not counted.
+ * @n_monitors               : number of file monitors created.
+ * @n_reparses_avoided       : number of desktop files that were not parsed
+ *                             again because their device, inode, size and
+ *                             modification time did not change, both for
+ *                             cached items during the load and on file
+ *                             monitor events since.
+ * @from_snapshot            : whether the menu was restored from a snapshot.
+ *
+ * Statistics of the last pojk_menu_load() or pojk_menu_load_async() of a
+ * menu, see pojk_menu_get_load_stats(). All times are monotonic and in
+ * microseconds.
+ **/
+struct _PojkMenuLoadStats
+{
+  gint64   total_time;
+  gint64   snapshot_time;
+  gint64   parse_time;
+  gint64   merge_time;
+  gint64   collect_time;
+  gint64   preload_time;
+  gint64   resolve_time;
+  gint64   resolve_unallocated_time;
+  gint64   directory_time;
+  gint64   monitor_time;
+
+  guint    n_desktop_files;
+  guint    n_items_parsed;
+  guint    n_item_cache_hits;
+  guint    n_app_dir_scans;
+  guint    n_app_dir_scan_hits;
+  guint    n_rules_evaluated;
+  guint    n_monitors;
+  guint    n_reparses_avoided;
+
+  gboolean from_snapshot;
+};
+
 GType                pojk_menu_get_type           (void) G_GNUC_CONST;
 
 PojkMenu          *pojk_menu_new                (GFile        *file) G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
@@ -49,6 +112,13 @@ PojkMenu          *pojk_menu_new_applications   (void) G_GNUC_MALLOC G_GNUC_WARN
 gboolean             pojk_menu_load               (PojkMenu   *menu,
                                                      GCancellable *cancellable,
                                                      GError      **error);
+void                 pojk_menu_load_async         (PojkMenu   *menu,
+                                                     GCancellable *cancellable,
+                                                     GAsyncReadyCallback callback,
+                                                     gpointer      user_data);
+gboolean             pojk_menu_load_finish        (PojkMenu   *menu,
+                                                     GAsyncResult *result,
+                                                     GError      **error);
 GFile               *pojk_menu_get_file           (PojkMenu   *menu);
 PojkMenuDirectory *pojk_menu_get_directory      (PojkMenu   *menu);
 GList               *pojk_menu_get_menus          (PojkMenu   *menu);
@@ -58,6 +128,7 @@ PojkMenu          *pojk_menu_get_menu_with_name (PojkMenu   *menu,
                                                      const gchar  *name);
 PojkMenu          *pojk_menu_get_parent         (PojkMenu   *menu);
 PojkMenuItemPool  *pojk_menu_get_item_pool      (PojkMenu   *menu);
+const PojkMenuLoadStats *pojk_menu_get_load_stats (PojkMenu *menu);
 GList               *pojk_menu_get_items          (PojkMenu   *menu);
 GList               *pojk_menu_get_elements       (PojkMenu   *menu);
 
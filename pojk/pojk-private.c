@@ -22,6 +22,17 @@
 #include <config.h>
 #endif
 
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <glib/gstdio.h>
 #include <gio/gio.h>
 
 #include <pojk/pojk-private.h>
@@ -110,3 +121,117 @@ _pojk_file_get_uri_relative_to_file (const gchar *path,
 
   return uri;
 }
+
+
+
+/* Returns the interned copy of @string, or %NULL if @string was never
+ * interned and hence is not used by any item */
+const gchar *
+_pojk_intern_lookup (const gchar *string)
+{
+  GQuark quark;
+
+  quark = g_quark_try_string (string);
+  if (quark == 0)
+    return NULL;
+
+  return g_quark_to_string (quark);
+}
+
+
+
+/* Replaces the strings of @strv with interned ones. Takes ownership of
+ * @strv, the result is freed with g_free() */
+const gchar **
+_pojk_intern_strv (gchar **strv)
+{
+  const gchar **interned;
+  gchar        *string;
+  guint         n;
+
+  if (strv == NULL)
+    return NULL;
+
+  interned = (const gchar **) strv;
+  for (n = 0; strv[n] != NULL; n++)
+    {
+      string = strv[n];
+      interned[n] = g_intern_string (string);
+      g_free (string);
+    }
+
+  return interned;
+}
+
+
+
+gboolean
+_pojk_intern_strv_contains (const gchar * const *strv,
+                            const gchar         *string)
+{
+  guint n;
+
+  for (n = 0; strv[n] != NULL; n++)
+    if (strv[n] == string)
+      return TRUE;
+
+  return FALSE;
+}
+
+
+
+
+/* Modification time of a stat'ed file in nanoseconds, as precise as
+ * the platform records it */
+gint64
+_pojk_stat_get_mtime (const GStatBuf *statb)
+{
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+  return (gint64) statb->st_mtime * G_GINT64_CONSTANT (1000000000) + statb->st_mtim.tv_nsec;
+#else
+  return (gint64) statb->st_mtime * G_GINT64_CONSTANT (1000000000);
+#endif
+}
+
+
+
+void
+_pojk_file_stamp_get (PojkFileStamp *stamp,
+                      const gchar   *filename)
+{
+  GStatBuf statb;
+
+  if (filename == NULL || g_stat (filename, &statb) != 0)
+    {
+      memset (stamp, 0, sizeof (*stamp));
+      return;
+    }
+
+  _pojk_file_stamp_set_stat (stamp, &statb);
+}
+
+
+
+void
+_pojk_file_stamp_set_stat (PojkFileStamp  *stamp,
+                           const GStatBuf *statb)
+{
+  stamp->device = statb->st_dev;
+  stamp->inode = statb->st_ino;
+  stamp->size = statb->st_size;
+  stamp->mtime = _pojk_stat_get_mtime (statb);
+}
+
+
+
+/* Whether both stamps are known and describe the same file contents */
+gboolean
+_pojk_file_stamp_equal (const PojkFileStamp *a,
+                        const PojkFileStamp *b)
+{
+  return a->inode != 0
+         && a->inode == b->inode
+         && a->device == b->device
+         && a->size == b->size
+         && a->mtime == b->mtime;
+}
@@ -26,6 +26,15 @@
 #ifndef __POJK_PRIVATE_H__
 #define __POJK_PRIVATE_H__
 
+#include <glib/gstdio.h>
+
+#include <pojk/pojk-category-set.h>
+#include <pojk/pojk-menu-item.h>
+#include <pojk/pojk-menu-item-cache.h>
+#include <pojk/pojk-menu-item-index.h>
+#include <pojk/pojk-menu-item-pool.h>
+#include <pojk/pojk-menu-node.h>
+
 G_BEGIN_DECLS
 
 /* Macro for new g_?list_free_full function */
@@ -56,6 +65,119 @@ GFile    *_pojk_file_new_relative_to_file     (const gchar *path,
 gchar    *_pojk_file_get_uri_relative_to_file (const gchar *path,
                                                  GFile       *file);
 
+/* Categories and desktop names are interned with g_intern_string(), so
+ * equal strings have equal pointers. Keywords are not, as they are no
+ * closed set */
+const gchar          *_pojk_intern_lookup         (const gchar          *string);
+const gchar         **_pojk_intern_strv           (gchar               **strv);
+gboolean              _pojk_intern_strv_contains  (const gchar * const  *strv,
+                                                   const gchar          *string);
+
+const gchar * const  *_pojk_get_environment_names (void);
+
+/* Identity of a local file at the time it was read. A zero inode means
+ * the file could not be stat'ed */
+typedef struct _PojkFileStamp PojkFileStamp;
+struct _PojkFileStamp
+{
+  guint64 device;
+  guint64 inode;
+  gint64  size;
+  gint64  mtime;
+};
+
+typedef enum
+{
+  POJK_FILE_STAMP_UNKNOWN,
+  POJK_FILE_STAMP_UNCHANGED,
+  POJK_FILE_STAMP_CHANGED,
+} PojkFileStampState;
+
+gint64                _pojk_stat_get_mtime        (const GStatBuf       *statb);
+void                  _pojk_file_stamp_get        (PojkFileStamp        *stamp,
+                                                   const gchar          *filename);
+void                  _pojk_file_stamp_set_stat   (PojkFileStamp        *stamp,
+                                                   const GStatBuf       *statb);
+gboolean              _pojk_file_stamp_equal      (const PojkFileStamp  *a,
+                                                   const PojkFileStamp  *b);
+
+/* Serialized form of a menu item, used by the menu snapshot cache and the
+ * item database */
+#define _POJK_MENU_ITEM_VARIANT_TYPE "(smsmsmsmsmsmsmsmsbbbbbbasasmasmasa(msmsms))"
+
+PojkMenuItemAction *_pojk_menu_item_action_new_take (gchar *name,
+                                                     gchar *command,
+                                                     gchar *icon_name);
+
+PojkMenuItem      *_pojk_menu_item_new_lazy      (GFile             *file,
+                                                  const gchar       *desktop_id);
+PojkFileStampState _pojk_menu_item_check_file    (PojkMenuItem      *item);
+void               _pojk_menu_item_get_stamp     (PojkMenuItem        *item,
+                                                  PojkFileStamp       *stamp);
+void               _pojk_menu_item_set_stamp     (PojkMenuItem        *item,
+                                                  const PojkFileStamp *stamp);
+gsize              _pojk_menu_item_get_memory_size (PojkMenuItem    *item);
+gint               _pojk_menu_item_get_size_serial (PojkMenuItem    *item);
+
+/* Plain node stored in menu trees, see pojk-menu-node.c */
+typedef struct _PojkMenuTreeNode PojkMenuTreeNode;
+typedef struct _PojkMenuNodeSlab PojkMenuNodeSlab;
+
+PojkMenuNodeSlab      *_pojk_menu_node_slab_new          (void);
+void                   _pojk_menu_node_slab_free         (PojkMenuNodeSlab *slab);
+PojkMenuTreeNode      *_pojk_menu_tree_node_new          (PojkMenuNodeSlab *slab,
+                                                          PojkMenuNodeType  node_type,
+                                                          gconstpointer     value);
+
+const PojkCategorySet *_pojk_menu_item_get_category_set  (PojkMenuItem *item);
+void                   _pojk_menu_node_tree_prepare_rule (GNode        *tree);
+
+/* Include or Exclude rule compiled by _pojk_menu_node_tree_compile_rule() */
+typedef struct _PojkMenuRuleProgram PojkMenuRuleProgram;
+
+PojkMenuRuleProgram   *_pojk_menu_node_tree_compile_rule  (GNode                     *tree);
+void                   _pojk_menu_rule_program_free       (PojkMenuRuleProgram       *program);
+gboolean               _pojk_menu_rule_program_is_exclude (const PojkMenuRuleProgram *program);
+gboolean               _pojk_menu_rule_program_matches    (const PojkMenuRuleProgram *program,
+                                                           PojkMenuItem              *item);
+void                   _pojk_menu_rule_program_check_set  (const PojkMenuRuleProgram *program,
+                                                           GArray                    *set,
+                                                           PojkMenuItemIndex         *index);
+
+GArray                *_pojk_menu_node_tree_resolve_rule  (GNode                     *tree,
+                                                           PojkMenuItemIndex         *index);
+
+GVariant          *_pojk_menu_item_serialize     (PojkMenuItem      *item);
+PojkMenuItem      *_pojk_menu_item_deserialize   (GVariant          *variant);
+
+PojkMenuItem      *_pojk_menu_item_cache_insert  (PojkMenuItemCache *cache,
+                                                  const gchar       *uri,
+                                                  PojkMenuItem      *item);
+gboolean           _pojk_menu_item_cache_preload (PojkMenuItemCache *cache,
+                                                  const gchar       *uri,
+                                                  const gchar       *desktop_id,
+                                                  gboolean          *unchanged);
+PojkMenuItem      *_pojk_menu_item_cache_lookup  (PojkMenuItemCache *cache,
+                                                  const gchar       *uri,
+                                                  const gchar       *desktop_id);
+PojkMenuItem      *_pojk_menu_item_cache_lookup_preloaded (PojkMenuItemCache *cache,
+                                                           const gchar       *uri,
+                                                           const gchar       *desktop_id);
+void               _pojk_menu_item_cache_begin_load       (PojkMenuItemCache *cache);
+void               _pojk_menu_item_cache_finish_load      (PojkMenuItemCache *cache);
+void               _pojk_menu_item_cache_sync_database    (PojkMenuItemCache *cache);
+void               _pojk_menu_item_cache_save_database    (PojkMenuItemCache *cache);
+
+void               _pojk_menu_item_pool_insert       (PojkMenuItemPool *pool,
+                                                      const gchar      *desktop_id,
+                                                      PojkMenuItem     *item);
+void               _pojk_menu_item_pool_remove       (PojkMenuItemPool *pool,
+                                                      const gchar      *desktop_id);
+void               _pojk_menu_item_pool_exclude_item (PojkMenuItemPool          *pool,
+                                                      const gchar               *desktop_id,
+                                                      PojkMenuItem              *item,
+                                                      const PojkMenuRuleProgram *program);
+
 G_END_DECLS
 
 #endif /* !__POJK_PRIVATE_H__ */
@@ -0,0 +1,236 @@
+/*-
+ * vi:set et ai sts=2 sw=2 cindent:
+ *
+ * Copyright (c) 2026 The pojk developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Compares parsing real desktop files with pojk_menu_item_new_for_path()
+ * to reading the same keys with XfceRc, which pojk used before.
+ *
+ * Usage: bench-desktop-entry [DIRECTORY [N_RUNS]]
+ *
+ * Without a directory, the applications directories of the system data
+ * directories are used. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#include <glib/gprintf.h>
+#include <libbladeutil/libbladeutil.h>
+
+#include <pojk/pojk.h>
+
+
+
+static void
+collect_files (const gchar *path,
+               GPtrArray   *files)
+{
+  GDir        *dir;
+  const gchar *name;
+  gchar       *filename;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      filename = g_build_filename (path, name, NULL);
+      if (g_file_test (filename, G_FILE_TEST_IS_DIR))
+        {
+          collect_files (filename, files);
+          g_free (filename);
+        }
+      else if (g_str_has_suffix (name, ".desktop"))
+        g_ptr_array_add (files, filename);
+      else
+        g_free (filename);
+    }
+
+  g_dir_close (dir);
+}
+
+
+
+static guint
+parse_pojk (GPtrArray *files)
+{
+  PojkMenuItem *item;
+  guint         n_items = 0;
+  guint         n;
+
+  for (n = 0; n < files->len; n++)
+    {
+      item = pojk_menu_item_new_for_path (g_ptr_array_index (files, n));
+      if (item != NULL)
+        {
+          n_items++;
+          g_object_unref (item);
+        }
+    }
+
+  return n_items;
+}
+
+
+
+/* Reads the keys that pojk_menu_item_new() reads */
+static guint
+parse_xfce_rc (GPtrArray *files)
+{
+  XfceRc *rc;
+  gchar **str_list;
+  guint   n_items = 0;
+  guint   n;
+
+  for (n = 0; n < files->len; n++)
+    {
+      rc = xfce_rc_simple_open (g_ptr_array_index (files, n), TRUE);
+      if (rc == NULL)
+        continue;
+
+      xfce_rc_set_group (rc, G_KEY_FILE_DESKTOP_GROUP);
+
+      if (xfce_rc_read_entry (rc, G_KEY_FILE_DESKTOP_KEY_NAME, NULL) != NULL
+          && (xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_EXEC, NULL) != NULL
+              || xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_URL, NULL) != NULL))
+        {
+          n_items++;
+
+          g_free (g_strdup (xfce_rc_read_entry (rc, G_KEY_FILE_DESKTOP_KEY_GENERIC_NAME, NULL)));
+          g_free (g_strdup (xfce_rc_read_entry (rc, G_KEY_FILE_DESKTOP_KEY_COMMENT, NULL)));
+          g_free (g_strdup (xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_TRY_EXEC, NULL)));
+          g_free (g_strdup (xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_ICON, NULL)));
+          g_free (g_strdup (xfce_rc_read_entry_untranslated (rc, G_KEY_FILE_DESKTOP_KEY_PATH, NULL)));
+          xfce_rc_read_bool_entry (rc, G_KEY_FILE_DESKTOP_KEY_TERMINAL, FALSE);
+          xfce_rc_read_bool_entry (rc, G_KEY_FILE_DESKTOP_KEY_NO_DISPLAY, FALSE);
+          xfce_rc_read_bool_entry (rc, G_KEY_FILE_DESKTOP_KEY_HIDDEN, FALSE);
+          xfce_rc_read_bool_entry (rc, G_KEY_FILE_DESKTOP_KEY_STARTUP_NOTIFY, FALSE);
+
+          str_list = xfce_rc_read_list_entry (rc, G_KEY_FILE_DESKTOP_KEY_CATEGORIES, ";");
+          g_strfreev (str_list);
+          str_list = xfce_rc_read_list_entry (rc, G_KEY_FILE_DESKTOP_KEY_KEYWORDS, ";");
+          g_strfreev (str_list);
+          str_list = xfce_rc_read_list_entry (rc, G_KEY_FILE_DESKTOP_KEY_ONLY_SHOW_IN, ";");
+          g_strfreev (str_list);
+          str_list = xfce_rc_read_list_entry (rc, G_KEY_FILE_DESKTOP_KEY_NOT_SHOW_IN, ";");
+          g_strfreev (str_list);
+          str_list = xfce_rc_read_list_entry (rc, G_KEY_FILE_DESKTOP_KEY_ACTIONS, ";");
+          g_strfreev (str_list);
+        }
+
+      xfce_rc_close (rc);
+    }
+
+  return n_items;
+}
+
+
+
+static gdouble
+run (const gchar *name,
+     guint      (*parse) (GPtrArray *files),
+     GPtrArray   *files,
+     guint        n_runs)
+{
+  GTimer *timer;
+  gdouble total = 0;
+  guint   n_items = 0;
+  guint   n;
+
+  timer = g_timer_new ();
+
+  for (n = 0; n < n_runs; n++)
+    {
+      g_timer_start (timer);
+      n_items = parse (files);
+      total += g_timer_elapsed (timer, NULL) * 1000;
+    }
+
+  g_timer_destroy (timer);
+
+  g_printf ("%-8s %.2f ms (average of %u runs, %u items)\n",
+            name, total / n_runs, n_runs, n_items);
+
+  return total / n_runs;
+}
+
+
+
+int
+main (int    argc,
+      char **argv)
+{
+  const gchar * const *dirs;
+  GPtrArray           *files;
+  gchar               *path;
+  guint                n_runs = 20;
+  guint                n;
+  gdouble              pojk_time;
+  gdouble              xfce_rc_time;
+
+  g_set_prgname ("bench-desktop-entry");
+
+  files = g_ptr_array_new_with_free_func (g_free);
+
+  if (argc > 1)
+    {
+      collect_files (argv[1], files);
+    }
+  else
+    {
+      dirs = g_get_system_data_dirs ();
+      for (n = 0; dirs[n] != NULL; n++)
+        {
+          path = g_build_filename (dirs[n], "applications", NULL);
+          collect_files (path, files);
+          g_free (path);
+        }
+    }
+
+  if (argc > 2)
+    n_runs = MAX (g_ascii_strtoull (argv[2], NULL, 10), 1);
+
+  if (files->len == 0)
+    g_error ("No desktop files found");
+
+  g_printf ("%u desktop files\n", files->len);
+
+  /* Fill the page cache so both parsers read from memory */
+  parse_pojk (files);
+
+  xfce_rc_time = run ("XfceRc", parse_xfce_rc, files, n_runs);
+  pojk_time = run ("pojk", parse_pojk, files, n_runs);
+
+  if (pojk_time > 0)
+    g_printf ("speedup: %.2fx\n", xfce_rc_time / pojk_time);
+
+  g_ptr_array_free (files, TRUE);
+
+#ifdef HAVE_STDLIB_H
+  return EXIT_SUCCESS;
+#else
+  return 0;
+#endif
+}
@@ -0,0 +1,242 @@
+/*-
+ * vi:set et ai sts=2 sw=2 cindent:
+ *
+ * Copyright (c) 2026 The pojk developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Looks up real desktop files in the default item cache from several
+ * threads at once. Every thread asks for all files, each starting at a
+ * different one, so the threads both parse different files at the same
+ * time and ask for files another thread is parsing.
+ *
+ * Usage: bench-item-cache [DIRECTORY [MAX_THREADS [N_RUNS]]]
+ *
+ * Without a directory, the applications directories of the system data
+ * directories are used. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#include <glib/gprintf.h>
+
+#include <pojk/pojk.h>
+
+
+
+typedef struct
+{
+  PojkMenuItemCache *cache;
+  GPtrArray         *uris;
+  GPtrArray         *desktop_ids;
+  guint              first;
+  guint              n_items;
+} LookupData;
+
+
+
+static void
+collect_files (const gchar *path,
+               GPtrArray   *uris,
+               GPtrArray   *desktop_ids)
+{
+  GDir        *dir;
+  const gchar *name;
+  gchar       *filename;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      filename = g_build_filename (path, name, NULL);
+      if (g_file_test (filename, G_FILE_TEST_IS_DIR))
+        {
+          collect_files (filename, uris, desktop_ids);
+        }
+      else if (g_str_has_suffix (name, ".desktop"))
+        {
+          g_ptr_array_add (uris, g_filename_to_uri (filename, NULL, NULL));
+          g_ptr_array_add (desktop_ids, g_strdup (name));
+        }
+      g_free (filename);
+    }
+
+  g_dir_close (dir);
+}
+
+
+
+static gpointer
+lookup_thread (gpointer user_data)
+{
+  LookupData *data = user_data;
+  guint       n;
+  guint       i;
+
+  data->n_items = 0;
+
+  for (n = 0; n < data->uris->len; n++)
+    {
+      i = (data->first + n) % data->uris->len;
+      if (pojk_menu_item_cache_lookup (data->cache,
+                                       g_ptr_array_index (data->uris, i),
+                                       g_ptr_array_index (data->desktop_ids, i)) != NULL)
+        data->n_items++;
+    }
+
+  return NULL;
+}
+
+
+
+static gdouble
+run (PojkMenuItemCache *cache,
+     GPtrArray         *uris,
+     GPtrArray         *desktop_ids,
+     guint              n_threads,
+     gboolean           cold,
+     guint             *n_items)
+{
+  LookupData *data;
+  GThread   **threads;
+  GTimer     *timer;
+  gdouble     elapsed;
+  guint       n;
+
+  if (cold)
+    pojk_menu_item_cache_invalidate (cache);
+
+  data = g_new0 (LookupData, n_threads);
+  threads = g_new0 (GThread *, n_threads);
+
+  timer = g_timer_new ();
+
+  for (n = 0; n < n_threads; n++)
+    {
+      data[n].cache = cache;
+      data[n].uris = uris;
+      data[n].desktop_ids = desktop_ids;
+      data[n].first = n * uris->len / n_threads;
+      threads[n] = g_thread_new ("lookup", lookup_thread, &data[n]);
+    }
+
+  for (n = 0; n < n_threads; n++)
+    g_thread_join (threads[n]);
+
+  elapsed = g_timer_elapsed (timer, NULL) * 1000;
+  g_timer_destroy (timer);
+
+  *n_items = data[0].n_items;
+
+  g_free (threads);
+  g_free (data);
+
+  return elapsed;
+}
+
+
+
+int
+main (int    argc,
+      char **argv)
+{
+  PojkMenuItemCache      *cache;
+  PojkMenuItemCacheStats  stats;
+  const gchar * const    *dirs;
+  GPtrArray              *uris;
+  GPtrArray              *desktop_ids;
+  gchar                  *path;
+  guint                   max_threads = 8;
+  guint                   n_runs = 5;
+  guint                   n_threads;
+  guint                   n_items = 0;
+  guint                   n;
+  gdouble                 cold_time;
+  gdouble                 warm_time;
+
+  g_set_prgname ("bench-item-cache");
+
+  uris = g_ptr_array_new_with_free_func (g_free);
+  desktop_ids = g_ptr_array_new_with_free_func (g_free);
+
+  if (argc > 1)
+    {
+      collect_files (argv[1], uris, desktop_ids);
+    }
+  else
+    {
+      dirs = g_get_system_data_dirs ();
+      for (n = 0; dirs[n] != NULL; n++)
+        {
+          path = g_build_filename (dirs[n], "applications", NULL);
+          collect_files (path, uris, desktop_ids);
+          g_free (path);
+        }
+    }
+
+  if (argc > 2)
+    max_threads = MAX (g_ascii_strtoull (argv[2], NULL, 10), 1);
+  if (argc > 3)
+    n_runs = MAX (g_ascii_strtoull (argv[3], NULL, 10), 1);
+
+  if (uris->len == 0)
+    g_error ("No desktop files found");
+
+  g_printf ("%u desktop files\n", uris->len);
+
+  cache = pojk_menu_item_cache_get_default ();
+
+  /* Fill the page cache so all runs read from memory */
+  run (cache, uris, desktop_ids, 1, TRUE, &n_items);
+
+  for (n_threads = 1; n_threads <= max_threads; n_threads *= 2)
+    {
+      cold_time = 0;
+      warm_time = 0;
+
+      for (n = 0; n < n_runs; n++)
+        {
+          cold_time += run (cache, uris, desktop_ids, n_threads, TRUE, &n_items);
+          warm_time += run (cache, uris, desktop_ids, n_threads, FALSE, &n_items);
+        }
+
+      g_printf ("%2u threads: cold %8.2f ms, warm %8.2f ms (average of %u runs, %u items)\n",
+                n_threads, cold_time / n_runs, warm_time / n_runs, n_runs, n_items);
+    }
+
+  pojk_menu_item_cache_get_stats (cache, &stats);
+  g_printf ("cache: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " misses, "
+            "%" G_GUINT64_FORMAT " from the item database, %u items, %" G_GSIZE_FORMAT " bytes\n",
+            stats.n_hits, stats.n_misses, stats.n_database_hits, stats.n_items, stats.n_bytes);
+
+  g_object_unref (cache);
+  g_ptr_array_free (desktop_ids, TRUE);
+  g_ptr_array_free (uris, TRUE);
+
+#ifdef HAVE_STDLIB_H
+  return EXIT_SUCCESS;
+#else
+  return 0;
+#endif
+}
@@ -0,0 +1,359 @@
+/*-
+ * vi:set et ai sts=2 sw=2 cindent:
+ *
+ * Copyright (c) 2026 The pojk developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Loads a large synthetic menu to measure how long resolving the
+ * Include and Exclude rules takes.
+ *
+ * Usage: bench-menu-resolve [N_ITEMS [N_MENUS [N_RUNS]]]
+ *
+ * The first load parses all desktop files, the following loads find
+ * them in the item cache and mostly measure the rule resolution. The
+ * growth of the resident memory during the first load approximates the
+ * memory used by the items. Items only read their names, commands and
+ * so on when they are first used, which is measured at the end. The
+ * warm loads are repeated with the rules of the menus resolved on
+ * several threads, which has to give the same menus. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <glib/gprintf.h>
+#include <glib/gstdio.h>
+
+#include <pojk/pojk.h>
+
+
+
+#define N_CATEGORIES 32
+
+
+
+static void
+write_file (const gchar *filename,
+            const gchar *contents)
+{
+  GError *error = NULL;
+
+  if (!g_file_set_contents (filename, contents, -1, &error))
+    g_error ("Could not write %s: %s", filename, error->message);
+}
+
+
+
+static gchar *
+create_menu (const gchar *base_dir,
+             guint        n_items,
+             guint        n_menus)
+{
+  GString *menu;
+  gchar   *app_dir;
+  gchar   *filename;
+  gchar   *contents;
+  guint    n;
+
+  app_dir = g_build_filename (base_dir, "applications", NULL);
+  g_mkdir (app_dir, 0700);
+
+  /* Desktop files in two of the categories each */
+  for (n = 0; n < n_items; n++)
+    {
+      filename = g_strdup_printf ("%s/bench-%u.desktop", app_dir, n);
+      contents = g_strdup_printf ("[Desktop Entry]\n"
+                                  "Type=Application\n"
+                                  "Name=Bench %u\n"
+                                  "Exec=true\n"
+                                  "Categories=Cat%u;Cat%u;\n",
+                                  n, n % N_CATEGORIES, (n / N_CATEGORIES) % N_CATEGORIES);
+      write_file (filename, contents);
+      g_free (contents);
+      g_free (filename);
+    }
+
+  menu = g_string_new ("<!DOCTYPE Menu PUBLIC \"-//freedesktop//DTD Menu 1.0//EN\"\n"
+                       " \"http://www.freedesktop.org/standards/menu-spec/1.0/menu.dtd\">\n"
+                       "<Menu>\n"
+                       "  <Name>Bench</Name>\n");
+  g_string_append_printf (menu, "  <AppDir>%s</AppDir>\n", app_dir);
+
+  /* Submenus with a mix of Include and Exclude rules */
+  for (n = 0; n < n_menus; n++)
+    {
+      g_string_append_printf (menu,
+                              "  <Menu>\n"
+                              "    <Name>Menu%u</Name>\n"
+                              "    <Include>\n"
+                              "      <And>\n"
+                              "        <Category>Cat%u</Category>\n"
+                              "        <Not><Category>Cat%u</Category></Not>\n"
+                              "      </And>\n"
+                              "      <Filename>bench-%u.desktop</Filename>\n"
+                              "    </Include>\n"
+                              "    <Exclude>\n"
+                              "      <Filename>bench-%u.desktop</Filename>\n"
+                              "    </Exclude>\n"
+                              "  </Menu>\n",
+                              n, n % N_CATEGORIES, (n + 1) % N_CATEGORIES,
+                              n, n % MAX (n_items, 1));
+    }
+
+  /* Catch everything the other menus did not take */
+  g_string_append (menu,
+                   "  <Menu>\n"
+                   "    <Name>Other</Name>\n"
+                   "    <OnlyUnallocated/>\n"
+                   "    <Include><All/></Include>\n"
+                   "  </Menu>\n"
+                   "</Menu>\n");
+
+  filename = g_build_filename (base_dir, "bench.menu", NULL);
+  write_file (filename, menu->str);
+
+  g_string_free (menu, TRUE);
+  g_free (app_dir);
+
+  return filename;
+}
+
+
+
+/* Returns the resident set size in KiB, or 0 if it is unknown */
+static gsize
+get_resident_size (void)
+{
+  gchar  *contents;
+  gchar **fields;
+  gsize   size = 0;
+
+#ifdef HAVE_UNISTD_H
+  if (g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL))
+    {
+      fields = g_strsplit (contents, " ", 3);
+      if (fields[0] != NULL && fields[1] != NULL)
+        size = g_ascii_strtoull (fields[1], NULL, 10) * (sysconf (_SC_PAGESIZE) / 1024);
+      g_strfreev (fields);
+      g_free (contents);
+    }
+#endif
+
+  return size;
+}
+
+
+
+/* Reads the names of all items, so that their remaining fields are loaded */
+static void
+materialize_items (PojkMenu *menu)
+{
+  GList *items;
+  GList *menus;
+  GList *lp;
+
+  items = pojk_menu_get_items (menu);
+  for (lp = items; lp != NULL; lp = lp->next)
+    pojk_menu_item_get_name (lp->data);
+  g_list_free (items);
+
+  menus = pojk_menu_get_menus (menu);
+  for (lp = menus; lp != NULL; lp = lp->next)
+    materialize_items (lp->data);
+  g_list_free (menus);
+}
+
+
+
+/* Aborts unless both menus and their submenus have the same items */
+static void
+compare_menus (PojkMenu *a,
+               PojkMenu *b)
+{
+  GList *items_a;
+  GList *items_b;
+  GList *menus_a;
+  GList *menus_b;
+  GList *la;
+  GList *lb;
+
+  items_a = pojk_menu_get_items (a);
+  items_b = pojk_menu_get_items (b);
+  for (la = items_a, lb = items_b; la != NULL && lb != NULL; la = la->next, lb = lb->next)
+    {
+      if (g_strcmp0 (pojk_menu_item_get_desktop_id (la->data),
+                     pojk_menu_item_get_desktop_id (lb->data)) != 0)
+        break;
+    }
+  if (la != NULL || lb != NULL)
+    g_error ("Menu %s has different items when resolved in parallel",
+             pojk_menu_element_get_name (POJK_MENU_ELEMENT (a)));
+  g_list_free (items_a);
+  g_list_free (items_b);
+
+  menus_a = pojk_menu_get_menus (a);
+  menus_b = pojk_menu_get_menus (b);
+  if (g_list_length (menus_a) != g_list_length (menus_b))
+    g_error ("Menu %s has different submenus when resolved in parallel",
+             pojk_menu_element_get_name (POJK_MENU_ELEMENT (a)));
+  for (la = menus_a, lb = menus_b; la != NULL; la = la->next, lb = lb->next)
+    compare_menus (la->data, lb->data);
+  g_list_free (menus_a);
+  g_list_free (menus_b);
+}
+
+
+
+static void
+remove_dir (const gchar *path)
+{
+  GDir        *dir;
+  const gchar *name;
+  gchar       *filename;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir != NULL)
+    {
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          filename = g_build_filename (path, name, NULL);
+          if (g_file_test (filename, G_FILE_TEST_IS_DIR))
+            remove_dir (filename);
+          else
+            g_unlink (filename);
+          g_free (filename);
+        }
+
+      g_dir_close (dir);
+    }
+
+  g_rmdir (path);
+}
+
+
+
+int
+main (int    argc,
+      char **argv)
+{
+  PojkMenu *menu;
+  PojkMenu *parallel_menu;
+  GTimer   *timer;
+  GError   *error = NULL;
+  gchar    *base_dir;
+  gchar    *filename;
+  guint     n_items = 5000;
+  guint     n_menus = 200;
+  guint     n_runs = 10;
+  guint     n;
+  gsize     resident_size;
+  gdouble   elapsed;
+  gdouble   total = 0;
+
+  g_set_prgname ("bench-menu-resolve");
+
+  if (argc > 1)
+    n_items = g_ascii_strtoull (argv[1], NULL, 10);
+  if (argc > 2)
+    n_menus = g_ascii_strtoull (argv[2], NULL, 10);
+  if (argc > 3)
+    n_runs = MAX (g_ascii_strtoull (argv[3], NULL, 10), 2);
+
+  base_dir = g_dir_make_tmp ("pojk-bench-XXXXXX", &error);
+  if (base_dir == NULL)
+    g_error ("Could not create a temporary directory: %s", error->message);
+
+  filename = create_menu (base_dir, n_items, n_menus);
+
+  menu = pojk_menu_new_for_path (filename);
+  g_object_set (menu, "snapshot", FALSE, NULL);
+
+  g_printf ("%u items, %u menus\n", n_items, n_menus + 1);
+
+  timer = g_timer_new ();
+  resident_size = get_resident_size ();
+
+  for (n = 0; n < n_runs; n++)
+    {
+      g_timer_start (timer);
+
+      if (!pojk_menu_load (menu, NULL, &error))
+        g_error ("Could not load menu from %s: %s", filename, error->message);
+
+      elapsed = g_timer_elapsed (timer, NULL) * 1000;
+
+      /* The first run also parses the desktop files */
+      if (n == 0)
+        {
+          g_printf ("cold load: %.2f ms\n", elapsed);
+          if (resident_size > 0)
+            g_printf ("memory: %" G_GSIZE_FORMAT " KiB, %" G_GSIZE_FORMAT " bytes per item\n",
+                      get_resident_size () - resident_size,
+                      (get_resident_size () - resident_size) * 1024 / MAX (n_items, 1));
+        }
+      else
+        total += elapsed;
+    }
+
+  g_printf ("warm load: %.2f ms (average of %u runs)\n", total / (n_runs - 1), n_runs - 1);
+
+  parallel_menu = pojk_menu_new_for_path (filename);
+  g_object_set (parallel_menu, "snapshot", FALSE, "parallel-resolve", TRUE, NULL);
+
+  for (n = 0, total = 0; n < n_runs; n++)
+    {
+      g_timer_start (timer);
+
+      if (!pojk_menu_load (parallel_menu, NULL, &error))
+        g_error ("Could not load menu from %s: %s", filename, error->message);
+
+      /* The items are in the cache from the loads above already */
+      total += g_timer_elapsed (timer, NULL) * 1000;
+    }
+
+  g_printf ("parallel warm load: %.2f ms (average of %u runs)\n", total / n_runs, n_runs);
+
+  compare_menus (menu, parallel_menu);
+  g_object_unref (parallel_menu);
+
+  resident_size = get_resident_size ();
+  materialize_items (menu);
+  if (resident_size > 0)
+    g_printf ("materialized items: %" G_GSIZE_FORMAT " bytes per item\n",
+              (get_resident_size () - resident_size) * 1024 / MAX (n_items, 1));
+
+  g_timer_destroy (timer);
+  g_object_unref (menu);
+
+  remove_dir (base_dir);
+  g_free (base_dir);
+  g_free (filename);
+
+#ifdef HAVE_STDLIB_H
+  return EXIT_SUCCESS;
+#else
+  return 0;
+#endif
+}
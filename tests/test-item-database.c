@@ -0,0 +1,332 @@
+/*-
+ * vi:set et ai sts=2 sw=2 cindent:
+ *
+ * Copyright (c) 2026 The pojk developers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Checks that items are read back from the item database by another
+ * process, and that items whose desktop file changed are parsed again
+ * instead.
+ *
+ * The test writes a system data dir with two desktop files and loads a
+ * menu, which writes the database in the background. It then runs
+ * itself with --check, which loads the menu in a new process and
+ * compares the items and the database hits with what it is told to
+ * expect. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#include <glib/gprintf.h>
+#include <glib/gstdio.h>
+
+#include <pojk/pojk.h>
+
+
+
+static void
+write_file (const gchar *filename,
+            const gchar *contents)
+{
+  GError *error = NULL;
+
+  if (!g_file_set_contents (filename, contents, -1, &error))
+    g_error ("Could not write %s: %s", filename, error->message);
+}
+
+
+
+static void
+write_desktop_file (const gchar *app_dir,
+                    const gchar *basename,
+                    const gchar *name)
+{
+  gchar *filename;
+  gchar *contents;
+
+  filename = g_build_filename (app_dir, basename, NULL);
+  contents = g_strdup_printf ("[Desktop Entry]\n"
+                              "Type=Application\n"
+                              "Name=%s\n"
+                              "Exec=true\n"
+                              "Categories=Utility;\n",
+                              name);
+  write_file (filename, contents);
+  g_free (contents);
+  g_free (filename);
+}
+
+
+
+/* Returns the database file in @directory, if there is one */
+static gchar *
+find_database (const gchar *directory)
+{
+  GDir        *dir;
+  const gchar *name;
+  gchar       *filename = NULL;
+
+  dir = g_dir_open (directory, 0, NULL);
+  if (dir == NULL)
+    return NULL;
+
+  while (filename == NULL && (name = g_dir_read_name (dir)) != NULL)
+    {
+      if (g_str_has_suffix (name, ".db"))
+        filename = g_build_filename (directory, name, NULL);
+    }
+
+  g_dir_close (dir);
+
+  return filename;
+}
+
+
+
+/* Waits until the background thread of the menu load wrote the database */
+static void
+wait_for_database (const gchar *directory)
+{
+  gchar *filename;
+  guint  n;
+
+  for (n = 0; n < 100; n++)
+    {
+      filename = find_database (directory);
+      if (filename != NULL)
+        {
+          g_free (filename);
+          return;
+        }
+
+      g_usleep (100 * 1000);
+    }
+
+  g_error ("No item database was written to %s", directory);
+}
+
+
+
+static PojkMenu *
+load_menu (const gchar *filename)
+{
+  PojkMenu *menu;
+  GError   *error = NULL;
+
+  menu = pojk_menu_new_for_path (filename);
+  g_object_set (menu, "snapshot", FALSE, NULL);
+
+  if (!pojk_menu_load (menu, NULL, &error))
+    g_error ("Could not load menu from %s: %s", filename, error->message);
+
+  return menu;
+}
+
+
+
+/* Loads the menu in this process, which has a new item cache, and
+ * checks the result */
+static void
+check (const gchar *filename,
+       guint        expected_hits,
+       const gchar *expected_name)
+{
+  PojkMenuItemCache      *cache;
+  PojkMenuItemCacheStats  stats;
+  PojkMenu               *menu;
+  GList                  *items;
+  GList                  *lp;
+  gboolean                found = FALSE;
+
+  menu = load_menu (filename);
+
+  items = pojk_menu_get_items (menu);
+  if (g_list_length (items) != 2)
+    g_error ("Expected 2 items, got %u", g_list_length (items));
+
+  for (lp = items; lp != NULL; lp = lp->next)
+    {
+      if (g_strcmp0 (pojk_menu_item_get_desktop_id (lp->data), "a.desktop") == 0)
+        found = (g_strcmp0 (pojk_menu_item_get_name (lp->data), expected_name) == 0);
+    }
+  g_list_free (items);
+
+  if (!found)
+    g_error ("a.desktop is not named \"%s\"", expected_name);
+
+  cache = pojk_menu_item_cache_get_default ();
+  pojk_menu_item_cache_get_stats (cache, &stats);
+  g_object_unref (cache);
+
+  if (stats.n_database_hits != expected_hits)
+    g_error ("Expected %u items from the item database, got %" G_GUINT64_FORMAT,
+             expected_hits, stats.n_database_hits);
+
+  g_object_unref (menu);
+}
+
+
+
+/* Runs this program with --check in a new process */
+static void
+spawn_check (const gchar *program,
+             const gchar *filename,
+             guint        expected_hits,
+             const gchar *expected_name)
+{
+  GError *error = NULL;
+  gchar  *argv[6];
+  gchar  *hits;
+  gint    status;
+
+  hits = g_strdup_printf ("%u", expected_hits);
+
+  argv[0] = (gchar *) program;
+  argv[1] = (gchar *) "--check";
+  argv[2] = (gchar *) filename;
+  argv[3] = hits;
+  argv[4] = (gchar *) expected_name;
+  argv[5] = NULL;
+
+  if (!g_spawn_sync (NULL, argv, NULL, G_SPAWN_CHILD_INHERITS_STDIN, NULL, NULL,
+                     NULL, NULL, &status, &error))
+    g_error ("Could not run %s: %s", program, error->message);
+
+  if (!g_spawn_check_exit_status (status, &error))
+    g_error ("Check with %u items from the item database failed: %s",
+             expected_hits, error->message);
+
+  g_free (hits);
+}
+
+
+
+static void
+remove_dir (const gchar *path)
+{
+  GDir        *dir;
+  const gchar *name;
+  gchar       *filename;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir != NULL)
+    {
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          filename = g_build_filename (path, name, NULL);
+          if (g_file_test (filename, G_FILE_TEST_IS_DIR))
+            remove_dir (filename);
+          else
+            g_unlink (filename);
+          g_free (filename);
+        }
+
+      g_dir_close (dir);
+    }
+
+  g_rmdir (path);
+}
+
+
+
+int
+main (int    argc,
+      char **argv)
+{
+  PojkMenu *menu;
+  GError   *error = NULL;
+  gchar    *base_dir;
+  gchar    *data_dir;
+  gchar    *app_dir;
+  gchar    *database_dir;
+  gchar    *path;
+  gchar    *filename;
+
+  g_set_prgname ("test-item-database");
+
+  /* The environment was set up by the parent process */
+  if (argc == 5 && g_strcmp0 (argv[1], "--check") == 0)
+    {
+      check (argv[2], g_ascii_strtoull (argv[3], NULL, 10), argv[4]);
+      return 0;
+    }
+
+  base_dir = g_dir_make_tmp ("pojk-test-XXXXXX", &error);
+  if (base_dir == NULL)
+    g_error ("Could not create a temporary directory: %s", error->message);
+
+  /* Use a system data dir of our own, before anything looks at it */
+  data_dir = g_build_filename (base_dir, "data", NULL);
+  app_dir = g_build_filename (data_dir, "applications", NULL);
+  g_mkdir_with_parents (app_dir, 0700);
+  g_setenv ("XDG_DATA_DIRS", data_dir, TRUE);
+
+  path = g_build_filename (base_dir, "home", NULL);
+  g_setenv ("XDG_DATA_HOME", path, TRUE);
+  g_free (path);
+
+  path = g_build_filename (base_dir, "cache", NULL);
+  g_setenv ("XDG_CACHE_HOME", path, TRUE);
+  g_free (path);
+
+  database_dir = g_build_filename (base_dir, "database", NULL);
+  g_setenv ("POJK_MENU_ITEM_DATABASE", database_dir, TRUE);
+
+  write_desktop_file (app_dir, "a.desktop", "A");
+  write_desktop_file (app_dir, "b.desktop", "B");
+
+  filename = g_build_filename (base_dir, "test.menu", NULL);
+  write_file (filename,
+              "<!DOCTYPE Menu PUBLIC \"-//freedesktop//DTD Menu 1.0//EN\"\n"
+              " \"http://www.freedesktop.org/standards/menu-spec/1.0/menu.dtd\">\n"
+              "<Menu>\n"
+              "  <Name>Test</Name>\n"
+              "  <DefaultAppDirs/>\n"
+              "  <Include><All/></Include>\n"
+              "</Menu>\n");
+
+  /* Parse the desktop files, which writes the database */
+  menu = load_menu (filename);
+  wait_for_database (database_dir);
+  g_object_unref (menu);
+
+  /* Another process reads both items from the database */
+  spawn_check (argv[0], filename, 2, "A");
+
+  /* A changed desktop file is parsed again */
+  write_desktop_file (app_dir, "a.desktop", "Changed");
+  spawn_check (argv[0], filename, 1, "Changed");
+
+  remove_dir (base_dir);
+  g_free (base_dir);
+  g_free (data_dir);
+  g_free (app_dir);
+  g_free (database_dir);
+  g_free (filename);
+
+#ifdef HAVE_STDLIB_H
+  return EXIT_SUCCESS;
+#else
+  return 0;
+#endif
+}
@@ -0,0 +1,132 @@
+#!/bin/sh
+#
+# Copyright (c) 2026 The pojk developers
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Library General Public
+# License as published by the Free Software Foundation; either
+# version 2 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Library General Public License for more details.
+#
+# You should have received a copy of the GNU Library General
+# Public License along with this library; if not, write to the
+# Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+# Boston, MA 02110-1301, USA.
+#
+# Loads a generated menu with test-menu-spec in its serial mode, with
+# parallel parsing and rule resolving and with the resolved item sets and
+# compiled rules checked against the rule trees, and checks that all of
+# them print the same menu. An item set or compiled rule that disagrees
+# with its tree is a fatal warning.
+
+set -e
+
+TEST_MENU_SPEC=${TEST_MENU_SPEC:-./test-menu-spec}
+
+base_dir=$(mktemp -d "${TMPDIR:-/tmp}/pojk-test-XXXXXX")
+trap 'rm -rf "$base_dir"' EXIT
+
+mkdir -p "$base_dir/config/menus" "$base_dir/data/applications/vendor"
+
+# Use only the generated menu and desktop files
+XDG_CONFIG_HOME="$base_dir/home-config"
+XDG_CONFIG_DIRS="$base_dir/config"
+XDG_DATA_HOME="$base_dir/home-data"
+XDG_DATA_DIRS="$base_dir/data"
+XDG_CACHE_HOME="$base_dir/cache"
+XDG_MENU_PREFIX="test-"
+export XDG_CONFIG_HOME XDG_CONFIG_DIRS XDG_DATA_HOME XDG_DATA_DIRS
+export XDG_CACHE_HOME XDG_MENU_PREFIX
+unset POJK_MENU_SNAPSHOT POJK_MENU_ITEM_DATABASE
+
+cat > "$base_dir/config/menus/test-applications.menu" <<EOF
+<!DOCTYPE Menu PUBLIC "-//freedesktop//DTD Menu 1.0//EN"
+ "http://www.freedesktop.org/standards/menu-spec/1.0/menu.dtd">
+<Menu>
+  <Name>Applications</Name>
+  <DefaultAppDirs/>
+  <Menu>
+    <Name>Development</Name>
+    <Include><Category>Development</Category></Include>
+  </Menu>
+  <Menu>
+    <Name>Graphics</Name>
+    <Include>
+      <And>
+        <Category>Graphics</Category>
+        <Not><Category>Viewer</Category></Not>
+      </And>
+    </Include>
+  </Menu>
+  <Menu>
+    <Name>Viewers</Name>
+    <Include>
+      <Or>
+        <Category>Viewer</Category>
+        <Filename>editor.desktop</Filename>
+      </Or>
+    </Include>
+    <Exclude><Filename>hidden-viewer.desktop</Filename></Exclude>
+  </Menu>
+  <Menu>
+    <Name>Utilities</Name>
+    <Include><Category>Utility</Category></Include>
+  </Menu>
+  <Menu>
+    <Name>Other</Name>
+    <OnlyUnallocated/>
+    <Include><All/></Include>
+  </Menu>
+</Menu>
+EOF
+
+write_desktop_file ()
+{
+  cat > "$base_dir/data/applications/$1" <<EOF
+[Desktop Entry]
+Type=Application
+Name=$2
+Exec=true
+Categories=$3
+EOF
+}
+
+n=0
+while [ $n -lt 50 ]; do
+  case $((n % 5)) in
+    0) categories="Development;" ;;
+    1) categories="Graphics;" ;;
+    2) categories="Graphics;Viewer;" ;;
+    3) categories="Utility;" ;;
+    4) categories="Game;" ;;
+  esac
+  write_desktop_file "app-$n.desktop" "App $n" "$categories"
+  n=$((n + 1))
+done
+
+write_desktop_file "editor.desktop" "Editor" "Development;Utility;"
+write_desktop_file "hidden-viewer.desktop" "Hidden Viewer" "Viewer;"
+write_desktop_file "vendor/tool.desktop" "Tool" "Utility;"
+
+POJK_MENU_PARALLEL_RESOLVE=0 POJK_MENU_PARSE_THREADS=1 \
+  "$TEST_MENU_SPEC" > "$base_dir/serial.txt"
+
+# Make sure the menu is not trivially empty
+tab=$(printf '\t')
+grep -q "^Other/${tab}app-4.desktop${tab}" "$base_dir/serial.txt"
+grep -q "^Viewers/${tab}editor.desktop${tab}" "$base_dir/serial.txt"
+grep -q "^Utilities/${tab}vendor-tool.desktop${tab}" "$base_dir/serial.txt"
+
+POJK_MENU_PARALLEL_RESOLVE=1 POJK_MENU_PARSE_THREADS=4 \
+  "$TEST_MENU_SPEC" > "$base_dir/parallel.txt"
+
+diff -u "$base_dir/serial.txt" "$base_dir/parallel.txt"
+
+POJK_MENU_CHECK_RULES=1 G_DEBUG=fatal-warnings \
+  "$TEST_MENU_SPEC" > "$base_dir/check-rules.txt"
+
+diff -u "$base_dir/serial.txt" "$base_dir/check-rules.txt"
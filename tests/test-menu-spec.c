@@ -105,12 +105,45 @@ print_menu (PojkMenu  *menu,
 
 
 
+static void
+print_stats (PojkMenu *menu)
+{
+  const PojkMenuLoadStats *stats;
+
+  stats = pojk_menu_get_load_stats (menu);
+
+  /* Keep the menu contents on stdout comparable */
+  g_printerr ("total:                %8.2f ms\n", stats->total_time / 1000.0);
+  g_printerr ("  snapshot:           %8.2f ms%s\n", stats->snapshot_time / 1000.0,
+              stats->from_snapshot ? " (restored)" : "");
+  g_printerr ("  parse:              %8.2f ms\n", stats->parse_time / 1000.0);
+  g_printerr ("  merge:              %8.2f ms\n", stats->merge_time / 1000.0);
+  g_printerr ("  collect files:      %8.2f ms\n", stats->collect_time / 1000.0);
+  g_printerr ("  parse items:        %8.2f ms\n", stats->preload_time / 1000.0);
+  g_printerr ("  resolve:            %8.2f ms\n", stats->resolve_time / 1000.0);
+  g_printerr ("  resolve unallocated:%8.2f ms\n", stats->resolve_unallocated_time / 1000.0);
+  g_printerr ("  directories:        %8.2f ms\n", stats->directory_time / 1000.0);
+  g_printerr ("  monitors:           %8.2f ms\n", stats->monitor_time / 1000.0);
+  g_printerr ("desktop files:        %u\n", stats->n_desktop_files);
+  g_printerr ("items parsed:         %u\n", stats->n_items_parsed);
+  g_printerr ("item cache hits:      %u (%u checked unchanged)\n", stats->n_item_cache_hits,
+              stats->n_reparses_avoided);
+  g_printerr ("app dir scans:        %u (%u reused)\n", stats->n_app_dir_scans,
+              stats->n_app_dir_scan_hits);
+  g_printerr ("rule matches:         %u\n", stats->n_rules_evaluated);
+  g_printerr ("monitors:             %u\n", stats->n_monitors);
+}
+
+
+
 int
 main (int    argc,
       char **argv)
 {
   PojkMenu *menu;
   GError     *error = NULL;
+  gboolean    show_stats = FALSE;
+  gint        n;
 #ifdef HAVE_STDLIB_H
   int         exit_code = EXIT_SUCCESS;
 #else
@@ -119,6 +152,11 @@ main (int    argc,
 
   g_set_prgname ("test-menu-spec");
 
+  /* Print the load statistics with --stats */
+  for (n = 1; n < argc; n++)
+    if (g_strcmp0 (argv[n], "--stats") == 0)
+      show_stats = TRUE;
+
 #if !GLIB_CHECK_VERSION (2, 36, 0)
   /* Initialize the type system */
   g_type_init ();
@@ -131,6 +169,9 @@ main (int    argc,
     {
       /* Print menu contents according to the test suite criteria */
       print_menu (menu, NULL);
+
+      if (show_stats)
+        print_stats (menu);
     }
   else
     {